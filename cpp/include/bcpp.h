@@ -0,0 +1,81 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FILE_BCPP_H
+#define FILE_BCPP_H
+#include <stdbool.h>
+#include <stdio.h>
+
+// The interface of libbcpp.a, which allows to pre-process in-process.
+// This header is used by bcc, so it must not include any other header of bcpp.
+// The program, that links against libbcpp.a, has to provide
+// strint(), strnint() (see strint.h) and panic_impl() (see cpp.h).
+
+// resets the state of the pre-processor,
+// must be called before any other function of this interface
+void bcpp_init(bool console_colors);
+
+// defines the macro `name` as `value` (NULL means "1"),
+// `value` must be valid until bcpp_free() is called
+void bcpp_define(const char* name, const char* value);
+void bcpp_undef(const char* name);
+
+// adds a directory, that is searched for includes
+void bcpp_include_dir(const char* dir);
+
+// pre-processes the file `source_name` ("-" is stdin) into `out`,
+// the defined macros are printed instead, if `dumpmacros` is set,
+// returns 0 on success
+int bcpp_run(const char* source_name, FILE* out, bool dumpmacros);
+
+// frees all macros and include directories
+void bcpp_free(void);
+
+
+// The state of the pre-processor can be saved and restored (see bcc's precompiled headers).
+
+// a macro, that is not built-in
+struct bcpp_macro {
+   const char* name;
+   const char* text;
+   bool is_func;                 // #define name(params...) text
+   const char* const* params;
+   size_t num_params;
+};
+
+// calls `f` for every defined macro in the order of their definitions
+void bcpp_foreach_macro(void (*f)(const struct bcpp_macro*, void* ctx), void* ctx);
+
+// (re-)defines a macro, `m->text` must be valid until bcpp_free() is called
+void bcpp_define_macro(const struct bcpp_macro* m);
+
+// a file, that was included
+struct bcpp_file {
+   const char* path;             // the canonical path
+   const char* guard;            // the macro of its include guard, or NULL
+   bool once;                    // #pragma once
+};
+
+// calls `f` for every file, that was included
+void bcpp_foreach_file(void (*f)(const struct bcpp_file*, void* ctx), void* ctx);
+
+// remembers a file, as if it was already included
+void bcpp_add_file(const struct bcpp_file* f);
+
+// searches the file of `#include "name"` (if `quoted`) or `#include <name>` in `source_name`,
+// returns its canonical path or NULL, if it was not found
+const char* bcpp_find_include(const char* source_name, const char* name, bool quoted);
+
+#endif /* FILE_BCPP_H */
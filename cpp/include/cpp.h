@@ -42,11 +42,23 @@ struct line_pair {
    size_t linenum;
 };
 
-int run_cpp(FILE* in, FILE* out, bool dumpmacros);
-struct line_pair* read_lines(FILE* file);
-void print_lines(FILE* out, const struct line_pair*);
-void free_lines(struct line_pair*);
-void trim_lines(struct line_pair**);
+// reads the logical lines (without comments and line continuations) of a file
+struct line_reader {
+   FILE* file;
+   size_t linenum;
+   bool eof;
+
+   // the string or character literal, that is currently read
+   int str_delim;
+   bool escaping;
+   int escape;
+   int escape_n;
+};
+
+int preprocess_file(FILE* in, FILE* out, bool dumpmacros);
+void init_reader(struct line_reader*, FILE*);
+// reads the next line, returns false at the end of the file
+bool read_line(struct line_reader*, struct line_pair*);
 
 void warn(size_t linenum, const char*, ...);
 void fail(size_t linenum, const char*, ...);
@@ -59,5 +71,10 @@ noreturn void panic_impl(const char*, const char*, ...);
 // Initialization stuff
 void init_macros(void);
 void init_includes(void);
+void clear_includes(void);
+
+// records the include guard or #pragma once of the file, that is currently included
+void include_guard(const char* guard);
+void pragma_once(void);
 
 #endif /* FILE_CPP_H */
@@ -44,6 +44,7 @@ define_dir(elif);
 define_dir(elifdef);
 define_dir(elifndef);
 define_dir(warning);
+define_dir(pragma);
 
 // other stuff
 const char* defined(void);
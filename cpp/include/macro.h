@@ -42,6 +42,9 @@ struct macro {
 void add_macro(const struct macro*);
 bool remove_macro(istr_t);
 const struct macro* get_macro(istr_t);
+void clear_macros(void);
+// calls `f` for every macro, except the special ones, from the oldest to the newest
+void foreach_macro(void (*f)(const struct macro*, void*), void* ctx);
 void add_cmdline_macro(const char* arg);
 void dump_macros(FILE*);
 
@@ -35,7 +35,7 @@ struct token {
    const char* end;
 };
 
-extern const char* token_type_str[];
+extern const char* cpp_token_type_str[];
 struct token* tokenize(const char* lines);
 bool is_directive(const char* line);
 
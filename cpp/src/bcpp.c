@@ -0,0 +1,111 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include "strint.h"
+#include "macro.h"
+#include "bcpp.h"
+#include "cpp.h"
+#include "buf.h"
+#include "if.h"
+
+extern const char** cmdline_includes;
+extern bool suppress_code;
+bool console_color = true;
+
+void bcpp_init(bool console_colors) {
+   bcpp_free();
+   console_color = console_colors;
+   init_macros();
+   init_includes();
+}
+
+void bcpp_define(const char* name, const char* value) {
+   struct macro m;
+   m.name = strint(name);
+   m.type = MACRO_VAR;
+   m.linenum = 0;
+   m.text = value ? value : "1";
+   add_macro(&m);
+}
+void bcpp_undef(const char* name) {
+   remove_macro(strint(name));
+}
+
+struct foreach_macro_ctx {
+   void (*f)(const struct bcpp_macro*, void*);
+   void* ctx;
+};
+static void foreach_macro_helper(const struct macro* m, void* p) {
+   const struct foreach_macro_ctx* c = p;
+   struct bcpp_macro bm;
+   bm.name = m->name;
+   bm.text = m->text ? m->text : "";
+   bm.is_func = m->type == MACRO_FUNC;
+   bm.params = bm.is_func ? m->params : NULL;
+   bm.num_params = bm.is_func ? buf_len(m->params) : 0;
+   c->f(&bm, c->ctx);
+}
+void bcpp_foreach_macro(void (*f)(const struct bcpp_macro*, void*), void* ctx) {
+   struct foreach_macro_ctx c = { f, ctx };
+   foreach_macro(foreach_macro_helper, &c);
+}
+void bcpp_define_macro(const struct bcpp_macro* bm) {
+   struct macro m;
+   m.name = strint(bm->name);
+   m.type = bm->is_func ? MACRO_FUNC : MACRO_VAR;
+   m.linenum = 0;
+   m.text = bm->text;
+   if (bm->is_func) {
+      m.params = NULL;
+      for (size_t i = 0; i < bm->num_params; ++i)
+         buf_push(m.params, strint(bm->params[i]));
+   }
+   add_macro(&m);
+}
+
+void bcpp_include_dir(const char* dir) {
+   // cmdline_includes is terminated by NULL
+   if (cmdline_includes)
+      buf_pop(cmdline_includes);
+   buf_push(cmdline_includes, dir);
+   buf_push(cmdline_includes, NULL);
+}
+
+int bcpp_run(const char* name, FILE* out, bool dumpmacros) {
+   FILE* source = !strcmp(name, "-") ? stdin : fopen(name, "r");
+   if (!source) {
+      fprintf(stderr, "bcpp: failed to open '%s': %s\n", name, strerror(errno));
+      return 1;
+   }
+   source_name = name;
+   failed = false;
+   suppress_code = false;
+   if_layers = NULL;
+
+   const int status = preprocess_file(source, out, dumpmacros);
+
+   if (source != stdin)
+      fclose(source);
+   return status;
+}
+
+void bcpp_free(void) {
+   clear_macros();
+   clear_includes();
+   buf_free(cmdline_includes);
+}
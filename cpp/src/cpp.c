@@ -13,11 +13,10 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
-#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <stdio.h>
-#include <errno.h>
 #include "expand.h"
 #include "strint.h"
 #include "token.h"
@@ -47,7 +46,7 @@ static bool do_cpp_stuff(size_t linenum, const char* line, struct token* tokens,
       return true;
    }
    if (tk_dir.type != TK_WORD) {
-      warn(linenum, "expected word, got %s", token_type_str[tk_dir.type]);
+      warn(linenum, "expected word, got %s", cpp_token_type_str[tk_dir.type]);
       return false;
    }
    const struct directive* dir = get_dir(tk_dir.begin, tk_dir.end - tk_dir.begin);
@@ -63,76 +62,111 @@ static bool do_cpp_stuff(size_t linenum, const char* line, struct token* tokens,
    return dir->handler(linenum, line, tokens + tki, num_tks - tki, out);
 }
 
-int run_cpp(FILE* in, FILE* out, bool dumpmacros) {
-   struct line_pair* lines = read_lines(in);
+static bool process_line(const struct line_pair* pair, FILE* out) {
+   if (is_directive(pair->line)) {
+      struct token* tokens = tokenize(pair->line);
+      const bool success = do_cpp_stuff(pair->linenum, pair->line, tokens, out);
+      buf_free(tokens);
+      return success;
+   }
+   if (suppress_code)
+      return true;
 
-   if (failed)
-      return 1;
-   //trim_lines(&lines);
+   char* e = expand(pair->linenum, pair->line, NULL, NULL, false);
+   if (!e) {
+      warn(pair->linenum, "failed to expand");
+      return false;
+   }
+   fputs(e, out);
+   fputc('\n', out);
+   buf_free(e);
+   return true;
+}
 
-   char* buf;
-   size_t len_buf;
-   FILE* tmp = open_memstream(&buf, &len_buf);
+static bool is_blank(const char* s) {
+   while (isspace(*s))
+      ++s;
+   return !*s;
+}
 
-   fprintf(tmp, "# 1 \"%s\"\n", source_name);
-   
-   for (size_t i = 0; i < buf_len(lines); ++i) {
-      const struct line_pair pair = lines[i];
-      struct token* tokens = tokenize(pair.line);
+// returns the macro name, if `line` is "#ifndef NAME"
+static istr_t ifndef_name(const char* s) {
+   while (isspace(*s)) ++s;
+   if (*s++ != '#')
+      return NULL;
+   while (isspace(*s)) ++s;
+   if (strncmp(s, "ifndef", 6) != 0 || !isspace(s[6]))
+      return NULL;
+   s += 6;
+   while (isspace(*s)) ++s;
+   const char* begin = s;
+   if (!isname1(*s))
+      return NULL;
+   while (isname(*s)) ++s;
+   const char* end = s;
+   return is_blank(s) ? strrint(begin, end) : NULL;
+}
 
-      if (is_directive(pair.line)) {
-         failed |= !do_cpp_stuff(pair.linenum, pair.line, tokens, tmp);
-         buf_free(tokens);
-         continue;
+// The include guard of a file is detected,
+// if the whole file is enclosed by an #ifndef (without #else or #elif).
+enum guard_state {
+   GUARD_START,      // before the first non-blank line
+   GUARD_OPEN,       // inside of the #ifndef
+   GUARD_CLOSED,     // after the matching #endif
+   GUARD_NONE,       // the file has no include guard
+};
+
+// every line is written to `out`, as soon as it was processed
+static void process_lines(FILE* in, FILE* out) {
+   struct line_reader reader;
+   struct line_pair pair;
+   size_t last_linenum = 0;
+   enum guard_state guard_state = GUARD_START;
+   istr_t guard = NULL;
+   init_reader(&reader, in);
+
+   fprintf(out, "# 1 \"%s\"\n", source_name);
+   while (read_line(&reader, &pair)) {
+      if (guard_state == GUARD_START && !is_blank(pair.line)) {
+         guard = ifndef_name(pair.line);
+         guard_state = guard ? GUARD_OPEN : GUARD_NONE;
+      } else if (guard_state == GUARD_CLOSED && !is_blank(pair.line)) {
+         guard_state = GUARD_NONE;
       }
 
-      buf_free(tokens);
-      if (suppress_code) continue;
+      failed |= !process_line(&pair, out);
+      last_linenum = pair.linenum;
+      buf_free(pair.line);
 
-      char* e = expand(lines[i].linenum, lines[i].line, NULL, NULL, false);
-      if (!e) {
-         warn(i, "failed to expand");
-         failed = true;
-         continue;
+      if (guard_state == GUARD_OPEN) {
+         if (buf_len(if_layers) == 0) {
+            guard_state = GUARD_CLOSED;
+         } else if (if_layers[0].type != LAY_IF) {
+            guard_state = GUARD_NONE;
+         }
       }
-      fputs(e, tmp);
-      fputc('\n', tmp);
-      buf_free(e);
    }
    if (buf_len(if_layers) != 0) {
-      fail(buf_last(lines).linenum, "unterminated #if somewhere in the code, good luck finding it");
+      fail(last_linenum, "unterminated #if somewhere in the code, good luck finding it");
    }
-
    buf_free(if_layers);
-   free_lines(lines);
-   fclose(tmp);
-
+   if (guard_state == GUARD_CLOSED && !failed)
+      include_guard(guard);
+}
 
-   if (!failed) {
-      if (dumpmacros) {
-         dump_macros(out);
-      } else fwrite(buf, 1, len_buf, out);
+int preprocess_file(FILE* in, FILE* out, bool dumpmacros) {
+   if (!dumpmacros) {
+      process_lines(in, out);
+      return failed;
    }
-   free(buf);
 
+   // only the macros are printed
+   FILE* null = fopen("/dev/null", "w");
+   if (!null)
+      panic("failed to open /dev/null");
+   process_lines(in, null);
+   fclose(null);
+   if (!failed)
+      dump_macros(out);
    return failed;
 }
-noreturn void panic_impl(const char* func, const char* fmt, ...) {
-   va_list ap;
-   va_start(ap, fmt);
-
-   const int errno_saved = errno;
-
-   if (console_color)
-      fputs("\033[31;1m", stderr);
-   fprintf(stderr, "bcpp: %s(): ", func);
-   if (console_color)
-      fputs("\033[0m", stderr);
-   vfprintf(stderr, fmt, ap);
-   if (errno_saved) fprintf(stderr, ": %s\n", strerror(errno_saved));
-   else fputc('\n', stderr);
-
-   va_end(ap);
-   abort();
-}
-
@@ -32,6 +32,7 @@ static struct directive dirs[] = {
    { .name = "elifdef", .handler = dir_elifdef, false },
    { .name = "elifndef",.handler = dir_elifndef,false },
    { .name = "warning", .handler = dir_warning, false },
+   { .name = "pragma",  .handler = dir_pragma,  true  },
 };
 
 struct directive* get_dir(const char* name, size_t len) {
@@ -63,3 +64,13 @@ bool dir_warning(size_t linenum, const char* line, struct token* tokens, size_t
    warn(linenum, "#warning: %s", tokens[0].begin);
    return true;
 }
+// only #pragma once is supported, other pragmas are ignored
+bool dir_pragma(size_t linenum, const char* line, struct token* tokens, size_t num_tks, FILE* out) {
+   (void)linenum;
+   (void)line;
+   (void)out;
+   if (num_tks >= 1 && tokens[0].type == TK_WORD
+      && tokens[0].end - tokens[0].begin == 4 && !memcmp(tokens[0].begin, "once", 4))
+      pragma_once();
+   return true;
+}
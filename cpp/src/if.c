@@ -44,7 +44,7 @@ static bool ifdef_impl(size_t linenum, struct token* tokens, size_t num_tks, boo
       return false;
    }
    if (tokens[0].type != TK_WORD) {
-      warn(linenum, "expected macro name, got '%s'", token_type_str[tokens[0].type]);
+      warn(linenum, "expected macro name, got '%s'", cpp_token_type_str[tokens[0].type]);
       return false;
    }
 
@@ -15,6 +15,7 @@
 
 #include <sys/stat.h>
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -22,6 +23,8 @@
 #include <stdio.h>
 #include "config.h"
 #include "strint.h"
+#include "macro.h"
+#include "bcpp.h"
 #include "dir.h"
 #include "cpp.h"
 #include "if.h"
@@ -51,6 +54,147 @@ const char** cmdline_includes = NULL;
 static char* full_search_include(const char* name, const char** includes);
 static char* search_same_dir(const char* name);
 
+// An included file, identified by its canonical path.
+struct include_file {
+   istr_t canon;
+   istr_t guard;     // the macro of the include guard, that spans the whole file
+   bool once;        // #pragma once
+};
+
+// A cached search for an include.
+struct include_lookup {
+   istr_t dir;       // the directory of the including file ("..."), or NULL (<...>)
+   istr_t name;
+   char* path;       // the path, as it is shown in line markers
+   struct include_file* file;
+};
+
+// The lookups are cached in an open-addressing hash table,
+// so that the include paths are only searched once per directory and name.
+static struct include_lookup* lookups = NULL;
+static size_t lookups_size = 0;     // a power of 2
+static size_t num_lookups = 0;
+static struct include_file** files = NULL;
+static struct include_file* cur_file = NULL;
+
+static size_t hash_lookup(istr_t dir, istr_t name) {
+   const uint64_t h = (uint64_t)(uintptr_t)dir * 31 + (uint64_t)(uintptr_t)name;
+   return (size_t)((h * 0x9e3779b97f4a7c15ull) >> 32);
+}
+static struct include_lookup* find_lookup(istr_t dir, istr_t name) {
+   const size_t mask = lookups_size - 1;
+   size_t i = hash_lookup(dir, name) & mask;
+   while (lookups[i].name && (lookups[i].dir != dir || lookups[i].name != name))
+      i = (i + 1) & mask;
+   return &lookups[i];
+}
+static void grow_lookups(void) {
+   struct include_lookup* old = lookups;
+   const size_t old_size = lookups_size;
+   lookups_size = lookups_size ? lookups_size * 2 : 64;
+   lookups = calloc(lookups_size, sizeof(*lookups));
+   if (!lookups)
+      panic("failed to allocate the include cache");
+   for (size_t i = 0; i < old_size; ++i) {
+      if (old[i].name)
+         *find_lookup(old[i].dir, old[i].name) = old[i];
+   }
+   free(old);
+}
+
+static struct include_file* get_file(const char* path) {
+   char* real = realpath(path, NULL);
+   const istr_t canon = strint(real ? real : path);
+   free(real);
+   for (size_t i = 0; i < buf_len(files); ++i) {
+      if (files[i]->canon == canon)
+         return files[i];
+   }
+   struct include_file* f = malloc(sizeof(*f));
+   if (!f)
+      panic("failed to allocate include file");
+   f->canon = canon;
+   f->guard = NULL;
+   f->once = false;
+   buf_push(files, f);
+   return f;
+}
+
+// the directory of the current file, for the lookup of "..." includes
+static istr_t current_dir(void) {
+   const char* slash = strrchr(source_name, '/');
+   return slash ? strrint(source_name, slash) : strint(".");
+}
+
+// returns NULL, if the include was not found
+static struct include_lookup* lookup_include(istr_t name, bool quoted) {
+   const istr_t dir = quoted ? current_dir() : NULL;
+   if (lookups_size) {
+      struct include_lookup* l = find_lookup(dir, name);
+      if (l->name)
+         return l;
+   }
+
+   char* path;
+   if (quoted) {
+      path = search_same_dir(name);
+      if (!path)
+         path = full_search_include(name, user_includes);
+   } else {
+      path = full_search_include(name, system_includes);
+   }
+   if (!path)
+      return NULL;
+
+   if (2 * (num_lookups + 1) > lookups_size)
+      grow_lookups();
+   struct include_lookup* l = find_lookup(dir, name);
+   l->dir = dir;
+   l->name = name;
+   l->path = path;
+   l->file = get_file(path);
+   ++num_lookups;
+   return l;
+}
+
+void include_guard(istr_t guard) {
+   if (cur_file)
+      cur_file->guard = guard;
+}
+void pragma_once(void) {
+   if (cur_file)
+      cur_file->once = true;
+}
+void bcpp_foreach_file(void (*f)(const struct bcpp_file*, void*), void* ctx) {
+   for (size_t i = 0; i < buf_len(files); ++i) {
+      const struct bcpp_file bf = { files[i]->canon, files[i]->guard, files[i]->once };
+      f(&bf, ctx);
+   }
+}
+void bcpp_add_file(const struct bcpp_file* bf) {
+   struct include_file* file = get_file(bf->path);
+   file->guard = bf->guard ? strint(bf->guard) : NULL;
+   file->once = bf->once;
+}
+const char* bcpp_find_include(const char* source, const char* name, bool quoted) {
+   const char* saved_name = source_name;
+   source_name = source;
+   const struct include_lookup* l = lookup_include(strint(name), quoted);
+   source_name = saved_name;
+   return l ? l->file->canon : NULL;
+}
+void clear_includes(void) {
+   for (size_t i = 0; i < lookups_size; ++i)
+      free(lookups[i].path);
+   free(lookups);
+   lookups = NULL;
+   lookups_size = num_lookups = 0;
+   for (size_t i = 0; i < buf_len(files); ++i)
+      free(files[i]);
+   buf_free(files);
+   cur_file = NULL;
+}
+
 bool dir_include(size_t linenum, const char* line, struct token* tokens, size_t num_tks, FILE* out) {
    (void)line;
    if (num_tks < 1) {
@@ -58,14 +202,11 @@ bool dir_include(size_t linenum, const char* line, struct token* tokens, size_t
       warn(linenum, "expected include path");
       return false;
    }
-   istr_t name;
-   char* path;
+   struct include_lookup* l;
    if (tokens->type == TK_STRING) {
-      name = strrint(tokens->begin + 1, tokens->end - 1);
-      path = search_same_dir(name);
-      if (!path)
-         path = full_search_include(name, user_includes);
-      if (!path) {
+      const istr_t name = strrint(tokens->begin + 1, tokens->end - 1);
+      l = lookup_include(name, true);
+      if (!l) {
          warn(linenum, "failed to find include \"%s\"", name);
          return false;
       }
@@ -78,42 +219,50 @@ bool dir_include(size_t linenum, const char* line, struct token* tokens, size_t
       while (*s && *s != '>') ++s;
       if (*s != '>')
          goto expected_ip;
-      name = strrint(begin, s);
-      path = full_search_include(name, system_includes);
-      if (!path) {
+      const istr_t name = strrint(begin, s);
+      l = lookup_include(name, false);
+      if (!l) {
          warn(linenum, "failed to find include <%s>", name);
          return false;
       }
    }
 
-   FILE* file = fopen(path, "r");
-   if (!file) {
-      warn(linenum, "failed to open '%s': %s", path, strerror(errno));
+   // skip the file, if it would not produce anything
+   struct include_file* file = l->file;
+   if (file->once || (file->guard && get_macro(file->guard))) {
+      fprintf(out, "# %zu \"%s\"\n", linenum + 2, source_name);
+      return true;
+   }
+
+   FILE* in = fopen(l->path, "r");
+   if (!in) {
+      warn(linenum, "failed to open '%s': %s", l->path, strerror(errno));
       return false;
    }
 
    // save values
    const char* saved_name = source_name;
    struct if_layer* saved_if_layers = if_layers;
+   struct include_file* saved_file = cur_file;
 
    // set new values
-   source_name = path;
+   source_name = l->path;
    if_layers = NULL;
+   cur_file = file;
 
    // run cpp on the included file
-   const int ec = run_cpp(file, out, false);
+   const int ec = preprocess_file(in, out, false);
 
 
    // restore old values
    source_name = saved_name;
    if_layers = saved_if_layers;
+   cur_file = saved_file;
    fprintf(out, "# %zu \"%s\"\n", linenum + 2, source_name);
-   fclose(file);
-   free(path);
+   fclose(in);
    return ec == 0;
 }
 
-// searching functions
 
 static bool file_exists(const char* path) {
    struct stat st;
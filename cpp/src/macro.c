@@ -13,6 +13,8 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <stdint.h>
+#include <stdlib.h>
 #include "expand.h"
 #include "token.h"
 #include "macro.h"
@@ -25,7 +27,64 @@ struct macro_entry {
    struct macro macro;
 };
 
+// The macros are found by an open-addressing hash table (linear probing),
+// that is keyed on the pointer of the interned name.
+// The list keeps the order of the definitions for dump_macros().
 static struct macro_entry* macros = NULL;
+static struct macro_entry** table = NULL;
+static size_t table_size = 0;    // a power of 2
+static size_t num_macros = 0;
+
+#define MIN_TABLE_SIZE 1024
+
+static size_t hash_name(istr_t name) {
+   return (size_t)(((uint64_t)(uintptr_t)name * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+// returns the slot of `name` or the empty slot, where it belongs
+static struct macro_entry** find_slot(istr_t name) {
+   const size_t mask = table_size - 1;
+   size_t i = hash_name(name) & mask;
+   while (table[i] && table[i]->macro.name != name)
+      i = (i + 1) & mask;
+   return &table[i];
+}
+
+static void grow_table(void) {
+   struct macro_entry** old_table = table;
+   const size_t old_size = table_size;
+   table_size = table_size ? table_size * 2 : MIN_TABLE_SIZE;
+   table = calloc(table_size, sizeof(*table));
+   if (!table)
+      panic("failed to allocate the macro table");
+   for (size_t i = 0; i < old_size; ++i) {
+      if (old_table[i])
+         *find_slot(old_table[i]->macro.name) = old_table[i];
+   }
+   free(old_table);
+}
+
+// removes the entry in `slot` and moves the following entries back,
+// so that no probe sequence contains a hole
+static void remove_slot(struct macro_entry** slot) {
+   const size_t mask = table_size - 1;
+   size_t i = (size_t)(slot - table);
+   size_t j = i;
+   table[i] = NULL;
+   while (1) {
+      j = (j + 1) & mask;
+      if (!table[j])
+         break;
+      const size_t k = hash_name(table[j]->macro.name) & mask;
+      // the entry stays, if its home slot `k` is cyclically in (i, j]
+      if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+         continue;
+      table[i] = table[j];
+      table[j] = NULL;
+      i = j;
+   }
+   --num_macros;
+}
 
 static void free_macro(struct macro* macro) {
    switch (macro->type) {
@@ -36,11 +95,7 @@ static void free_macro(struct macro* macro) {
 }
 
 static struct macro_entry* find_me(istr_t name) {
-   for (struct macro_entry* e = macros; e; e = e->next) {
-      if (name == e->macro.name)
-         return e;
-   }
-   return NULL;
+   return table_size ? *find_slot(name) : NULL;
 }
 
 
@@ -62,6 +117,11 @@ void add_macro(const struct macro* m) {
       e->macro = *m;
       if (macros) macros->prev = e;
       macros = e;
+
+      if (2 * (num_macros + 1) > table_size)
+         grow_table();
+      *find_slot(m->name) = e;
+      ++num_macros;
    }
 }
 
@@ -76,12 +136,34 @@ bool remove_macro(istr_t name) {
       if (e->prev) e->prev->next = e->next;
       else macros = e->next;
       if (e->next) e->next->prev = e->prev;
+      remove_slot(find_slot(name));
       free_macro(&e->macro);
       free(e);
    }
 
    return e != NULL;
 }
+void clear_macros(void) {
+   while (macros) {
+      struct macro_entry* e = macros;
+      macros = e->next;
+      free_macro(&e->macro);
+      free(e);
+   }
+   free(table);
+   table = NULL;
+   table_size = 0;
+   num_macros = 0;
+}
+void foreach_macro(void (*f)(const struct macro*, void*), void* ctx) {
+   const struct macro_entry* e = macros;
+   while (e && e->next)
+      e = e->next;
+   for (; e; e = e->prev) {
+      if (e->macro.type != MACRO_SPEC)
+         f(&e->macro, ctx);
+   }
+}
 const struct macro* get_macro(istr_t name) {
    const struct macro_entry* e = find_me(name);
    return e ? &e->macro : NULL;
@@ -95,6 +177,7 @@ void add_cmdline_macro(const char* arg) {
 
    m.name = strrint(begin_name, arg);
    m.type = MACRO_VAR;
+   m.linenum = 0;
    m.text = *arg ? arg + 1 : "1";
    add_macro(&m);
 }
@@ -110,7 +193,7 @@ bool dir_define(size_t linenum, const char* line, struct token* tokens, size_t n
       warn(linenum, "expected word");
       return false;
    } else if (tokens[0].type != TK_WORD) {
-      warn(linenum, "expected word, got %s", token_type_str[tokens[0].type]);
+      warn(linenum, "expected word, got %s", cpp_token_type_str[tokens[0].type]);
       return false;
    }
    struct macro m;
@@ -170,7 +253,7 @@ bool dir_undef(size_t linenum, const char* line, struct token* tokens, size_t nu
       warn(linenum, "expected word");
       return false;
    } else if (tokens[0].type != TK_WORD) {
-      warn(linenum, "expected word, got %s", token_type_str[tokens[0].type]);
+      warn(linenum, "expected word, got %s", cpp_token_type_str[tokens[0].type]);
       return false;
    }
    remove_macro(strnint(tokens[0].begin, tokens[0].end - tokens[0].begin));
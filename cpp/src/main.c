@@ -13,6 +13,8 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <stdarg.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
@@ -20,17 +22,17 @@
 #include "help_options.h"
 #include "config.h"
 #include "macro.h"
+#include "bcpp.h"
 #include "cpp.h"
 #include "buf.h"
 
-extern const char** cmdline_includes;
-bool console_color = true;
-
 int main(int argc, char* argv[]) {
    bool dumpmacros = false;
    const char* output_name = "-";
-   istr_t* undef_macros = NULL;
+   const char* input_name;
+   const char** undef_macros = NULL;
    int option;
+   bcpp_init(true);
    while ((option = getopt(argc, argv, ":D:VEo:I:ChU:d:")) != -1) {
       switch (option) {
       case 'h':
@@ -59,7 +61,7 @@ int main(int argc, char* argv[]) {
          output_name = optarg;
          break;
       case 'I':
-         buf_push(cmdline_includes, optarg);
+         bcpp_include_dir(optarg);
          break;
       case 'C':
          console_color = false;
@@ -68,7 +70,7 @@ int main(int argc, char* argv[]) {
          add_cmdline_macro(optarg);
          break;
       case 'U':
-         buf_push(undef_macros, strint(optarg));
+         buf_push(undef_macros, optarg);
          break;
       case 'd':
          if (!strcmp(optarg, "umpmacros") || !strcmp(optarg, "M")) {
@@ -88,11 +90,11 @@ int main(int argc, char* argv[]) {
    // check the additional arguments
    const int argn = argc - optind;
    if (argn == 0) {
-      source_name = "-";
+      input_name = "-";
    } else if (argn == 1) {
-      source_name = argv[optind];
+      input_name = argv[optind];
    } else if (argn == 2) {
-      source_name = argv[optind];
+      input_name = argv[optind];
       if (output_name) {
          fputs("bcpp: output filename specified multiple times\n", stderr);
          return 1;
@@ -104,34 +106,42 @@ int main(int argc, char* argv[]) {
 
    // remove the macros specified by -U
    for (size_t i = 0; i < buf_len(undef_macros); ++i) {
-      remove_macro(undef_macros[i]);
-   }
-   buf_push(cmdline_includes, NULL);
-
-   // initialization stuff
-   init_macros();
-   init_includes();
-
-   // open the source file
-   FILE* source = !strcmp(source_name, "-") ? stdin : fopen(source_name, "r");
-   if (!source) {
-      fprintf(stderr, "bcpp: failed to open '%s': %s\n", source_name, strerror(errno));
-      return 1;
+      bcpp_undef(undef_macros[i]);
    }
+   buf_free(undef_macros);
 
    // open the output file
    FILE* output = !strcmp(output_name, "-") ? stdout : fopen(output_name, "w");
    if (!output) {
       fprintf(stderr, "bcpp: failed to open '%s': %s\n", output_name, strerror(errno));
-      fclose(source);
       return 1;
    }
 
    // run the pre-processor
-   const int status = run_cpp(source, output, dumpmacros);
+   const int status = bcpp_run(input_name, output, dumpmacros);
 
-   // close the files
-   fclose(source);
    fclose(output);
+   bcpp_free();
    return status;
 }
+
+// libbcpp.a expects the program to provide panic_impl()
+noreturn void panic_impl(const char* func, const char* fmt, ...) {
+   va_list ap;
+   va_start(ap, fmt);
+
+   const int errno_saved = errno;
+
+   if (console_color)
+      fputs("\033[31;1m", stderr);
+   fprintf(stderr, "bcpp: %s(): ", func);
+   if (console_color)
+      fputs("\033[0m", stderr);
+   vfprintf(stderr, fmt, ap);
+   if (errno_saved) fprintf(stderr, ": %s\n", strerror(errno_saved));
+   else fputc('\n', stderr);
+
+   va_end(ap);
+   abort();
+}
+
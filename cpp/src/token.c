@@ -17,7 +17,7 @@
 #include "token.h"
 #include "buf.h"
 
-const char* token_type_str[] = {
+const char* cpp_token_type_str[] = {
    "word",
    "string",
    "number",
@@ -21,27 +21,33 @@
 
 const char* source_name = NULL;
 
-static int read_char2(FILE* file, size_t* linenum) {
-   const int ch = fgetc(file);
+void init_reader(struct line_reader* r, FILE* file) {
+   r->file = file;
+   r->linenum = 0;
+   r->eof = false;
+   r->str_delim = 0;
+   r->escaping = false;
+   r->escape = 0;
+   r->escape_n = 0;
+}
+
+static int read_char2(struct line_reader* r) {
+   const int ch = fgetc(r->file);
    if (ch == '\n') {
-      ++*linenum;
+      ++r->linenum;
    }
    return ch;
 }
 
-static char str_delim = 0;
-static bool escaping = false;
-static int escape = 0;
-static int escape_n = 0;
-static int read_char(FILE* file, size_t* linenum) {
-   int ch = read_char2(file, linenum);
+static int read_char(struct line_reader* r) {
+   int ch = read_char2(r);
 
-   if (str_delim) {
-      if (escaping) {
-         switch (escape) {
+   if (r->str_delim) {
+      if (r->escaping) {
+         switch (r->escape) {
          case 0:
-            escape = ch;
-            escape_n = 0;
+            r->escape = ch;
+            r->escape_n = 0;
             break;
          case '0':
          case '1':
@@ -51,73 +57,73 @@ static int read_char(FILE* file, size_t* linenum) {
          case '5':
          case '6':
          case '7':
-            if (escape_n == 3 || !isodigit(ch))
-               escape = escape_n = 0;
-            else ++escape_n;
+            if (r->escape_n == 3 || !isodigit(ch))
+               r->escape = r->escape_n = 0;
+            else ++r->escape_n;
             break;
          case 'x':
-            if (escape_n == 2 || !isxdigit(ch))
-               escape = escape_n = 0;
-            else ++escape_n;
+            if (r->escape_n == 2 || !isxdigit(ch))
+               r->escape = r->escape_n = 0;
+            else ++r->escape_n;
             break;
          case 'u':
-            if (escape_n == 4 || !isxdigit(ch))
-               escape = escape_n = 0;
-            else ++escape_n;
+            if (r->escape_n == 4 || !isxdigit(ch))
+               r->escape = r->escape_n = 0;
+            else ++r->escape_n;
             break;
          case 'U':
-            if (escape_n == 8 || !isxdigit(ch))
-               escape = escape_n = 0;
-            else ++escape_n;
+            if (r->escape_n == 8 || !isxdigit(ch))
+               r->escape = r->escape_n = 0;
+            else ++r->escape_n;
             break;
          default:
-            escaping = false;
-            escape = 0;
+            r->escaping = false;
+            r->escape = 0;
             break;
          }
       } else if (ch == '\\') {
-         escaping = true;
-         escape = 0;
-      } else if (ch == str_delim) {
-         str_delim = 0;
+         r->escaping = true;
+         r->escape = 0;
+      } else if (ch == r->str_delim) {
+         r->str_delim = 0;
       }
       return ch;
    } else if (ch == '"' || ch == '\'') {
-      str_delim = ch;
+      r->str_delim = ch;
       return ch;
    }
 
    if (ch == '/') {
-      ch = read_char2(file, linenum);
+      ch = read_char2(r);
       if (ch == '/') {
-         while (!feof(file) && read_char2(file, linenum) != '\n');
-         return read_char(file, linenum);
+         while (!feof(r->file) && read_char2(r) != '\n');
+         return read_char(r);
       } else if (ch == '*') {
-         while (!feof(file)) {
-            if (read_char2(file, linenum) == '*' && read_char2(file, linenum) == '/')
-               return read_char(file, linenum);
+         while (!feof(r->file)) {
+            if (read_char2(r) == '*' && read_char2(r) == '/')
+               return read_char(r);
          }
          return EOF;
       } else {
-         return ungetc(ch, file), '/';
+         return ungetc(ch, r->file), '/';
       }
    } else return ch;
 }
 
-static char* read_line(FILE* file, bool* eof, size_t* linenum) {
+static char* read_line_impl(struct line_reader* r) {
    char* line = NULL;
    int ch;
-   while ((ch = read_char(file, linenum)) != EOF) {
+   while ((ch = read_char(r)) != EOF) {
    begin:;
       if (ch == '\n')
          break;
       else if (ch == '\\') {
-         ch = read_char2(file, linenum);
+         ch = read_char2(r);
          if (ch == '\n')
             continue;
          else if (ch == EOF) {
-            warn(*linenum, "'\\' at end of file");
-            *eof = true;
+            warn(r->linenum, "'\\' at end of file");
+            r->eof = true;
             break;
          }
          buf_push(line, '\\');
@@ -125,7 +131,7 @@ static char* read_line(FILE* file, bool* eof, size_t* linenum) {
       } else buf_push(line, ch);
    }
    buf_push(line, '\0');
-   *eof |= (ch == EOF);
+   r->eof |= (ch == EOF);
    return line;
 }
 
@@ -160,70 +166,33 @@ static bool check_hline(const char* s, size_t* linenum, const char** filename) {
    return true;
 }
 
-struct line_pair* read_lines(FILE* file) {
-   struct line_pair* pairs = NULL;
-   bool eof = false;
-   size_t linenum = 0;
-   do {
-      struct line_pair pair;
-      pair.linenum = linenum;
-      pair.line = read_line(file, &eof, &linenum);
-      if (pair.line) {
-         const char* filename;
-         if (check_hline(pair.line, &linenum, &filename)) {
-            char buf[64];
-            if (filename) {
-               printf("%s\n", filename);
-               snprintf(buf, sizeof(buf), "# %zu \"%s\"", linenum + 1, filename);
-            } else {
-               snprintf(buf, sizeof(buf), "# %zu", linenum + 1);
-            }
-            pair.linenum = linenum;
-            char* new_buf = NULL;
-            for (size_t i = 0; buf[i]; ++i)
-               buf_push(new_buf, buf[i]);
-            buf_push(new_buf, '\0');
-            pair.line = new_buf;
-         }
-         buf_push(pairs, pair);
-      }
-   } while (!eof);
-   if (!buf_last(pairs).line[1])
-      buf_remove(pairs, buf_len(pairs) - 1, 1);
-   return pairs;
-}
+bool read_line(struct line_reader* r, struct line_pair* pair) {
+   if (r->eof)
+      return false;
+   pair->linenum = r->linenum;
+   pair->line = read_line_impl(r);
 
-void free_lines(struct line_pair* lines) {
-   for (size_t i = 0; i < buf_len(lines); ++i) {
-      buf_free(lines[i].line);
-   }
-   buf_free(lines);
-}
-void print_lines(FILE* file, const struct line_pair* lines) {
-   for (size_t i = 0; i < buf_len(lines); ++i) {
-      fprintf(file, "%s\n", lines[i].line);
+   // the empty line after the last newline
+   if (r->eof && !pair->line[0]) {
+      buf_free(pair->line);
+      return false;
    }
-}
 
-static bool is_empty(const char* s) {
-   while (1) {
-      if (!isspace(*s++))
-         return false;
+   const char* filename;
+   if (check_hline(pair->line, &r->linenum, &filename)) {
+      char buf[64];
+      if (filename) {
+         snprintf(buf, sizeof(buf), "# %zu \"%s\"", r->linenum + 1, filename);
+      } else {
+         snprintf(buf, sizeof(buf), "# %zu", r->linenum + 1);
+      }
+      pair->linenum = r->linenum;
+      char* new_buf = NULL;
+      for (size_t i = 0; buf[i]; ++i)
+         buf_push(new_buf, buf[i]);
+      buf_push(new_buf, '\0');
+      buf_free(pair->line);
+      pair->line = new_buf;
    }
    return true;
 }
-
-void trim_lines(struct line_pair** plines) {
-   struct line_pair* lines = *plines;
-   // find the last non-ws line
-   struct line_pair* end;
-   for (end = &buf_last(lines); end != lines; --end) {
-      if (!is_empty(end->line))
-         break;
-   }
-   if (end != lines) {
-      const size_t off = end - lines;
-      buf_remove(lines, off, buf_len(lines) - off);
-   }
-   *plines = lines;
-}
@@ -0,0 +1,39 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef FILE_ARENA_H
+#define FILE_ARENA_H
+#include <stddef.h>
+
+// A bump allocator, everything allocated from an arena is released at once.
+
+struct arena_block;
+
+struct arena {
+   struct arena_block* blocks;
+};
+
+// allocates `size` zero-initialized bytes from `arena`
+void* arena_alloc(struct arena*, size_t size);
+
+// releases all memory of `arena`
+void arena_free(struct arena*);
+
+// owns the expressions, statements and value types of the translation unit,
+// it is released by free_unit()
+extern struct arena ast_arena;
+
+#endif /* FILE_ARENA_H */
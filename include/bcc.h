@@ -71,5 +71,13 @@ const char* create_output_name(const char* old, enum compilation_level level);
 // this is the high-level wrapper function that does everything
 int process_file(const char* source, const char* output, enum compilation_level level);
 
+// precompiles the header `source` into `output` (see pch.h)
+int process_header(const char* source, const char* output);
+
+// processes the `n` sources (with process_file() or process_header()) in up to `jobs` processes,
+// returns the exit code of the first source, that failed
+int process_files(const char** sources, const char** outputs, size_t n,
+      enum compilation_level level, bool header, unsigned jobs);
+
 #endif /* FILE_BCC_H */
 
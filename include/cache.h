@@ -0,0 +1,57 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+#include <stdbool.h>
+#include <stdio.h>
+#include "bcc.h"
+
+// Compilation cache (-fcache):
+// The assembly or object of a source is stored in the cache directory
+// under a hash of its pre-processed text, the loaded precompiled header,
+// the version and target of bcc, the optimization level and the -f/-m options.
+// A later compilation with the same key copies the stored file instead of
+// compiling the source.
+// The least recently used files are evicted, once the cache is larger than -fcache-size.
+
+struct cache_key {
+   char hex[33];     // the 128-bit hash in hexadecimal
+};
+
+// records an -f or -m option of the command line
+void cache_add_option(char prefix, const char* option);
+
+// returns true, if the output of a compilation to `level` can be cached
+bool cache_enabled(const char* output_name, enum compilation_level level);
+
+// computes the key of the pre-processed `data`, that is compiled to `level`,
+// the declarations of `pch_file` (if not NULL) are not part of `data`,
+// returns false, if the PCH cannot be read
+bool cache_compute_key(struct cache_key*, const char* data, size_t len,
+      enum compilation_level level, const char* pch_file);
+
+// copies the cached output of `key` to `output_name`,
+// returns false, if there is none (a miss)
+bool cache_lookup(const struct cache_key* key, const char* output_name);
+
+// stores `output_name` under `key`
+void cache_store(const struct cache_key* key, const char* output_name);
+
+// -fcache-stats
+void cache_print_stats(FILE*);
+
+#endif /* FILE_CACHE_H */
@@ -18,11 +18,27 @@
 #include <stdint.h>
 #include <stdio.h>
 #include "cmdline.h"
+#include "pch.h"
 
 extern struct cmdline_arg* cpp_args;
 extern bool nostdinc;
 
+// pre-processes `source_name` into `out` with the built-in bcpp (see cpp/include/bcpp.h),
+// `pch_file` is set to the name of the loaded PCH or NULL (with PCH_LOAD),
+// returns false, if it failed
+bool preprocess(const char* source_name, FILE* out, enum pch_mode, istr_t* pch_file);
+
+// a hash of the predefined macros and the pre-processor options
+uint64_t cpp_options_hash(void);
+
+// starts bcpp, its output can be read from the returned file,
+// while it is running
 FILE* run_cpp(const char* source_name);
+
+// waits for bcpp to exit, after its output was read,
+// returns false, if it failed
+bool wait_cpp(void);
+
 void define_macros(void);
 void define_macro(const char*);
 void define_macro2(const char*, const char*);
@@ -18,6 +18,7 @@
 #include "strint.h"
 #include "value.h"
 #include "scope.h"
+#include "arena.h"
 
 struct ir_node;
 
@@ -28,6 +29,7 @@ struct function {
    struct scope* scope;             // optional
    struct source_pos begin, end;
    struct ir_node* ir_code;         // optional
+   struct arena ir_arena;           // owns the nodes of ir_code
    bool variadic;
    unsigned attrs;
    unsigned max_reg;
@@ -39,6 +41,9 @@ void parse_func_part(struct function*);
 void print_func(FILE*, const struct function*);
 void free_func(struct function*);
 
+// releases the IR code of `func` at once
+void free_func_ir(struct function*);
+
 size_t func_find_param_idx(const struct function*, const char*);
 const struct variable* func_find_param(const struct function*, const char*);
 bool func_has_label(const struct function*, istr_t);
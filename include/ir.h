@@ -80,6 +80,7 @@ enum ir_node_type {
    IR_FLOOKUP,       // .lstr       | function lookup
    IR_SRET,          // .sret       | return struct/union
    IR_ASM,           // .str        | line of inline assembly
+   IR_JMPTBL,        // .jmptbl     | jump to the label at index R of a table
 
    // optional optimization-related IR nodes (-O3, SEE: fuse_memops()[optim_ir.c])
    IR_FFPRD,         // .ffprw      | fused IR_FPARAM    + IR_READ
@@ -138,6 +139,7 @@ typedef struct ir_node {
    struct ir_node* prev;
    struct ir_node* next;
    const struct function* func;
+   const struct source_pos* pos;    // where the node was generated from, or NULL
    union {
       struct scope* scope;
       istr_t str;
@@ -219,6 +221,11 @@ typedef struct ir_node {
          bool sign_extend;
          bool is_volatile;
       } ffprw;
+      struct {
+         ir_reg_t reg;     // index (IRS_PTR), must be within the table
+         istr_t label;     // label of the table
+         istr_t* targets;  // buf of labels
+      } jmptbl;
       struct {
          ir_reg_t reg;
          istr_t name;
@@ -273,7 +280,15 @@ void print_ir_value(FILE*, const struct ir_value*);
 
 
 /// Memory management
+
+// allocates a node from the arena of the current function (see ir_set_func())
 ir_node_t* new_node(enum ir_node_type t);
+
+// sets the function, that new nodes belong to
+void ir_set_func(struct function*);
+
+// frees the buffers of the node(s),
+// the nodes themselves are released with the arena of their function
 void free_ir_node(ir_node_t*);
 void free_ir_nodes(ir_node_t*);
 
@@ -313,6 +328,18 @@ size_t sizeof_irs(enum ir_value_size);
 // compute the maximum IR register from a series for nodes
 ir_reg_t ir_max_reg(const ir_node_t*);
 
+// a register operand of an IR node
+struct ir_operand {
+   ir_reg_t* reg;
+   bool is_use;
+   bool is_def;
+};
+#define IR_MAX_OPERANDS 3
+
+// stores the register operands of `n` in `ops` and returns their number,
+// the parameters and the address of calls are not included
+size_t ir_operands(ir_node_t* n, struct ir_operand* ops);
+
 
 #define ir_is_func(n) (((n)->type == IR_IFCALL) || ((n)->type == IR_FCALL) \
                      ||((n)->type == IR_IRCALL) || ((n)->type == IR_RCALL))
@@ -19,7 +19,11 @@
 #include <stdio.h>
 #include "token.h"
 
-void lexer_init(FILE*, const char*);
+// `done` is called, when the end of the input is reached, it may be NULL
+void lexer_init(FILE*, const char* filename, void (*done)(void));
+// lexes `len` bytes at `data`, which must be allocated with malloc(),
+// the lexer takes the ownership of `data`
+void lexer_init_buffer(char* data, size_t len, const char* filename);
 void lexer_free(void);
 
 struct token lexer_peek(void);
@@ -15,6 +15,7 @@
 
 #ifndef FILE_OPTIM_H
 #define FILE_OPTIM_H
+#include <stdio.h>
 #include "expr.h"
 #include "stmt.h"
 #include "ir.h"
@@ -23,6 +24,56 @@ struct expression* optim_expr(struct expression*, struct scope*);
 struct statement* optim_stmt(struct statement*);
 struct ir_node* optim_ir_nodes(struct ir_node*);
 
+// A peephole optimization of the IR (see optim_ir.c),
+// `run` returns true, if it changed the node or its neighbours.
+struct ir_pass {
+   const char* name;
+   const char* description;
+   bool (*run)(struct ir_node*);
+   unsigned min_level;        // minimum optimization level
+   bool enabled;
+   size_t visits;             // number of times the pass was tried
+   size_t changes;            // number of successful runs
+};
+
+// -f<pass> and -fno-<pass>, returns false, if there is no such pass
+bool optim_set_pass(const char* name, bool enabled);
+
+// -fpasses=pass1,pass2,...
+bool optim_select_passes(const char* list);
+
+// -fpass-stats
+void optim_print_stats(FILE*);
+
+// target-specific rewrites of the IR (see optim_note())
+enum target_rewrite {
+   TR_MUL_TO_FUNC,         // multiplications and divisions by library calls
+   TR_COPY_TO_MEMCPY,      // copies of structs by calls to memcpy()
+   NUM_TARGET_REWRITES,
+};
+
+// records, that a target-specific optimization rewrote `node` (-fopt-stats and -Rpass)
+void optim_note(enum target_rewrite, const struct ir_node* node);
+
+// -Rpass=pass1,pass2,... or -Rpass=all, prints a remark at every rewrite of the passes
+bool optim_select_remarks(const char* list);
+
+// returns true, if remarks were requested with -Rpass
+bool optim_has_remarks(void);
+
+// -fopt-stats: resets the counters of a function, before its IR is generated
+void optim_begin_func(void);
+
+// the number of IR nodes, including the parameters of calls
+size_t optim_count_nodes(const struct ir_node*);
+
+// -fopt-stats: prints how often every rewrite changed the IR of `func`,
+// `num_nodes` is the number of nodes before optim_ir_nodes()
+void optim_print_func_stats(FILE*, const struct function* func, size_t num_nodes);
+
+// -fopt-stats: prints the totals of the translation unit and resets them
+void optim_print_unit_stats(FILE*, const char* source_name);
+
 // target-specific IR optimizations
 bool target_optim_ir(struct ir_node**);
 
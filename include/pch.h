@@ -0,0 +1,52 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef FILE_PCH_H
+#define FILE_PCH_H
+#include <stdbool.h>
+#include "strint.h"
+
+// Precompiled headers:
+// `bcc -x c-header foo.h` saves the macros of the pre-processor and
+// the declarations of foo.h (typedefs, structs, unions, enums, prototypes
+// and variable declarations) into foo.pch.
+// If a file begins with `#include "foo.h"`, foo.pch is loaded instead of
+// pre-processing and parsing foo.h, as long as it is up to date
+// and was made with the same pre-processor options.
+
+// what preprocess() does with precompiled headers
+enum pch_mode {
+   PCH_NONE,
+   PCH_LOAD,      // load the PCH of the first #include (see pch_load())
+   PCH_SAVE,      // save the state of the pre-processor (see pch_save_cpp())
+};
+
+// the name of the PCH of `header_name`
+istr_t pch_name(const char* header_name);
+
+// saves the macros and included files of bcpp, after `header_name` was pre-processed,
+// must be called before bcpp_free()
+void pch_save_cpp(const char* header_name);
+
+// writes the saved state of bcpp and the declarations of cunit to `filename`,
+// the header may only contain declarations, returns false, if writing failed
+bool pch_write(const char* filename);
+
+// installs the PCH of the header, that is included by the first line of `source_name`,
+// into bcpp and cunit, returns the name of the PCH or NULL, if there is none or it is out of date
+istr_t pch_load(const char* source_name);
+
+#endif /* FILE_PCH_H */
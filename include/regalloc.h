@@ -0,0 +1,91 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FILE_REGALLOC_H
+#define FILE_REGALLOC_H
+
+#include <stdint.h>
+#include "func.h"
+#include "ir.h"
+
+// Common infrastructure for the register allocators of the backends.
+//
+// The IR of a function is linearized, with the arguments of a call
+// (evaluated in order) and the address of an indirect call
+// placed before the call itself. Every register is split into webs
+// (connected def-use chains), then liveness and live intervals are computed.
+// Positions: 2*i are the uses and 2*i+1 are the definitions of insns[i].
+
+enum ra_insn_flag {
+   RA_CALL  = 1 << 0,   // function call, clobbers the caller-saved registers
+   RA_DIV   = 1 << 1,   // integer division or modulo
+   RA_ARG   = 1 << 2,   // implicit use of a call argument or address
+};
+
+struct ra_insn {
+   ir_node_t* node;
+   ir_node_t** list;    // head of the list containing `node`
+   struct ir_operand ops[IR_MAX_OPERANDS];
+   size_t num_ops;
+   unsigned flags;
+};
+
+struct ra_block {
+   size_t begin, end;   // range of insns
+   size_t* succ;        // buf of successor blocks
+   uint64_t* live_in;
+   uint64_t* live_out;
+};
+
+struct ra_interval {
+   size_t begin, end;   // SIZE_MAX, if the register is never used
+   unsigned crosses;    // RA_CALL and/or RA_DIV, if live across such an insn
+   bool spillable;      // false for the loads and stores of spilled registers
+   ir_reg_t reg;        // the physical register or IRR_NONSENSE
+};
+
+struct ra_func {
+   const struct function* func;
+   ir_node_t* code;
+   struct ra_insn* insns;
+   struct ra_block* blocks;
+   struct ra_interval* intervals;   // indexed by virtual register
+   size_t num_vregs;
+   size_t num_slots;
+};
+
+// prepares the register allocation of `code` (the whole function),
+// the arguments of calls get optimized here
+void ra_init(struct ra_func*, const struct function*, ir_node_t* code);
+
+// (re-)computes the insns, liveness and intervals,
+// the registers are renamed to webs, if `split` is set
+void ra_analyze(struct ra_func*, bool split);
+
+// rewrites every use/definition of `vreg` to a load/store of a new stack slot
+void ra_spill(struct ra_func*, ir_reg_t vreg);
+
+// promotes the local variables and parameters, whose address does not escape,
+// to registers (see mem2reg.c), requires a split analysis
+bool ra_mem2reg(struct ra_func*);
+
+// replaces every virtual register by its assigned physical register
+void ra_assign(struct ra_func*);
+
+void ra_free(struct ra_func*);
+
+#define ra_bit_test(set, i) (((set)[(i) / 64] >> ((i) % 64)) & 1)
+
+#endif /* FILE_REGALLOC_H */
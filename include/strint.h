@@ -25,4 +25,12 @@ istr_t strnint(const char*, size_t);   // Creates an interned string
 
 #define strrint(begin, end) (strnint((begin), ((end) - (begin))))
 
+struct strint_stats {
+   size_t num_strings;
+   size_t table_size;
+   size_t memory;                      // bytes used by the table and the strings
+};
+
+void strint_stats(struct strint_stats*);
+
 #endif /* FILE_STRINT_H */
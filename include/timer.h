@@ -0,0 +1,56 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef FILE_TIMER_H
+#define FILE_TIMER_H
+#include <stdbool.h>
+#include <stdio.h>
+#include "func.h"
+
+// -ftime-report:
+// The wall time, CPU time and maximum RSS of every phase of the compiler.
+// Phases may be nested, the time of the inner phase is not counted by the outer one
+// (eg. irgen and optim run inside of parse_unit()). The CPU time and RSS of
+// child processes (bcpp, as, ld) are counted by the phase, that waits for them.
+// The RSS is not a per-phase peak: it is the high-water mark of the process
+// (ru_maxrss) so far, sampled when the phase ends, or of the children it waited for.
+
+enum time_phase {
+   TP_PREPROCESS,
+   TP_PARSE,
+   TP_IRGEN,
+   TP_OPTIM,
+   TP_EMIT,
+   TP_ASSEMBLE,
+   TP_LINK,
+   NUM_TIME_PHASES,
+};
+
+// enables the report, if requested by -ftime-report or -ftime-report-json,
+// time_push() and time_pop() do nothing otherwise
+void time_report_init(void);
+
+// begins a phase, that is charged to `func` too (may be NULL)
+void time_push(enum time_phase, const struct function* func);
+
+// ends the innermost phase
+void time_pop(void);
+
+// prints the report, and writes the JSON file (-ftime-report-json),
+// returns false, if writing the JSON file failed
+bool time_report_finish(void);
+
+#endif /* FILE_TIMER_H */
@@ -89,6 +89,10 @@ struct token {
 };
 
 void token_init(void);
+
+// returns the keyword `s[0..len]` or TK_NAME, if it is not a keyword
+enum token_type token_keyword(const char* s, size_t len);
+
 void print_token(FILE*, const struct token*);
 void print_token_info(FILE*, const struct token*);
 void print_source_pos(FILE*, const struct source_pos*);
@@ -0,0 +1,69 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "error.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+struct arena_block {
+   struct arena_block* next;
+   size_t size, used;
+   alignas(max_align_t) char data[];
+};
+
+static size_t align_size(size_t n) {
+   const size_t a = alignof(max_align_t);
+   return (n + a - 1) & ~(a - 1);
+}
+
+void* arena_alloc(struct arena* arena, size_t size) {
+   size = align_size(size);
+   struct arena_block* b = arena->blocks;
+   if (!b || b->size - b->used < size) {
+      // allocations bigger than a block get their own block
+      const size_t bsize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+      b = malloc(sizeof(struct arena_block) + bsize);
+      if (!b)
+         panic("failed to allocate an arena block");
+      b->size = bsize;
+      b->used = 0;
+      if (arena->blocks && bsize > ARENA_BLOCK_SIZE) {
+         // keep the current block for the following allocations
+         b->next = arena->blocks->next;
+         arena->blocks->next = b;
+      } else {
+         b->next = arena->blocks;
+         arena->blocks = b;
+      }
+   }
+   void* ptr = b->data + b->used;
+   b->used += size;
+   return memset(ptr, 0, size);
+}
+
+void arena_free(struct arena* arena) {
+   struct arena_block* b = arena->blocks;
+   while (b) {
+      struct arena_block* next = b->next;
+      free(b);
+      b = next;
+   }
+   arena->blocks = NULL;
+}
@@ -188,6 +188,12 @@ ir_node_t* emit_ir(const ir_node_t* n) {
       emit("b %s", n->str);
       return n->next;
 
+   case IR_JMPTBL:
+      // lr is saved by the prologue
+      emit("ldr lr, .LC%zu", add_rel_sym(n->jmptbl.label));
+      emit("ldr pc, [lr, %s, lsl #2]", reg(n->jmptbl.reg));
+      return n->next;
+
    case IR_JMPIF:
       instr = "bne";
       goto ir_cjmp;
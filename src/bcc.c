@@ -13,12 +13,19 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <sys/wait.h>
+#include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
+#include <signal.h>
 #include <ctype.h>
 #include <stdio.h>
 #include <errno.h>
 #include "target.h"
 #include "error.h"
+#include "cache.h"
+#include "optim.h"
+#include "timer.h"
 #include "cpp.h"
 #include "lex.h"
 #include "bcc.h"
@@ -90,30 +97,152 @@ static void close_file(FILE* file) {
    fclose(file);
 }
 
+// called by the lexer at the end of the output of bcpp
+static void cpp_done(void) {
+   if (!wait_cpp())
+      exit(1);
+}
+
+// the assembler, that reads from a pipe
+static pid_t as_pid = -1;
+
+// starts the assembler, that reads the assembly from the returned file, while it is written
+static FILE* run_assembler(const char* output_name) {
+   int pipes[2];
+   if (pipe(pipes) != 0)
+      panic("failed to create pipes");
+   fflush(stdout);
+   fflush(stderr);
+   const pid_t pid = fork();
+   if (pid < 0) {
+      panic("failed to fork()");
+   } else if (pid == 0) {
+      close(pipes[1]);
+      if (dup2(pipes[0], 0) < 0)
+         panic("failed to duplicate file descriptor");
+      close(pipes[0]);
+      _exit(assemble("-", output_name));
+   }
+   close(pipes[0]);
+
+   // if the assembler fails early, its exit code is reported by wait_assembler()
+   signal(SIGPIPE, SIG_IGN);
+   FILE* file = fdopen(pipes[1], "w");
+   if (!file)
+      panic("failed to open pipes[1]");
+   as_pid = pid;
+   return file;
+}
+
+// waits for the assembler, after its input was closed, returns its exit code
+static int wait_assembler(void) {
+   int wstatus;
+   while (waitpid(as_pid, &wstatus, 0) < 0) {
+      if (errno != EINTR)
+         panic("failed to wait for the assembler");
+   }
+   as_pid = -1;
+   if (WIFEXITED(wstatus))
+      return WEXITSTATUS(wstatus);
+   fprintf(stderr, "bcc: the assembler was killed by signal %d\n", WTERMSIG(wstatus));
+   return 1;
+}
+
 int process_file(const char* source_name, const char* output_name, enum compilation_level level) {
    if (ends_with_one(source_name, target_info.fend_asm)) {
-      return level >= LEVEL_ASSEMBLE ? assemble(source_name, output_name) : 0;
+      if (level < LEVEL_ASSEMBLE)
+         return 0;
+      time_push(TP_ASSEMBLE, NULL);
+      const int ec = assemble(source_name, output_name);
+      time_pop();
+      return ec;
    }
-   FILE* source = run_cpp(source_name);
-   if (!source)
-      return 1;
-   if (level == LEVEL_PREPROCESS) {
-      FILE* output = open_file_write(output_name);
-      if (!output)
+   // with the cache, the whole pre-processed source is needed to compute its key
+   bool use_cache = cache_enabled(output_name, level);
+   char* data = NULL;
+   size_t len = 0;
+   istr_t pch_file = NULL;
+   if (get_flag_opt("integrated-cpp")->bVal) {
+      if (level == LEVEL_PREPROCESS) {
+         FILE* output = open_file_write(output_name);
+         if (!output)
+            return 1;
+         time_push(TP_PREPROCESS, NULL);
+         const bool success = preprocess(source_name, output, PCH_NONE, NULL);
+         time_pop();
+         close_file(output);
+         return success ? 0 : 1;
+      }
+      FILE* mem = open_memstream(&data, &len);
+      if (!mem)
+         panic("failed to open a memory stream");
+      const enum pch_mode pch = get_flag_opt("pch")->bVal ? PCH_LOAD : PCH_NONE;
+      time_push(TP_PREPROCESS, NULL);
+      const bool success = preprocess(source_name, mem, pch, &pch_file);
+      time_pop();
+      fclose(mem);
+      if (!success) {
+         free(data);
          return 1;
-      int ch;
-      while ((ch = fgetc(source)) != EOF)
-         fputc(ch, output);
-      close_file(output);
-      close_file(source);
-      return 0;
+      }
+   } else {
+      FILE* source = run_cpp(source_name);
+      if (!source)
+         return 1;
+      if (level == LEVEL_PREPROCESS) {
+         FILE* output = open_file_write(output_name);
+         if (!output)
+            return 1;
+         int ch;
+         while ((ch = fgetc(source)) != EOF)
+            fputc(ch, output);
+         close_file(output);
+         close_file(source);
+         return wait_cpp() ? 0 : 1;
+      }
+      if (use_cache) {
+         FILE* mem = open_memstream(&data, &len);
+         if (!mem)
+            panic("failed to open a memory stream");
+         time_push(TP_PREPROCESS, NULL);
+         char buffer[4096];
+         size_t n;
+         while ((n = fread(buffer, 1, sizeof(buffer), source)) != 0)
+            fwrite(buffer, 1, n, mem);
+         fclose(mem);
+         close_file(source);
+         const bool success = wait_cpp();
+         time_pop();
+         if (!success) {
+            free(data);
+            return 1;
+         }
+      } else {
+         // bcpp runs, while its output is parsed
+         lexer_init(source, source_name, cpp_done);
+      }
    }
-   lexer_init(source, source_name);
+
+   struct cache_key key;
+   if (use_cache && !cache_compute_key(&key, data, len, level, pch_file))
+      use_cache = false;
+   if (use_cache) {
+      if (cache_lookup(&key, output_name)) {
+         free(data);
+         return 0;
+      }
+   }
+   if (data)
+      lexer_init_buffer(data, len, source_name);
 
    target_init();
 
+   time_push(TP_PARSE, NULL);
    parse_unit(level >= LEVEL_IRGEN);
    lexer_free();
+   time_pop();
+   if (level >= LEVEL_IRGEN && get_flag_opt("opt-stats")->bVal)
+      optim_print_unit_stats(stderr, source_name);
 
    if (level == LEVEL_PARSE || level == LEVEL_IRGEN) {
       FILE* output = open_file_write(output_name);
@@ -127,19 +256,177 @@ int process_file(const char* source_name, const char* output_name, enum compilat
       return 0;
    }
 
+   // the assembly is streamed into the assembler, a temporary file is only written for -save-temps
+   const bool pipe_asm = level >= LEVEL_ASSEMBLE && !save_temps;
    const char* asm_name;
-   if (level >= LEVEL_ASSEMBLE) {
-      asm_name = create_output_name(source_name, LEVEL_GEN);
-   } else asm_name = output_name;
-   FILE* asm_file = open_file_write(asm_name);
+   FILE* asm_file;
+   if (pipe_asm) {
+      asm_name = NULL;
+      asm_file = run_assembler(output_name);
+   } else {
+      if (level >= LEVEL_ASSEMBLE) {
+         asm_name = create_output_name(source_name, LEVEL_GEN);
+      } else asm_name = output_name;
+      asm_file = open_file_write(asm_name);
+   }
    if (level >= LEVEL_GEN)
       emit_init(asm_file);
+   time_push(TP_EMIT, NULL);
    emit_unit();
-   free_unit();
    emit_free();
-   if (level <= LEVEL_GEN)
+   time_pop();
+   free_unit();
+   int ec;
+   if (level <= LEVEL_GEN) {
+      ec = 0;
+   } else {
+      // the piped assembler runs concurrently with emit_unit(),
+      // only the time waited for it is counted here
+      time_push(TP_ASSEMBLE, NULL);
+      ec = pipe_asm ? wait_assembler() : assemble(asm_name, output_name);
+      time_pop();
+   }
+   // outputs with warnings are not cached, a hit would hide them
+   if (ec == 0 && use_cache && num_warnings == 0)
+      cache_store(&key, output_name);
+   return ec;
+}
+
+int process_header(const char* source_name, const char* output_name) {
+   if (!get_flag_opt("integrated-cpp")->bVal) {
+      fputs("bcc: precompiled headers require the integrated pre-processor\n", stderr);
+      return 1;
+   }
+   char* data;
+   size_t len;
+   FILE* mem = open_memstream(&data, &len);
+   if (!mem)
+      panic("failed to open a memory stream");
+   const bool success = preprocess(source_name, mem, PCH_SAVE, NULL);
+   fclose(mem);
+   if (!success) {
+      free(data);
+      return 1;
+   }
+   lexer_init_buffer(data, len, source_name);
+   target_init();
+   parse_unit(false);
+   lexer_free();
+   const bool written = pch_write(output_name);
+   free_unit();
+   return written ? 0 : 1;
+}
+
+static int process(const char* source_name, const char* output_name, enum compilation_level level, bool header) {
+   return header ? process_header(source_name, output_name) : process_file(source_name, output_name, level);
+}
+
+// A worker process, that compiles one source.
+struct worker {
+   pid_t pid;
+   FILE* log;        // the standard error of the worker
+   bool done;
+   int ec;
+};
+
+static void start_worker(struct worker* w, const char* source_name, const char* output_name,
+      enum compilation_level level, bool header) {
+   w->log = tmpfile();
+   if (!w->log)
+      panic("failed to create a temporary file");
+   w->done = false;
+   fflush(stdout);
+   fflush(stderr);
+   w->pid = fork();
+   if (w->pid < 0) {
+      panic("failed to fork()");
+   } else if (w->pid == 0) {
+      if (dup2(fileno(w->log), 2) < 0)
+         panic("failed to duplicate file descriptor");
+      const int ec = process(source_name, output_name, level, header);
+      fflush(stdout);
+      exit(ec);
+   }
+}
+
+static void finish_worker(struct worker* w, int wstatus) {
+   w->done = true;
+   if (WIFEXITED(wstatus)) {
+      w->ec = WEXITSTATUS(wstatus);
+   } else if (WIFSIGNALED(wstatus)) {
+      w->ec = 128 + WTERMSIG(wstatus);
+   } else {
+      w->ec = 254;
+   }
+}
+
+// prints the diagnostics of a worker
+static void print_log(struct worker* w) {
+   char buffer[4096];
+   size_t n;
+   rewind(w->log);
+   while ((n = fread(buffer, 1, sizeof(buffer), w->log)) != 0)
+      fwrite(buffer, 1, n, stderr);
+   fclose(w->log);
+   w->log = NULL;
+}
+
+int process_files(const char** sources, const char** outputs, size_t n,
+      enum compilation_level level, bool header, unsigned jobs) {
+   // the statistics of the passes and the time report are collected in-process
+   if (jobs <= 1 || n <= 1 || get_flag_opt("pass-stats")->bVal
+      || get_flag_opt("time-report")->bVal || get_flag_opt("time-report-json")->sVal) {
+      for (size_t i = 0; i < n; ++i) {
+         const int ec = process(sources[i], outputs[i], level, header);
+         if (ec != 0)
+            return ec;
+      }
       return 0;
-   const int ec = assemble(asm_name, output_name);  
-   remove(asm_name);
+   }
+
+   // The diagnostics of the workers are printed in the order of the sources.
+   // Like above, nothing after the first source, that failed, is reported,
+   // the workers, that are still running, are left to finish (and clean up their temporary files).
+   struct worker* workers = calloc(n, sizeof(struct worker));
+   if (!workers)
+      panic("failed to allocate workers");
+   size_t next = 0, printed = 0;
+   unsigned running = 0;
+   int ec = 0;
+   while (printed < n) {
+      while (!ec && next < n && running < jobs) {
+         start_worker(&workers[next], sources[next], outputs[next], level, header);
+         ++next;
+         ++running;
+      }
+      if (!running)
+         break;
+
+      int wstatus;
+      const pid_t pid = wait(&wstatus);
+      if (pid < 0) {
+         if (errno == EINTR)
+            continue;
+         panic("failed to wait for the workers");
+      }
+      for (size_t i = printed; i < next; ++i) {
+         if (workers[i].pid == pid && !workers[i].done) {
+            finish_worker(&workers[i], wstatus);
+            --running;
+            break;
+         }
+      }
+
+      while (!ec && printed < next && workers[printed].done) {
+         print_log(&workers[printed]);
+         ec = workers[printed].ec;
+         ++printed;
+      }
+   }
+   for (size_t i = 0; i < n; ++i) {
+      if (workers[i].log)
+         fclose(workers[i].log);
+   }
+   free(workers);
    return ec;
 }
@@ -22,6 +22,7 @@
 #include "target.h"
 #include "config.h"
 #include "strdb.h"
+#include "timer.h"
 
 #define check_flag(name) (get_mach_opt(name)->bVal)
 #define is_clean_asm() check_flag("clean-asm")
@@ -156,15 +157,37 @@ static void emit_func(const struct function* func) {
       emit(".size %s, . - %s", name, name);
    }
 
+   // emit jump tables
+   bool has_tables = false;
+   for (const ir_node_t* n = func->ir_code; n; n = n->next) {
+      if (n->type != IR_JMPTBL)
+         continue;
+      if (!has_tables) {
+         emit(".section %s", binutils_info.section_rodata);
+         emit(".balign %zu", sizeof_irs(IRS_PTR));
+         has_tables = true;
+      }
+      emit("%s:", n->jmptbl.label);
+      for (size_t i = 0; i < buf_len(n->jmptbl.targets); ++i)
+         emit("%s %s", binutils_info.init_ptr, n->jmptbl.targets[i]);
+   }
+   if (has_tables)
+      emit(".section %s", binutils_info.section_text);
+
    emit("");
 }
 
 void emit_unit(void) {
    emit_begin();
    for (size_t i = 0; i < buf_len(cunit.funcs); ++i) {
-      const struct function* f = cunit.funcs[i];
-      if (f->ir_code)
+      struct function* f = cunit.funcs[i];
+      if (f->ir_code) {
+         time_push(TP_EMIT, f);
+         ir_set_func(f);
          emit_func(f);
+         free_func_ir(f);
+         time_pop();
+      }
    }
    emit_end();
 }
@@ -0,0 +1,376 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "cmdline.h"
+#include "target.h"
+#include "config.h"
+#include "optim.h"
+#include "error.h"
+#include "cache.h"
+#include "buf.h"
+
+// Layout of the cache directory:
+// XX/YYYY...    the cached files, XX are the first two digits of the key
+// stats         "hits misses size", updated under a lock (see update_stats())
+// New files are written to a temporary file and renamed into place,
+// so that concurrent compilations never see a partially written file.
+
+// the -f/-m options, that were given on the command line
+static char** options = NULL;
+
+void cache_add_option(char prefix, const char* option) {
+   // the options of the cache and the time report do not change the output
+   if (!strncmp(option, "cache", 5) || !strncmp(option, "no-cache", 8)
+      || !strncmp(option, "time-report", 11) || !strncmp(option, "no-time-report", 14))
+      return;
+   char* s = NULL;
+   buf_push(s, prefix);
+   buf_puts(s, option);
+   buf_push(s, '\0');
+   buf_push(options, s);
+}
+
+bool cache_enabled(const char* output_name, enum compilation_level level) {
+   // a hit would skip the statistics and remarks of the optimizer
+   return get_flag_opt("cache")->bVal && level >= LEVEL_GEN
+      && !save_temps && strcmp(output_name, "-") != 0
+      && !get_flag_opt("opt-stats")->bVal && !optim_has_remarks();
+}
+
+
+/// hashing
+
+// FNV-1a with 128 bits, the prime is 2^88 + 0x13b
+struct hash {
+   uint64_t hi, lo;
+};
+
+static void hash_bytes(struct hash* h, const void* data, size_t len) {
+   const uint8_t* p = data;
+   for (size_t i = 0; i < len; ++i) {
+      const uint64_t lo = h->lo ^ p[i];
+      const uint64_t m0 = (lo & 0xffffffff) * 0x13b;
+      const uint64_t m1 = (lo >> 32) * 0x13b + (m0 >> 32);
+      h->hi = h->hi * 0x13b + (m1 >> 32) + (lo << 24);
+      h->lo = (m1 << 32) | (m0 & 0xffffffff);
+   }
+}
+static void hash_str(struct hash* h, const char* s) {
+   hash_bytes(h, s, strlen(s) + 1);
+}
+
+// hashes the contents of the file `path`
+static bool hash_file(struct hash* h, const char* path) {
+   FILE* file = fopen(path, "rb");
+   if (!file)
+      return false;
+   char buffer[8192];
+   size_t n;
+   while ((n = fread(buffer, 1, sizeof(buffer), file)) != 0)
+      hash_bytes(h, buffer, n);
+   const bool success = !ferror(file);
+   fclose(file);
+   return success;
+}
+
+bool cache_compute_key(struct cache_key* key, const char* data, size_t len,
+      enum compilation_level level, const char* pch_file) {
+   struct hash h = { 0x6c62272e07bb0142ull, 0x62b821756295c58dull };
+   const uint64_t nums[] = {
+      level >= LEVEL_ASSEMBLE ? LEVEL_ASSEMBLE : level,
+      optim_level,
+      len,
+   };
+   hash_str(&h, "bcc " VERSION " " BCC_TARGET);
+   hash_bytes(&h, nums, sizeof(nums));
+   for (size_t i = 0; i < buf_len(options); ++i)
+      hash_str(&h, options[i]);
+   hash_bytes(&h, data, len);
+   if (pch_file && !hash_file(&h, pch_file))
+      return false;
+   snprintf(key->hex, sizeof(key->hex), "%016llx%016llx",
+         (unsigned long long)h.hi, (unsigned long long)h.lo);
+   return true;
+}
+
+
+/// the directory
+
+// returns the cache directory, that is created if necessary, or NULL
+static const char* cache_dir(void) {
+   static char* dir = NULL;
+   static bool failed = false;
+   if (dir || failed)
+      return dir;
+
+   const char* s;
+   char* path = NULL;
+   if ((s = get_flag_opt("cache-dir")->sVal) != NULL && *s) {
+      buf_puts(path, s);
+   } else if ((s = getenv("BCC_CACHE_DIR")) != NULL && *s) {
+      buf_puts(path, s);
+   } else if ((s = getenv("XDG_CACHE_HOME")) != NULL && *s) {
+      buf_puts(path, s);
+      buf_puts(path, "/bcc");
+   } else if ((s = getenv("HOME")) != NULL && *s) {
+      buf_puts(path, s);
+      buf_puts(path, "/.cache/bcc");
+   } else {
+      fputs("bcc: no cache directory, use -fcache-dir\n", stderr);
+      failed = true;
+      return NULL;
+   }
+   buf_push(path, '\0');
+
+   // create every component of the path
+   for (char* p = path + 1; ; ++p) {
+      const char ch = *p;
+      if (ch != '/' && ch != '\0')
+         continue;
+      *p = '\0';
+      const bool ok = mkdir(path, 0777) == 0 || errno == EEXIST;
+      *p = ch;
+      if (!ok) {
+         fprintf(stderr, "bcc: failed to create the cache directory '%s': %s\n", path, strerror(errno));
+         buf_free(path);
+         failed = true;
+         return NULL;
+      }
+      if (ch == '\0')
+         break;
+   }
+   dir = path;
+   return dir;
+}
+
+// returns the path of `name` in the cache directory
+static char* cache_path(const char* dir, const char* name) {
+   char* path = NULL;
+   buf_puts(path, dir);
+   buf_push(path, '/');
+   buf_puts(path, name);
+   buf_push(path, '\0');
+   return path;
+}
+
+// returns the path of the cached file of `key`, and creates its sub-directory
+static char* entry_path(const char* dir, const struct cache_key* key) {
+   char sub[3] = { key->hex[0], key->hex[1], '\0' };
+   char* path = cache_path(dir, sub);
+   mkdir(path, 0777);
+   buf_pop(path);
+   buf_push(path, '/');
+   buf_puts(path, key->hex + 2);
+   buf_push(path, '\0');
+   return path;
+}
+
+static bool copy_file(const char* from, const char* to) {
+   FILE* in = fopen(from, "rb");
+   if (!in)
+      return false;
+   FILE* out = fopen(to, "wb");
+   if (!out) {
+      fclose(in);
+      return false;
+   }
+   char buffer[8192];
+   size_t n;
+   while ((n = fread(buffer, 1, sizeof(buffer), in)) != 0)
+      fwrite(buffer, 1, n, out);
+   const bool success = !ferror(in) && !ferror(out);
+   fclose(in);
+   return fclose(out) == 0 && success;
+}
+
+
+/// statistics and eviction
+
+struct stats {
+   unsigned long long hits, misses, size;
+};
+
+struct entry {
+   char* path;
+   time_t mtime;
+   off_t size;
+};
+
+static int cmp_entry(const void* a, const void* b) {
+   const time_t x = ((const struct entry*)a)->mtime;
+   const time_t y = ((const struct entry*)b)->mtime;
+   return (x > y) - (x < y);
+}
+
+// removes the least recently used files, until the cache is smaller than 90% of -fcache-size,
+// returns the new size of the cache
+static unsigned long long evict(const char* dir, unsigned long long limit) {
+   struct entry* entries = NULL;
+   unsigned long long size = 0;
+   DIR* top = opendir(dir);
+   if (!top)
+      return 0;
+   struct dirent* d;
+   while ((d = readdir(top)) != NULL) {
+      if (strlen(d->d_name) != 2 || d->d_name[0] == '.')
+         continue;
+      char* sub_path = cache_path(dir, d->d_name);
+      DIR* sub = opendir(sub_path);
+      if (sub) {
+         struct dirent* f;
+         while ((f = readdir(sub)) != NULL) {
+            // temporary files of concurrent compilations are left alone
+            if (f->d_name[0] == '.' || strchr(f->d_name, '.'))
+               continue;
+            struct entry e;
+            e.path = cache_path(sub_path, f->d_name);
+            struct stat st;
+            if (stat(e.path, &st) != 0) {
+               buf_free(e.path);
+               continue;
+            }
+            e.mtime = st.st_mtime;
+            e.size = st.st_size;
+            size += (unsigned long long)st.st_size;
+            buf_push(entries, e);
+         }
+         closedir(sub);
+      }
+      buf_free(sub_path);
+   }
+   closedir(top);
+
+   if (entries)
+      qsort(entries, buf_len(entries), sizeof(struct entry), cmp_entry);
+   for (size_t i = 0; i < buf_len(entries); ++i) {
+      if (size > limit / 10 * 9 && remove(entries[i].path) == 0)
+         size -= (unsigned long long)entries[i].size;
+      buf_free(entries[i].path);
+   }
+   buf_free(entries);
+   return size;
+}
+
+// adds to the statistics, while the stats file is locked,
+// evicts files, if the cache became too large
+static void update_stats(const char* dir, const struct stats* add, struct stats* result) {
+   char* path = cache_path(dir, "stats");
+   const int fd = open(path, O_RDWR | O_CREAT, 0666);
+   buf_free(path);
+   if (fd < 0)
+      return;
+   struct flock lock = { .l_type = F_WRLCK, .l_whence = SEEK_SET };
+   while (fcntl(fd, F_SETLKW, &lock) != 0) {
+      if (errno != EINTR) {
+         close(fd);
+         return;
+      }
+   }
+
+   FILE* file = fdopen(fd, "r+");
+   if (!file) {
+      close(fd);
+      return;
+   }
+   struct stats st = { 0, 0, 0 };
+   if (fscanf(file, "%llu %llu %llu", &st.hits, &st.misses, &st.size) != 3)
+      st = (struct stats){ 0, 0, 0 };
+   st.hits += add->hits;
+   st.misses += add->misses;
+   st.size += add->size;
+
+   const unsigned long long limit = (unsigned long long)get_flag_opt("cache-size")->iVal << 20;
+   if (add->size && st.size > limit)
+      st.size = evict(dir, limit);
+
+   if (add->hits || add->misses || add->size) {
+      rewind(file);
+      const int n = fprintf(file, "%llu %llu %llu\n", st.hits, st.misses, st.size);
+      if (fflush(file) != 0 || n < 0 || ftruncate(fd, n) != 0)
+         fputs("bcc: failed to update the statistics of the cache\n", stderr);
+   }
+   if (result)
+      *result = st;
+   fclose(file);
+}
+
+
+/// lookup and store
+
+bool cache_lookup(const struct cache_key* key, const char* output_name) {
+   const char* dir = cache_dir();
+   if (!dir)
+      return false;
+   char* path = entry_path(dir, key);
+   const bool hit = copy_file(path, output_name);
+   if (hit) {
+      // the modification time orders the files for eviction
+      utimensat(AT_FDCWD, path, NULL, 0);
+   } else {
+      remove(output_name);
+   }
+   buf_free(path);
+   if (verbose)
+      fprintf(stderr, "bcc: cache %s %s\n", hit ? "hit" : "miss", key->hex);
+   update_stats(dir, &(struct stats){ hit, !hit, 0 }, NULL);
+   return hit;
+}
+
+void cache_store(const struct cache_key* key, const char* output_name) {
+   const char* dir = cache_dir();
+   if (!dir)
+      return;
+   char* path = entry_path(dir, key);
+   char* tmp = NULL;
+   buf_puts(tmp, path);
+   buf_pop(tmp);
+   char suffix[32];
+   snprintf(suffix, sizeof(suffix), ".tmp%ld", (long)getpid());
+   buf_puts(tmp, suffix);
+   buf_push(tmp, '\0');
+
+   struct stat st;
+   if (copy_file(output_name, tmp) && stat(tmp, &st) == 0 && rename(tmp, path) == 0) {
+      update_stats(dir, &(struct stats){ 0, 0, (unsigned long long)st.st_size }, NULL);
+   } else {
+      remove(tmp);
+   }
+   buf_free(tmp);
+   buf_free(path);
+}
+
+void cache_print_stats(FILE* file) {
+   const char* dir = cache_dir();
+   if (!dir)
+      return;
+   struct stats st = { 0, 0, 0 };
+   update_stats(dir, &st, &st);
+   const unsigned long long total = st.hits + st.misses;
+   fprintf(file, "cache directory: %s\n", dir);
+   fprintf(file, "hits:            %llu\n", st.hits);
+   fprintf(file, "misses:          %llu\n", st.misses);
+   fprintf(file, "hit rate:        %.1f%%\n", total ? 100.0 * (double)st.hits / (double)total : 0.0);
+   fprintf(file, "size:            %llu KiB of %ld KiB\n", st.size >> 10,
+         (long)get_flag_opt("cache-size")->iVal << 10);
+}
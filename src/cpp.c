@@ -18,9 +18,12 @@
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <errno.h>
 #include "target.h"
 #include "config.h"
 #include "error.h"
+#include "pch.h"
+#include "bcpp.h"
 #include "cpp.h"
 #include "bcc.h"
 #include "buf.h"
@@ -28,6 +31,16 @@
 struct cmdline_arg* cpp_args = NULL;
 bool nostdinc = false;
 
+// the predefined macros, the user-specified macros (in cpp_args) come after them
+struct predef_macro {
+   const char* name;
+   const char* value;   // NULL means 1
+};
+static struct predef_macro* predef_macros = NULL;
+
+// the running bcpp process
+static pid_t cpp_pid = -1;
+
 #define TARGET_INCLUDE_DIR COMPILERDIR "/include"
 
 FILE* run_cpp(const char* source_name) {
@@ -41,6 +54,16 @@ FILE* run_cpp(const char* source_name) {
    if (!console_colors)
       buf_push(args, strdup("-C"));
    buf_push(args, strdup("-E"));
+   for (size_t i = 0; i < buf_len(predef_macros); ++i) {
+      const struct predef_macro m = predef_macros[i];
+      const char* value = m.value ? m.value : "1";
+      const size_t len_buffer = strlen(m.name) + strlen(value) + 4;
+      char* buffer = malloc(len_buffer);
+      if (!buffer)
+         panic("failed to allocate argument");
+      snprintf(buffer, len_buffer, "-D%s=%s", m.name, value);
+      buf_push(args, buffer);
+   }
    for (size_t i = 0; i < buf_len(cpp_args); ++i) {
       const struct cmdline_arg arg = cpp_args[i];
       const size_t len_buffer = (arg.arg ? strlen(arg.arg) : 0) + 3;
@@ -77,62 +100,142 @@ FILE* run_cpp(const char* source_name) {
       panic("failed to exec %s", cpp_path);
    } else {
       close(pipes[1]);
-      FILE* file = fdopen(pipes[0], "r");
+      for (size_t i = 0; i < buf_len(args); ++i)
+         free(args[i]);
+      buf_free(args);
 
+      FILE* file = fdopen(pipes[0], "r");
       if (!file)
          panic("failed to open pipes[0]");
-      
-      int wstatus;
-      waitpid(pid, &wstatus, 0);
-      if (WIFEXITED(wstatus)) {
-         const int ec = WEXITSTATUS(wstatus);
-         if (ec == 0) {
-            return file;
-         } else {
-            fprintf(stderr, "bcc: bcpp exited with code %d\n", ec);
-            return NULL;
-         }
-      } else if (WIFSIGNALED(wstatus)) {
-         fprintf(stderr, "bcc: bcpp killed by signal %d\n", WTERMSIG(wstatus));
-      } else if (WIFSTOPPED(wstatus)) {
-         fprintf(stderr, "bcc: bcpp stopped by signal %d\n", WSTOPSIG(wstatus));
-      } else if (WIFCONTINUED(wstatus)) {
-         fprintf(stderr, "bcc: bcpp continued\n");
+      cpp_pid = pid;
+      return file;
+   }
+}
+
+bool wait_cpp(void) {
+   if (cpp_pid < 0)
+      return true;
+   int wstatus;
+   while (waitpid(cpp_pid, &wstatus, 0) < 0) {
+      if (errno != EINTR)
+         panic("failed to wait for bcpp");
+   }
+   cpp_pid = -1;
+   if (WIFEXITED(wstatus)) {
+      const int ec = WEXITSTATUS(wstatus);
+      if (ec == 0) {
+         return true;
       } else {
-         fprintf(stderr, "bcc: bcpp failed by undetermined cause\n");
+         fprintf(stderr, "bcc: bcpp exited with code %d\n", ec);
+         return false;
+      }
+   } else if (WIFSIGNALED(wstatus)) {
+      fprintf(stderr, "bcc: bcpp killed by signal %d\n", WTERMSIG(wstatus));
+   } else {
+      fprintf(stderr, "bcc: bcpp failed by undetermined cause\n");
+   }
+   exit(254);
+}
+
+// FNV-1a, the terminating NUL is included
+static uint64_t hash_str(uint64_t h, const char* s) {
+   if (s) {
+      for (; *s; ++s)
+         h = (h ^ (uint8_t)*s) * 0x100000001b3ull;
+   }
+   return h * 0x100000001b3ull;
+}
+uint64_t cpp_options_hash(void) {
+   uint64_t h = 0xcbf29ce484222325ull;
+   for (size_t i = 0; i < buf_len(predef_macros); ++i) {
+      h = hash_str(h, predef_macros[i].name);
+      h = hash_str(h, predef_macros[i].value);
+   }
+   for (size_t i = 0; i < buf_len(cpp_args); ++i) {
+      const char opt[] = { cpp_args[i].option, '\0' };
+      h = hash_str(h, opt);
+      h = hash_str(h, cpp_args[i].arg);
+   }
+   return hash_str(h, nostdinc ? "nostdinc" : NULL);
+}
+
+bool preprocess(const char* source_name, FILE* out, enum pch_mode pch, istr_t* pch_file) {
+   bool dumpmacros = false;
+   if (pch_file)
+      *pch_file = NULL;
+   bcpp_init(console_colors);
+   for (size_t i = 0; i < buf_len(predef_macros); ++i)
+      bcpp_define(predef_macros[i].name, predef_macros[i].value);
+
+   // like bcpp(1): first the -D and -I options, then the -U options
+   for (size_t i = 0; i < buf_len(cpp_args); ++i) {
+      const struct cmdline_arg arg = cpp_args[i];
+      switch (arg.option) {
+      case 'D':
+      {
+         const char* eq = strchr(arg.arg, '=');
+         if (eq) {
+            bcpp_define(strnint(arg.arg, eq - arg.arg), eq + 1);
+         } else bcpp_define(arg.arg, NULL);
+         break;
       }
-      exit(254);
+      case 'I':
+         bcpp_include_dir(arg.arg);
+         break;
+      case 'd':
+         dumpmacros = true;
+         break;
+      case 'U':
+         break;
+      default:
+         fprintf(stderr, "bcc: invalid pre-processor option '-%c'\n", arg.option);
+         bcpp_free();
+         return false;
+      }
+   }
+   if (!nostdinc)
+      bcpp_include_dir(TARGET_INCLUDE_DIR);
+   for (size_t i = 0; i < buf_len(cpp_args); ++i) {
+      if (cpp_args[i].option == 'U')
+         bcpp_undef(cpp_args[i].arg);
+   }
+
+   if (pch == PCH_LOAD && !dumpmacros) {
+      const istr_t loaded = pch_load(source_name);
+      if (pch_file)
+         *pch_file = loaded;
    }
 
+   if (verbose)
+      fprintf(stderr, "Pre-processing %s\n", source_name);
+   const int ec = bcpp_run(source_name, out, dumpmacros);
+   if (ec == 0 && pch == PCH_SAVE)
+      pch_save_cpp(source_name);
+   bcpp_free();
+   return ec == 0;
 }
 
 void define_macro2(const char* n, const char* v) {
-   const size_t len = strlen(n) + strlen(v) + 2;
-   char* str = malloc(len);
-   if (!str)
-      panic("failed to allocate string");
-   snprintf(str, len, "%s=%s", n, v);
-
-   struct cmdline_arg arg;
-   arg.option = 'D';
-   arg.arg = str;
-   buf_push(cpp_args, arg); 
+   struct predef_macro m;
+   m.name = n;
+   m.value = v;
+   buf_push(predef_macros, m);
 }
 void define_macro2i(const char* n, intmax_t x) {
    char str[100];
    snprintf(str, sizeof(str), "%jd", x);
-   define_macro2(n, str);
+   define_macro2(n, strint(str));
 }
 void define_macro2u(const char* n, uintmax_t x) {
    char str[100];
    snprintf(str, sizeof(str), "%ju", x);
-   define_macro2(n, str);
+   define_macro2(n, strint(str));
 }
 void define_macro(const char* n) {
-   struct cmdline_arg arg;
-   arg.option = 'D';
-   arg.arg = n;
-   buf_push(cpp_args, arg); 
+   const char* eq = strchr(n, '=');
+   if (eq) {
+      define_macro2(strnint(n, eq - n), eq + 1);
+   } else define_macro2(n, NULL);
 }
 void define_macros(void) {
    if (!target_info.has_c99_array) {
@@ -140,10 +243,10 @@ void define_macros(void) {
    }
    define_ctarget_macros();
 
-   char* predef_macros = strdup(CPP_MACROS);
-   char* macro = strtok(predef_macros, " ");
+   char* predef = strdup(CPP_MACROS);
+   char* macro = strtok(predef, " ");
    while (macro != NULL) {
-      define_macro(strdup(macro));
+      define_macro(macro);
       macro = strtok(NULL, " ");
    }
 }
@@ -21,6 +21,8 @@
 #include "error.h"
 #include "bcc.h"
 
+unsigned num_warnings = 0;
+
 noreturn void panic_impl(const char* func, const char* fmt, ...) {
    va_list ap;
    va_start(ap, fmt);
@@ -65,6 +67,7 @@ noreturn void parse_error(const struct source_pos* pos, const char* fmt, ...) {
 
 void parse_warn(const struct source_pos* pos, const char* fmt, ...) {
    if (!enable_warnings) return;
+   ++num_warnings;
    va_list ap;
    va_start(ap, fmt);
 
@@ -83,3 +86,21 @@ void parse_warn(const struct source_pos* pos, const char* fmt, ...) {
    va_end(ap);
 }
 
+void parse_remark(const struct source_pos* pos, const char* fmt, ...) {
+   va_list ap;
+   va_start(ap, fmt);
+
+   if (console_colors)
+      fputs("\033[31;1m", stderr);
+   fputs("bcc:", stderr);
+   if (console_colors)
+      fputs("\033[0m\033[36m", stderr);
+   print_source_pos(stderr, pos);
+   fputs(": ", stderr);
+   if (console_colors)
+      fputs("\033[0m", stderr);
+   vfprintf(stderr, fmt, ap);
+   fputc('\n', stderr);
+
+   va_end(ap);
+}
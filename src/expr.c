@@ -17,6 +17,7 @@
 #include <string.h>
 #include <errno.h>
 #include "parser.h"
+#include "arena.h"
 #include "error.h"
 #include "optim.h"
 #include "lex.h"
@@ -49,10 +50,7 @@ const char* expr_type_str[NUM_EXPRS] = {
 };
 
 struct expression* new_expr(void) {
-   struct expression* expr = malloc(sizeof(struct expression));
-   if (!expr) panic("failed to allocate expression");
-   expr->vtype = NULL;
-   return expr;
+   return arena_alloc(&ast_arena, sizeof(struct expression));
 }
 
 static struct scope* scope;
@@ -569,7 +567,6 @@ void free_expr(struct expression* e) {
    case NUM_EXPRS:   break;
    }
    if (e->vtype) free_value_type(e->vtype);
-   free(e);
 }
 
 void print_expr(FILE* file, const struct expression* e) {
@@ -112,10 +112,15 @@ void free_func(struct function* func) {
    for (size_t i = 0; i < buf_len(func->params); ++i) {
       free_value_type(func->params[i].type);
    }
-   if (func->ir_code) free_ir_nodes(func->ir_code);
+   free_func_ir(func);
    buf_free(func->params);
    free(func);
 }
+void free_func_ir(struct function* func) {
+   free_ir_nodes(func->ir_code);
+   arena_free(&func->ir_arena);
+   func->ir_code = NULL;
+}
 size_t func_find_param_idx(const struct function* func, const char* name) {
    name = strint(name);
    for (size_t i = 0; i < buf_len(func->params); ++i) {
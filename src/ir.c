@@ -87,6 +87,7 @@ const char* ir_node_type_str[NUM_IR_NODES] = {
    [IR_FLOOKUP]      = "flookup",
    [IR_SRET]         = "sret",
    [IR_ASM]          = "asm",
+   [IR_JMPTBL]       = "jmptbl",
    [IR_FFPRD]        = "ffprd",
    [IR_FFPWR]        = "ffpwr",
    [IR_FGLRD]        = "fglrd",
@@ -244,6 +245,11 @@ void print_ir_node(FILE* file, const ir_node_t* n) {
    case IR_ASM:
       fprintf(file, " %s", n->str);
       break;
+   case IR_JMPTBL:
+      fprintf(file, " %s[R%u]:", n->jmptbl.label, n->jmptbl.reg);
+      for (size_t i = 0; i < buf_len(n->jmptbl.targets); ++i)
+         fprintf(file, " %s", n->jmptbl.targets[i]);
+      break;
    }
    fputc('\n', file);
 }
@@ -263,8 +269,9 @@ void free_ir_node(ir_node_t* n) {
       for (size_t i = 0; i < buf_len(n->call.params); ++i)
          free_ir_nodes(n->call.params[i]);
       buf_free(n->call.params);
+   } else if (n->type == IR_JMPTBL) {
+      buf_free(n->jmptbl.targets);
    }
-   free(n);
 }
 void free_ir_nodes(ir_node_t* n) {
    while (n) {
@@ -361,6 +368,8 @@ bool ir_is_source(const ir_node_t* n, ir_reg_t r) {
       return n->fglrw.reg;
    case IR_FLUWR:
       return n->flurw.reg;
+   case IR_JMPTBL:
+      return n->jmptbl.reg == r;
    default:
       return false;
    }
@@ -439,3 +448,119 @@ ir_reg_t ir_max_reg(const ir_node_t* n) {
    }
    return r;
 }
+
+#define add_op(r, use, def) (ops[num++] = (struct ir_operand){ .reg = (r), .is_use = (use), .is_def = (def) })
+#define add_irv(v) do { if ((v)->type == IRT_REG) add_op(&(v)->reg, true, false); } while (0)
+
+size_t ir_operands(ir_node_t* n, struct ir_operand* ops) {
+   size_t num = 0;
+   switch (n->type) {
+   case IR_MOVE:
+   case IR_READ:
+      add_op(&n->move.dest, false, true);
+      add_op(&n->move.src, true, false);
+      break;
+   case IR_WRITE:
+      add_op(&n->rw.dest, true, false);
+      add_op(&n->rw.src, true, false);
+      break;
+   case IR_LOAD:
+      add_op(&n->load.dest, false, true);
+      break;
+   case IR_IADD:
+   case IR_ISUB:
+   case IR_IAND:
+   case IR_IOR:
+   case IR_IXOR:
+   case IR_ILSL:
+   case IR_ILSR:
+   case IR_IASR:
+   case IR_IMUL:
+   case IR_IDIV:
+   case IR_IMOD:
+   case IR_UMUL:
+   case IR_UDIV:
+   case IR_UMOD:
+   case IR_ISTEQ:
+   case IR_ISTNE:
+   case IR_ISTGR:
+   case IR_ISTGE:
+   case IR_ISTLT:
+   case IR_ISTLE:
+   case IR_USTGR:
+   case IR_USTGE:
+   case IR_USTLT:
+   case IR_USTLE:
+      add_op(&n->binary.dest, false, true);
+      add_irv(&n->binary.a);
+      add_irv(&n->binary.b);
+      break;
+   case IR_INEG:
+   case IR_INOT:
+   case IR_BNOT:
+      add_op(&n->unary.reg, true, true);
+      break;
+   case IR_IRET:
+      add_op(&n->unary.reg, true, false);
+      break;
+   case IR_LOOKUP:
+   case IR_ARRAYLEN:
+      add_op(&n->lookup.reg, false, true);
+      break;
+   case IR_IICAST:
+      add_op(&n->iicast.dest, false, true);
+      add_op(&n->iicast.src, true, false);
+      break;
+   case IR_IFCALL:
+   case IR_IRCALL:
+      add_op(&n->call.dest, false, true);
+      break;
+   case IR_FPARAM:
+      add_op(&n->fparam.reg, false, true);
+      break;
+   case IR_LSTR:
+   case IR_GLOOKUP:
+   case IR_FLOOKUP:
+      add_op(&n->lstr.reg, false, true);
+      break;
+   case IR_JMPIF:
+   case IR_JMPIFN:
+      add_op(&n->cjmp.reg, true, false);
+      break;
+   case IR_JMPTBL:
+      add_op(&n->jmptbl.reg, true, false);
+      break;
+   case IR_ALLOCA:
+      add_op(&n->alloca.dest, false, true);
+      add_irv(&n->alloca.size);
+      break;
+   case IR_COPY:
+      add_op(&n->copy.dest, true, false);
+      add_op(&n->copy.src, true, false);
+      break;
+   case IR_SRET:
+      add_op(&n->sret.ptr, true, false);
+      break;
+   case IR_FFPRD:
+      add_op(&n->ffprw.reg, false, true);
+      break;
+   case IR_FFPWR:
+      add_op(&n->ffprw.reg, true, false);
+      break;
+   case IR_FGLRD:
+      add_op(&n->fglrw.reg, false, true);
+      break;
+   case IR_FGLWR:
+      add_op(&n->fglrw.reg, true, false);
+      break;
+   case IR_FLURD:
+      add_op(&n->flurw.reg, false, true);
+      break;
+   case IR_FLUWR:
+      add_op(&n->flurw.reg, true, false);
+      break;
+   default:
+      break;
+   }
+   return num;
+}
@@ -24,12 +24,21 @@
 
 static struct function* cur_func = NULL;
 
+// the expression or statement, that is currently generated (see ir_node.pos)
+static const struct source_pos* cur_pos = NULL;
+
+void ir_set_func(struct function* func) {
+   cur_func = func;
+}
+
 ir_node_t* new_node(enum ir_node_type t) {
-   ir_node_t* n = calloc(1, sizeof(ir_node_t));
-   if (!n) panic("failed to allocate ir_node");
+   if (!cur_func)
+      panic("no function for the ir_node");
+   ir_node_t* n = arena_alloc(&cur_func->ir_arena, sizeof(ir_node_t));
    n->type = t;
    n->prev = n->next = NULL;
    n->func = cur_func;
+   n->pos = cur_pos;
    return n;
 }
 
@@ -218,7 +227,16 @@ static ir_node_t* ir_lvalue(struct scope* scope, const struct expression* e, boo
    default: panic("unsupported expression '%s'", expr_type_str[e->type]);
    }
 }
+static ir_node_t* gen_expr(struct scope* scope, const struct expression* e);
 static ir_node_t* ir_expr(struct scope* scope, const struct expression* e) {
+   const struct source_pos* saved = cur_pos;
+   cur_pos = &e->begin;
+   ir_node_t* n = gen_expr(scope, e);
+   cur_pos = saved;
+   return n;
+}
+
+static ir_node_t* gen_expr(struct scope* scope, const struct expression* e) {
    assert(e->vtype != NULL);
    const struct value_type* vt = e->vtype;
    ir_node_t* n;
@@ -254,12 +272,22 @@ static ir_node_t* ir_expr(struct scope* scope, const struct expression* e) {
          tmp->cjmp.size = vt2irs(vr);
          ir_append(n, tmp);
 
-         tmp = make_iload(creg - 1, 1, irs, true);
+         // the condition registers are not valid after a jump,
+         // if the backend merged the comparison into the jump
+         const istr_t lbl_end = make_label(clbl++);
+         ir_append(n, make_iload(creg - 1, 1, irs, true));
+         tmp = new_node(IR_JMP);
+         tmp->str = lbl_end;
          ir_append(n, tmp);
 
          tmp = new_node(IR_LABEL);
          tmp->str = lbl;
          ir_append(n, tmp);
+         ir_append(n, make_iload(creg - 1, 0, irs, true));
+
+         tmp = new_node(IR_LABEL);
+         tmp->str = lbl_end;
+         ir_append(n, tmp);
          return n;
       } else if (e->binary.op.type == TK_PIPI) {
          const istr_t lbl_end = make_label(clbl++);
@@ -273,10 +301,15 @@ static ir_node_t* ir_expr(struct scope* scope, const struct expression* e) {
          --creg;
 
          ir_append(n, ir_expr(scope, e->binary.right));
-         tmp = new_node(IR_JMPIFN);
-         tmp->cjmp.label = lbl_end;
+         tmp = new_node(IR_JMPIF);
+         tmp->cjmp.label = lbl_1;
          tmp->cjmp.reg = creg - 1;
-         tmp->cjmp.size = vt2irs(vl);
+         tmp->cjmp.size = vt2irs(vr);
+         ir_append(n, tmp);
+
+         ir_append(n, make_iload(creg - 1, 0, irs, true));
+         tmp = new_node(IR_JMP);
+         tmp->str = lbl_end;
          ir_append(n, tmp);
 
          tmp = new_node(IR_LABEL);
@@ -537,7 +570,16 @@ static ir_node_t* ir_expr(struct scope* scope, const struct expression* e) {
             tmp->iicast.sign_extend = irs == IRS_PTR ? false : !func->func.ret_val->integer.is_unsigned;
             ir_append(ir, tmp);
          }
-         buf_push(n->call.params, optim_ir_nodes(ir));
+         ir = optim_ir_nodes(ir);
+         // the value of &&, || and ?: is defined before their end label,
+         // but the argument has to end with a definition of it (see regalloc.c)
+         if (ir_get_target(ir_end(ir)) == IRR_NONSENSE) {
+            tmp = new_node(IR_MOVE);
+            tmp->move.dest = tmp->move.src = creg - 1;
+            tmp->move.size = IRS_PTR;
+            ir_append(ir, tmp);
+         }
+         buf_push(n->call.params, ir);
          --creg;
       }
       ++creg;
@@ -675,8 +717,10 @@ static ir_node_t* ir_expr(struct scope* scope, const struct expression* e) {
       tmp->cjmp.reg = --creg;
       tmp->cjmp.size = irs;
       ir_append(n, tmp);
-      
-      ir_append(n, irgen_expr(scope, e->ternary.true_case));
+
+      // both cases leave their value in the register of the condition
+      const ir_reg_t base = creg;
+      ir_append(n, ir_expr(scope, e->ternary.true_case));
 
       tmp = new_node(IR_JMP);
       tmp->str = l2;
@@ -686,7 +730,8 @@ static ir_node_t* ir_expr(struct scope* scope, const struct expression* e) {
       tmp->str = l1;
       ir_append(n, tmp);
 
-      ir_append(n, irgen_expr(scope, e->ternary.false_case));
+      creg = base;
+      ir_append(n, ir_expr(scope, e->ternary.false_case));
 
       tmp = new_node(IR_LABEL);
       tmp->str = l2;
@@ -778,7 +823,164 @@ ir_node_t* irgen_expr(struct scope* scope, const struct expression* expr) {
    return ir_expr(scope, expr);
 }
 
+// Lowering of switch statements:
+// Dense ranges of cases are dispatched through a jump table,
+// sparse sets by a binary search, and a few cases by a linear search.
+#define SWITCH_MAX_LINEAR  3        // maximum number of linearly compared cases
+#define SWITCH_MIN_TABLE   4        // minimum number of cases in a jump table
+#define SWITCH_MIN_DENSITY 40       // minimum percentage of used jump table entries
+#define SWITCH_MAX_TABLE   4096     // maximum number of jump table entries
+
+struct switch_case {
+   uintmax_t value;
+   uintmax_t key;                // `value` in an unsigned order, the sign bit is flipped for signed values
+   istr_t label;
+};
+
+struct switch_info {
+   const struct switch_case* cases;
+   ir_reg_t reg;                 // value of the controlling expression
+   enum ir_value_size size;
+   bool is_unsigned;
+   istr_t default_label;
+};
+
+static int cmp_switch_case(const void* a, const void* b) {
+   const uintmax_t x = ((const struct switch_case*)a)->key;
+   const uintmax_t y = ((const struct switch_case*)b)->key;
+   return (x > y) - (x < y);
+}
+
+// constants, that don't fit into an immediate, are loaded into `tmp`
+static struct ir_value switch_value(ir_node_t** n, const struct switch_info* sw, ir_reg_t tmp, uintmax_t value) {
+   if ((intmax_t)value >= target_info.min_immed && (intmax_t)value <= target_info.max_immed)
+      return irv_uint(value);
+   *n = ir_append(*n, make_iload(tmp, value, sw->size, sw->is_unsigned));
+   return irv_reg(tmp);
+}
+
+static ir_node_t* make_cjmp(const struct switch_info* sw, enum ir_node_type cmp, uintmax_t value, istr_t label) {
+   ir_node_t* n = NULL;
+   const struct ir_value b = switch_value(&n, sw, sw->reg + 1, value);
+
+   ir_node_t* tmp = new_node(cmp);
+   tmp->binary.size = sw->size;
+   tmp->binary.dest = sw->reg + 1;
+   tmp->binary.a = irv_reg(sw->reg);
+   tmp->binary.b = b;
+   n = ir_append(n, tmp);
+
+   tmp = new_node(IR_JMPIF);
+   tmp->cjmp.label = label;
+   tmp->cjmp.reg = sw->reg + 1;
+   tmp->cjmp.size = sw->size;
+   return ir_append(n, tmp);
+}
+
+static ir_node_t* make_jmp(istr_t label) {
+   ir_node_t* n = new_node(IR_JMP);
+   n->str = label;
+   return n;
+}
+
+// jumps through a table to cases[begin..end], which must be sorted
+static ir_node_t* irgen_switch_table(const struct switch_info* sw, size_t begin, size_t end) {
+   const struct switch_case* cases = sw->cases;
+   const uintmax_t min = cases[begin].value;
+   const uintmax_t range = cases[end - 1].value - min;
+   const ir_reg_t idx = sw->reg + 1;
+
+   // idx = (uintptr_t)(value - min)
+   ir_node_t* n = new_node(IR_MOVE);
+   n->move.dest = idx;
+   n->move.src = sw->reg;
+   n->move.size = sw->size;
+
+   struct ir_value val = switch_value(&n, sw, idx + 1, min);
+   ir_node_t* tmp = new_node(IR_ISUB);
+   tmp->binary.size = sw->size;
+   tmp->binary.dest = idx;
+   tmp->binary.a = irv_reg(idx);
+   tmp->binary.b = val;
+   ir_append(n, tmp);
+
+   tmp = new_node(IR_IICAST);
+   tmp->iicast.dest = idx;
+   tmp->iicast.src = idx;
+   tmp->iicast.ds = IRS_PTR;
+   tmp->iicast.ss = sw->size;
+   tmp->iicast.sign_extend = false;
+   ir_append(n, tmp);
+
+   // if (idx > range) goto default;
+   val = switch_value(&n, sw, idx + 1, range);
+   tmp = new_node(IR_USTGR);
+   tmp->binary.size = IRS_PTR;
+   tmp->binary.dest = idx + 1;
+   tmp->binary.a = irv_reg(idx);
+   tmp->binary.b = val;
+   ir_append(n, tmp);
+
+   tmp = new_node(IR_JMPIF);
+   tmp->cjmp.label = sw->default_label;
+   tmp->cjmp.reg = idx + 1;
+   tmp->cjmp.size = IRS_PTR;
+   ir_append(n, tmp);
+
+   tmp = new_node(IR_JMPTBL);
+   tmp->jmptbl.reg = idx;
+   tmp->jmptbl.label = make_label(clbl++);
+   tmp->jmptbl.targets = NULL;
+   for (size_t i = begin; i < end; ++i) {
+      // compare indices, min + len wraps around if min < 0 <= value
+      while (buf_len(tmp->jmptbl.targets) < (uintmax_t)(cases[i].value - min))
+         buf_push(tmp->jmptbl.targets, sw->default_label);
+      buf_push(tmp->jmptbl.targets, cases[i].label);
+   }
+   return ir_append(n, tmp);
+}
+
+static bool is_dense(const struct switch_case* cases, size_t begin, size_t end) {
+   const size_t num = end - begin;
+   const uintmax_t range = cases[end - 1].value - cases[begin].value;
+   return num >= SWITCH_MIN_TABLE && range < SWITCH_MAX_TABLE
+      && num * 100 >= (range + 1) * SWITCH_MIN_DENSITY;
+}
+
+// dispatches to cases[begin..end] or the default label
+static ir_node_t* irgen_switch_dispatch(const struct switch_info* sw, size_t begin, size_t end) {
+   const size_t num = end - begin;
+   if (num <= SWITCH_MAX_LINEAR) {
+      ir_node_t* n = NULL;
+      for (size_t i = begin; i < end; ++i)
+         n = ir_append(n, make_cjmp(sw, IR_ISTEQ, sw->cases[i].value, sw->cases[i].label));
+      return ir_append(n, make_jmp(sw->default_label));
+   } else if (is_dense(sw->cases, begin, end)) {
+      return irgen_switch_table(sw, begin, end);
+   }
+
+   // if (value < cases[mid]) goto left; else goto right;
+   const size_t mid = begin + num / 2;
+   const istr_t left = make_label(clbl++);
+   ir_node_t* n = make_cjmp(sw, sw->is_unsigned ? IR_USTLT : IR_ISTLT, sw->cases[mid].value, left);
+   ir_append(n, irgen_switch_dispatch(sw, mid, end));
+
+   ir_node_t* tmp = new_node(IR_LABEL);
+   tmp->str = left;
+   ir_append(n, tmp);
+   return ir_append(n, irgen_switch_dispatch(sw, begin, mid));
+}
+
+static ir_node_t* gen_stmt(const struct statement* s);
 ir_node_t* irgen_stmt(const struct statement* s) {
+   const struct source_pos* saved = cur_pos;
+   cur_pos = &s->begin;
+   ir_node_t* n = gen_stmt(s);
+   cur_pos = saved;
+   return n;
+}
+
+static ir_node_t* gen_stmt(const struct statement* s) {
    ir_node_t* n;
    ir_node_t* tmp;
    creg = 0;
@@ -1118,39 +1320,42 @@ ir_node_t* irgen_stmt(const struct statement* s) {
    case STMT_SWITCH:
    {
       const istr_t old_end = end_loop;
-      const enum ir_value_size sz = vt2irs(s->sw.expr->vtype);
       n = ir_expr(s->parent, s->sw.expr);
-      const size_t lbl = clbl;
-      size_t nlbl = 0;
+
+      const bool is_unsigned = vt_is_unsigned(s->sw.expr->vtype);
+      const uintmax_t sign = is_unsigned ? 0 : (uintmax_t)INTMAX_MAX + 1;
+      struct switch_case* cases = NULL;
       bool has_default = false;
       for (size_t i = 0; i < buf_len(s->sw.body); ++i) {
          const struct switch_entry* e = &s->sw.body[i];
          if (e->type == SWITCH_CASE) {
-            tmp = new_node(IR_ISTEQ);
-            tmp->binary.size = sz;
-            tmp->binary.dest = creg;
-            tmp->binary.a.type = IRT_REG;
-            tmp->binary.a.reg = creg - 1;
-            tmp->binary.b.type = IRT_UINT;
-            tmp->binary.b.uVal = e->cs.value.uVal;
-            ir_append(n, tmp);
-            tmp = new_node(IR_JMPIF);
-            tmp->cjmp.label = make_label(clbl++);
-            tmp->cjmp.reg = creg;
-            tmp->cjmp.size = sz;
-            ir_append(n, tmp);
-            ++nlbl;
+            const uintmax_t value = e->cs.value.uVal;
+            const struct switch_case c = { value, value ^ sign, make_label(clbl++) };
+            buf_push(cases, c);
          } else if (e->type == SWITCH_DEFAULT)
             has_default = true;
       }
+      const size_t lbl = clbl - buf_len(cases);
       const size_t def_lbl = has_default ? clbl++ : 0;
       const size_t end_lbl = clbl++;
-      tmp = new_node(IR_JMP);
-      tmp->str = make_label(has_default ? def_lbl : end_lbl);
-      ir_append(n, tmp);
       end_loop = make_label(end_lbl);
 
-      nlbl = 0;
+      struct switch_info sw = {
+         .cases = cases,
+         .reg = creg - 1,
+         .size = vt2irs(s->sw.expr->vtype),
+         .is_unsigned = is_unsigned,
+         .default_label = make_label(has_default ? def_lbl : end_lbl),
+      };
+      if (cases) {
+         qsort(cases, buf_len(cases), sizeof(struct switch_case), cmp_switch_case);
+         ir_append(n, irgen_switch_dispatch(&sw, 0, buf_len(cases)));
+      } else {
+         ir_append(n, make_jmp(sw.default_label));
+      }
+      buf_free(cases);
+
+      size_t nlbl = 0;
       for (size_t i = 0; i < buf_len(s->sw.body); ++i) {
          const struct switch_entry* e = &s->sw.body[i];
          switch (e->type) {
@@ -1199,6 +1404,7 @@ ir_node_t* irgen_stmt(const struct statement* s) {
 
 ir_node_t* irgen_func(struct function* f) {
    cur_func = f;
+   cur_pos = &f->begin;
    ir_node_t* tmp;
    ir_node_t* n = new_node(IR_PROLOGUE);
 
@@ -1215,6 +1421,8 @@ ir_node_t* irgen_func(struct function* f) {
    ir_append(n, tmp);
 
    tmp = new_node(IR_EPILOGUE);
+   // the nodes of later passes have no position
+   cur_pos = NULL;
    return ir_append(n, tmp);
 }
 
@@ -13,9 +13,13 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <string.h>
+#include <unistd.h>
 #include <stdio.h>
 #include <ctype.h>
 #include <math.h>
@@ -24,64 +28,111 @@
 #include "lex.h"
 #include "buf.h"
 
+// Regular files are mapped into memory as a whole.
+// Pipes (eg. the output of bcpp) are read in blocks, while the lexer runs,
+// only complete lines are scanned, so that no token crosses the end of the buffer.
 static FILE* file = NULL;
-static int peekd_ch = '\0';
+static char* input = NULL;
+static size_t input_cap = 0;
+static bool input_mapped = false;
+static bool input_eof = false;
+static void (*input_done)(void) = NULL;
+static const char* cur;             // the next character
+static const char* end;             // the end of the complete lines
+static const char* data_end;        // the end of the read data
 static struct token peekd_tks[2];
 static struct source_pos pos;
 
+#define READ_BLOCK_SIZE (256 * 1024)
+
 // INPUT STUFF
 
-#define input_peek() (peekd_ch ? peekd_ch : (peekd_ch = input_read()))
-#define input_skip() (peekd_ch ? peekd_ch = '\0' : (input_read(), 0))
-static int isspacennl(int ch) {
-   return (ch != '\n') && isspace(ch);
+static void open_input(FILE* f) {
+   const int fd = fileno(f);
+   struct stat st;
+   file = f;
+   input_eof = false;
+   input_mapped = false;
+   if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void* ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr != MAP_FAILED) {
+         input = ptr;
+         input_cap = (size_t)st.st_size;
+         input_mapped = true;
+         input_eof = true;
+         cur = input;
+         end = data_end = input + input_cap;
+         if (input_done)
+            input_done();
+         return;
+      }
+   }
+
+   input_cap = READ_BLOCK_SIZE;
+   input = malloc(input_cap);
+   if (!input)
+      panic("failed to allocate the input buffer");
+   cur = end = data_end = input;
 }
-static int input_read(void) {
-   int ch = fgetc(file);
-   if (ch == '#' && pos.column == 0) {
-      ++pos.column;
-      while (isspacennl(ch = input_read()));
-      if (ch == '\n') {
-         pos.line += 1;
-         pos.column = 0;
-         return input_read();
+
+// reads more lines, returns false at the end of the input
+static bool refill(void) {
+   if (cur < end)
+      return true;
+   if (input_eof)
+      return false;
+
+   // move the incomplete line to the beginning
+   size_t used = (size_t)(data_end - cur);
+   memmove(input, cur, used);
+   while (1) {
+      if (input_cap - used < READ_BLOCK_SIZE) {
+         input_cap *= 2;
+         input = realloc(input, input_cap);
+         if (!input)
+            panic("failed to allocate the input buffer");
       }
-      size_t n = 0;
-      while (isdigit(ch)) {
-         n = n * 10 + (ch - '0');
-         ch = input_read();
+      const ssize_t n = read(fileno(file), input + used, input_cap - used);
+      if (n < 0) {
+         if (errno == EINTR)
+            continue;
+         panic("failed to read the input: %s", strerror(errno));
+      } else if (n == 0) {
+         input_eof = true;
+         if (input_done)
+            input_done();
+         break;
       }
-      if (!n)
-         parse_error(&pos, "invalid line number");
-      while (isspacennl(ch = input_read()));
+      used += (size_t)n;
+      if (memchr(input + used - n, '\n', (size_t)n))
+         break;
+   }
 
-      const char* filename = NULL;
-      if (ch != '\n' && ch == '"') {
-         char* buf = NULL;
-         while ((ch = input_read()) != '"')
-            buf_push(buf, ch);
-         buf_push(buf, '\0');
-         filename = strint(buf);
-         buf_free(buf);
-         while ((ch = input_read()) != '\n');
-      }
-      pos.file = filename;
-      pos.line = n - 1;
-      pos.column = 0;
-      return ch;
-   } else if (ch == '\n') {
+   cur = input;
+   data_end = end = input + used;
+   if (!input_eof) {
+      while (end[-1] != '\n')
+         --end;
+   }
+   return cur < end;
+}
+
+#define input_peek() (cur < end || refill() ? (unsigned char)*cur : EOF)
+static int isspacennl(int ch) {
+   return (ch != '\n') && isspace(ch);
+}
+static void input_skip(void) {
+   if (cur == end && !refill())
+      return;
+   if (*cur++ == '\n') {
       pos.line += 1;
       pos.column = 0;
    } else ++pos.column;
-   return ch;
 }
-
 static int input_next(void) {
-   if (peekd_ch) {
-      const int tmp = peekd_ch;
-      peekd_ch = '\0';
-      return tmp;
-   } else return input_read();
+   const int ch = input_peek();
+   input_skip();
+   return ch;
 }
 static bool input_match(int ch) {
    if (input_peek() == ch) return input_skip(), true;
@@ -90,25 +141,97 @@ static bool input_match(int ch) {
 
 #define lex_error(...) parse_error(&pos, __VA_ARGS__)
 
+// parses a line marker (# 1 "file.c"), `cur` points to the '#' at the beginning of a line
+static void line_marker(void) {
+   ++cur;
+   ++pos.column;
+   while (isspacennl(input_peek())) input_skip();
+   if (input_peek() == '\n') {
+      input_skip();
+      return;
+   }
+   size_t n = 0;
+   while (isdigit(input_peek()))
+      n = n * 10 + (input_next() - '0');
+   if (!n)
+      lex_error("invalid line number");
+   while (isspacennl(input_peek())) input_skip();
+
+   const char* filename = NULL;
+   if (input_peek() == '"') {
+      const char* begin = ++cur;
+      while (cur < end && *cur != '"' && *cur != '\n')
+         ++cur;
+      filename = strrint(begin, cur);
+   }
+   while (cur < end && *cur++ != '\n');
+   pos.file = filename;
+   pos.line = n - 1;
+   pos.column = 0;
+}
+
+// skips whitespace and line markers
+static void skip_ws(void) {
+   while (1) {
+      const char* p = cur;
+      while (p < end && isspace((unsigned char)*p)) {
+         if (*p == '\n') {
+            pos.line += 1;
+            pos.column = 0;
+         } else ++pos.column;
+         ++p;
+      }
+      cur = p;
+      if (cur == end) {
+         if (refill())
+            continue;
+         break;
+      } else if (*cur == '#' && pos.column == 0) {
+         line_marker();
+      } else break;
+   }
+}
+
 // LEXER STUFF
 
-void lexer_init(FILE* f, const char* fn) {
-   token_init();
-   if (file) fclose(file);
-   file = f;
-   peekd_ch = '\0';
+static void init_state(const char* fn) {
    for (size_t i = 0; i < arraylen(peekd_tks); ++i)
       peekd_tks[i].type = TK_DUMMY;
    pos.file = fn;
    pos.line = 0;
    pos.column = 0;
 }
+void lexer_init(FILE* f, const char* fn, void (*done)(void)) {
+   token_init();
+   lexer_free();
+   input_done = done;
+   open_input(f);
+   init_state(fn);
+}
+void lexer_init_buffer(char* data, size_t len, const char* fn) {
+   token_init();
+   lexer_free();
+   input_done = NULL;
+   file = NULL;
+   input = data;
+   input_cap = len;
+   input_mapped = false;
+   input_eof = true;
+   cur = input;
+   end = data_end = input + len;
+   init_state(fn);
+}
 void lexer_free(void) {
-   if (file) {
-      if (file != stdin)
-         fclose(file);
-      file = NULL;
-   }
+   if (!input)
+      return;
+   if (input_mapped)
+      munmap(input, input_cap);
+   else free(input);
+   if (file && file != stdin)
+      fclose(file);
+   file = NULL;
+   input = NULL;
+   cur = end = data_end = NULL;
 }
 static struct token lexer_impl(void);
 
@@ -144,7 +267,7 @@ void lexer_unget(const struct token* tk) {
 }
 
 bool lexer_eof(void) {
-   return feof(file) && !peekd_ch && !peekd_tks[0].type;
+   return !peekd_tks[0].type && input_peek() == EOF;
 }
 
 bool lexer_matches(enum token_type type) {
@@ -160,8 +283,6 @@ struct token lexer_expect(enum token_type type) {
    else lex_error("expected %s, got %s", token_type_str[type], token_type_str[tk.type]);
 }
 
-#define skip_ws() while (isspace(input_peek())) input_skip()
-
 static int xctoi(int ch) {
    if (isdigit(ch)) return ch - '0';
    else if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
@@ -222,7 +343,10 @@ static struct token lexer_impl(void) {
          }
          return (struct token){ .type = TK_INTEGER, start, pos, .iVal = iVal };
       }
-      while (isdigit(input_peek())) iVal = iVal * 10 + (input_next() - '0');
+      const char* begin = cur;
+      while (cur < end && isdigit((unsigned char)*cur))
+         iVal = iVal * 10 + (*cur++ - '0');
+      pos.column += (size_t)(cur - begin);
 #if ENABLE_FP
       if (input_match('.')) {
          fpmax_t fVal = 0.0;
@@ -250,19 +374,16 @@ static struct token lexer_impl(void) {
 #endif
       return (struct token){ TK_INTEGER, start, pos, .iVal = iVal };
    } else if (isalpha(ch) || ch == '_') {
-      char* buf = NULL;
-      while ((ch = input_peek()) && (isalnum(ch) || ch == '_')) {
-         buf_push(buf, ch);
-         input_skip();
-      }
-      const istr_t s = strnint(buf, buf_len(buf));
-      for (int i = TK_EOF + 1; i < NUM_TOKENS; ++i) {
-         if (s == token_type_str[i])
-            return (struct token){ i, start, pos, 0 };
-      }
-
-      buf_free(buf);
-      return (struct token){ TK_NAME, start, pos, .str = s };
+      const char* begin = cur;
+      while (cur < end && (isalnum((unsigned char)*cur) || *cur == '_'))
+         ++cur;
+      const size_t len = (size_t)(cur - begin);
+      pos.column += len;
+      const enum token_type kw = token_keyword(begin, len);
+      if (kw != TK_NAME)
+         return (struct token){ kw, start, pos, 0 };
+      const istr_t str = strnint(begin, len);
+      return (struct token){ TK_NAME, start, pos, .str = str };
    } else if (ch == '"') {
       char* buf = NULL;
       input_skip();
@@ -21,10 +21,13 @@
 #include "help_options.h"
 #include "cmdline.h"
 #include "parser.h"
+#include "optim.h"
 #include "target.h"
 #include "config.h"
 #include "linker.h"
 #include "lex.h"
+#include "cache.h"
+#include "timer.h"
 #include "bcc.h"
 #include "cpp.h"
 #include "ir.h"
@@ -32,9 +35,21 @@
 bool verbose = false;
 
 struct flag_option flag_opts[] = {
-   { "path-ld",      "Path to the LD linker",         FLAG_STRING, .sVal = GNU_LD },
-   { "path-as",      "Path to the AS assembler",      FLAG_STRING, .sVal = GNU_AS },
-   { "path-cpp",     "Path to the C preprocessor",    FLAG_STRING, .sVal = BCPP_PATH },
+   { "path-ld",            "Path to the LD linker",           FLAG_STRING, .sVal = GNU_LD },
+   { "path-as",            "Path to the AS assembler",        FLAG_STRING, .sVal = GNU_AS },
+   { "path-cpp",           "Path to the C preprocessor",      FLAG_STRING, .sVal = BCPP_PATH },
+   { "integrated-cpp",     "Use the built-in preprocessor",   FLAG_BOOL,   .bVal = true },
+   { "pch",                "Use precompiled headers",         FLAG_BOOL,   .bVal = true },
+   { "pass-stats",         "Print IR pass statistics",        FLAG_BOOL,   .bVal = false },
+   { "free",               "Free the unit one by one",        FLAG_BOOL,   .bVal = true },
+   { "cache",              "Cache the compiled outputs",      FLAG_BOOL,   .bVal = false },
+   { "cache-dir",          "Directory of the cache",          FLAG_STRING, .sVal = NULL },
+   { "cache-size",         "Maximum cache size in MiB",       FLAG_INT,    .iVal = 1024 },
+   { "cache-stats",        "Print cache statistics",          FLAG_BOOL,   .bVal = false },
+   { "time-report",        "Print the time of each phase",    FLAG_BOOL,   .bVal = false },
+   { "time-report-json",   "Write the time report as JSON",   FLAG_STRING, .sVal = NULL },
+   { "time-report-funcs",  "Report the N slowest functions",  FLAG_INT,    .iVal = 0 },
+   { "opt-stats",          "Print IR rewrite statistics",     FLAG_BOOL,   .bVal = false },
 };
 const size_t num_flag_opts = arraylen(flag_opts);
 
@@ -43,8 +58,10 @@ int main(int argc, char* argv[]) {
    struct cmdline_arg cmd_arg;
    const char* output_name = NULL;
    enum compilation_level level = LEVEL_LINK;
+   bool header = false;
+   unsigned jobs = 1;
    int option;
-   while ((option = getopt(argc, argv, ":d:hm:VO:wciSAo:EI:CD:U:L:l:s:n:vf:")) != -1) {
+   while ((option = getopt(argc, argv, ":d:hm:VO:wciSAo:EI:CD:U:L:l:s:n:vf:x:j:R:")) != -1) {
       switch (option) {
       case 'h':
          printf("Usage: bcc [options] file...\nOptions:\n%s", help_options);
@@ -99,6 +116,20 @@ int main(int argc, char* argv[]) {
          }
          break;
       }
+      case 'j':
+      {
+         char* endp;
+         jobs = (unsigned)strtoul(optarg, &endp, 10);
+         if (*endp) {
+            fprintf(stderr, "bcc: '%s' is not a valid number.\n", optarg);
+            return 1;
+         }
+         if (jobs == 0) {
+            const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+            jobs = ncpus > 0 ? (unsigned)ncpus : 1;
+         }
+         break;
+      }
       case 'V':
          printf("bcc %s\nCopyleft Benjamin Stürz.\n"
                "This software is distributed under the terms of the GPLv3\n", VERSION);
@@ -110,10 +141,25 @@ int main(int argc, char* argv[]) {
          printf("Compiled on %s for %s\n", __DATE__, BCC_TARGET);
          return 0;
       case 'm':
+         cache_add_option(option, optarg);
          if (!parse_mach_opt(optarg)) return 1;
          break;
       case 'f':
-         if (!parse_flag_opt(optarg)) return 1;
+         cache_add_option(option, optarg);
+         if (!strncmp(optarg, "passes=", 7)) {
+            if (!optim_select_passes(optarg + 7)) return 1;
+         } else if (!optim_set_pass(optarg, true)
+            && !(!strncmp(optarg, "no-", 3) && optim_set_pass(optarg + 3, false))
+            && !parse_flag_opt(optarg)) {
+            return 1;
+         }
+         break;
+      case 'R':
+         if (strncmp(optarg, "pass=", 5) != 0) {
+            fprintf(stderr, "bcc: invalid option '-R%s'\n", optarg);
+            return 1;
+         }
+         if (!optim_select_remarks(optarg + 5)) return 1;
          break;
       case 'I':
       case 'D':
@@ -146,6 +192,16 @@ int main(int argc, char* argv[]) {
       case 'v':
          verbose = true;
          break;
+      case 'x':
+         if (!strcmp(optarg, "c-header")) {
+            header = true;
+         } else if (!strcmp(optarg, "c")) {
+            header = false;
+         } else {
+            fprintf(stderr, "bcc: unsupported language '%s'\n", optarg);
+            return 1;
+         }
+         break;
       case ':':
          if (optopt == 's') {
             cmd_arg.option = optopt;
@@ -167,12 +223,18 @@ int main(int argc, char* argv[]) {
       }
    }
    const int nfiles = argc - optind;
-   if (nfiles < 1) {
+   if (nfiles < 1 && get_flag_opt("cache-stats")->bVal) {
+      cache_print_stats(stdout);
+      return 0;
+   } else if (nfiles < 1) {
       fputs("bcc: no input file\n", stderr);
       return 1;
    } else if (nfiles > 1 && level != LEVEL_LINK) {
       fputs("bcc: '-o' cannot be specified with '-E', '-A', '-i', '-S' or '-c' with multiple input files\n", stderr);
       return 1;
+   } else if (nfiles > 1 && header && output_name) {
+      fputs("bcc: '-o' cannot be specified with '-x c-header' with multiple input files\n", stderr);
+      return 1;
    }
    if (dumpmacros) {
       if (level == 'E') {
@@ -182,38 +244,57 @@ int main(int argc, char* argv[]) {
       }
    }
    if (!emit_prepare()) return 1;
+   time_report_init();
    define_macros();
 
    const char** objects = NULL;
    const char** delete_objects = NULL;
-   int ec = 0;
+   const char** sources = NULL;
+   const char** outputs = NULL;
    for (; optind < argc; ++optind) {
       const char* source_name = argv[optind];
       const char* output_name2;
-      if (ends_with_one(source_name, target_info.fend_obj)
+      if (header) {
+         output_name2 = output_name ? output_name : pch_name(source_name);
+      } else if (ends_with_one(source_name, target_info.fend_obj)
          || ends_with_one(source_name, target_info.fend_archive)
          || ends_with_one(source_name, target_info.fend_dll)) {
          buf_push(objects, source_name);
          continue;
-      } else if (level == LEVEL_LINK) {
-         output_name2 = create_output_name(source_name, LEVEL_ASSEMBLE);
-         buf_push(objects, output_name2);
-      } else if (!output_name) {
-         output_name2 = create_output_name(source_name, level);
-      } else output_name2 = output_name;
-      buf_push(delete_objects, output_name2);
-      ec = process_file(source_name, output_name2, level);
-      if (ec != 0) break;
+      } else {
+         if (level == LEVEL_LINK) {
+            output_name2 = create_output_name(source_name, LEVEL_ASSEMBLE);
+            buf_push(objects, output_name2);
+         } else if (!output_name) {
+            output_name2 = create_output_name(source_name, level);
+         } else output_name2 = output_name;
+         buf_push(delete_objects, output_name2);
+      }
+      buf_push(sources, source_name);
+      buf_push(outputs, output_name2);
    }
+   int ec = process_files(sources, outputs, buf_len(sources), level, header, jobs);
+   buf_free(sources);
+   buf_free(outputs);
 
-   if (level == LEVEL_LINK) {
-      if (!ec)
+   if (get_flag_opt("pass-stats")->bVal)
+      optim_print_stats(stderr);
+   if (get_flag_opt("cache-stats")->bVal)
+      cache_print_stats(stderr);
+
+   if (level == LEVEL_LINK && !header) {
+      if (!ec) {
+         time_push(TP_LINK, NULL);
          ec = run_linker(output_name, objects);
+         time_pop();
+      }
       if (!save_temps) {
          for (size_t i = 0; i < buf_len(delete_objects); ++i) {
             remove(delete_objects[i]);
          }
       }
    }
+   if (!time_report_finish() && !ec)
+      ec = 1;
    return ec;
 }
@@ -0,0 +1,308 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include "regalloc.h"
+#include "error.h"
+#include "scope.h"
+#include "value.h"
+#include "buf.h"
+
+// Promotion of local variables and parameters to registers.
+//
+// A variable is promoted, if every web defined by IR_LOOKUP (or IR_FPARAM)
+// of the variable is only used as the address of IR_READ and IR_WRITE,
+// so the address never escapes. All accesses must agree on the size.
+// The variable then lives in a single register, which is kept extended
+// according to its type and gets broken up into its live ranges
+// by the web-splitting of the register allocator.
+
+#define WEB_NONE  ((size_t)-1)
+#define WEB_MIXED ((size_t)-2)
+
+struct candidate {
+   const struct scope* scope;    // NULL for parameters
+   size_t idx;
+   enum ir_value_size size;
+   bool has_size;
+   bool sign_extend;    // how the register is extended
+   bool is_read;
+   bool rejected;
+   ir_reg_t reg;
+};
+
+static bool is_scalar(const struct value_type* vt) {
+   if (vt_is_volatile(vt))
+      return false;
+   switch (vt->type) {
+   case VAL_INT:
+   case VAL_BOOL:
+   case VAL_ENUM:
+      return true;
+   case VAL_POINTER:
+      return !vt_is_array(vt);
+   default:
+      return false;
+   }
+}
+
+static size_t get_candidate(struct candidate** cands, const struct function* func,
+      const struct scope* scope, size_t idx) {
+   for (size_t i = 0; i < buf_len(*cands); ++i) {
+      if ((*cands)[i].scope == scope && (*cands)[i].idx == idx)
+         return i;
+   }
+   const struct value_type* vt = scope ? scope->vars[idx].type : func->params[idx].type;
+   struct candidate c = {
+      .scope = scope,
+      .idx = idx,
+      .sign_extend = vt_is_signed(vt),
+      .rejected = !is_scalar(vt),
+      .reg = IRR_NONSENSE,
+   };
+   buf_push(*cands, c);
+   return buf_len(*cands) - 1;
+}
+
+// the candidate, whose address is computed by `n`
+static size_t address_of(struct candidate** cands, const struct function* func, const ir_node_t* n) {
+   switch (n->type) {
+   case IR_LOOKUP:
+      return get_candidate(cands, func, n->lookup.scope, n->lookup.var_idx);
+   case IR_FPARAM:
+      return get_candidate(cands, func, NULL, n->fparam.idx);
+   default:
+      return WEB_NONE;
+   }
+}
+
+// the candidate, that is directly read or written by `n`
+static size_t accessed_by(struct candidate** cands, const struct function* func, const ir_node_t* n) {
+   switch (n->type) {
+   case IR_FLURD:
+   case IR_FLUWR:
+      return get_candidate(cands, func, n->flurw.scope, n->flurw.var_idx);
+   case IR_FFPRD:
+   case IR_FFPWR:
+      return get_candidate(cands, func, NULL, n->ffprw.idx);
+   default:
+      return WEB_NONE;
+   }
+}
+
+static void check_access(struct candidate* c, enum ir_value_size size, bool is_read, bool is_volatile) {
+   if (is_volatile || (c->has_size && c->size != size))
+      c->rejected = true;
+   c->size = size;
+   c->has_size = true;
+   c->is_read |= is_read;
+}
+
+// finds the variables, whose address does not escape
+static struct candidate* find_candidates(const struct ra_func* ra, size_t* webs) {
+   const struct function* func = ra->func;
+   struct candidate* cands = NULL;
+
+   for (size_t i = 0; i < ra->num_vregs; ++i)
+      webs[i] = WEB_NONE;
+
+   // which variable's address is held by a web
+   for (size_t i = 0; i < buf_len(ra->insns); ++i) {
+      const struct ra_insn* insn = &ra->insns[i];
+      if (insn->flags & RA_ARG)
+         continue;
+      for (size_t k = 0; k < insn->num_ops; ++k) {
+         if (!insn->ops[k].is_def)
+            continue;
+         const ir_reg_t w = *insn->ops[k].reg;
+         const size_t c = address_of(&cands, func, insn->node);
+         if (webs[w] == WEB_NONE && c != WEB_NONE)
+            webs[w] = c;
+         else if (webs[w] != c)
+            webs[w] = WEB_MIXED;
+      }
+   }
+   for (size_t i = 0; i < buf_len(ra->insns); ++i) {
+      const struct ra_insn* insn = &ra->insns[i];
+      if (insn->flags & RA_ARG)
+         continue;
+      const size_t c = address_of(&cands, func, insn->node);
+      if (c != WEB_NONE && webs[*insn->ops[0].reg] != c)
+         cands[c].rejected = true;
+   }
+
+   // the address may only be used by loads and stores
+   for (size_t i = 0; i < buf_len(ra->insns); ++i) {
+      const struct ra_insn* insn = &ra->insns[i];
+      const ir_node_t* n = insn->node;
+      if (!(insn->flags & RA_ARG)) {
+         const size_t c = accessed_by(&cands, func, n);
+         if (c != WEB_NONE) {
+            if (n->type == IR_FLURD || n->type == IR_FLUWR)
+               check_access(&cands[c], n->flurw.size, n->type == IR_FLURD, n->flurw.is_volatile);
+            else check_access(&cands[c], n->ffprw.size, n->type == IR_FFPRD, n->ffprw.is_volatile);
+         }
+      }
+      for (size_t k = 0; k < insn->num_ops; ++k) {
+         const struct ir_operand* op = &insn->ops[k];
+         if (!op->is_use)
+            continue;
+         const size_t c = webs[*op->reg];
+         if (c == WEB_NONE || c == WEB_MIXED)
+            continue;
+         if (insn->flags & RA_ARG) {
+            cands[c].rejected = true;
+         } else if (n->type == IR_READ && op->reg == &n->rw.src) {
+            check_access(&cands[c], n->rw.size, true, n->rw.is_volatile);
+         } else if (n->type == IR_WRITE && op->reg == &n->rw.dest) {
+            check_access(&cands[c], n->rw.size, false, n->rw.is_volatile);
+         } else {
+            cands[c].rejected = true;
+         }
+      }
+   }
+   return cands;
+}
+
+static void remove_node(ir_node_t** list, ir_node_t* n) {
+   if (n == *list)
+      *list = n->next;
+   ir_remove(n);
+}
+
+// turns `n` into `dest = src`, extended from `size`
+static void to_move(ir_node_t* n, ir_reg_t dest, ir_reg_t src, enum ir_value_size size, bool sign_extend) {
+   if (sizeof_irs(size) < sizeof_irs(IRS_PTR)) {
+      n->type = IR_IICAST;
+      n->iicast.dest = dest;
+      n->iicast.src = src;
+      n->iicast.ds = IRS_PTR;
+      n->iicast.ss = size;
+      n->iicast.sign_extend = sign_extend;
+   } else {
+      n->type = IR_MOVE;
+      n->move.dest = dest;
+      n->move.src = src;
+      n->move.size = IRS_PTR;
+   }
+}
+
+static void to_store(ir_node_t* n, const struct candidate* c, ir_reg_t src) {
+   to_move(n, c->reg, src, c->size, c->sign_extend);
+}
+
+// the register is already extended, unless the load extends differently
+static void to_load(ir_node_t* n, const struct candidate* c, ir_reg_t dest, bool sign_extend) {
+   if (sign_extend == c->sign_extend) {
+      to_move(n, dest, c->reg, IRS_PTR, false);
+   } else {
+      to_move(n, dest, c->reg, c->size, sign_extend);
+   }
+}
+
+bool ra_mem2reg(struct ra_func* ra) {
+   const struct function* func = ra->func;
+   size_t* webs = malloc((ra->num_vregs + 1) * sizeof(size_t));
+   if (!webs)
+      panic("failed to allocate webs");
+   struct candidate* cands = find_candidates(ra, webs);
+
+   bool success = false;
+   ir_reg_t next_reg = ra->num_vregs;
+   for (size_t i = 0; i < buf_len(cands); ++i) {
+      if (!cands[i].rejected) {
+         cands[i].reg = next_reg++;
+         success = true;
+      }
+   }
+   if (!success)
+      goto end;
+
+   // rewrite the accesses (the address-computations are removed last)
+   ir_node_t** removed = NULL;
+   ir_node_t*** lists = NULL;
+   for (size_t i = 0; i < buf_len(ra->insns); ++i) {
+      const struct ra_insn* insn = &ra->insns[i];
+      ir_node_t* n = insn->node;
+      if (insn->flags & RA_ARG)
+         continue;
+
+      size_t c = accessed_by(&cands, func, n);
+      if (c != WEB_NONE && !cands[c].rejected) {
+         switch (n->type) {
+         case IR_FLURD:
+            to_load(n, &cands[c], n->flurw.reg, n->flurw.sign_extend);
+            break;
+         case IR_FFPRD:
+            to_load(n, &cands[c], n->ffprw.reg, n->ffprw.sign_extend);
+            break;
+         case IR_FLUWR:
+            to_store(n, &cands[c], n->flurw.reg);
+            break;
+         case IR_FFPWR:
+            to_store(n, &cands[c], n->ffprw.reg);
+            break;
+         default:
+            break;
+         }
+         continue;
+      }
+
+      c = address_of(&cands, func, n);
+      if (c != WEB_NONE && !cands[c].rejected) {
+         buf_push(removed, n);
+         buf_push(lists, insn->list);
+         continue;
+      }
+
+      if (n->type == IR_READ) {
+         c = webs[n->rw.src];
+         if (c != WEB_NONE && c != WEB_MIXED && !cands[c].rejected)
+            to_load(n, &cands[c], n->rw.dest, n->rw.sign_extend);
+      } else if (n->type == IR_WRITE) {
+         c = webs[n->rw.dest];
+         if (c != WEB_NONE && c != WEB_MIXED && !cands[c].rejected)
+            to_store(n, &cands[c], n->rw.src);
+      }
+   }
+   for (size_t i = 0; i < buf_len(removed); ++i)
+      remove_node(lists[i], removed[i]);
+   buf_free(removed);
+   buf_free(lists);
+
+   // parameters are loaded once at the beginning of the function
+   for (size_t i = 0; i < buf_len(cands); ++i) {
+      const struct candidate* c = &cands[i];
+      if (c->rejected || c->scope || !c->is_read)
+         continue;
+      ir_node_t* n = new_node(IR_FFPRD);
+      n->func = func;
+      n->ffprw.reg = c->reg;
+      n->ffprw.idx = c->idx;
+      n->ffprw.size = c->size;
+      n->ffprw.sign_extend = c->sign_extend;
+      n->ffprw.is_volatile = false;
+      n->prev = ra->code;
+      n->next = ra->code->next;
+      if (n->next)
+         n->next->prev = n;
+      ra->code->next = n;
+   }
+
+end:
+   buf_free(cands);
+   free(webs);
+   return success;
+}
@@ -28,6 +28,7 @@ bool copy_to_memcpy(ir_node_t** n) {
       fcall.prev = cur->prev;
       fcall.next = cur->next;
       fcall.func = cur->func;
+      fcall.pos = cur->pos;
 
       fcall.call.name = strint("__builtin_memcpy");
       fcall.call.dest = cur->copy.dest;
@@ -51,6 +52,7 @@ bool copy_to_memcpy(ir_node_t** n) {
       param->load.size = IRS_PTR;
       buf_push(fcall.call.params, param);
       *cur = fcall;
+      optim_note(TR_COPY_TO_MEMCPY, cur);
       success = true;
    }
    return success;
@@ -14,247 +14,211 @@
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <tgmath.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
 #include "target.h"
 #include "error.h"
 #include "optim.h"
 #include "bcc.h"
+#include "buf.h"
 
-static size_t depth = 0;
-
-// remove NOPs
-static bool remove_nops(ir_node_t** n) {
-   bool success = false;
-   if (!*n)
-      return false;
-   ir_node_t* next;
-   while (*n && (*n)->type == IR_NOP) {
-      next = (*n)->next;
-      free_ir_node(*n);
-      *n = next;
-      success = true;
-   }
-   ir_node_t* cur = *n;
-   while (cur) {
-      next = cur->next;
-      if (cur->type == IR_NOP)
-         ir_remove(cur);
-      cur = next;
-   }
-   return success;
-}
+// Every pass is a peephole optimization, that is tried at one node.
+// A pass may change the node and its successor and turns removed nodes
+// into IR_NOP. The pass manager keeps a worklist of nodes, whose
+// neighbourhood changed, instead of rescanning the whole function.
 
 static bool is_immed(const intmax_t v) {
    return v >= target_info.min_immed && v <= target_info.max_immed;
 }
 
 // (load R1, 40; iadd R0, R0, R1) -> (iadd R0, R0, 40) 
-static bool direct_val(ir_node_t** n) {
-   bool success = false;
-   
-   for (ir_node_t* cur = *n; cur; cur = cur->next) {
-      if (cur->type == IR_LOAD
-            && ir_isv(cur->next, IR_IADD, IR_ISUB, IR_IMUL, IR_IDIV, IR_UMUL, IR_UDIV,
-               IR_IMOD, IR_UMOD, IR_IAND, IR_IOR, IR_IXOR, IR_ILSL, IR_ILSR, IR_IASR,
-               IR_ISTEQ, IR_ISTNE, IR_ISTGR, IR_ISTGE, IR_ISTLT, IR_ISTLE,
-               IR_USTGR, IR_USTGE, IR_USTLT, IR_USTLE, NUM_IR_NODES)
-            && is_immed(cur->load.value) ) {
-         ir_node_t* next = cur->next;
-         if (next->binary.b.type == IRT_REG && cur->load.dest == next->binary.b.reg) {
-            next->binary.b.type = IRT_UINT;
-            next->binary.b.uVal = cur->load.value;
-            cur->type = IR_NOP;
-            success = true;
-         } else if (next->binary.a.type == IRT_REG && cur->load.dest == next->binary.a.reg) {
-            next->binary.a.type = IRT_UINT;
-            next->binary.a.uVal = cur->load.value;
-            cur->type = IR_NOP;
-            success = true;
-         }
+static bool direct_val(ir_node_t* cur) {
+   if (cur->type == IR_LOAD
+         && ir_isv(cur->next, IR_IADD, IR_ISUB, IR_IMUL, IR_IDIV, IR_UMUL, IR_UDIV,
+            IR_IMOD, IR_UMOD, IR_IAND, IR_IOR, IR_IXOR, IR_ILSL, IR_ILSR, IR_IASR,
+            IR_ISTEQ, IR_ISTNE, IR_ISTGR, IR_ISTGE, IR_ISTLT, IR_ISTLE,
+            IR_USTGR, IR_USTGE, IR_USTLT, IR_USTLE, NUM_IR_NODES)
+         && is_immed(cur->load.value) ) {
+      ir_node_t* next = cur->next;
+      if (next->binary.b.type == IRT_REG && cur->load.dest == next->binary.b.reg) {
+         next->binary.b.type = IRT_UINT;
+         next->binary.b.uVal = cur->load.value;
+         cur->type = IR_NOP;
+         return true;
+      } else if (next->binary.a.type == IRT_REG && cur->load.dest == next->binary.a.reg) {
+         next->binary.a.type = IRT_UINT;
+         next->binary.a.uVal = cur->load.value;
+         cur->type = IR_NOP;
+         return true;
       }
    }
-   return success;
+   return false;
 }
 
 // evaluate constant expressions not evaluated by the optim_expr() function.
-static bool fold(ir_node_t** n) {
-   bool success = false;
-   for (ir_node_t* cur = *n; cur; cur = cur->next) {
-      if (ir_isv(cur, IR_IADD, IR_ISUB, IR_IMUL, IR_IDIV, IR_UMUL, IR_UDIV,
-            IR_IMOD, IR_UMOD, IR_IAND, IR_IOR, IR_IXOR, IR_ILSL, IR_ILSR, IR_IASR,
-            IR_ISTEQ, IR_ISTNE, IR_ISTGR, IR_ISTGE, IR_ISTLT, IR_ISTLE,
-            IR_USTGR, IR_USTGE, IR_USTLT, IR_USTLE, NUM_IR_NODES)
-         && cur->binary.a.type == cur->binary.b.type
-         && cur->binary.a.type == IRT_UINT) {
-         const ir_reg_t dest = cur->binary.dest;
-         const enum ir_value_size sz = cur->binary.size;
-         const uintmax_t a = cur->binary.a.uVal;
-         const uintmax_t b = cur->binary.b.uVal;
-         uintmax_t res;
-
-         switch (cur->type) {
-         case IR_IADD:  res = a + b; break;
-         case IR_ISUB:  res = a - b; break;
-         case IR_IAND:  res = a & b; break;
-         case IR_IOR:   res = a | b; break;
-         case IR_IXOR:  res = a ^ b; break;
-         case IR_ILSL:  res = a << b; break;
-         case IR_ILSR:  res = a >> b; break;
-         case IR_IASR:  res = (intmax_t)a >> b; break;
-         case IR_UMUL:  res = a * b; break;
-         case IR_UDIV:  res = a / b; break;
-         case IR_UMOD:  res = a % b; break;
-         case IR_IMUL:  res = (intmax_t)a * (intmax_t)b; break;
-         case IR_IDIV:  res = (intmax_t)a / (intmax_t)b; break;
-         case IR_IMOD:  res = (intmax_t)a % (intmax_t)b; break;
-         case IR_ISTEQ: res = a == b; break;
-         case IR_ISTNE: res = a != b; break;
-         case IR_USTGR: res = a >  b; break;
-         case IR_USTGE: res = a >= b; break;
-         case IR_USTLT: res = a <  b; break;
-         case IR_USTLE: res = a <= b; break;
-         case IR_ISTGR: res = (intmax_t)a >  (intmax_t)b; break;
-         case IR_ISTGE: res = (intmax_t)a >= (intmax_t)b; break;
-         case IR_ISTLT: res = (intmax_t)a <  (intmax_t)b; break;
-         case IR_ISTLE: res = (intmax_t)a <= (intmax_t)b; break;
-         default: continue;
-         }
+static bool fold(ir_node_t* cur) {
+   if (ir_isv(cur, IR_IADD, IR_ISUB, IR_IMUL, IR_IDIV, IR_UMUL, IR_UDIV,
+         IR_IMOD, IR_UMOD, IR_IAND, IR_IOR, IR_IXOR, IR_ILSL, IR_ILSR, IR_IASR,
+         IR_ISTEQ, IR_ISTNE, IR_ISTGR, IR_ISTGE, IR_ISTLT, IR_ISTLE,
+         IR_USTGR, IR_USTGE, IR_USTLT, IR_USTLE, NUM_IR_NODES)
+      && cur->binary.a.type == cur->binary.b.type
+      && cur->binary.a.type == IRT_UINT) {
+      const ir_reg_t dest = cur->binary.dest;
+      const enum ir_value_size sz = cur->binary.size;
+      const uintmax_t a = cur->binary.a.uVal;
+      const uintmax_t b = cur->binary.b.uVal;
+      uintmax_t res;
 
-         cur->type = IR_LOAD;
-         cur->load.dest = dest;
-         cur->load.size = sz;
-         cur->load.value = res;
-         success = true;
-      } else if (cur->type == IR_LOAD && ir_isv(cur->next, IR_INOT, IR_INEG, NUM_IR_NODES)
-            && cur->next->unary.reg == cur->load.dest) {
-         uintmax_t a = cur->load.value;
-         if (cur->next->type == IR_INOT) a = ~a;
-         else a = ~a + 1;
-         cur->next->type = IR_NOP;
-         cur->load.value = a;// & target_get_umax(cur->load.size);
-         success = true;
+      switch (cur->type) {
+      case IR_IADD:  res = a + b; break;
+      case IR_ISUB:  res = a - b; break;
+      case IR_IAND:  res = a & b; break;
+      case IR_IOR:   res = a | b; break;
+      case IR_IXOR:  res = a ^ b; break;
+      case IR_ILSL:  res = a << b; break;
+      case IR_ILSR:  res = a >> b; break;
+      case IR_IASR:  res = (intmax_t)a >> b; break;
+      case IR_UMUL:  res = a * b; break;
+      case IR_UDIV:  res = a / b; break;
+      case IR_UMOD:  res = a % b; break;
+      case IR_IMUL:  res = (intmax_t)a * (intmax_t)b; break;
+      case IR_IDIV:  res = (intmax_t)a / (intmax_t)b; break;
+      case IR_IMOD:  res = (intmax_t)a % (intmax_t)b; break;
+      case IR_ISTEQ: res = a == b; break;
+      case IR_ISTNE: res = a != b; break;
+      case IR_USTGR: res = a >  b; break;
+      case IR_USTGE: res = a >= b; break;
+      case IR_USTLT: res = a <  b; break;
+      case IR_USTLE: res = a <= b; break;
+      case IR_ISTGR: res = (intmax_t)a >  (intmax_t)b; break;
+      case IR_ISTGE: res = (intmax_t)a >= (intmax_t)b; break;
+      case IR_ISTLT: res = (intmax_t)a <  (intmax_t)b; break;
+      case IR_ISTLE: res = (intmax_t)a <= (intmax_t)b; break;
+      default: return false;
       }
+
+      cur->type = IR_LOAD;
+      cur->load.dest = dest;
+      cur->load.size = sz;
+      cur->load.value = res;
+      return true;
+   } else if (cur->type == IR_LOAD && ir_isv(cur->next, IR_INOT, IR_INEG, NUM_IR_NODES)
+         && cur->next->unary.reg == cur->load.dest) {
+      uintmax_t a = cur->load.value;
+      if (cur->next->type == IR_INOT) a = ~a;
+      else a = ~a + 1;
+      cur->next->type = IR_NOP;
+      cur->load.value = a;// & target_get_umax(cur->load.size);
+      return true;
    }
-   return success;
+   return false;
 }
 
 // (4 * x) -> (x << 2) 
-static bool unmuldiv(ir_node_t** n) {
-   bool success = false;
-   for (ir_node_t* cur = *n; cur; cur = cur->next) {
-      if (ir_isv(cur, IR_IMUL, IR_UMUL, IR_IDIV, IR_UDIV, NUM_IR_NODES)
-            && ((cur->binary.a.type == IRT_UINT) ^ (cur->binary.b.type == IRT_UINT))) {
-         const enum ir_value_size sz = cur->binary.size;
-         const ir_reg_t dest = cur->binary.dest;
-         ir_reg_t a;
-         uintmax_t u;
-         if (cur->binary.a.type == IRT_UINT) {
-            u = cur->binary.a.uVal;
-            a = cur->binary.b.reg;
-         } else {
-            u = cur->binary.b.uVal;
-            a = cur->binary.a.reg;
-         }
-         if (u == 1) {
-            cur->type = IR_NOP;
-            success = true;
-            continue;
-         } else if (u == 0) {
-            cur->type = IR_LOAD;
-            cur->load.dest = dest;
-            cur->load.size = sz;
-            cur->load.value = 0;
-            success = true;
-            continue;
-         }
-         if (!is_pow2(u)) continue;
-         switch (cur->type) {
-         case IR_IMUL:
-         case IR_UMUL:
-            cur->type = IR_ILSL;
-            break;
-         case IR_IDIV:
-            cur->type = IR_IASR;
-            break;
-         case IR_UDIV:
-            cur->type = IR_ILSR;
-            break;
-         default:
-            continue;
-         }
-         cur->binary.dest = dest;
-         cur->binary.size = sz;
-         cur->binary.a.type = IRT_REG;
-         cur->binary.a.reg = a;
-         cur->binary.b.type = IRT_UINT;
-         cur->binary.b.uVal = log2(u);
-         success = true;
+// (x / 4) -> (x >> 2), only if x is unsigned, because signed division rounds towards zero
+static bool unmuldiv(ir_node_t* cur) {
+   // only the divisor may be replaced
+   if (ir_isv(cur, IR_IDIV, IR_UDIV, NUM_IR_NODES) && cur->binary.b.type != IRT_UINT)
+      return false;
+   if (ir_isv(cur, IR_IMUL, IR_UMUL, IR_IDIV, IR_UDIV, NUM_IR_NODES)
+         && ((cur->binary.a.type == IRT_UINT) ^ (cur->binary.b.type == IRT_UINT))) {
+      const enum ir_value_size sz = cur->binary.size;
+      const ir_reg_t dest = cur->binary.dest;
+      ir_reg_t a;
+      uintmax_t u;
+      if (cur->binary.a.type == IRT_UINT) {
+         u = cur->binary.a.uVal;
+         a = cur->binary.b.reg;
+      } else {
+         u = cur->binary.b.uVal;
+         a = cur->binary.a.reg;
       }
+      if (u == 1) {
+         cur->type = IR_NOP;
+         return true;
+      } else if (u == 0) {
+         cur->type = IR_LOAD;
+         cur->load.dest = dest;
+         cur->load.size = sz;
+         cur->load.value = 0;
+         return true;
+      }
+      if (!is_pow2(u)) return false;
+      switch (cur->type) {
+      case IR_IMUL:
+      case IR_UMUL:
+         cur->type = IR_ILSL;
+         break;
+      case IR_UDIV:
+         cur->type = IR_ILSR;
+         break;
+      default:
+         return false;
+      }
+      cur->binary.dest = dest;
+      cur->binary.size = sz;
+      cur->binary.a.type = IRT_REG;
+      cur->binary.a.reg = a;
+      cur->binary.b.type = IRT_UINT;
+      cur->binary.b.uVal = log2(u);
+      return true;
    }
-   return success;
+   return false;
 }
 // (add R0, 42, R0) -> (add R0, R0, 42)
-static bool reorder_params(ir_node_t** n) {
-   bool success = false;
-   for (ir_node_t* cur = *n; cur; cur = cur->next) {
-      if (ir_isv(cur, IR_IADD, IR_IMUL, IR_UMUL, IR_IAND, IR_IOR, IR_IXOR, IR_ISTEQ, IR_ISTNE, NUM_IR_NODES)
-         && cur->binary.a.type == IRT_UINT
-         && cur->binary.b.type == IRT_REG) {
-         const struct ir_value tmp = cur->binary.a;
-         cur->binary.a = cur->binary.b;
-         cur->binary.b = tmp;
-         success = true;
-      }
+static bool reorder_params(ir_node_t* cur) {
+   if (ir_isv(cur, IR_IADD, IR_IMUL, IR_UMUL, IR_IAND, IR_IOR, IR_IXOR, IR_ISTEQ, IR_ISTNE, NUM_IR_NODES)
+      && cur->binary.a.type == IRT_UINT
+      && cur->binary.b.type == IRT_REG) {
+      const struct ir_value tmp = cur->binary.a;
+      cur->binary.a = cur->binary.b;
+      cur->binary.b = tmp;
+      return true;
    }
-   return success;
+   return false;
 }
 
 // (add R0, R0, 0) -> (nop)
 // (imul R0, R0, 1) -> (nop)
 // (imul R0, R0, 0) -> (load R0, 0)
 // (idiv R0, R0, 0) -> warning
-static bool add_zero(ir_node_t** n) {
-   bool success = false;
-   for (ir_node_t* cur = *n; cur; cur = cur->next) {
-      if (ir_isv(cur, IR_IADD, IR_ISUB, IR_ILSL, IR_ILSR, IR_IASR, IR_IOR, IR_IXOR, NUM_IR_NODES)
-         && cur->binary.b.type == IRT_UINT
-         && cur->binary.b.uVal == 0) {
-         cur->type = IR_NOP;
-         success = true;
-      } else if (ir_isv(cur, IR_IMUL, IR_UMUL, IR_IDIV, IR_UDIV, IR_IAND, NUM_IR_NODES)
-         && cur->binary.b.type == IRT_UINT
-         && cur->binary.b.uVal == 1) {
-         cur->type = IR_NOP;
-         success = true;
-      } else if (ir_isv(cur, IR_IMUL, IR_UMUL, NUM_IR_NODES)
-         && cur->binary.b.type == IRT_UINT
-         && cur->binary.b.uVal == 0) {
-         const ir_reg_t dest = cur->binary.dest;
-         const enum ir_value_size sz = cur->binary.size;
-         cur->type = IR_LOAD;
-         cur->load.dest = dest;
-         cur->load.value = 0;
-         cur->load.size = sz;
-         success = true;
-      } else if (ir_isv(cur, IR_IDIV, IR_UDIV, NUM_IR_NODES)
-         && cur->binary.b.type == IRT_UINT
-         && cur->binary.b.uVal == 0) {
-         fprintf(stderr, "integer division by zero in IR code\n");
-      }
+static bool add_zero(ir_node_t* cur) {
+   if (ir_isv(cur, IR_IADD, IR_ISUB, IR_ILSL, IR_ILSR, IR_IASR, IR_IOR, IR_IXOR, NUM_IR_NODES)
+      && cur->binary.b.type == IRT_UINT
+      && cur->binary.b.uVal == 0) {
+      cur->type = IR_NOP;
+      return true;
+   } else if (ir_isv(cur, IR_IMUL, IR_UMUL, IR_IDIV, IR_UDIV, NUM_IR_NODES)
+      && cur->binary.b.type == IRT_UINT
+      && cur->binary.b.uVal == 1) {
+      cur->type = IR_NOP;
+      return true;
+   } else if (ir_isv(cur, IR_IMUL, IR_UMUL, NUM_IR_NODES)
+      && cur->binary.b.type == IRT_UINT
+      && cur->binary.b.uVal == 0) {
+      const ir_reg_t dest = cur->binary.dest;
+      const enum ir_value_size sz = cur->binary.size;
+      cur->type = IR_LOAD;
+      cur->load.dest = dest;
+      cur->load.value = 0;
+      cur->load.size = sz;
+      return true;
+   } else if (ir_isv(cur, IR_IDIV, IR_UDIV, NUM_IR_NODES)
+      && cur->binary.b.type == IRT_UINT
+      && cur->binary.b.uVal == 0) {
+      fprintf(stderr, "integer division by zero in IR code\n");
    }
-   return success;
+   return false;
 }
 
 // (load R0, 42; load R0, 39; ... R0) -> (load R0, 39)
-static bool remove_unreferenced(ir_node_t** n) {
-   if (optim_level < 3) return false; // XXX: experimental
-   bool success = false;
-   for (ir_node_t* cur = *n; cur && cur->next; cur = cur->next) {
-      if (cur->type == IR_READ && !ir_is_used(cur->next, cur->rw.dest)) {
-         cur->type = IR_NOP;
-         success = true;
-      }
+static bool remove_unreferenced(ir_node_t* cur) {
+   if (cur->next && cur->type == IR_READ && !ir_is_used(cur->next, cur->rw.dest)) {
+      cur->type = IR_NOP;
+      return true;
    }
-   return success;
+   return false;
 }
 
 static enum ir_node_type rcall_to_fcall(enum ir_node_type t) {
@@ -266,87 +230,78 @@ static enum ir_node_type rcall_to_fcall(enum ir_node_type t) {
 }
 
 // (flookup R0, add; read.ptr R0, R0; rcall R0) -> (fcall add)
-static bool direct_call(ir_node_t** n) {
-   bool success = false;
-   for (ir_node_t* cur = *n; cur; cur = cur->next) {
-      if (ir_isv(cur, IR_RCALL, IR_IRCALL, NUM_IR_NODES)
-         && ir_is(cur->call.addr, IR_FLOOKUP) && !cur->call.addr->next) {
-         const istr_t name = cur->call.addr->lstr.str;
-         cur->type = rcall_to_fcall(cur->type);
-         cur->call.name = name;
-         success = true;
-      }
+static bool direct_call(ir_node_t* cur) {
+   if (ir_isv(cur, IR_RCALL, IR_IRCALL, NUM_IR_NODES)
+      && ir_is(cur->call.addr, IR_FLOOKUP) && !cur->call.addr->next) {
+      const istr_t name = cur->call.addr->lstr.str;
+      cur->type = rcall_to_fcall(cur->type);
+      cur->call.name = name;
+      return true;
    }
-   return success;
+   return false;
 }
 
-// (imod R0, R0, 16) -> (iand R0, R0, 15)
+// (umod R0, R0, 16) -> (iand R0, R0, 15)
 // (imod R0, R0, 1) -> (load R0, 0)
 // (imod R0, R0, 0) -> (warning)
-static bool mod_to_and(ir_node_t** n) {
-   bool success = false;
-   for (ir_node_t* cur = *n; cur; cur = cur->next) {
-      if ((cur->type == IR_IMOD || cur->type == IR_UMOD)
-         && cur->binary.b.type == IRT_UINT
-         && cur->binary.a.type == IRT_REG) {
-         const unsigned pc = popcnt(cur->binary.b.uVal);
-         if (pc == 1) {
-            const uintmax_t mask = cur->binary.b.uVal - 1;
-            if (mask) {
-               cur->type = IR_IAND;
-               cur->binary.b.uVal = mask;
-            } else {
-               const ir_reg_t dest = cur->binary.dest;
-               const enum ir_value_size sz = cur->binary.size;
-               cur->type = IR_LOAD;
-               cur->load.dest = dest;
-               cur->load.size = sz;
-               cur->load.value = 0;
-            }
-            success = true;
-         } else if (!pc) fprintf(stderr, "integer modulo by zero in IR code\n");
-      }
+static bool mod_to_and(ir_node_t* cur) {
+   if ((cur->type == IR_IMOD || cur->type == IR_UMOD)
+      && cur->binary.b.type == IRT_UINT
+      && cur->binary.a.type == IRT_REG) {
+      const unsigned pc = popcnt(cur->binary.b.uVal);
+      if (pc == 1) {
+         const uintmax_t mask = cur->binary.b.uVal - 1;
+         // the remainder of a signed division has the sign of the dividend
+         if (mask && cur->type == IR_IMOD)
+            return false;
+         if (mask) {
+            cur->type = IR_IAND;
+            cur->binary.b.uVal = mask;
+         } else {
+            const ir_reg_t dest = cur->binary.dest;
+            const enum ir_value_size sz = cur->binary.size;
+            cur->type = IR_LOAD;
+            cur->load.dest = dest;
+            cur->load.size = sz;
+            cur->load.value = 0;
+         }
+         return true;
+      } else if (!pc) fprintf(stderr, "integer modulo by zero in IR code\n");
    }
-   return success;
+   return false;
 }
 
 // (load.char R0, 42; iicast.int R0, char R0) -> (load.int R0, 42)
-static bool fuse_load_iicast(ir_node_t** n) {
-   bool success = false;
-   for (ir_node_t* cur = *n; cur; cur = cur->next) {
-      if (cur->type == IR_LOAD && ir_is(cur->next, IR_IICAST)
-         && cur->load.dest == cur->next->iicast.src) {
-         cur->load.dest = cur->next->iicast.dest;
-         const enum ir_value_size ds = cur->next->iicast.ds;
-         const enum ir_value_size ss = cur->next->iicast.ss;
-         uintmax_t value = cur->load.value;
-         if (cur->next->iicast.sign_extend && ds > ss) {
-            const uintmax_t dm = target_get_umax(ds);
-            const uintmax_t sm = target_get_umax(ss);
-            if (value & ((sm >> 1) + 1))
-               value |= dm & ~sm;
-         } else if (ds < ss) {
-            const uintmax_t dm = target_get_umax(ds);
-            value &= dm;
-         }
-         cur->load.value = value;
-         cur->next->type = IR_NOP;
-         success = true;
+static bool fuse_load_iicast(ir_node_t* cur) {
+   if (cur->type == IR_LOAD && ir_is(cur->next, IR_IICAST)
+      && cur->load.dest == cur->next->iicast.src) {
+      cur->load.dest = cur->next->iicast.dest;
+      const enum ir_value_size ds = cur->next->iicast.ds;
+      const enum ir_value_size ss = cur->next->iicast.ss;
+      uintmax_t value = cur->load.value;
+      if (cur->next->iicast.sign_extend && ds > ss) {
+         const uintmax_t dm = target_get_umax(ds);
+         const uintmax_t sm = target_get_umax(ss);
+         if (value & ((sm >> 1) + 1))
+            value |= dm & ~sm;
+      } else if (ds < ss) {
+         const uintmax_t dm = target_get_umax(ds);
+         value &= dm;
       }
+      cur->load.value = value;
+      cur->next->type = IR_NOP;
+      return true;
    }
-   return success;
+   return false;
 }
 
 // (move R0, R0) -> (nop)
-static bool useless_move(ir_node_t** n) {
-   bool success = false;
-   for (ir_node_t* cur = *n; cur; cur = cur->next) {
-      if (cur->type == IR_MOVE && cur->move.dest == cur->move.src) {
-         cur->type = IR_NOP;
-         success = true;
-      }
+static bool useless_move(ir_node_t* cur) {
+   if (cur->type == IR_MOVE && cur->move.dest == cur->move.src) {
+      cur->type = IR_NOP;
+      return true;
    }
-   return success;
+   return false;
 }
 
 #define is_rw(t) (((t) == IR_READ) || ((t) == IR_WRITE))
@@ -361,131 +316,383 @@ static bool check_if_used(ir_node_t* cur, ir_reg_t r) {
    return ir_is_used(next->next, r);
 }
 
+// The fused memory-nodes are experimental and only used at -O3.
+// The fused read/write is turned into a NOP, which is removed by the pass manager.
+
 // (fparam R0, 0; read R0, R0) -> (ffprd R0, 0)
-static bool fuse_fp_rw(ir_node_t** n) {
-   bool success = false;
-   for (ir_node_t* cur = *n; cur && cur->next; cur = cur->next) {
-      ir_node_t* next = cur->next;
-      if (cur->type == IR_FPARAM && is_rw(next->type) && cur->fparam.reg == get_memreg(next)) {
-         if (check_if_used(cur, get_memreg(next)))
-            continue;
-         ir_node_t tmp;
-         tmp.type = next->type == IR_READ ? IR_FFPRD : IR_FFPWR;
-         tmp.prev = cur->prev;
-         tmp.next = next->next;
-         tmp.func = cur->func;
-         tmp.ffprw.reg = get_datreg(next);
-         tmp.ffprw.idx = cur->fparam.idx;
-         tmp.ffprw.size = next->rw.size;
-         tmp.ffprw.sign_extend = next->rw.sign_extend;
-         tmp.ffprw.is_volatile = next->rw.is_volatile;
-
-         ir_remove(next);
-         *cur = tmp;
-         success = true;
-      }
+static bool fuse_fp_rw(ir_node_t* cur) {
+   ir_node_t* next = cur->next;
+   if (!target_info.fuse_fp_rw || !next)
+      return false;
+   if (cur->type == IR_FPARAM && is_rw(next->type) && cur->fparam.reg == get_memreg(next)) {
+      if (check_if_used(cur, get_memreg(next)))
+         return false;
+      ir_node_t tmp;
+      tmp.type = next->type == IR_READ ? IR_FFPRD : IR_FFPWR;
+      tmp.prev = cur->prev;
+      tmp.next = next;
+      tmp.func = cur->func;
+      tmp.pos = cur->pos;
+      tmp.ffprw.reg = get_datreg(next);
+      tmp.ffprw.idx = cur->fparam.idx;
+      tmp.ffprw.size = next->rw.size;
+      tmp.ffprw.sign_extend = next->rw.sign_extend;
+      tmp.ffprw.is_volatile = next->rw.is_volatile;
+
+      next->type = IR_NOP;
+      *cur = tmp;
+      return true;
    }
-   return success;
+   return false;
 }
 
 // (glookup R0, name; write R0, R1) -> (fglwr name, R1)
-static bool fuse_gl_rw(ir_node_t** n) {
-   bool success = false;
-   for (ir_node_t* cur = *n; cur && cur->next; cur = cur->next) {
-      ir_node_t* next = cur->next;
-      if (cur->type == IR_GLOOKUP && is_rw(next->type) && cur->lstr.reg == get_memreg(next)) {
-         if (check_if_used(cur, get_memreg(next)))
-            continue;
-         ir_node_t tmp;
-         tmp.type = next->type == IR_READ ? IR_FGLRD : IR_FGLWR;
-         tmp.prev = cur->prev;
-         tmp.next = next->next;
-         tmp.func = cur->func;
-         tmp.fglrw.reg = get_datreg(next);
-         tmp.fglrw.name = cur->lstr.str;
-         tmp.fglrw.size = next->rw.size;
-         tmp.fglrw.sign_extend = next->rw.sign_extend;
-         tmp.fglrw.is_volatile = next->rw.is_volatile;
-
-         ir_remove(next);
-         *cur = tmp;
-         success = true;
-      }
+static bool fuse_gl_rw(ir_node_t* cur) {
+   ir_node_t* next = cur->next;
+   if (!target_info.fuse_gl_rw || !next)
+      return false;
+   if (cur->type == IR_GLOOKUP && is_rw(next->type) && cur->lstr.reg == get_memreg(next)) {
+      if (check_if_used(cur, get_memreg(next)))
+         return false;
+      ir_node_t tmp;
+      tmp.type = next->type == IR_READ ? IR_FGLRD : IR_FGLWR;
+      tmp.prev = cur->prev;
+      tmp.next = next;
+      tmp.func = cur->func;
+      tmp.pos = cur->pos;
+      tmp.fglrw.reg = get_datreg(next);
+      tmp.fglrw.name = cur->lstr.str;
+      tmp.fglrw.size = next->rw.size;
+      tmp.fglrw.sign_extend = next->rw.sign_extend;
+      tmp.fglrw.is_volatile = next->rw.is_volatile;
+
+      next->type = IR_NOP;
+      *cur = tmp;
+      return true;
    }
-   return success;
+   return false;
 }
 
 // (lookup R0, ...; read R1, R0) -> (flurd R1, ...)
-static bool fuse_lu_rw(ir_node_t** n) {
-   bool success = false;
-   for (ir_node_t* cur = *n; cur && cur->next; cur = cur->next) {
-      ir_node_t* next = cur->next;
-      if (cur->type == IR_LOOKUP && is_rw(next->type) && cur->lookup.reg == get_memreg(next)) {
-         if (check_if_used(cur, get_memreg(next)))
-            continue;
-         ir_node_t tmp;
-         tmp.type = next->type == IR_READ ? IR_FLURD : IR_FLUWR;
-         tmp.prev = cur->prev;
-         tmp.next = next->next;
-         tmp.func = cur->func;
-         tmp.flurw.reg = get_datreg(next);
-         tmp.flurw.scope = cur->lookup.scope;
-         tmp.flurw.var_idx = cur->lookup.var_idx;
-         tmp.flurw.size = next->rw.size;
-         tmp.flurw.sign_extend = next->rw.sign_extend;
-         tmp.flurw.is_volatile = next->rw.is_volatile;
-         
-         ir_remove(next);
-         *cur = tmp;
-         success = true;
-      }
+static bool fuse_lu_rw(ir_node_t* cur) {
+   ir_node_t* next = cur->next;
+   if (!target_info.fuse_lu_rw || !next)
+      return false;
+   if (cur->type == IR_LOOKUP && is_rw(next->type) && cur->lookup.reg == get_memreg(next)) {
+      if (check_if_used(cur, get_memreg(next)))
+         return false;
+      ir_node_t tmp;
+      tmp.type = next->type == IR_READ ? IR_FLURD : IR_FLUWR;
+      tmp.prev = cur->prev;
+      tmp.next = next;
+      tmp.func = cur->func;
+      tmp.pos = cur->pos;
+      tmp.flurw.reg = get_datreg(next);
+      tmp.flurw.scope = cur->lookup.scope;
+      tmp.flurw.var_idx = cur->lookup.var_idx;
+      tmp.flurw.size = next->rw.size;
+      tmp.flurw.sign_extend = next->rw.sign_extend;
+      tmp.flurw.is_volatile = next->rw.is_volatile;
+
+      next->type = IR_NOP;
+      *cur = tmp;
+      return true;
    }
-   return success;
+   return false;
 }
 
-// Fuse memory-nodes (experimental)
-static bool fuse_memops(ir_node_t** n) {
-   if (optim_level < 3)
+// The passes are tried in this order at every node of the worklist.
+static struct ir_pass passes[] = {
+   { "direct-val",            "Use constants directly as operands",           direct_val,          1, true, 0, 0 },
+   { "fuse-fp-rw",            "Fuse parameter accesses (experimental)",       fuse_fp_rw,          3, true, 0, 0 },
+   { "fuse-gl-rw",            "Fuse global variable accesses (experimental)", fuse_gl_rw,          3, true, 0, 0 },
+   { "fuse-lu-rw",            "Fuse local variable accesses (experimental)",  fuse_lu_rw,          3, true, 0, 0 },
+   { "unmuldiv",              "Replace multiplications by powers of 2",       unmuldiv,            1, true, 0, 0 },
+   { "fold",                  "Evaluate constant operations",                 fold,                1, true, 0, 0 },
+   { "reorder-params",        "Move constants to the right operand",          reorder_params,      1, true, 0, 0 },
+   { "add-zero",              "Remove operations without effect",             add_zero,            1, true, 0, 0 },
+   { "remove-unreferenced",   "Remove unused reads (experimental)",           remove_unreferenced, 3, false, 0, 0 },
+   { "direct-call",           "Call known functions directly",                direct_call,         1, true, 0, 0 },
+   { "mod-to-and",            "Replace modulo by powers of 2",                mod_to_and,          1, true, 0, 0 },
+   { "fuse-load-iicast",      "Fold casts of constants",                      fuse_load_iicast,    1, true, 0, 0 },
+   { "useless-move",          "Remove moves to the same register",            useless_move,        1, true, 0, 0 },
+};
+
+static size_t num_rounds = 0;
+
+// target-specific rewrites, that are counted after the passes
+static const struct {
+   const char* name;
+   const char* description;
+} target_rewrites[NUM_TARGET_REWRITES] = {
+   [TR_MUL_TO_FUNC]     = { "mul-to-func",    "Replace multiplications and divisions by library calls" },
+   [TR_COPY_TO_MEMCPY]  = { "copy-to-memcpy", "Replace copies by calls to memcpy()" },
+};
+
+#define NUM_REWRITES (arraylen(passes) + NUM_TARGET_REWRITES)
+
+// -fopt-stats and -Rpass, indexed like `passes`, followed by the target-specific rewrites
+static struct {
+   size_t func, unit;      // number of changes
+   bool remark;
+} rewrites[NUM_REWRITES];
+static bool has_remarks = false;
+static size_t unit_funcs = 0, unit_nodes_before = 0, unit_nodes_after = 0;
+
+static struct ir_pass* find_pass(const char* name, size_t len) {
+   for (size_t i = 0; i < arraylen(passes); ++i) {
+      if (strlen(passes[i].name) == len && !strncmp(passes[i].name, name, len))
+         return &passes[i];
+   }
+   return NULL;
+}
+
+bool optim_set_pass(const char* name, bool enabled) {
+   struct ir_pass* pass = find_pass(name, strlen(name));
+   if (!pass)
       return false;
+   pass->enabled = enabled;
+   return true;
+}
+
+bool optim_select_passes(const char* list) {
+   if (!strcmp(list, "help")) {
+      puts("Available IR passes:");
+      for (size_t i = 0; i < arraylen(passes); ++i) {
+         const struct ir_pass* pass = &passes[i];
+         printf("%-24s-O%u, %s%s\n", pass->name, pass->min_level, pass->description,
+               pass->enabled ? "" : " (disabled)");
+      }
+      exit(0);
+   }
+   for (size_t i = 0; i < arraylen(passes); ++i)
+      passes[i].enabled = false;
+   while (*list) {
+      const char* end = strchr(list, ',');
+      if (!end)
+         end = list + strlen(list);
+      struct ir_pass* pass = find_pass(list, (size_t)(end - list));
+      if (!pass) {
+         fprintf(stderr, "bcc: no such IR pass: '%.*s'\n", (int)(end - list), list);
+         return false;
+      }
+      pass->enabled = true;
+      list = *end ? end + 1 : end;
+   }
+   return true;
+}
+
+static const char* rewrite_name(size_t i) {
+   return i < arraylen(passes) ? passes[i].name : target_rewrites[i - arraylen(passes)].name;
+}
+static const char* rewrite_description(size_t i) {
+   return i < arraylen(passes) ? passes[i].description : target_rewrites[i - arraylen(passes)].description;
+}
+
+// `pos` is the position of `node` before the rewrite
+static void count_rewrite(size_t i, const struct function* func, const struct source_pos* pos) {
+   ++rewrites[i].func;
+   ++rewrites[i].unit;
+   if (!rewrites[i].remark)
+      return;
+   if (!pos || !pos->file)
+      pos = &func->begin;
+   parse_remark(pos, "remark: %s in '%s' [-Rpass=%s]", rewrite_description(i), func->name, rewrite_name(i));
+}
+
+void optim_note(enum target_rewrite tr, const ir_node_t* node) {
+   count_rewrite(arraylen(passes) + tr, node->func, node->pos);
+}
+
+bool optim_select_remarks(const char* list) {
+   while (*list) {
+      const char* end = strchr(list, ',');
+      if (!end)
+         end = list + strlen(list);
+      const size_t len = (size_t)(end - list);
+      bool found = false;
+      for (size_t i = 0; i < NUM_REWRITES; ++i) {
+         const char* name = rewrite_name(i);
+         if ((len == 3 && !strncmp(list, "all", 3)) || (strlen(name) == len && !strncmp(name, list, len))) {
+            rewrites[i].remark = true;
+            found = true;
+         }
+      }
+      if (!found) {
+         fprintf(stderr, "bcc: no such IR pass: '%.*s'\n", (int)len, list);
+         return false;
+      }
+      has_remarks = true;
+      list = *end ? end + 1 : end;
+   }
+   return true;
+}
+
+bool optim_has_remarks(void) {
+   return has_remarks;
+}
+
+void optim_begin_func(void) {
+   for (size_t i = 0; i < NUM_REWRITES; ++i)
+      rewrites[i].func = 0;
+}
+
+size_t optim_count_nodes(const ir_node_t* n) {
+   size_t num = 0;
+   for (; n; n = n->next) {
+      ++num;
+      if (!ir_is_func(n))
+         continue;
+      for (size_t i = 0; i < buf_len(n->call.params); ++i)
+         num += optim_count_nodes(n->call.params[i]);
+      if (n->type == IR_IRCALL || n->type == IR_RCALL)
+         num += optim_count_nodes(n->call.addr);
+   }
+   return num;
+}
+
+static void print_rewrites(FILE* file, bool unit) {
+   for (size_t i = 0; i < NUM_REWRITES; ++i) {
+      const size_t n = unit ? rewrites[i].unit : rewrites[i].func;
+      if (n)
+         fprintf(file, "  %-24s%12zu\n", rewrite_name(i), n);
+   }
+}
+
+void optim_print_func_stats(FILE* file, const struct function* func, size_t num_nodes) {
+   const size_t after = optim_count_nodes(func->ir_code);
+   fprintf(file, "opt-stats: function '%s': %zu -> %zu IR nodes\n", func->name, num_nodes, after);
+   print_rewrites(file, false);
+   ++unit_funcs;
+   unit_nodes_before += num_nodes;
+   unit_nodes_after += after;
+}
+
+void optim_print_unit_stats(FILE* file, const char* source_name) {
+   fprintf(file, "opt-stats: translation unit '%s': %zu functions, %zu -> %zu IR nodes\n",
+         source_name, unit_funcs, unit_nodes_before, unit_nodes_after);
+   print_rewrites(file, true);
+   for (size_t i = 0; i < NUM_REWRITES; ++i)
+      rewrites[i].func = rewrites[i].unit = 0;
+   unit_funcs = unit_nodes_before = unit_nodes_after = 0;
+}
+
+void optim_print_stats(FILE* file) {
+   fprintf(file, "%-24s%12s%12s\n", "IR pass", "visits", "changes");
+   for (size_t i = 0; i < arraylen(passes); ++i) {
+      const struct ir_pass* pass = &passes[i];
+      if (pass->visits)
+         fprintf(file, "%-24s%12zu%12zu\n", pass->name, pass->visits, pass->changes);
+   }
+   fprintf(file, "%-24s%12zu\n", "rounds", num_rounds);
+}
+
+// unlinks `node` from the list, if it is a NOP,
+// it gets freed at the end of the round, because it may still be on the worklist.
+// Unlinked nodes point to themselves.
+static bool is_unlinked(const ir_node_t* node) {
+   return node->next == node;
+}
+static void unlink_nop(ir_node_t** n, ir_node_t* node, ir_node_t*** dead) {
+   if (!node || node->type != IR_NOP || is_unlinked(node))
+      return;
+   if (node->prev) node->prev->next = node->next;
+   else *n = node->next;
+   if (node->next) node->next->prev = node->prev;
+   node->prev = node->next = node;
+   buf_push(*dead, node);
+}
+
+// runs all enabled passes on the nodes of the worklist until no pass succeeds,
+// the neighbours of a changed node get re-visited, because most passes look at two adjacent nodes
+static bool run_passes(ir_node_t** n) {
+   ir_node_t** worklist = NULL;
+   ir_node_t** dead = NULL;
    bool success = false;
 
-   if (target_info.fuse_fp_rw)
-      success |= fuse_fp_rw(n);
+   if (!*n)
+      return false;
+   for (ir_node_t* cur = ir_end(*n); cur; cur = cur->prev)
+      buf_push(worklist, cur);
 
-   if (target_info.fuse_gl_rw)
-      success |= fuse_gl_rw(n);
+   while (buf_len(worklist)) {
+      ir_node_t* cur = buf_last(worklist);
+      buf_pop(worklist);
+      if (cur->type == IR_NOP) {
+         if (is_unlinked(cur))
+            continue;
+         ir_node_t* prev = cur->prev;
+         ir_node_t* next = cur->next;
+         unlink_nop(n, cur, &dead);
+         if (prev) buf_push(worklist, prev);
+         if (next) buf_push(worklist, next);
+         continue;
+      }
 
-   if (target_info.fuse_lu_rw)
-      success |= fuse_lu_rw(n);
+      const struct source_pos* pos = cur->pos;
+      for (size_t i = 0; i < arraylen(passes); ++i) {
+         struct ir_pass* pass = &passes[i];
+         if (!pass->enabled || optim_level < pass->min_level)
+            continue;
+         ++pass->visits;
+         if (!pass->run(cur))
+            continue;
+         ++pass->changes;
+         count_rewrite(i, cur->func, pos);
+         success = true;
+
+         ir_node_t* next = cur->next;
+         unlink_nop(n, next, &dead);
+         next = cur->next;
+         ir_node_t* prev = cur->prev;
+         unlink_nop(n, cur, &dead);
 
+         if (next) buf_push(worklist, next);
+         if (cur->type != IR_NOP) buf_push(worklist, cur);
+         if (prev) buf_push(worklist, prev);
+         break;
+      }
+   }
+
+   for (size_t i = 0; i < buf_len(dead); ++i)
+      free_ir_node(dead[i]);
+   buf_free(dead);
+   buf_free(worklist);
    return success;
 }
 
-// TODO: add recursive optimization of IR_*CALL arguments
+// removes the NOPs, that were inserted by the target-specific optimizations
+static void remove_nops(ir_node_t** n) {
+   while (*n && (*n)->type == IR_NOP) {
+      ir_node_t* next = (*n)->next;
+      if (next) next->prev = NULL;
+      free_ir_node(*n);
+      *n = next;
+   }
+   for (ir_node_t* cur = *n; cur; ) {
+      ir_node_t* next = cur->next;
+      if (cur->type == IR_NOP)
+         ir_remove(cur);
+      cur = next;
+   }
+}
 
 ir_node_t* optim_ir_nodes(ir_node_t* n) {
-   ++depth;
    if (optim_level < 1) {
       while (target_optim_ir(&n));
       while (target_post_optim_ir(&n));
-      --depth;
       return n;
    }
-   while (remove_nops(&n)
-      || direct_val(&n)
-      || fuse_memops(&n)
-      || unmuldiv(&n)
-      || fold(&n)
-      || reorder_params(&n)
-      || add_zero(&n)
-      //|| remove_unreferenced(&n)
-      || direct_call(&n)
-      || mod_to_and(&n)
-      || fuse_load_iicast(&n)
-      || target_optim_ir(&n)
-      || useless_move(&n)
-   );
+   // Some passes look further than the next node (eg. ir_is_used()),
+   // so another round is done, until nothing changes anymore.
+   bool success;
+   do {
+      ++num_rounds;
+      success = run_passes(&n);
+      while (target_optim_ir(&n))
+         success = true;
+      remove_nops(&n);
+   } while (success);
    while (target_post_optim_ir(&n));
-   --depth;
    return n;
 }
@@ -20,8 +20,7 @@
 #include "bcc.h"
 
 static struct statement* make_nop(struct statement* old) {
-   struct statement* s = malloc(sizeof(struct statement));
-   if (!s) panic("failed to allocate statement");
+   struct statement* s = new_stmt();
    s->type = STMT_NOP;
    s->begin = old->begin;
    s->end = old->end;
@@ -66,7 +65,6 @@ struct statement* optim_stmt(struct statement* s) {
          free_expr(s->ifstmt.cond);
          if (!branch)
             branch = make_nop(s);
-         free(s);
          return branch;
       }
 end_if:
@@ -117,7 +115,6 @@ end_if:
 end_switch:
       buf_free(s->sw.body);
       free_expr(s->sw.expr);
-      free(s);
       return new_st;
       break;
    }
@@ -0,0 +1,712 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "target.h"
+#include "config.h"
+#include "error.h"
+#include "arena.h"
+#include "bcpp.h"
+#include "unit.h"
+#include "bcc.h"
+#include "cpp.h"
+#include "pch.h"
+#include "buf.h"
+
+// The layout of a PCH:
+//    struct pch_header
+//    the body:
+//       the canonical path of the header
+//       the files, that were read, with their modification times and sizes
+//       the macros and included files of bcpp
+//       the typedefs, enums, constants, structs, unions, functions and variables of cunit
+//    the string table
+//
+// The numbers are written in the byte order of the host (the PCH only works
+// with the same bcc anyway), every string is written as an index into the string table.
+// All strings are interned, while the PCH is loaded, so that
+// the declarations can be installed into cunit directly.
+
+#define PCH_MAGIC "BCCPCH1"      // the digit is the version of the format
+#define NO_STR UINT32_MAX
+#define NO_TYPE UINT8_MAX
+
+struct pch_header {
+   char magic[8];
+   uint64_t options;             // see options_hash()
+   uint64_t strings;             // the offset of the string table
+   uint64_t num_strings;
+};
+
+// the state of the PCH that is written
+static uint8_t* body = NULL;
+static istr_t* strings = NULL;
+static uint32_t* str_slots = NULL;  // indices+1 into strings, 0 means empty
+static size_t str_slots_size = 0;   // a power of 2
+
+// the state of the PCH that is read
+static istr_t pch_file;
+static const uint8_t* rd_pos;
+static const uint8_t* rd_end;
+static istr_t* rd_strings = NULL;
+
+istr_t pch_name(const char* header_name) {
+   return replace_ending(header_name, "pch");
+}
+
+// everything that changes the result of pre-processing or parsing the header
+static uint64_t options_hash(void) {
+   const uint64_t target[] = {
+      target_info.size_char, target_info.size_short, target_info.size_int,
+      target_info.size_long, target_info.size_pointer, target_info.unsigned_char,
+      ENABLE_FP,
+   };
+   uint64_t h = cpp_options_hash();
+   for (const char* s = VERSION BCC_TARGET; *s; ++s)
+      h = (h ^ (uint8_t)*s) * 0x100000001b3ull;
+   for (size_t i = 0; i < arraylen(target); ++i)
+      h = (h ^ target[i]) * 0x100000001b3ull;
+   return h;
+}
+
+
+/// writing
+
+static void put(const void* p, size_t n) {
+   buf__fit(body, buf_len(body) + n);
+   memcpy(body + buf_len(body), p, n);
+   buf__hdr(body)->len += n;
+}
+static void put_u8(uint8_t v) {
+   put(&v, sizeof(v));
+}
+static void put_u32(uint32_t v) {
+   put(&v, sizeof(v));
+}
+static void put_u64(uint64_t v) {
+   put(&v, sizeof(v));
+}
+
+static size_t hash_str(istr_t s) {
+   return (size_t)(((uint64_t)(uintptr_t)s * 0x9e3779b97f4a7c15ull) >> 32);
+}
+static uint32_t* find_str_slot(istr_t s) {
+   const size_t mask = str_slots_size - 1;
+   size_t i = hash_str(s) & mask;
+   while (str_slots[i] && strings[str_slots[i] - 1] != s)
+      i = (i + 1) & mask;
+   return &str_slots[i];
+}
+static void put_str(const char* str) {
+   if (!str) {
+      put_u32(NO_STR);
+      return;
+   }
+   const istr_t s = strint(str);
+   if (2 * (buf_len(strings) + 1) > str_slots_size) {
+      free(str_slots);
+      str_slots_size = str_slots_size ? str_slots_size * 2 : 1024;
+      str_slots = calloc(str_slots_size, sizeof(*str_slots));
+      if (!str_slots)
+         panic("failed to allocate the string table");
+      for (size_t i = 0; i < buf_len(strings); ++i)
+         *find_str_slot(strings[i]) = i + 1;
+   }
+   uint32_t* slot = find_str_slot(s);
+   if (!*slot) {
+      buf_push(strings, s);
+      *slot = buf_len(strings);
+   }
+   put_u32(*slot - 1);
+}
+static void put_pos(const struct source_pos* pos) {
+   put_str(pos->file);
+   put_u32(pos->line);
+   put_u32(pos->column);
+}
+
+static void put_type(const struct value_type*);
+static void put_enum(const struct enumeration* e) {
+   put_str(e->name);
+   put_u8(e->is_definition);
+   put_u32(buf_len(e->entries));
+   for (size_t i = 0; i < buf_len(e->entries); ++i) {
+      put_str(e->entries[i].name);
+      put_u64(e->entries[i].value);
+   }
+}
+static void put_struct(const struct structure* s) {
+   put_str(s->name);
+   put_u8(s->is_definition);
+   put_u32(buf_len(s->entries));
+   for (size_t i = 0; i < buf_len(s->entries); ++i) {
+      put_type(s->entries[i].type);
+      put_str(s->entries[i].name);
+   }
+}
+static void put_type(const struct value_type* vt) {
+   if (!vt) {
+      put_u8(NO_TYPE);
+      return;
+   }
+   put_u8(vt->type);
+   put_u8(vt->is_const | vt->is_volatile << 1);
+   put_pos(&vt->begin);
+   put_pos(&vt->end);
+   switch (vt->type) {
+   case VAL_INT:
+      put_u8(vt->integer.size);
+      put_u8(vt->integer.is_unsigned);
+      break;
+#if ENABLE_FP
+   case VAL_FLOAT:
+      put_u8(vt->fp.size);
+      break;
+#endif
+   case VAL_POINTER:
+      put_u8(vt->pointer.is_array | vt->pointer.is_restrict << 1);
+      if (vt->pointer.is_array) {
+         put_u8(vt->pointer.array.has_const_size);
+         if (vt->pointer.array.has_const_size) {
+            put_u64(vt->pointer.array.size);
+         } else if (vt->pointer.array.dsize) {
+            parse_error(&vt->begin, "variable length arrays cannot be precompiled");
+         }
+      }
+      put_type(vt->pointer.type);
+      break;
+   case VAL_FUNC:
+      put_str(vt->func.name);
+      put_type(vt->func.ret_val);
+      put_u32(buf_len(vt->func.params));
+      for (size_t i = 0; i < buf_len(vt->func.params); ++i)
+         put_type(vt->func.params[i]);
+      put_u8(vt->func.variadic);
+      break;
+   case VAL_ENUM:
+      put_enum(vt->venum);
+      break;
+   case VAL_STRUCT:
+   case VAL_UNION:
+      put_struct(vt->vstruct);
+      break;
+   default:
+      break;
+   }
+}
+static void put_var(const struct variable* var) {
+   put_type(var->type);
+   put_str(var->name);
+   put_pos(&var->begin);
+   put_pos(&var->end);
+   put_u32(var->attrs);
+}
+
+static void put_dep(const char* path) {
+   struct stat st;
+   if (stat(path, &st) != 0)
+      memset(&st, 0, sizeof(st));
+   put_str(path);
+   put_u64(st.st_mtim.tv_sec);
+   put_u64(st.st_mtim.tv_nsec);
+   put_u64(st.st_size);
+}
+static void count_file(const struct bcpp_file* f, void* ctx) {
+   (void)f;
+   ++*(uint32_t*)ctx;
+}
+static void save_dep(const struct bcpp_file* f, void* ctx) {
+   (void)ctx;
+   put_dep(f->path);
+}
+static void save_file(const struct bcpp_file* f, void* ctx) {
+   (void)ctx;
+   put_str(f->path);
+   put_str(f->guard);
+   put_u8(f->once);
+}
+static void count_macro(const struct bcpp_macro* m, void* ctx) {
+   (void)m;
+   ++*(uint32_t*)ctx;
+}
+static void save_macro(const struct bcpp_macro* m, void* ctx) {
+   (void)ctx;
+   put_str(m->name);
+   put_str(m->text);
+   put_u8(m->is_func);
+   put_u32(m->num_params);
+   for (size_t i = 0; i < m->num_params; ++i)
+      put_str(m->params[i]);
+}
+
+void pch_save_cpp(const char* header_name) {
+   buf_free(body);
+   buf_free(strings);
+   free(str_slots);
+   str_slots = NULL;
+   str_slots_size = 0;
+
+   char* canon = realpath(header_name, NULL);
+   put_str(canon ? canon : header_name);
+
+   uint32_t num_files = 0;
+   bcpp_foreach_file(count_file, &num_files);
+   put_u32(num_files + 1);
+   put_dep(canon ? canon : header_name);
+   bcpp_foreach_file(save_dep, NULL);
+   free(canon);
+
+   uint32_t num_macros = 0;
+   bcpp_foreach_macro(count_macro, &num_macros);
+   put_u32(num_macros);
+   bcpp_foreach_macro(save_macro, NULL);
+
+   put_u32(num_files);
+   bcpp_foreach_file(save_file, NULL);
+}
+
+bool pch_write(const char* filename) {
+   if (!body)
+      panic("the pre-processor state was not saved");
+
+   put_u32(buf_len(cunit.aliases));
+   for (size_t i = 0; i < buf_len(cunit.aliases); ++i) {
+      const struct typerename* a = &cunit.aliases[i];
+      put_pos(&a->begin);
+      put_pos(&a->end);
+      put_type(a->type);
+      put_str(a->name);
+   }
+   put_u32(buf_len(cunit.enums));
+   for (size_t i = 0; i < buf_len(cunit.enums); ++i)
+      put_enum(cunit.enums[i]);
+   put_u32(buf_len(cunit.constants));
+   for (size_t i = 0; i < buf_len(cunit.constants); ++i) {
+      put_str(cunit.constants[i].name);
+      put_u64(cunit.constants[i].value);
+   }
+   put_u32(buf_len(cunit.structs));
+   for (size_t i = 0; i < buf_len(cunit.structs); ++i)
+      put_struct(cunit.structs[i]);
+   put_u32(buf_len(cunit.unions));
+   for (size_t i = 0; i < buf_len(cunit.unions); ++i)
+      put_struct(cunit.unions[i]);
+
+   put_u32(buf_len(cunit.funcs));
+   for (size_t i = 0; i < buf_len(cunit.funcs); ++i) {
+      const struct function* f = cunit.funcs[i];
+      if (f->scope)
+         parse_error(&f->begin, "function definitions cannot be precompiled");
+      put_str(f->name);
+      put_type(f->type);
+      put_pos(&f->begin);
+      put_pos(&f->end);
+      put_u32(f->attrs);
+      put_u8(f->variadic);
+      put_u32(buf_len(f->params));
+      for (size_t j = 0; j < buf_len(f->params); ++j)
+         put_var(&f->params[j]);
+   }
+   put_u32(buf_len(cunit.vars));
+   for (size_t i = 0; i < buf_len(cunit.vars); ++i) {
+      const struct variable* v = &cunit.vars[i];
+      if (v->init)
+         parse_error(&v->begin, "initialized variables cannot be precompiled");
+      put_var(v);
+   }
+
+   bool success = false;
+   FILE* file = fopen(filename, "wb");
+   if (!file) {
+      fprintf(stderr, "bcc: failed to open '%s': %s\n", filename, strerror(errno));
+   } else {
+      struct pch_header hdr;
+      memset(&hdr, 0, sizeof(hdr));
+      memcpy(hdr.magic, PCH_MAGIC, sizeof(hdr.magic));
+      hdr.options = options_hash();
+      hdr.strings = sizeof(hdr) + buf_len(body);
+      hdr.num_strings = buf_len(strings);
+      fwrite(&hdr, sizeof(hdr), 1, file);
+      fwrite(body, 1, buf_len(body), file);
+      for (size_t i = 0; i < buf_len(strings); ++i) {
+         const uint32_t len = strlen(strings[i]);
+         fwrite(&len, sizeof(len), 1, file);
+         fwrite(strings[i], 1, len, file);
+      }
+      success = !ferror(file);
+      if (fclose(file) != 0 || !success) {
+         fprintf(stderr, "bcc: failed to write '%s'\n", filename);
+         success = false;
+      }
+   }
+
+   buf_free(body);
+   buf_free(strings);
+   free(str_slots);
+   str_slots = NULL;
+   str_slots_size = 0;
+   return success;
+}
+
+
+/// reading
+
+static const void* get(size_t n) {
+   if ((size_t)(rd_end - rd_pos) < n)
+      panic("corrupt precompiled header '%s'", pch_file);
+   const void* p = rd_pos;
+   rd_pos += n;
+   return p;
+}
+static uint8_t get_u8(void) {
+   return *(const uint8_t*)get(1);
+}
+static uint32_t get_u32(void) {
+   uint32_t v;
+   memcpy(&v, get(sizeof(v)), sizeof(v));
+   return v;
+}
+static uint64_t get_u64(void) {
+   uint64_t v;
+   memcpy(&v, get(sizeof(v)), sizeof(v));
+   return v;
+}
+static istr_t get_str(void) {
+   const uint32_t i = get_u32();
+   if (i == NO_STR)
+      return NULL;
+   if (i >= buf_len(rd_strings))
+      panic("corrupt precompiled header '%s'", pch_file);
+   return rd_strings[i];
+}
+static struct source_pos get_pos(void) {
+   struct source_pos pos;
+   pos.file = get_str();
+   pos.line = get_u32();
+   pos.column = get_u32();
+   return pos;
+}
+
+static struct value_type* get_type(void);
+static struct enumeration* get_enum(void) {
+   struct enumeration* e = malloc(sizeof(*e));
+   if (!e)
+      panic("failed to allocate enum");
+   e->name = get_str();
+   e->is_definition = get_u8();
+   e->entries = NULL;
+   for (uint32_t n = get_u32(); n != 0; --n) {
+      struct enum_entry entry;
+      entry.name = get_str();
+      entry.value = get_u64();
+      buf_push(e->entries, entry);
+   }
+   return e;
+}
+static struct structure* get_struct(void) {
+   struct structure* s = malloc(sizeof(*s));
+   if (!s)
+      panic("failed to allocate struct");
+   s->name = get_str();
+   s->is_definition = get_u8();
+   s->entries = NULL;
+   for (uint32_t n = get_u32(); n != 0; --n) {
+      struct struct_entry entry;
+      entry.type = get_type();
+      entry.name = get_str();
+      buf_push(s->entries, entry);
+   }
+   return s;
+}
+static struct value_type* get_type(void) {
+   const uint8_t type = get_u8();
+   if (type == NO_TYPE)
+      return NULL;
+   if (type >= NUM_VALS)
+      panic("corrupt precompiled header '%s'", pch_file);
+   struct value_type* vt = arena_alloc(&ast_arena, sizeof(struct value_type));
+   vt->type = type;
+   const uint8_t flags = get_u8();
+   vt->is_const = flags & 1;
+   vt->is_volatile = (flags >> 1) & 1;
+   vt->begin = get_pos();
+   vt->end = get_pos();
+   switch (vt->type) {
+   case VAL_INT:
+      vt->integer.size = get_u8();
+      vt->integer.is_unsigned = get_u8();
+      break;
+#if ENABLE_FP
+   case VAL_FLOAT:
+      vt->fp.size = get_u8();
+      break;
+#endif
+   case VAL_POINTER:
+   {
+      const uint8_t ptr_flags = get_u8();
+      vt->pointer.is_array = ptr_flags & 1;
+      vt->pointer.is_restrict = (ptr_flags >> 1) & 1;
+      if (vt->pointer.is_array) {
+         vt->pointer.array.has_const_size = get_u8();
+         if (vt->pointer.array.has_const_size)
+            vt->pointer.array.size = get_u64();
+      }
+      vt->pointer.type = get_type();
+      break;
+   }
+   case VAL_FUNC:
+      vt->func.name = get_str();
+      vt->func.ret_val = get_type();
+      vt->func.params = NULL;
+      for (uint32_t n = get_u32(); n != 0; --n)
+         buf_push(vt->func.params, get_type());
+      vt->func.variadic = get_u8();
+      break;
+   case VAL_ENUM:
+      vt->venum = get_enum();
+      break;
+   case VAL_STRUCT:
+   case VAL_UNION:
+      vt->vstruct = get_struct();
+      break;
+   default:
+      break;
+   }
+   return vt;
+}
+static struct variable get_var(void) {
+   struct variable var;
+   memset(&var, 0, sizeof(var));
+   var.type = get_type();
+   var.name = get_str();
+   var.begin = get_pos();
+   var.end = get_pos();
+   var.attrs = get_u32();
+   return var;
+}
+
+// finds the header of `#include "name"` or `#include <name>`,
+// if it is the first thing in `file` (after comments)
+static bool first_include(FILE* file, char* name, size_t size, bool* quoted) {
+   int ch;
+   while (1) {
+      ch = fgetc(file);
+      if (isspace(ch))
+         continue;
+      if (ch != '/')
+         break;
+      ch = fgetc(file);
+      if (ch == '/') {
+         while ((ch = fgetc(file)) != EOF && ch != '\n');
+      } else if (ch == '*') {
+         int prev = 0;
+         while ((ch = fgetc(file)) != EOF && !(prev == '*' && ch == '/'))
+            prev = ch;
+         if (ch == EOF)
+            return false;
+      } else {
+         return false;
+      }
+   }
+   if (ch != '#')
+      return false;
+   do ch = fgetc(file); while (ch == ' ' || ch == '\t');
+   for (const char* s = "include"; *s; ++s, ch = fgetc(file)) {
+      if (ch != *s)
+         return false;
+   }
+   while (ch == ' ' || ch == '\t')
+      ch = fgetc(file);
+   int end;
+   if (ch == '"') {
+      end = '"';
+   } else if (ch == '<') {
+      end = '>';
+   } else {
+      return false;
+   }
+   *quoted = ch == '"';
+   size_t len = 0;
+   while ((ch = fgetc(file)) != end) {
+      if (ch == EOF || ch == '\n' || len + 1 >= size)
+         return false;
+      name[len++] = ch;
+   }
+   name[len] = '\0';
+   return len != 0;
+}
+
+// checks, that the files, that were read by the header, did not change
+static bool deps_unchanged(void) {
+   bool unchanged = true;
+   for (uint32_t n = get_u32(); n != 0; --n) {
+      const istr_t path = get_str();
+      const uint64_t sec = get_u64();
+      const uint64_t nsec = get_u64();
+      const uint64_t size = get_u64();
+      struct stat st;
+      if (stat(path, &st) != 0 || (uint64_t)st.st_mtim.tv_sec != sec
+         || (uint64_t)st.st_mtim.tv_nsec != nsec || (uint64_t)st.st_size != size)
+         unchanged = false;
+   }
+   return unchanged;
+}
+
+static bool load(const char* source_name, const char* header) {
+   const uint8_t* start = rd_pos;
+   const struct pch_header* hdr = get(sizeof(struct pch_header));
+   if (memcmp(hdr->magic, PCH_MAGIC, sizeof(hdr->magic)) != 0) {
+      if (verbose)
+         fprintf(stderr, "bcc: '%s' is not a precompiled header\n", pch_file);
+      return false;
+   }
+   if (hdr->options != options_hash()) {
+      if (verbose)
+         fprintf(stderr, "bcc: '%s' was made with different options\n", pch_file);
+      return false;
+   }
+
+   // intern the string table
+   const uint8_t* body_pos = rd_pos;
+   if (hdr->strings > (uint64_t)(rd_end - start))
+      panic("corrupt precompiled header '%s'", pch_file);
+   rd_pos = start + hdr->strings;
+   for (uint64_t i = 0; i < hdr->num_strings; ++i) {
+      const uint32_t len = get_u32();
+      buf_push(rd_strings, strnint(get(len), len));
+   }
+   rd_pos = body_pos;
+
+   if (get_str() != header || !deps_unchanged()) {
+      if (verbose)
+         fprintf(stderr, "bcc: '%s' is out of date\n", pch_file);
+      return false;
+   }
+   if (verbose)
+      fprintf(stderr, "Using precompiled header %s for %s\n", pch_file, source_name);
+
+   // pre-processor
+   const char** params = NULL;
+   for (uint32_t n = get_u32(); n != 0; --n) {
+      struct bcpp_macro m;
+      m.name = get_str();
+      m.text = get_str();
+      m.is_func = get_u8();
+      m.num_params = get_u32();
+      if (params)
+         buf__hdr(params)->len = 0;
+      for (size_t i = 0; i < m.num_params; ++i)
+         buf_push(params, get_str());
+      m.params = params;
+      bcpp_define_macro(&m);
+   }
+   buf_free(params);
+   for (uint32_t n = get_u32(); n != 0; --n) {
+      struct bcpp_file f;
+      f.path = get_str();
+      f.guard = get_str();
+      f.once = get_u8();
+      bcpp_add_file(&f);
+   }
+   // the header itself is skipped, when it is included
+   const struct bcpp_file self = { header, NULL, true };
+   bcpp_add_file(&self);
+
+   // declarations
+   for (uint32_t n = get_u32(); n != 0; --n) {
+      struct typerename a;
+      a.begin = get_pos();
+      a.end = get_pos();
+      a.type = get_type();
+      a.name = get_str();
+      buf_push(cunit.aliases, a);
+   }
+   for (uint32_t n = get_u32(); n != 0; --n)
+      buf_push(cunit.enums, get_enum());
+   for (uint32_t n = get_u32(); n != 0; --n) {
+      struct enum_entry e;
+      e.name = get_str();
+      e.value = get_u64();
+      buf_push(cunit.constants, e);
+   }
+   for (uint32_t n = get_u32(); n != 0; --n)
+      buf_push(cunit.structs, get_struct());
+   for (uint32_t n = get_u32(); n != 0; --n)
+      buf_push(cunit.unions, get_struct());
+   for (uint32_t n = get_u32(); n != 0; --n) {
+      struct function* f = calloc(1, sizeof(struct function));
+      if (!f)
+         panic("failed to allocate function");
+      f->name = get_str();
+      f->type = get_type();
+      f->begin = get_pos();
+      f->end = get_pos();
+      f->attrs = get_u32();
+      f->variadic = get_u8();
+      for (uint32_t m = get_u32(); m != 0; --m)
+         buf_push(f->params, get_var());
+      buf_push(cunit.funcs, f);
+   }
+   for (uint32_t n = get_u32(); n != 0; --n)
+      buf_push(cunit.vars, get_var());
+   return true;
+}
+
+istr_t pch_load(const char* source_name) {
+   if (!strcmp(source_name, "-"))
+      return NULL;
+   FILE* source = fopen(source_name, "r");
+   if (!source)
+      return NULL;
+   char name[256];
+   bool quoted;
+   const bool found = first_include(source, name, sizeof(name), &quoted);
+   fclose(source);
+   if (!found)
+      return NULL;
+
+   const char* header = bcpp_find_include(source_name, name, quoted);
+   if (!header)
+      return NULL;
+   pch_file = pch_name(header);
+   const int fd = open(pch_file, O_RDONLY);
+   if (fd < 0)
+      return NULL;
+   struct stat st;
+   if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct pch_header)) {
+      close(fd);
+      return NULL;
+   }
+   void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (data == MAP_FAILED)
+      return NULL;
+
+   rd_pos = data;
+   rd_end = rd_pos + st.st_size;
+   const bool success = load(source_name, header);
+   munmap(data, st.st_size);
+   buf_free(rd_strings);
+   return success ? pch_file : NULL;
+}
@@ -0,0 +1,599 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <string.h>
+#include <stdio.h>
+#include "regalloc.h"
+#include "strint.h"
+#include "target.h"
+#include "optim.h"
+#include "error.h"
+#include "scope.h"
+#include "value.h"
+#include "buf.h"
+
+#define num_words(n) (((n) + 63) / 64 + 1)
+#define bit_set(set, i) ((set)[(i) / 64] |= (uint64_t)1 << ((i) % 64))
+#define bit_clear(set, i) ((set)[(i) / 64] &= ~((uint64_t)1 << ((i) % 64)))
+
+static uint64_t* new_bitset(size_t n) {
+   uint64_t* set = calloc(num_words(n), sizeof(uint64_t));
+   if (!set)
+      panic("failed to allocate bitset");
+   return set;
+}
+
+// returns the first set bit starting at `i`, or `n`
+static size_t next_bit(const uint64_t* set, size_t n, size_t i) {
+   while (i < n) {
+      const uint64_t w = set[i / 64] >> (i % 64);
+      if (!w) {
+         i = (i / 64 + 1) * 64;
+         continue;
+      }
+      if (w & 1)
+         return i;
+      ++i;
+   }
+   return n;
+}
+#define for_each_bit(set, n, i) for (size_t i = next_bit((set), (n), 0); i < (n); i = next_bit((set), (n), i + 1))
+
+static void optim_args(ir_node_t* n) {
+   for (; n; n = n->next) {
+      if (!ir_is_func(n))
+         continue;
+      for (size_t i = 0; i < buf_len(n->call.params); ++i) {
+         ir_node_t** params = &n->call.params[i];
+         const ir_reg_t target = ir_get_target(ir_end(*params));
+         *params = optim_ir_nodes(*params);
+         // the optimizer removes moves of a register to itself,
+         // but the argument still has to be defined by the list
+         if (!*params || ir_get_target(ir_end(*params)) != target) {
+            ir_node_t* move = new_node(IR_MOVE);
+            move->func = n->func;
+            move->move.dest = move->move.src = target;
+            move->move.size = IRS_PTR;
+            *params = ir_append(*params, move);
+         }
+         optim_args(*params);
+      }
+      if (n->type == IR_RCALL || n->type == IR_IRCALL)
+         optim_args(n->call.addr);
+   }
+}
+
+void ra_init(struct ra_func* ra, const struct function* func, ir_node_t* code) {
+   ra->func = func;
+   ra->code = code;
+   ra->insns = NULL;
+   ra->blocks = NULL;
+   ra->intervals = NULL;
+   ra->num_vregs = 0;
+   ra->num_slots = 0;
+   optim_args(code);
+}
+
+// linearization
+
+static void push_insn(struct ra_func* ra, ir_node_t* n, ir_node_t** list) {
+   struct ra_insn insn;
+   insn.node = n;
+   insn.list = list;
+   insn.num_ops = ir_operands(n, insn.ops);
+   insn.flags = 0;
+   if (ir_is_func(n))
+      insn.flags |= RA_CALL;
+   else if (ir_isv(n, IR_IDIV, IR_UDIV, IR_IMOD, IR_UMOD, NUM_IR_NODES))
+      insn.flags |= RA_DIV;
+   buf_push(ra->insns, insn);
+}
+
+// the value computed by `*list` is used by the call
+static void push_arg(struct ra_func* ra, ir_node_t** list) {
+   ir_node_t* last = ir_end(*list);
+   struct ir_operand ops[IR_MAX_OPERANDS];
+   const size_t num = ir_operands(last, ops);
+   for (size_t i = 0; i < num; ++i) {
+      if (!ops[i].is_def)
+         continue;
+      struct ra_insn insn;
+      insn.node = last;
+      insn.list = list;
+      insn.ops[0] = (struct ir_operand){ .reg = ops[i].reg, .is_use = true, .is_def = false };
+      insn.num_ops = 1;
+      insn.flags = RA_ARG;
+      buf_push(ra->insns, insn);
+      return;
+   }
+}
+
+static void linearize(struct ra_func* ra, ir_node_t** list) {
+   for (ir_node_t* n = *list; n; n = n->next) {
+      if (ir_is_func(n)) {
+         for (size_t i = 0; i < buf_len(n->call.params); ++i) {
+            if (!n->call.params[i])
+               continue;
+            linearize(ra, &n->call.params[i]);
+            push_arg(ra, &n->call.params[i]);
+         }
+         if (n->type == IR_RCALL || n->type == IR_IRCALL) {
+            linearize(ra, &n->call.addr);
+            push_arg(ra, &n->call.addr);
+         }
+      }
+      push_insn(ra, n, list);
+   }
+}
+
+// control-flow
+
+static enum ir_node_type insn_type(const struct ra_insn* insn) {
+   return insn->flags & RA_ARG ? IR_NOP : insn->node->type;
+}
+
+struct label {
+   istr_t name;
+   size_t block;
+};
+
+static int cmp_label(const void* a, const void* b) {
+   const uintptr_t x = (uintptr_t)((const struct label*)a)->name;
+   const uintptr_t y = (uintptr_t)((const struct label*)b)->name;
+   return (x > y) - (x < y);
+}
+
+static size_t find_label(const struct label* labels, istr_t name) {
+   const struct label key = { .name = name };
+   const struct label* l = labels ? bsearch(&key, labels, buf_len(labels), sizeof(struct label), cmp_label) : NULL;
+   if (!l)
+      panic("undefined label '%s'", name);
+   return l->block;
+}
+
+static void build_blocks(struct ra_func* ra) {
+   struct label* labels = NULL;
+   size_t epilogue = SIZE_MAX;
+   const size_t num = buf_len(ra->insns);
+   for (size_t i = 0; i < num; ++i) {
+      const enum ir_node_type t = insn_type(&ra->insns[i]);
+      const bool leader = i == 0 || t == IR_LABEL || t == IR_EPILOGUE
+         || ir_isv(ra->insns[i - 1].flags & RA_ARG ? NULL : ra->insns[i - 1].node,
+               IR_JMP, IR_JMPIF, IR_JMPIFN, IR_JMPTBL, IR_RET, IR_IRET, NUM_IR_NODES);
+      if (leader) {
+         if (ra->blocks)
+            buf_last(ra->blocks).end = i;
+         struct ra_block b;
+         b.begin = i;
+         b.end = num;
+         b.succ = NULL;
+         b.live_in = b.live_out = NULL;
+         buf_push(ra->blocks, b);
+      }
+      if (t == IR_LABEL) {
+         const struct label l = { .name = ra->insns[i].node->str, .block = buf_len(ra->blocks) - 1 };
+         buf_push(labels, l);
+      } else if (t == IR_EPILOGUE) {
+         epilogue = buf_len(ra->blocks) - 1;
+      }
+   }
+   if (labels)
+      qsort(labels, buf_len(labels), sizeof(struct label), cmp_label);
+
+   for (size_t i = 0; i < buf_len(ra->blocks); ++i) {
+      struct ra_block* b = &ra->blocks[i];
+      const struct ra_insn* last = &ra->insns[b->end - 1];
+      switch (insn_type(last)) {
+      case IR_JMP:
+         buf_push(b->succ, find_label(labels, last->node->str));
+         break;
+      case IR_JMPIF:
+      case IR_JMPIFN:
+         buf_push(b->succ, find_label(labels, last->node->cjmp.label));
+         if (i + 1 < buf_len(ra->blocks))
+            buf_push(b->succ, i + 1);
+         break;
+      case IR_JMPTBL:
+         for (size_t j = 0; j < buf_len(last->node->jmptbl.targets); ++j)
+            buf_push(b->succ, find_label(labels, last->node->jmptbl.targets[j]));
+         break;
+      case IR_RET:
+      case IR_IRET:
+         if (epilogue != SIZE_MAX)
+            buf_push(b->succ, epilogue);
+         break;
+      case IR_EPILOGUE:
+         break;
+      default:
+         if (i + 1 < buf_len(ra->blocks))
+            buf_push(b->succ, i + 1);
+         break;
+      }
+   }
+   buf_free(labels);
+}
+
+// liveness
+
+static void compute_liveness(struct ra_func* ra) {
+   const size_t nb = buf_len(ra->blocks);
+   const size_t nv = ra->num_vregs;
+   const size_t nw = num_words(nv);
+   uint64_t** gen = malloc(nb * sizeof(uint64_t*) + 1);
+   uint64_t** kill = malloc(nb * sizeof(uint64_t*) + 1);
+   if (!gen || !kill)
+      panic("failed to allocate liveness sets");
+
+   for (size_t i = 0; i < nb; ++i) {
+      struct ra_block* b = &ra->blocks[i];
+      free(b->live_in);
+      free(b->live_out);
+      b->live_in = new_bitset(nv);
+      b->live_out = new_bitset(nv);
+      gen[i] = new_bitset(nv);
+      kill[i] = new_bitset(nv);
+      for (size_t j = b->begin; j < b->end; ++j) {
+         const struct ra_insn* insn = &ra->insns[j];
+         for (size_t k = 0; k < insn->num_ops; ++k) {
+            const ir_reg_t r = *insn->ops[k].reg;
+            if (insn->ops[k].is_use && !ra_bit_test(kill[i], r))
+               bit_set(gen[i], r);
+         }
+         for (size_t k = 0; k < insn->num_ops; ++k) {
+            if (insn->ops[k].is_def)
+               bit_set(kill[i], *insn->ops[k].reg);
+         }
+      }
+   }
+
+   bool changed;
+   do {
+      changed = false;
+      for (size_t i = nb; i != 0; --i) {
+         struct ra_block* b = &ra->blocks[i - 1];
+         for (size_t j = 0; j < buf_len(b->succ); ++j) {
+            const uint64_t* in = ra->blocks[b->succ[j]].live_in;
+            for (size_t w = 0; w < nw; ++w)
+               b->live_out[w] |= in[w];
+         }
+         for (size_t w = 0; w < nw; ++w) {
+            const uint64_t in = gen[i - 1][w] | (b->live_out[w] & ~kill[i - 1][w]);
+            if (in != b->live_in[w]) {
+               b->live_in[w] = in;
+               changed = true;
+            }
+         }
+      }
+   } while (changed);
+
+   for (size_t i = 0; i < nb; ++i) {
+      free(gen[i]);
+      free(kill[i]);
+   }
+   free(gen);
+   free(kill);
+}
+
+// webs
+
+static size_t uf_new(size_t** uf) {
+   buf_push(*uf, buf_len(*uf));
+   return buf_len(*uf) - 1;
+}
+static size_t uf_find(size_t* uf, size_t x) {
+   while (uf[x] != x) {
+      uf[x] = uf[uf[x]];
+      x = uf[x];
+   }
+   return x;
+}
+static void uf_union(size_t* uf, size_t a, size_t b) {
+   a = uf_find(uf, a);
+   b = uf_find(uf, b);
+   if (a != b)
+      uf[b] = a;
+}
+
+// renames the registers, so that every def-use web gets its own register
+static void split_webs(struct ra_func* ra) {
+   const size_t nb = buf_len(ra->blocks);
+   const size_t nv = ra->num_vregs;
+   const size_t ni = buf_len(ra->insns);
+   size_t* uf = NULL;
+   size_t** entry = calloc(nb + 1, sizeof(size_t*));
+   size_t* cur = calloc(nv + 1, sizeof(size_t));
+   size_t* epoch = calloc(nv + 1, sizeof(size_t));
+   size_t* webs = calloc(ni * IR_MAX_OPERANDS + 1, sizeof(size_t));
+   if (!entry || !cur || !epoch || !webs)
+      panic("failed to allocate webs");
+
+   for (size_t i = 0; i < nb; ++i) {
+      for_each_bit(ra->blocks[i].live_in, nv, r)
+         buf_push(entry[i], uf_new(&uf));
+   }
+
+   for (size_t i = 0; i < nb; ++i) {
+      const struct ra_block* b = &ra->blocks[i];
+      size_t k = 0;
+      for_each_bit(b->live_in, nv, r) {
+         cur[r] = entry[i][k++];
+         epoch[r] = i + 1;
+      }
+      for (size_t j = b->begin; j < b->end; ++j) {
+         const struct ra_insn* insn = &ra->insns[j];
+         for (size_t k = 0; k < insn->num_ops; ++k) {
+            const ir_reg_t r = *insn->ops[k].reg;
+            if (!insn->ops[k].is_use)
+               continue;
+            if (epoch[r] != i + 1) {
+               cur[r] = uf_new(&uf);
+               epoch[r] = i + 1;
+            }
+            webs[j * IR_MAX_OPERANDS + k] = cur[r];
+         }
+         for (size_t k = 0; k < insn->num_ops; ++k) {
+            const ir_reg_t r = *insn->ops[k].reg;
+            if (!insn->ops[k].is_def || insn->ops[k].is_use)
+               continue;
+            cur[r] = uf_new(&uf);
+            epoch[r] = i + 1;
+            webs[j * IR_MAX_OPERANDS + k] = cur[r];
+         }
+      }
+      for (size_t j = 0; j < buf_len(b->succ); ++j) {
+         const struct ra_block* s = &ra->blocks[b->succ[j]];
+         size_t k = 0;
+         for_each_bit(s->live_in, nv, r) {
+            if (epoch[r] == i + 1)
+               uf_union(uf, cur[r], entry[b->succ[j]][k]);
+            ++k;
+         }
+      }
+   }
+
+   // number the webs
+   size_t* ids = malloc((buf_len(uf) + 1) * sizeof(size_t));
+   if (!ids)
+      panic("failed to allocate webs");
+   size_t num = 0;
+   for (size_t i = 0; i < buf_len(uf); ++i)
+      ids[i] = SIZE_MAX;
+   for (size_t j = 0; j < ni; ++j) {
+      const struct ra_insn* insn = &ra->insns[j];
+      for (size_t k = 0; k < insn->num_ops; ++k) {
+         const size_t root = uf_find(uf, webs[j * IR_MAX_OPERANDS + k]);
+         if (ids[root] == SIZE_MAX)
+            ids[root] = num++;
+      }
+   }
+   // the operands of RA_ARG insns alias definitions of the same web
+   for (size_t j = 0; j < ni; ++j) {
+      const struct ra_insn* insn = &ra->insns[j];
+      for (size_t k = 0; k < insn->num_ops; ++k)
+         *insn->ops[k].reg = ids[uf_find(uf, webs[j * IR_MAX_OPERANDS + k])];
+   }
+   ra->num_vregs = num;
+
+   for (size_t i = 0; i < nb; ++i)
+      buf_free(entry[i]);
+   free(entry);
+   free(cur);
+   free(epoch);
+   free(webs);
+   free(ids);
+   buf_free(uf);
+}
+
+// intervals
+
+static void extend(struct ra_interval* it, size_t pos) {
+   if (it->begin == SIZE_MAX || pos < it->begin)
+      it->begin = pos;
+   if (pos > it->end)
+      it->end = pos;
+}
+
+static void compute_intervals(struct ra_func* ra) {
+   const size_t nv = ra->num_vregs;
+   while (buf_len(ra->intervals) < nv) {
+      const struct ra_interval it = { .spillable = true };
+      buf_push(ra->intervals, it);
+   }
+   for (size_t i = 0; i < nv; ++i) {
+      struct ra_interval* it = &ra->intervals[i];
+      it->begin = SIZE_MAX;
+      it->end = 0;
+      it->crosses = 0;
+      it->reg = IRR_NONSENSE;
+   }
+
+   uint64_t* live = new_bitset(nv);
+   for (size_t i = 0; i < buf_len(ra->blocks); ++i) {
+      const struct ra_block* b = &ra->blocks[i];
+      memcpy(live, b->live_out, num_words(nv) * sizeof(uint64_t));
+      for_each_bit(live, nv, r)
+         extend(&ra->intervals[r], 2 * (b->end - 1) + 1);
+
+      for (size_t j = b->end; j != b->begin; --j) {
+         const struct ra_insn* insn = &ra->insns[j - 1];
+         for (size_t k = 0; k < insn->num_ops; ++k) {
+            const struct ir_operand* op = &insn->ops[k];
+            if (!op->is_def)
+               continue;
+            extend(&ra->intervals[*op->reg], 2 * (j - 1) + 1);
+            if (!op->is_use)
+               bit_clear(live, *op->reg);
+         }
+         const unsigned crosses = insn->flags & (RA_CALL | RA_DIV);
+         if (crosses) {
+            for_each_bit(live, nv, r)
+               ra->intervals[r].crosses |= crosses;
+         }
+         for (size_t k = 0; k < insn->num_ops; ++k) {
+            const struct ir_operand* op = &insn->ops[k];
+            if (!op->is_use)
+               continue;
+            extend(&ra->intervals[*op->reg], 2 * (j - 1));
+            bit_set(live, *op->reg);
+         }
+      }
+
+      for_each_bit(live, nv, r)
+         extend(&ra->intervals[r], 2 * b->begin);
+   }
+   free(live);
+}
+
+static void free_analysis(struct ra_func* ra) {
+   for (size_t i = 0; i < buf_len(ra->blocks); ++i) {
+      free(ra->blocks[i].live_in);
+      free(ra->blocks[i].live_out);
+      buf_free(ra->blocks[i].succ);
+   }
+   buf_free(ra->blocks);
+   buf_free(ra->insns);
+}
+
+void ra_analyze(struct ra_func* ra, bool split) {
+   free_analysis(ra);
+   linearize(ra, &ra->code);
+   if (!buf_len(ra->insns))
+      return;
+   build_blocks(ra);
+
+   if (split) {
+      ra->num_vregs = 0;
+      for (size_t i = 0; i < buf_len(ra->insns); ++i) {
+         const struct ra_insn* insn = &ra->insns[i];
+         for (size_t k = 0; k < insn->num_ops; ++k) {
+            if (*insn->ops[k].reg >= ra->num_vregs)
+               ra->num_vregs = *insn->ops[k].reg + 1;
+         }
+      }
+      compute_liveness(ra);
+      split_webs(ra);
+   }
+
+   compute_liveness(ra);
+   compute_intervals(ra);
+}
+
+// spilling
+
+static ir_node_t* slot_node(const struct ra_func* ra, enum ir_node_type type, ir_reg_t reg, size_t idx) {
+   ir_node_t* n = new_node(type);
+   n->func = ra->func;
+   n->flurw.reg = reg;
+   n->flurw.scope = ra->func->scope;
+   n->flurw.var_idx = idx;
+   n->flurw.size = IRS_PTR;
+   n->flurw.sign_extend = false;
+   n->flurw.is_volatile = false;
+   return n;
+}
+
+static void insert_before(ir_node_t** list, ir_node_t* pos, ir_node_t* n) {
+   n->prev = pos->prev;
+   n->next = pos;
+   if (pos->prev)
+      pos->prev->next = n;
+   else *list = n;
+   pos->prev = n;
+}
+
+static void insert_after(ir_node_t* pos, ir_node_t* n) {
+   n->prev = pos;
+   n->next = pos->next;
+   if (pos->next)
+      pos->next->prev = n;
+   pos->next = n;
+}
+
+static ir_reg_t new_tmp(struct ra_func* ra) {
+   struct ra_interval it;
+   it.begin = SIZE_MAX;
+   it.end = 0;
+   it.crosses = 0;
+   it.spillable = false;
+   it.reg = IRR_NONSENSE;
+   buf_push(ra->intervals, it);
+   return ra->num_vregs++;
+}
+
+void ra_spill(struct ra_func* ra, ir_reg_t vreg) {
+   struct variable var;
+   char name[32];
+   memset(&var, 0, sizeof(var));
+   snprintf(name, sizeof(name), "spill.%zu", ra->num_slots++);
+   var.name = strint(name);
+   var.type = make_int(INT_LONG, true);
+   const size_t idx = scope_add_var(ra->func->scope, &var);
+
+   // arguments of calls get reloaded at the end of their lists
+   ir_node_t*** args = NULL;
+   for (size_t i = 0; i < buf_len(ra->insns); ++i) {
+      const struct ra_insn* insn = &ra->insns[i];
+      if ((insn->flags & RA_ARG) && *insn->ops[0].reg == vreg)
+         buf_push(args, insn->list);
+   }
+
+   for (size_t i = 0; i < buf_len(ra->insns); ++i) {
+      const struct ra_insn* insn = &ra->insns[i];
+      if (insn->flags & RA_ARG)
+         continue;
+      bool use = false, def = false;
+      for (size_t k = 0; k < insn->num_ops; ++k) {
+         if (*insn->ops[k].reg == vreg) {
+            use |= insn->ops[k].is_use;
+            def |= insn->ops[k].is_def;
+         }
+      }
+      if (!use && !def)
+         continue;
+
+      const ir_reg_t tmp = new_tmp(ra);
+      for (size_t k = 0; k < insn->num_ops; ++k) {
+         if (*insn->ops[k].reg == vreg)
+            *insn->ops[k].reg = tmp;
+      }
+      if (use)
+         insert_before(insn->list, insn->node, slot_node(ra, IR_FLURD, tmp, idx));
+      if (def)
+         insert_after(insn->node, slot_node(ra, IR_FLUWR, tmp, idx));
+   }
+
+   for (size_t i = 0; i < buf_len(args); ++i)
+      insert_after(ir_end(*args[i]), slot_node(ra, IR_FLURD, new_tmp(ra), idx));
+   buf_free(args);
+}
+
+void ra_assign(struct ra_func* ra) {
+   for (size_t i = 0; i < buf_len(ra->insns); ++i) {
+      const struct ra_insn* insn = &ra->insns[i];
+      if (insn->flags & RA_ARG)
+         continue;
+      for (size_t k = 0; k < insn->num_ops; ++k) {
+         const ir_reg_t r = ra->intervals[*insn->ops[k].reg].reg;
+         if (r == IRR_NONSENSE)
+            panic("no register assigned to R%u", *insn->ops[k].reg);
+         *insn->ops[k].reg = r;
+      }
+   }
+}
+
+void ra_free(struct ra_func* ra) {
+   free_analysis(ra);
+   buf_free(ra->intervals);
+}
@@ -23,6 +23,10 @@
 
 static uintreg_t size_stack;
 
+// callee-saved registers used by the current function and their frame offsets
+static unsigned saved_regs;
+static uintreg_t saved_addrs[NUM_REGS];
+
 void emit_init_int(enum ir_value_size irs, intmax_t val, bool is_unsigned);
 
 static int calc_fp_addr(size_t idx) {
@@ -89,7 +93,8 @@ ir_node_t* emit_ir(const ir_node_t* n) {
       emit("nop");
       return n->next;
    case IR_MOVE:
-      emit("mv   %s, %s", reg(n->move.dest), reg(n->move.src));
+      if (n->move.dest != n->move.src)
+         emit("mv   %s, %s", reg(n->move.dest), reg(n->move.src));
       return n->next;
    case IR_LOAD:
       emit("li   %s, %jd", reg(n->load.dest), (intmax_t)n->load.value);
@@ -140,7 +145,7 @@ ir_node_t* emit_ir(const ir_node_t* n) {
       if (av.type == IRT_REG) {
          a = reg(av.reg);
       } else {
-         a = reg(n->binary.dest);
+         a = REG_TMP;
          emit("li %s, %jd", a, av.sVal);
       }
       if (bv.type == IRT_REG) {
@@ -183,11 +188,22 @@ ir_node_t* emit_ir(const ir_node_t* n) {
          request_builtin("__check_sp");
       }
 
+      // the register allocator may add spill slots to the scope
+      saved_regs = color_regs((ir_node_t*)n);
+      size_t num_saved = 0;
+      for (size_t i = 0; i < NUM_REGS; ++i) {
+         if (saved_regs & (1u << i))
+            ++num_saved;
+      }
+
       // stack allocation
       const size_t num_reg_params = my_min(8, buf_len(n->func->params));
       size_stack = sizeof_scope(n->func->scope);
       size_stack += 3 * REGSIZE;
       size_stack += num_reg_params * REGSIZE;
+      size_stack = (size_stack + REGSIZE - 1) & ~(uintreg_t)(REGSIZE - 1);
+      uintreg_t fp_saved = size_stack;
+      size_stack += num_saved * REGSIZE;
       size_stack = align_stack_size(size_stack);
       emit("addi sp, sp, -%ju", (uintmax_t)size_stack);
       uintreg_t sp = size_stack;
@@ -201,12 +217,24 @@ ir_node_t* emit_ir(const ir_node_t* n) {
       uintreg_t fp = REGSIZE * (3 + num_reg_params);
       assign_scope(n->func->scope, &fp);
 
+      // save the used callee-saved registers
+      for (size_t i = 0; i < NUM_REGS; ++i) {
+         if (saved_regs & (1u << i)) {
+            saved_addrs[i] = (fp_saved += REGSIZE);
+            emit(SW "   %s, -%ju(fp)", reg(i), (uintmax_t)saved_addrs[i]);
+         }
+      }
+
       return n->next;
    }
    case IR_EPILOGUE:
       if (!strcmp(n->func->name, "main"))
          emit("mv   a0, x0");
       emit("%s.ret:", n->func->name);
+      for (size_t i = 0; i < NUM_REGS; ++i) {
+         if (saved_regs & (1u << i))
+            emit(LW "   %s, -%ju(fp)", reg(i), (uintmax_t)saved_addrs[i]);
+      }
       emit(LW "   fp, %ju(sp)", (uintmax_t)(size_stack - 1*REGSIZE));
       emit(LW "   ra, %ju(sp)", (uintmax_t)(size_stack - 2*REGSIZE));
       emit("addi sp, sp, %ju",     (uintmax_t)size_stack);
@@ -227,6 +255,14 @@ ir_node_t* emit_ir(const ir_node_t* n) {
    case IR_JMP:
       emit("j    %s", n->str);
       return n->next;
+   case IR_JMPTBL:
+      // ra is saved by the prologue, so it can be used as a second temporary
+      emit("la   ra, %s", n->jmptbl.label);
+      emit("slli %s, %s, %d", REG_TMP, reg(n->jmptbl.reg), REGSIZE == 8 ? 3 : 2);
+      emit("add  %s, %s, ra", REG_TMP, REG_TMP);
+      emit(LW "   %s, 0(%s)", REG_TMP, REG_TMP);
+      emit("jr   %s", REG_TMP);
+      return n->next;
    case IR_JMPIF:
       instr = "bne ";
       goto ir_branch;
@@ -286,8 +322,8 @@ ir_node_t* emit_ir(const ir_node_t* n) {
       if (n->binary.a.type == IRT_REG) {
          a = reg(n->binary.a.reg);
       } else {
-         a = reg(n->binary.dest);
-         emit("li %s, %jd", a, n->binary.b.sVal);
+         a = REG_TMP;
+         emit("li %s, %jd", a, n->binary.a.sVal);
       }
       if (n->binary.b.type == IRT_REG) {
          emit("sub %s, %s, %s", dest, a, reg(n->binary.b.reg));
@@ -415,7 +451,25 @@ ir_node_t* emit_ir(const ir_node_t* n) {
 #endif
             }
          } else {
-            emit("mv %s, %s", dest, src);
+            switch (ss) {
+            case IRS_BYTE:
+            case IRS_CHAR:
+               emit("andi %s, %s, 255", dest, src);
+               break;
+            case IRS_SHORT:
+               emit("slli %s, %s, %d", dest, src, BITS - 16);
+               emit("srli %s, %s, %d", dest, dest, BITS - 16);
+               break;
+#if BITS >= 64
+            case IRS_INT:
+               emit("slli %s, %s, %d", dest, src, BITS - 32);
+               emit("srli %s, %s, %d", dest, dest, BITS - 32);
+               break;
+#endif
+            default:
+               emit("mv %s, %s", dest, src);
+               break;
+            }
          }
       }
       return n->next;
@@ -438,45 +492,30 @@ ir_node_t* emit_ir(const ir_node_t* n) {
       const ir_reg_t dest = n->call.dest;
       struct ir_node** params = n->call.params;
       const size_t np = buf_len(params);
-      uintreg_t n_stack = (dest + np) * REGSIZE;
-      const uintreg_t saved_sp = n_stack;
-      uintreg_t sp = saved_sp;
-      n_stack = align_stack_size(n_stack);
+      const uintreg_t n_stack = align_stack_size(np * REGSIZE);
 
-      emit("addi sp, sp, -%ju", (uintmax_t)n_stack);
+      if (!flag && is_builtin_func(n->call.name))
+         request_builtin(n->call.name);
 
-      if (flag2) {
-         if (is_builtin_func(n->call.name))
-            request_builtin(n->call.name);
-         for (size_t i = 0; i < dest; ++i) {
-            emit(SW " %s, %ju(sp)", reg(i), (uintmax_t)(sp -= REGSIZE));
-         }
-      }
-      const size_t params_sp = sp;
-
-      if (np) {
-         for (size_t i = 0; i < my_min(8, np); ++i) {
-            ir_node_t* tmp = params[i];
-            while ((tmp = emit_ir(tmp)) != NULL);
-            emit(SW " %s, %ju(sp)", reg(dest), (uintmax_t)(sp -= REGSIZE));
-         }
+      if (n_stack)
+         emit("addi sp, sp, -%ju", (uintmax_t)n_stack);
 
-         for (size_t i = np - 1; i >= 8; --i) {
-            ir_node_t* tmp = params[i];
-            while ((tmp = emit_ir(tmp)) != NULL);
-            emit(SW " %s, %ju(sp)", reg(dest), (uintmax_t)(sp -= REGSIZE));
-         }
+      // the parameters are evaluated in order (see regalloc.c)
+      for (size_t i = 0; i < np; ++i) {
+         const ir_reg_t target = ir_get_target(ir_end(params[i]));
+         ir_node_t* tmp = params[i];
+         while ((tmp = emit_ir(tmp)) != NULL);
+         emit(SW " %s, %ju(sp)", reg(target), (uintmax_t)param_offset(i, np));
       }
 
       if (flag) {
          ir_node_t* tmp = n->call.addr;
          while ((tmp = emit_ir(tmp)) != NULL);
-         emit("mv t0, a0");
+         emit("mv t0, %s", reg(ir_get_target(ir_end(n->call.addr))));
       }
 
-      sp = params_sp;
       for (size_t i = 0; i < my_min(8, np); ++i) {
-         emit(LW " a%zu, %ju(sp)", i, (uintmax_t)(sp -= REGSIZE));
+         emit(LW " a%zu, %ju(sp)", i, (uintmax_t)param_offset(i, np));
       }
       if (flag) {
          emit("jalr t0");
@@ -485,12 +524,9 @@ ir_node_t* emit_ir(const ir_node_t* n) {
       }
       if (flag2 && dest != 0) {
          emit("mv %s, a0", reg(dest));
-         sp = saved_sp;
-         for (size_t i = 0; i < dest; ++i) {
-            emit(LW " %s, %ju(sp)", reg(i), (uintmax_t)(sp -= REGSIZE));
-         }
       }
-      emit("addi sp, sp, %ju", (uintmax_t)n_stack);
+      if (n_stack)
+         emit("addi sp, sp, %ju", (uintmax_t)n_stack);
       return n->next;
    }
 
@@ -529,10 +565,6 @@ ir_node_t* emit_ir(const ir_node_t* n) {
          return n->next;
       }
       
-      if (n->binary.b.type == IRT_UINT && n->binary.a.type == IRT_REG) {
-         av = n->binary.b;
-         bv = n->binary.a;
-      }
       const char* a;
       const char* b;
 
@@ -547,18 +579,13 @@ ir_node_t* emit_ir(const ir_node_t* n) {
       if (bv.type == IRT_REG) {
          b = reg(bv.reg);
       } else {
-         b = "s1";
-         emit(SW " s1, -4(sp)");
+         // a is a register, unless both are constants
+         b = av.type == IRT_REG ? REG_TMP : dest;
          emit("li %s, %jd", b, bv.sVal);
       }
 
       emit("%s %s, %s, %s", instr, dest, a, b);
 
-
-      if (bv.type == IRT_UINT) {
-         emit(LW " s1, -4(sp)");
-      }
-
       return n->next;
    }
    case IR_ASM:
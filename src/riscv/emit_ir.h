@@ -18,11 +18,22 @@
 #include "target.h"
 #include "regs.h"
 
+// places a variable of `sz` bytes below `sp` and returns its address,
+// it is aligned to its size (at most REGSIZE)
+static size_t alloc_slot(size_t sp, size_t sz) {
+   size_t align = REGSIZE;
+   while (align > sz && align > 1)
+      align >>= 1;
+   sp += sz;
+   return (sp + align - 1) & ~(align - 1);
+}
+
 static size_t sizeof_scope(const struct scope* scope) {
    size_t num = 0;
    for (size_t i = 0; i < buf_len(scope->vars); ++i) {
-      num += sizeof_value(scope->vars[i].type, false);
+      num = alloc_slot(num, sizeof_value(scope->vars[i].type, false));
    }
+   num = (num + REGSIZE - 1) & ~(size_t)(REGSIZE - 1);
    size_t max_child = 0;
    for (size_t i = 0; i < buf_len(scope->children); ++i) {
       const size_t sz = sizeof_scope(scope->children[i]);
@@ -33,11 +44,30 @@ static size_t sizeof_scope(const struct scope* scope) {
 
 static void assign_scope(struct scope* scope, uintreg_t* sp) {
    for (size_t i = 0; i < buf_len(scope->vars); ++i) {
-      *sp += sizeof_value(scope->vars[i].type, false);
+      *sp = alloc_slot(*sp, sizeof_value(scope->vars[i].type, false));
       scope->vars[i].addr = *sp;
    }
+   // sibling scopes share the same stack space (see sizeof_scope())
+   *sp = (*sp + REGSIZE - 1) & ~(uintreg_t)(REGSIZE - 1);
+   const uintreg_t base_sp = *sp;
    for (size_t i = 0; i < buf_len(scope->children); ++i) {
-      assign_scope(scope->children[i], sp);
+      uintreg_t tmp_sp = base_sp;
+      assign_scope(scope->children[i], &tmp_sp);
+      if (tmp_sp > *sp)
+         *sp = tmp_sp;
+   }
+}
+
+// stack offset of the `idx`th of `np` parameters of a call
+static uintreg_t param_offset(size_t idx, size_t np) {
+   if (idx < 8) {
+      return REGSIZE * (np - 1 - idx);
+   } else {
+      return REGSIZE * (idx - 8);
    }
 }
+
+// allocates the registers of a function (see regalloc.c),
+// returns the mask of the used callee-saved registers
+unsigned color_regs(ir_node_t* prologue);
 #endif /* FILE_EMIT_IR_H */
@@ -63,6 +63,10 @@ static bool mul_to_func(ir_node_t** n) {
 
       ir_node_t fc;
       fc.type = IR_IFCALL;
+      fc.prev = cur->prev;
+      fc.next = cur->next;
+      fc.func = cur->func;
+      fc.pos = cur->pos;
       fc.call.name = strint(name);
       fc.call.dest = cur->binary.dest;
       fc.call.params = NULL;
@@ -96,6 +100,7 @@ static bool mul_to_func(ir_node_t** n) {
       buf_push(fc.call.params, tmp);
 
       *cur = fc;
+      optim_note(TR_MUL_TO_FUNC, cur);
       success = true;
    }
    return success;
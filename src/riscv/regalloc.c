@@ -0,0 +1,436 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <string.h>
+#include "regalloc.h"
+#include "emit_ir.h"
+#include "regs.h"
+#include "buf.h"
+#include "bcc.h"
+
+// Graph-coloring register allocation (Chaitin-Briggs).
+//
+// Registers that are connected by an IR_MOVE are coalesced,
+// if the merged node is still trivially colorable (Briggs' test).
+// Nodes that are live across a call can only be colored with s1-s11.
+// Simplify takes the nodes of degree < K from a worklist, only when it is empty,
+// a spill candidate is chosen by (uses and definitions weighted by loop-depth) / degree.
+
+#define ALL_REGS ((1u << NUM_REGS) - 1)
+#define CALLEE_SAVED_REGS (ALL_REGS & ~((1u << REGI_CALLEE_SAVED) - 1))
+#define INF_COST 1e30
+
+struct graph {
+   size_t num;
+   // The edges are kept in a hash set (linear probing, 0 is an empty slot),
+   // which is replaced by a triangular bit matrix, once it would be bigger than that.
+   uint64_t* edges;
+   size_t edges_size;
+   size_t num_edges;
+   uint64_t* matrix;
+   ir_reg_t** adj;
+   size_t* degree;
+   ir_reg_t* alias;     // coalesced nodes
+   unsigned* allowed;   // mask of allowed registers
+   double* cost;
+};
+
+static size_t popcount(unsigned x) {
+   size_t n = 0;
+   for (; x; x &= x - 1)
+      ++n;
+   return n;
+}
+
+// the key of the edge between a and b, it is never 0, because a != b
+static uint64_t edge_key(ir_reg_t a, ir_reg_t b) {
+   return a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+}
+static size_t hash_edge(uint64_t key) {
+   return (size_t)(key * 0x9E3779B97F4A7C15ull >> 32);
+}
+
+// the bit of the edge in the matrix
+static size_t matrix_bit(uint64_t key) {
+   const size_t a = (size_t)(key >> 32);
+   const size_t b = (size_t)(key & 0xffffffff);
+   return b * (b - 1) / 2 + a;
+}
+static size_t matrix_words(size_t num) {
+   return (num * (num - 1) / 2 + 63) / 64 + 1;
+}
+
+static bool interferes(const struct graph* g, ir_reg_t a, ir_reg_t b) {
+   if (a == b)
+      return false;
+   const uint64_t key = edge_key(a, b);
+   if (g->matrix) {
+      const size_t i = matrix_bit(key);
+      return (g->matrix[i / 64] >> (i % 64)) & 1;
+   }
+   for (size_t i = hash_edge(key) & (g->edges_size - 1); g->edges[i]; i = (i + 1) & (g->edges_size - 1)) {
+      if (g->edges[i] == key)
+         return true;
+   }
+   return false;
+}
+
+static void edges_insert(struct graph* g, uint64_t key) {
+   if (g->matrix) {
+      const size_t i = matrix_bit(key);
+      g->matrix[i / 64] |= (uint64_t)1 << (i % 64);
+      return;
+   }
+   size_t i = hash_edge(key) & (g->edges_size - 1);
+   while (g->edges[i])
+      i = (i + 1) & (g->edges_size - 1);
+   g->edges[i] = key;
+}
+
+// the hash set is kept at most half full
+static void grow_edges(struct graph* g) {
+   uint64_t* old = g->edges;
+   const size_t old_size = g->edges_size;
+   if (2 * old_size >= matrix_words(g->num)) {
+      g->matrix = calloc(matrix_words(g->num), sizeof(uint64_t));
+      g->edges = NULL;
+      g->edges_size = 0;
+      if (!g->matrix)
+         panic("failed to allocate the interference graph");
+   } else {
+      g->edges_size *= 2;
+      g->edges = calloc(g->edges_size, sizeof(uint64_t));
+      if (!g->edges)
+         panic("failed to allocate the interference graph");
+   }
+   for (size_t i = 0; i < old_size; ++i) {
+      if (old[i])
+         edges_insert(g, old[i]);
+   }
+   free(old);
+}
+
+static void add_edge(struct graph* g, ir_reg_t a, ir_reg_t b) {
+   if (a == b || interferes(g, a, b))
+      return;
+   if (!g->matrix && 2 * (g->num_edges + 1) > g->edges_size)
+      grow_edges(g);
+   edges_insert(g, edge_key(a, b));
+   ++g->num_edges;
+   buf_push(g->adj[a], b);
+   buf_push(g->adj[b], a);
+   ++g->degree[a];
+   ++g->degree[b];
+}
+
+static ir_reg_t get_alias(const struct graph* g, ir_reg_t r) {
+   while (g->alias[r] != r)
+      r = g->alias[r];
+   return r;
+}
+
+static bool is_move(const struct ra_insn* insn) {
+   return !(insn->flags & RA_ARG) && insn->node->type == IR_MOVE;
+}
+
+// loop-depth of each block, approximated by the backward edges
+static size_t* loop_depths(const struct ra_func* ra) {
+   const size_t nb = buf_len(ra->blocks);
+   size_t* depth = calloc(nb + 1, sizeof(size_t));
+   if (!depth)
+      panic("failed to allocate loop-depths");
+   for (size_t i = 0; i < nb; ++i) {
+      const struct ra_block* b = &ra->blocks[i];
+      for (size_t j = 0; j < buf_len(b->succ); ++j) {
+         if (b->succ[j] > i)
+            continue;
+         for (size_t k = b->succ[j]; k <= i; ++k)
+            ++depth[k];
+      }
+   }
+   return depth;
+}
+
+static void build_graph(struct graph* g, const struct ra_func* ra) {
+   const size_t nv = ra->num_vregs;
+   g->num = nv;
+   g->edges_size = 256;
+   g->num_edges = 0;
+   g->edges = calloc(g->edges_size, sizeof(uint64_t));
+   g->matrix = NULL;
+   g->adj = calloc(nv + 1, sizeof(ir_reg_t*));
+   g->degree = calloc(nv + 1, sizeof(size_t));
+   g->alias = malloc((nv + 1) * sizeof(ir_reg_t));
+   g->allowed = malloc((nv + 1) * sizeof(unsigned));
+   g->cost = calloc(nv + 1, sizeof(double));
+   if (!g->edges || !g->adj || !g->degree || !g->alias || !g->allowed || !g->cost)
+      panic("failed to allocate the interference graph");
+
+   for (size_t i = 0; i < nv; ++i) {
+      const struct ra_interval* it = &ra->intervals[i];
+      g->alias[i] = i;
+      g->allowed[i] = it->crosses & RA_CALL ? CALLEE_SAVED_REGS : ALL_REGS;
+      if (!it->spillable)
+         g->cost[i] = INF_COST;
+   }
+
+   size_t* depth = loop_depths(ra);
+   uint64_t* live = calloc((nv + 63) / 64 + 1, sizeof(uint64_t));
+   if (!live)
+      panic("failed to allocate the interference graph");
+   for (size_t i = 0; i < buf_len(ra->blocks); ++i) {
+      const struct ra_block* b = &ra->blocks[i];
+      double weight = 1.0;
+      for (size_t d = 0; d < my_min(depth[i], 8); ++d)
+         weight *= 10.0;
+
+      memcpy(live, b->live_out, ((nv + 63) / 64 + 1) * sizeof(uint64_t));
+      for (size_t j = b->end; j != b->begin; --j) {
+         const struct ra_insn* insn = &ra->insns[j - 1];
+         const bool move = is_move(insn);
+         for (size_t k = 0; k < insn->num_ops; ++k) {
+            const struct ir_operand* op = &insn->ops[k];
+            const ir_reg_t r = *op->reg;
+            g->cost[r] += weight;
+            if (!op->is_def)
+               continue;
+            for (size_t l = 0; l < nv; ++l) {
+               if (!live[l / 64]) {
+                  l |= 63;
+                  continue;
+               }
+               // the source of a move does not interfere with its destination
+               if (ra_bit_test(live, l) && (!move || l != insn->node->move.src))
+                  add_edge(g, r, l);
+            }
+         }
+         for (size_t k = 0; k < insn->num_ops; ++k) {
+            const struct ir_operand* op = &insn->ops[k];
+            if (op->is_def && !op->is_use)
+               live[*op->reg / 64] &= ~((uint64_t)1 << (*op->reg % 64));
+         }
+         for (size_t k = 0; k < insn->num_ops; ++k) {
+            const struct ir_operand* op = &insn->ops[k];
+            if (op->is_use)
+               live[*op->reg / 64] |= (uint64_t)1 << (*op->reg % 64);
+         }
+      }
+   }
+   free(live);
+   free(depth);
+}
+
+static void free_graph(struct graph* g) {
+   for (size_t i = 0; i < g->num; ++i)
+      buf_free(g->adj[i]);
+   free(g->edges);
+   free(g->matrix);
+   free(g->adj);
+   free(g->degree);
+   free(g->alias);
+   free(g->allowed);
+   free(g->cost);
+}
+
+// Briggs' test: the merged node has less than K neighbors of significant degree
+static bool can_coalesce(const struct graph* g, ir_reg_t a, ir_reg_t b) {
+   const unsigned allowed = g->allowed[a] & g->allowed[b];
+   const size_t k = popcount(allowed);
+   if (!k)
+      return false;
+   size_t num = 0;
+   for (size_t i = 0; i < 2; ++i) {
+      const ir_reg_t n = i ? b : a;
+      for (size_t j = 0; j < buf_len(g->adj[n]); ++j) {
+         const ir_reg_t t = g->adj[n][j];
+         if (g->alias[t] != t)
+            continue;
+         // count common neighbors once
+         if (i && interferes(g, a, t))
+            continue;
+         if (g->degree[t] >= k)
+            ++num;
+      }
+   }
+   return num < k;
+}
+
+static void coalesce(struct graph* g, const struct ra_func* ra) {
+   for (size_t i = 0; i < buf_len(ra->insns); ++i) {
+      const struct ra_insn* insn = &ra->insns[i];
+      if (!is_move(insn))
+         continue;
+      ir_reg_t a = get_alias(g, insn->node->move.dest);
+      ir_reg_t b = get_alias(g, insn->node->move.src);
+      if (a == b || interferes(g, a, b) || !can_coalesce(g, a, b))
+         continue;
+
+      // merge b into a, the smaller adjacency list is copied,
+      // so that a chain of moves doesn't copy the growing list of the merged node again and again
+      if (buf_len(g->adj[b]) > buf_len(g->adj[a])) {
+         const ir_reg_t tmp = a;
+         a = b;
+         b = tmp;
+      }
+      g->alias[b] = a;
+      g->allowed[a] &= g->allowed[b];
+      g->cost[a] += g->cost[b];
+      for (size_t j = 0; j < buf_len(g->adj[b]); ++j) {
+         const ir_reg_t t = g->adj[b][j];
+         if (g->alias[t] != t)
+            continue;
+         add_edge(g, a, t);
+         --g->degree[t];
+      }
+   }
+}
+
+// returns the registers to spill
+static ir_reg_t* color(struct graph* g, struct ra_func* ra) {
+   const size_t nv = g->num;
+   size_t* degree = malloc((nv + 1) * sizeof(size_t));
+   bool* removed = calloc(nv + 1, sizeof(bool));
+   if (!degree || !removed)
+      panic("failed to allocate registers");
+   ir_reg_t* stack = NULL;
+   ir_reg_t* spills = NULL;
+   ir_reg_t* low = NULL;      // the nodes, that are trivially colorable
+   ir_reg_t* high = NULL;     // the other nodes, some of them may be removed already
+   size_t left = 0;
+
+   for (size_t i = 0; i < nv; ++i) {
+      degree[i] = g->degree[i];
+      ra->intervals[i].reg = IRR_NONSENSE;
+      if (g->alias[i] != i || ra->intervals[i].begin == SIZE_MAX) {
+         removed[i] = true;
+         continue;
+      }
+      ++left;
+      if (degree[i] < popcount(g->allowed[i]))
+         buf_push(low, i);
+      else buf_push(high, i);
+   }
+
+   // simplify
+   while (left) {
+      ir_reg_t node = IRR_NONSENSE;
+      if (buf_len(low)) {
+         node = buf_pop(low);
+      } else {
+         // optimistically push a spill candidate,
+         // all nodes, that are left, are in `high`
+         double best = 0.0;
+         size_t num = 0;
+         for (size_t i = 0; i < buf_len(high); ++i) {
+            const ir_reg_t t = high[i];
+            if (removed[t])
+               continue;
+            high[num++] = t;
+            const double c = g->cost[t] / (double)(degree[t] + 1);
+            if (node == IRR_NONSENSE || c < best) {
+               node = t;
+               best = c;
+            }
+         }
+         buf__hdr(high)->len = num;
+      }
+      removed[node] = true;
+      --left;
+      buf_push(stack, node);
+      for (size_t j = 0; j < buf_len(g->adj[node]); ++j) {
+         const ir_reg_t t = g->adj[node][j];
+         if (removed[t])
+            continue;
+         // t becomes trivially colorable
+         if (degree[t]-- == popcount(g->allowed[t]))
+            buf_push(low, t);
+      }
+   }
+
+   // select
+   while (buf_len(stack)) {
+      const ir_reg_t node = buf_pop(stack);
+      unsigned used = 0;
+      for (size_t j = 0; j < buf_len(g->adj[node]); ++j) {
+         const ir_reg_t t = g->adj[node][j];
+         if (g->alias[t] == t && ra->intervals[t].reg != IRR_NONSENSE)
+            used |= 1u << ra->intervals[t].reg;
+      }
+      const unsigned avail = g->allowed[node] & ~used;
+      if (!avail) {
+         if (g->cost[node] >= INF_COST)
+            panic("failed to allocate a register for R%u", (unsigned)node);
+         for (size_t i = 0; i < nv; ++i) {
+            if (get_alias(g, i) == node && ra->intervals[i].begin != SIZE_MAX)
+               buf_push(spills, i);
+         }
+         continue;
+      }
+      // caller-saved registers come first
+      ir_reg_t r = 0;
+      while (!(avail & (1u << r)))
+         ++r;
+      ra->intervals[node].reg = r;
+   }
+
+   for (size_t i = 0; i < nv; ++i) {
+      if (g->alias[i] != i)
+         ra->intervals[i].reg = ra->intervals[get_alias(g, i)].reg;
+   }
+
+   buf_free(stack);
+   buf_free(low);
+   buf_free(high);
+   free(degree);
+   free(removed);
+   return spills;
+}
+
+unsigned color_regs(ir_node_t* prologue) {
+   struct ra_func ra;
+   ra_init(&ra, prologue->func, prologue);
+   if (optim_level >= 1) {
+      ra_analyze(&ra, true);
+      ra_mem2reg(&ra);
+   }
+
+   bool split = true;
+   while (1) {
+      struct graph g;
+      ra_analyze(&ra, split);
+      split = false;
+
+      build_graph(&g, &ra);
+      coalesce(&g, &ra);
+      ir_reg_t* spills = color(&g, &ra);
+      free_graph(&g);
+
+      if (!spills)
+         break;
+      for (size_t i = 0; i < buf_len(spills); ++i)
+         ra_spill(&ra, spills[i]);
+      buf_free(spills);
+   }
+
+   unsigned used = 0;
+   for (size_t i = 0; i < ra.num_vregs; ++i) {
+      if (ra.intervals[i].reg != IRR_NONSENSE)
+         used |= 1u << ra.intervals[i].reg;
+   }
+   ra_assign(&ra);
+   ra_free(&ra);
+   return used & CALLEE_SAVED_REGS;
+}
@@ -36,7 +36,10 @@ typedef int64_t intreg_t;
 #define REG_TMP "t6"
 
 
-extern const char* regs[14];
+// a0-a7 and t0-t5 are caller-saved, s1-s11 are callee-saved
+#define NUM_REGS 25
+#define REGI_CALLEE_SAVED 14
+extern const char* regs[NUM_REGS];
 
 #define reg(r) ((const char*)((r) < arraylen(regs) ? regs[r] : (panic("register out of range"), NULL)))
 
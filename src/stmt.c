@@ -18,6 +18,7 @@
 #include "target.h"
 #include "error.h"
 #include "parser.h"
+#include "arena.h"
 #include "optim.h"
 #include "lex.h"
 
@@ -78,7 +79,6 @@ void free_stmt(struct statement* s) {
       break;
    default: break;
    }
-   free(s);
 }
 
 void print_stmt(FILE* file, const struct statement* s) {
@@ -187,9 +187,7 @@ void print_stmt(FILE* file, const struct statement* s) {
 }
 
 struct statement* new_stmt(void) {
-   struct statement* stmt = malloc(sizeof(struct statement));
-   if (!stmt) panic("failed to allocate statement");
-   else return stmt;
+   return arena_alloc(&ast_arena, sizeof(struct statement));
 }
 
 struct statement* parse_stmt(struct scope* scope) {
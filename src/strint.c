@@ -13,50 +13,117 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "strint.h"
-#include "buf.h"
+
+// Open-addressing hash table (linear probing) with stored hashes,
+// the strings are stored in chunks, that are never freed.
+
+#define STRING_CHUNK_SIZE (64 * 1024)
+#define MIN_TABLE_SIZE 1024
 
 struct entry {
-	char* str;
-	size_t len;
+   const char* str;        // NULL, if the slot is empty
+   size_t len;
+   uint64_t hash;
+};
+
+struct chunk {
+   struct chunk* next;
+   size_t size, used;
+   char data[];
 };
 
-static struct entry* table[1024] = { NULL };
+static struct entry* table = NULL;
+static size_t table_size = 0;    // always a power of 2
+static size_t num_strings = 0;
+static struct chunk* chunks = NULL;
+static size_t chunk_bytes = 0;
+
+// FNV-1a, stops at the end of `s` or after `*len` characters,
+// `*len` is set to the length of the hashed string
+static uint64_t do_hash(const char* s, size_t* len) {
+   uint64_t hash = UINT64_C(14695981039346656037);
+   size_t i;
+   for (i = 0; i < *len && s[i]; ++i) {
+      hash ^= (unsigned char)s[i];
+      hash *= UINT64_C(1099511628211);
+   }
+   *len = i;
+   return hash;
+}
 
-// source: (djb2) https://www.cse.yorku.ca/~oz/hash.html
-static size_t do_hash(const char* s, size_t len) {
-   size_t hash = 5381;
-   for (size_t i = 0; i < len; ++i) {
-      hash += (hash * 33) + s[i];
+static char* alloc_string(const char* s, size_t len) {
+   if (!chunks || chunks->size - chunks->used <= len) {
+      const size_t size = len >= STRING_CHUNK_SIZE ? len + 1 : STRING_CHUNK_SIZE;
+      struct chunk* c = malloc(sizeof(struct chunk) + size);
+      assert(c != NULL);
+      c->size = size;
+      c->used = 0;
+      c->next = chunks;
+      chunks = c;
+      chunk_bytes += sizeof(struct chunk) + size;
    }
-   return hash % arraylen(table);
+   char* str = chunks->data + chunks->used;
+   memcpy(str, s, len);
+   str[len] = '\0';
+   chunks->used += len + 1;
+   return str;
+}
+
+static void grow_table(void) {
+   const size_t new_size = table_size ? table_size * 2 : MIN_TABLE_SIZE;
+   struct entry* new_table = calloc(new_size, sizeof(struct entry));
+   assert(new_table != NULL);
+   for (size_t i = 0; i < table_size; ++i) {
+      const struct entry* e = &table[i];
+      if (!e->str)
+         continue;
+      size_t j = e->hash & (new_size - 1);
+      while (new_table[j].str)
+         j = (j + 1) & (new_size - 1);
+      new_table[j] = *e;
+   }
+   free(table);
+   table = new_table;
+   table_size = new_size;
 }
 
 static istr_t do_strint(const char* str, size_t len) {
-   const size_t hash = do_hash(str, len);
-   struct entry* line = table[hash];
-   for (size_t i = 0; i < buf_len(line); ++i) {
-      if (len == line[i].len && !memcmp(str, line[i].str, len))
-         return line[i].str;
+   const uint64_t hash = do_hash(str, &len);
+
+   // keep the load factor below 1/2
+   if (2 * (num_strings + 1) > table_size)
+      grow_table();
+
+   size_t i = hash & (table_size - 1);
+   while (table[i].str) {
+      const struct entry* e = &table[i];
+      if (e->hash == hash && e->len == len && !memcmp(e->str, str, len))
+         return e->str;
+      i = (i + 1) & (table_size - 1);
    }
-   char* new_str = malloc(len + 1);
-   assert(new_str != NULL);
-   memcpy(new_str, str, len);
-   new_str[len] = '\0';
-   struct entry e;
-   e.str = new_str;
-   e.len = len;
-   buf_push(line, e);
-   table[hash] = line;
-   return new_str;
+   struct entry* e = &table[i];
+   e->str = alloc_string(str, len);
+   e->len = len;
+   e->hash = hash;
+   ++num_strings;
+   return e->str;
 }
 
 istr_t strint(const char* s) {
-   return do_strint(s, strlen(s));
+   return do_strint(s, SIZE_MAX);
 }
 istr_t strnint(const char* s, size_t len) {
-   return do_strint(s, strnlen(s, len));
+   return do_strint(s, len);
+}
+
+void strint_stats(struct strint_stats* stats) {
+   stats->num_strings = num_strings;
+   stats->table_size = table_size;
+   stats->memory = table_size * sizeof(struct entry) + chunk_bytes;
 }
@@ -0,0 +1,271 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include "cmdline.h"
+#include "error.h"
+#include "timer.h"
+#include "buf.h"
+
+static const char* phase_names[NUM_TIME_PHASES] = {
+   [TP_PREPROCESS]   = "preprocess",
+   [TP_PARSE]        = "parse",
+   [TP_IRGEN]        = "irgen",
+   [TP_OPTIM]        = "optim",
+   [TP_EMIT]         = "emit",
+   [TP_ASSEMBLE]     = "assemble",
+   [TP_LINK]         = "link",
+};
+
+struct sample {
+   double wall, cpu, children;
+   long rss, children_rss;    // KiB
+};
+
+struct phase_stats {
+   double wall, cpu;
+   long rss;
+};
+
+// the irgen, optim and emit time of a function
+struct func_stats {
+   const struct function* func;
+   istr_t name;
+   const char* file;
+   double time[NUM_TIME_PHASES];
+};
+
+struct frame {
+   enum time_phase phase;
+   size_t func;               // index into `funcs` or SIZE_MAX
+};
+
+static bool enabled = false;
+static struct phase_stats phases[NUM_TIME_PHASES];
+static struct func_stats* funcs = NULL;
+static struct frame* stack = NULL;
+static struct sample last;    // when the time was last charged to the innermost phase
+static struct sample first;
+
+static double get_clock(clockid_t id) {
+   struct timespec ts;
+   clock_gettime(id, &ts);
+   return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+static double tv2sec(struct timeval tv) {
+   return (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+}
+
+static void take_sample(struct sample* s) {
+   struct rusage self, children;
+   getrusage(RUSAGE_SELF, &self);
+   getrusage(RUSAGE_CHILDREN, &children);
+   s->wall = get_clock(CLOCK_MONOTONIC);
+   s->cpu = get_clock(CLOCK_PROCESS_CPUTIME_ID);
+   s->children = tv2sec(children.ru_utime) + tv2sec(children.ru_stime);
+   s->rss = self.ru_maxrss;
+   s->children_rss = children.ru_maxrss;
+}
+
+// charges the time since the last sample to the innermost phase
+static void charge(void) {
+   struct sample now;
+   take_sample(&now);
+   if (buf_len(stack)) {
+      const struct frame* f = &buf_last(stack);
+      struct phase_stats* p = &phases[f->phase];
+      const double wall = now.wall - last.wall;
+      p->wall += wall;
+      p->cpu += (now.cpu - last.cpu) + (now.children - last.children);
+      // the high-water mark of the process so far, not of this phase alone
+      if (now.rss > p->rss)
+         p->rss = now.rss;
+      // a child process exited during this phase
+      if (now.children != last.children && now.children_rss > p->rss)
+         p->rss = now.children_rss;
+      if (f->func != SIZE_MAX)
+         funcs[f->func].time[f->phase] += wall;
+   }
+   last = now;
+}
+
+void time_report_init(void) {
+   enabled = get_flag_opt("time-report")->bVal || get_flag_opt("time-report-json")->sVal;
+   if (enabled) {
+      take_sample(&first);
+      last = first;
+   }
+}
+
+// returns the index of the statistics of `func`
+static size_t find_func(enum time_phase phase, const struct function* func) {
+   // a function is generated once, then optimized and later emitted,
+   // in the order of their code generation
+   static size_t hint = 0;
+   if (phase != TP_IRGEN) {
+      for (size_t i = hint; i < buf_len(funcs) && i <= hint + 1; ++i) {
+         if (funcs[i].func == func && funcs[i].name == func->name)
+            return hint = i;
+      }
+      for (size_t i = buf_len(funcs); i != 0; --i) {
+         if (funcs[i - 1].func == func && funcs[i - 1].name == func->name)
+            return hint = i - 1;
+      }
+   }
+   struct func_stats fs;
+   memset(&fs, 0, sizeof(fs));
+   fs.func = func;
+   fs.name = func->name;
+   fs.file = func->begin.file;
+   buf_push(funcs, fs);
+   return hint = buf_len(funcs) - 1;
+}
+
+void time_push(enum time_phase phase, const struct function* func) {
+   if (!enabled)
+      return;
+   charge();
+   struct frame f = { phase, func ? find_func(phase, func) : SIZE_MAX };
+   buf_push(stack, f);
+}
+
+void time_pop(void) {
+   if (!enabled)
+      return;
+   if (!buf_len(stack))
+      panic("no phase to end");
+   charge();
+   buf_pop(stack);
+}
+
+
+/// reporting
+
+static double func_total(const struct func_stats* fs) {
+   return fs->time[TP_IRGEN] + fs->time[TP_OPTIM] + fs->time[TP_EMIT];
+}
+static int cmp_func(const void* a, const void* b) {
+   const double x = func_total(a);
+   const double y = func_total(b);
+   return (x < y) - (x > y);
+}
+
+// the -ftime-report-funcs slowest functions
+static size_t num_top_funcs(void) {
+   const int32_t n = get_flag_opt("time-report-funcs")->iVal;
+   if (n <= 0)
+      return 0;
+   if (funcs)
+      qsort(funcs, buf_len(funcs), sizeof(struct func_stats), cmp_func);
+   return (size_t)n < buf_len(funcs) ? (size_t)n : buf_len(funcs);
+}
+
+static void print_text(FILE* file, const struct phase_stats* total, size_t num_funcs) {
+   fputs("Time report:\n", file);
+   fprintf(file, "  %-12s %10s %10s %14s\n", "phase", "wall (s)", "CPU (s)", "max RSS (KiB)");
+   for (size_t i = 0; i < NUM_TIME_PHASES; ++i) {
+      const struct phase_stats* p = &phases[i];
+      fprintf(file, "  %-12s %10.4f %10.4f %14ld\n", phase_names[i], p->wall, p->cpu, p->rss);
+   }
+   fprintf(file, "  %-12s %10.4f %10.4f %14ld\n", "total", total->wall, total->cpu, total->rss);
+   if (!num_funcs)
+      return;
+   fputs("Slowest functions:\n", file);
+   fprintf(file, "  %-24s %10s %10s %10s %10s\n", "function", "total (s)", "irgen (s)", "optim (s)", "emit (s)");
+   for (size_t i = 0; i < num_funcs; ++i) {
+      const struct func_stats* fs = &funcs[i];
+      fprintf(file, "  %-24s %10.4f %10.4f %10.4f %10.4f\n", fs->name, func_total(fs),
+            fs->time[TP_IRGEN], fs->time[TP_OPTIM], fs->time[TP_EMIT]);
+   }
+}
+
+static void print_json_str(FILE* file, const char* s) {
+   fputc('"', file);
+   for (; *s; ++s) {
+      if (*s == '"' || *s == '\\') {
+         fprintf(file, "\\%c", *s);
+      } else if ((unsigned char)*s < 0x20) {
+         fprintf(file, "\\u%04x", (unsigned char)*s);
+      } else {
+         fputc(*s, file);
+      }
+   }
+   fputc('"', file);
+}
+
+static void print_json(FILE* file, const struct phase_stats* total, size_t num_funcs) {
+   fputs("{\n  \"phases\": [\n", file);
+   for (size_t i = 0; i < NUM_TIME_PHASES; ++i) {
+      const struct phase_stats* p = &phases[i];
+      fprintf(file, "    {\"name\": \"%s\", \"wall\": %.6f, \"cpu\": %.6f, \"peak_rss_kib\": %ld}%s\n",
+            phase_names[i], p->wall, p->cpu, p->rss, i + 1 < NUM_TIME_PHASES ? "," : "");
+   }
+   fprintf(file, "  ],\n  \"total\": {\"wall\": %.6f, \"cpu\": %.6f, \"peak_rss_kib\": %ld},\n",
+         total->wall, total->cpu, total->rss);
+   fputs("  \"functions\": [\n", file);
+   for (size_t i = 0; i < num_funcs; ++i) {
+      const struct func_stats* fs = &funcs[i];
+      fputs("    {\"name\": ", file);
+      print_json_str(file, fs->name);
+      fputs(", \"file\": ", file);
+      print_json_str(file, fs->file ? fs->file : "");
+      fprintf(file, ", \"total\": %.6f, \"irgen\": %.6f, \"optim\": %.6f, \"emit\": %.6f}%s\n",
+            func_total(fs), fs->time[TP_IRGEN], fs->time[TP_OPTIM], fs->time[TP_EMIT],
+            i + 1 < num_funcs ? "," : "");
+   }
+   fputs("  ]\n}\n", file);
+}
+
+bool time_report_finish(void) {
+   if (!enabled)
+      return true;
+   struct sample now;
+   take_sample(&now);
+   struct phase_stats total;
+   total.wall = now.wall - first.wall;
+   total.cpu = (now.cpu - first.cpu) + (now.children - first.children);
+   total.rss = now.rss > now.children_rss ? now.rss : now.children_rss;
+   const size_t num_funcs = num_top_funcs();
+
+   if (get_flag_opt("time-report")->bVal)
+      print_text(stderr, &total, num_funcs);
+
+   bool success = true;
+   const char* json = get_flag_opt("time-report-json")->sVal;
+   if (json) {
+      FILE* file = !strcmp(json, "-") ? stdout : fopen(json, "w");
+      if (!file) {
+         fprintf(stderr, "bcc: failed to open '%s': %s\n", json, strerror(errno));
+         return false;
+      }
+      print_json(file, &total, num_funcs);
+      if (file == stdout) {
+         fflush(file);
+      } else if (fclose(file) != 0) {
+         fprintf(stderr, "bcc: failed to write '%s'\n", json);
+         success = false;
+      }
+   }
+   buf_free(funcs);
+   buf_free(stack);
+   return success;
+}
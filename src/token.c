@@ -14,8 +14,10 @@
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <stdbool.h>
+#include <string.h>
 #include "strint.h"
 #include "token.h"
+#include "error.h"
 
 const char* token_type_str[NUM_TOKENS] = {
    [TK_DUMMY]     = "dummy",
@@ -117,15 +119,33 @@ const char* token_type_str[NUM_TOKENS] = {
    [KW_GOTO]      = "goto",
 };
 
+// perfect hash of the keywords, token_init() checks for collisions
+#define KW_HASH(s, len) (((len) + 9 * (unsigned char)(s)[0] + 6 * (unsigned char)(s)[(len) - 1]) % 128)
+
+// TK_DUMMY, if there is no keyword with that hash
+static enum token_type keywords[128];
+
 void token_init(void) {
    static bool initialized = false;
    if (initialized) return;
    initialized = true;
    for (int i = TK_EOF + 1; i < NUM_TOKENS; ++i) {
-      token_type_str[i] = strint(token_type_str[i]);
+      const char* s = token_type_str[i];
+      const size_t h = KW_HASH(s, strlen(s));
+      if (keywords[h] != TK_DUMMY)
+         panic("keywords '%s' and '%s' have the same hash", s, token_type_str[keywords[h]]);
+      keywords[h] = i;
+      token_type_str[i] = strint(s);
    }
 }
 
+enum token_type token_keyword(const char* s, size_t len) {
+   const enum token_type kw = keywords[KW_HASH(s, len)];
+   if (kw != TK_DUMMY && !strncmp(token_type_str[kw], s, len) && !token_type_str[kw][len])
+      return kw;
+   return TK_NAME;
+}
+
 void print_token(FILE* file, const struct token* tk) {
    switch (tk->type) {
    case TK_INTEGER:     fprintf(file, "%ju", tk->iVal); break;
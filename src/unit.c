@@ -14,12 +14,17 @@
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <stdlib.h>
+#include <string.h>
+#include "cmdline.h"
 #include "parser.h"
+#include "arena.h"
 #include "optim.h"
+#include "timer.h"
 #include "lex.h"
 #include "ir.h"
 
 struct cunit cunit = { NULL};
+struct arena ast_arena = { NULL };
 
 void unit_add_enum(const struct value_type* type) {
    if (type->venum->name && type->venum->is_definition) {
@@ -54,8 +59,8 @@ void unit_add_union(const struct value_type* type) {
    }
 }
 
+// cunit may already contain the declarations of a precompiled header (see pch.h)
 void parse_unit(bool gen_ir) {
-   buf_free(cunit.funcs);
    while (!lexer_match(TK_EOF)) {
       if (lexer_matches(KW_TYPEDEF)) {
          struct typerename alias;
@@ -163,8 +168,19 @@ void parse_unit(bool gen_ir) {
             if (func->attrs & ATTR_EXTERN)
                parse_warn(&begin, "function definition shall not be extern");
             if (gen_ir) {
-               func->ir_code = optim_ir_nodes(irgen_func(func));
+               const bool opt_stats = get_flag_opt("opt-stats")->bVal;
+               if (opt_stats)
+                  optim_begin_func();
+               time_push(TP_IRGEN, func);
+               ir_node_t* ir = irgen_func(func);
+               time_pop();
+               const size_t num_nodes = opt_stats ? optim_count_nodes(ir) : 0;
+               time_push(TP_OPTIM, func);
+               func->ir_code = optim_ir_nodes(ir);
+               time_pop();
                func->max_reg = ir_max_reg(func->ir_code);
+               if (opt_stats)
+                  optim_print_func_stats(stderr, func, num_nodes);
             }
          }
       } else {
@@ -278,6 +294,14 @@ struct function* unit_get_func(istr_t name) {
    } \
    buf_free(structs)
 void free_unit(void) {
+   // -fno-free: the tables of the unit are left to the OS, because bcc exits soon,
+   // but the arena is still released, so that several units don't pile up their trees
+   if (!get_flag_opt("free")->bVal) {
+      memset(&cunit, 0, sizeof(cunit));
+      arena_free(&ast_arena);
+      return;
+   }
+
    // free functions
    for (size_t i = 0; i < buf_len(cunit.funcs); ++i) {
       free_func(cunit.funcs[i]);
@@ -307,6 +331,9 @@ void free_unit(void) {
    // free structs & unions
    free_structs(cunit.structs);
    free_structs(cunit.unions);
+
+   // free expressions, statements and types
+   arena_free(&ast_arena);
 }
 size_t unit_get_var_idx(istr_t name) {
    for (size_t i = 0; i < buf_len(cunit.vars); ++i) {
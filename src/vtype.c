@@ -16,6 +16,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include "target.h"
+#include "arena.h"
 #include "scope.h"
 #include "value.h"
 #include "error.h"
@@ -192,13 +193,10 @@ void free_value_type(struct value_type* val) {
    case NUM_VALS:
       break;
    }
-   free(val);
 }
 
 static struct value_type* new_vt(void) {
-   struct value_type* vt = calloc(1, sizeof(struct value_type));
-   if (!vt) panic("failed to allocate value type");
-   else return vt;
+   return arena_alloc(&ast_arena, sizeof(struct value_type));
 }
 
 struct value_type* make_int(enum integer_size sz, bool is_unsigned) {
@@ -431,7 +429,6 @@ struct value_type* parse_value_type(struct scope* scope) {
    }
    if (vt->type == NUM_VALS) {
       // no error handling
-      free(vt);
       return NULL;
    }
    if (!has_begon) {
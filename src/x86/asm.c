@@ -0,0 +1,1825 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <stdarg.h>
+#include <strings.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <elf.h>
+#include "error.h"
+#include "asm.h"
+#include "buf.h"
+
+// The assembly is parsed into a list of items, then the sizes of the branches
+// are determined (see layout()), then the items are written to the sections.
+//
+// The encodings and relocations are the same, that the GNU assembler chooses:
+// - the shortest form of every instruction (eg. imm8, disp8, the accumulator forms)
+// - branches are short, if the target is in range and in the same section
+// - calls of global or undefined functions get an R_X86_64_PLT32 relocation
+// - absolute addresses get an R_X86_64_32S relocation,
+//   local symbols are relocated against their section symbol
+
+#define SYM_NONE  SIZE_MAX
+#define SYM_DOT   (SIZE_MAX - 1)  // the current location `.`
+
+char ias_error[256];
+
+// `value` + `sym` - `neg`
+struct expr {
+   uint64_t value;
+   size_t sym;
+   size_t neg;
+};
+
+enum fixup_kind {
+   FIX_NONE,
+   FIX_ABS32,           // R_X86_64_32
+   FIX_ABS32S,          // R_X86_64_32S
+   FIX_ABS64,           // R_X86_64_64
+   FIX_CALL,            // rel32 of a call
+};
+
+struct fixup {
+   enum fixup_kind kind;
+   size_t pos;          // position of the field in the item
+   struct expr expr;
+};
+
+enum item_kind {
+   ITEM_BYTES,
+   ITEM_ZERO,
+   ITEM_BRANCH,
+   ITEM_LABEL,
+   ITEM_ALIGN,
+   ITEM_SIZE,
+};
+
+struct item {
+   enum item_kind kind;
+   enum ias_section section;
+   unsigned line;
+   uint64_t offset;     // see layout()
+   union {
+      struct {
+         size_t begin, len;   // range in `bytes`
+         struct fixup fix;
+      } bytes;
+      uint64_t zero;
+      struct {
+         int cc;              // -1 for jmp
+         bool is_long;
+         struct expr target;
+      } branch;
+      size_t label;
+      uint64_t align;
+      struct {
+         size_t sym;
+         struct expr expr;
+      } size;
+   };
+};
+
+enum operand_kind {
+   OP_REG,
+   OP_IMM,
+   OP_MEM,
+   OP_SYM,
+};
+
+struct operand {
+   enum operand_kind kind;
+   unsigned size;       // 0, if unknown
+   unsigned reg;
+   bool rex8;           // spl, bpl, sil and dil require a REX prefix
+   int base, index;     // -1, if none
+   unsigned scale;
+   struct expr disp;    // displacement, immediate or symbol
+};
+
+// an encoded instruction
+struct insn {
+   uint8_t buf[16];
+   size_t len;
+   struct fixup fix;
+};
+
+static const char* source_name;
+static unsigned cur_line;
+static enum ias_section cur_section;
+static struct ias_object obj;
+static struct item* items;
+static uint8_t* bytes;
+static bool has_comment;
+
+// hash table of the symbols, 0 is an empty slot
+static size_t* sym_table;
+static size_t sym_table_size;
+
+static bool fail(const char* fmt, ...) PRINTF_FMT_WARN(1, 2);
+static bool fail(const char* fmt, ...) {
+   va_list ap;
+   va_start(ap, fmt);
+   int n = snprintf(ias_error, sizeof(ias_error), "%s:%u: ", source_name, cur_line);
+   if (n < 0 || (size_t)n >= sizeof(ias_error))
+      n = 0;
+   vsnprintf(ias_error + n, sizeof(ias_error) - n, fmt, ap);
+   va_end(ap);
+   return false;
+}
+
+// symbols
+
+static size_t hash_ptr(istr_t s) {
+   return (size_t)(((uintptr_t)s >> 3) * 0x9E3779B97F4A7C15ull);
+}
+
+static void sym_table_insert(size_t idx) {
+   size_t i = hash_ptr(obj.symbols[idx].name) & (sym_table_size - 1);
+   while (sym_table[i])
+      i = (i + 1) & (sym_table_size - 1);
+   sym_table[i] = idx + 1;
+}
+
+static size_t get_symbol(istr_t name) {
+   if (sym_table_size) {
+      size_t i = hash_ptr(name) & (sym_table_size - 1);
+      for (; sym_table[i]; i = (i + 1) & (sym_table_size - 1)) {
+         if (obj.symbols[sym_table[i] - 1].name == name)
+            return sym_table[i] - 1;
+      }
+   }
+   if (2 * (buf_len(obj.symbols) + 1) > sym_table_size) {
+      free(sym_table);
+      sym_table_size = sym_table_size ? 2 * sym_table_size : 256;
+      sym_table = calloc(sym_table_size, sizeof(size_t));
+      if (!sym_table)
+         panic("failed to allocate the symbol table");
+      for (size_t i = 0; i < buf_len(obj.symbols); ++i)
+         sym_table_insert(i);
+   }
+   const struct ias_symbol sym = {
+      .name = name,
+      .section = -1,
+      .type = STT_NOTYPE,
+      .bind = STB_LOCAL,
+      .temp = !strncmp(name, ".L", 2),
+   };
+   buf_push(obj.symbols, sym);
+   sym_table_insert(buf_len(obj.symbols) - 1);
+   return buf_len(obj.symbols) - 1;
+}
+
+// lexing
+
+struct span {
+   const char* begin;
+   size_t len;
+};
+
+static const char* skip_ws(const char* p) {
+   while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\f' || *p == '\v')
+      ++p;
+   return p;
+}
+
+static bool is_ident_start(char ch) {
+   return isalpha((unsigned char)ch) || ch == '_' || ch == '.' || ch == '$';
+}
+static bool is_ident_char(char ch) {
+   return isalnum((unsigned char)ch) || ch == '_' || ch == '.' || ch == '$';
+}
+
+static bool peek_ident(const char* p, struct span* id) {
+   if (!is_ident_start(*p))
+      return false;
+   id->begin = p;
+   while (is_ident_char(*p))
+      ++p;
+   id->len = (size_t)(p - id->begin);
+   return true;
+}
+
+// case-insensitive comparison for mnemonics, registers and keywords
+static bool span_is(struct span id, const char* s) {
+   return strlen(s) == id.len && !strncasecmp(id.begin, s, id.len);
+}
+
+static bool expect_end(const char* p) {
+   p = skip_ws(p);
+   return *p ? fail("junk at the end of the line: '%s'", p) : true;
+}
+
+static bool parse_number(const char** pp, uint64_t* value) {
+   const char* p = *pp;
+   int base = 10;
+   if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+      base = 16;
+      p += 2;
+   } else if (p[0] == '0' && (p[1] == 'b' || p[1] == 'B')) {
+      base = 2;
+      p += 2;
+   } else if (p[0] == '0') {
+      base = 8;
+   }
+   char* end;
+   *value = strtoull(p, &end, base);
+   if (end == p || is_ident_char(*end))
+      return fail("invalid number");
+   *pp = end;
+   return true;
+}
+
+// registers
+
+static const char* const reg_names[4][16] = {
+   { "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+     "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b" },
+   { "ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+     "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w" },
+   { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+     "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d" },
+   { "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+     "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" },
+};
+
+// registers, that cannot be encoded
+static const char* const bad_regs[] = { "ah", "ch", "dh", "bh", "rip", "eip" };
+
+// returns 0, if `id` is not a register, otherwise the size of the register
+static unsigned lookup_reg(struct span id, unsigned* num) {
+   if (id.len < 2 || id.len > 4)
+      return 0;
+   for (unsigned s = 0; s < 4; ++s) {
+      for (unsigned i = 0; i < 16; ++i) {
+         if (span_is(id, reg_names[s][i])) {
+            *num = i;
+            return 1u << s;
+         }
+      }
+   }
+   return 0;
+}
+
+static bool is_bad_reg(struct span id) {
+   for (size_t i = 0; i < arraylen(bad_regs); ++i) {
+      if (span_is(id, bad_regs[i]))
+         return true;
+   }
+   return false;
+}
+
+// expressions
+
+static bool add_term(struct expr* e, int sign, size_t sym) {
+   size_t* dest = sign > 0 ? &e->sym : &e->neg;
+   if (*dest != SYM_NONE)
+      return fail("unsupported expression");
+   *dest = sym;
+   return true;
+}
+
+// expr := ['+'|'-'] term { ('+'|'-') term }
+// term := number | symbol | '.'
+static bool parse_expr(const char** pp, struct expr* e) {
+   const char* p = *pp;
+   bool first = true;
+   e->value = 0;
+   e->sym = e->neg = SYM_NONE;
+   while (1) {
+      p = skip_ws(p);
+      int sign = 1;
+      bool has_sign = false;
+      while (*p == '+' || *p == '-') {
+         if (*p == '-')
+            sign = -sign;
+         has_sign = true;
+         p = skip_ws(p + 1);
+      }
+      if (!first && !has_sign)
+         break;
+      first = false;
+
+      struct span id;
+      unsigned num;
+      if (isdigit((unsigned char)*p)) {
+         uint64_t v;
+         if (!parse_number(&p, &v))
+            return false;
+         e->value += sign > 0 ? v : -v;
+      } else if (peek_ident(p, &id)) {
+         if (lookup_reg(id, &num) || is_bad_reg(id))
+            return fail("unexpected register '%.*s'", (int)id.len, id.begin);
+         const size_t sym = id.len == 1 && *id.begin == '.' ? SYM_DOT : get_symbol(strnint(id.begin, id.len));
+         if (!add_term(e, sign, sym))
+            return false;
+         p += id.len;
+      } else {
+         return fail("expected an expression");
+      }
+   }
+   *pp = p;
+   return true;
+}
+
+static bool parse_const(const char** pp, uint64_t* value) {
+   struct expr e;
+   if (!parse_expr(pp, &e))
+      return false;
+   if (e.sym != SYM_NONE || e.neg != SYM_NONE)
+      return fail("expected a constant");
+   *value = e.value;
+   return true;
+}
+
+// operands
+
+static unsigned size_keyword(struct span id) {
+   if (span_is(id, "byte"))   return 1;
+   if (span_is(id, "word"))   return 2;
+   if (span_is(id, "dword"))  return 4;
+   if (span_is(id, "qword"))  return 8;
+   return 0;
+}
+
+// '[' term { ('+'|'-') term } ']'
+// term := reg ['*' scale] | number ['*' reg] | symbol
+static bool parse_mem(const char** pp, struct operand* op) {
+   const char* p = *pp + 1;
+   bool first = true;
+   op->kind = OP_MEM;
+   while (1) {
+      p = skip_ws(p);
+      if (*p == ']' && !first)
+         break;
+      int sign = 1;
+      bool has_sign = false;
+      while (*p == '+' || *p == '-') {
+         if (*p == '-')
+            sign = -sign;
+         has_sign = true;
+         p = skip_ws(p + 1);
+      }
+      if (!first && !has_sign)
+         return fail("expected ']'");
+      first = false;
+
+      struct span id;
+      unsigned reg, scale = 0;
+      bool is_reg = false;
+      if (isdigit((unsigned char)*p)) {
+         uint64_t v;
+         if (!parse_number(&p, &v))
+            return false;
+         const char* q = skip_ws(p);
+         if (*q == '*') {
+            q = skip_ws(q + 1);
+            if (!peek_ident(q, &id) || lookup_reg(id, &reg) != 8)
+               return fail("expected a register");
+            scale = (unsigned)v;
+            is_reg = true;
+            p = q + id.len;
+         } else {
+            op->disp.value += sign > 0 ? v : -v;
+         }
+      } else if (peek_ident(p, &id)) {
+         const unsigned size = lookup_reg(id, &reg);
+         p += id.len;
+         if (size) {
+            if (size != 8)
+               return fail("only 64-bit registers can be used for addressing");
+            const char* q = skip_ws(p);
+            if (*q == '*') {
+               q = skip_ws(q + 1);
+               uint64_t v;
+               if (!isdigit((unsigned char)*q) || !parse_number(&q, &v))
+                  return fail("expected a scale factor");
+               scale = (unsigned)v;
+               p = q;
+            }
+            is_reg = true;
+         } else if (is_bad_reg(id)) {
+            return fail("unsupported register '%.*s'", (int)id.len, id.begin);
+         } else {
+            if (sign < 0 || op->disp.sym != SYM_NONE)
+               return fail("unsupported memory operand");
+            if (id.len == 1 && *id.begin == '.')
+               return fail("unsupported memory operand");
+            op->disp.sym = get_symbol(strnint(id.begin, id.len));
+         }
+      } else {
+         return fail("expected an address");
+      }
+
+      if (is_reg) {
+         if (sign < 0)
+            return fail("registers cannot be subtracted");
+         if (scale) {
+            if (scale != 1 && scale != 2 && scale != 4 && scale != 8)
+               return fail("invalid scale factor %u", scale);
+            if (op->index >= 0)
+               return fail("too many registers");
+            op->index = (int)reg;
+            op->scale = scale;
+         } else if (op->base < 0) {
+            op->base = (int)reg;
+         } else if (op->index < 0) {
+            op->index = (int)reg;
+            op->scale = 1;
+         } else {
+            return fail("too many registers");
+         }
+      }
+   }
+
+   // rsp cannot be an index
+   if (op->index == 4) {
+      if (op->scale != 1 || op->base == 4)
+         return fail("rsp cannot be used as an index");
+      op->index = op->base;
+      op->base = 4;
+      if (op->index < 0)
+         op->scale = 0;
+   }
+   *pp = p + 1;
+   return true;
+}
+
+static bool parse_operand(const char** pp, struct operand* op) {
+   const char* p = skip_ws(*pp);
+   struct span id;
+   memset(op, 0, sizeof(*op));
+   op->base = op->index = -1;
+   op->disp.sym = op->disp.neg = SYM_NONE;
+
+   if (peek_ident(p, &id)) {
+      unsigned reg;
+      const unsigned size = lookup_reg(id, &reg);
+      if (size) {
+         op->kind = OP_REG;
+         op->size = size;
+         op->reg = reg;
+         op->rex8 = size == 1 && reg >= 4 && reg < 8;
+         *pp = p + id.len;
+         return true;
+      } else if (is_bad_reg(id)) {
+         return fail("unsupported register '%.*s'", (int)id.len, id.begin);
+      } else if ((op->size = size_keyword(id)) != 0) {
+         p = skip_ws(p + id.len);
+         if (!peek_ident(p, &id) || !span_is(id, "ptr"))
+            return fail("expected PTR");
+         p = skip_ws(p + id.len);
+         if (*p != '[')
+            return fail("unsupported memory operand");
+      }
+   }
+   if (*p == '[') {
+      if (!parse_mem(&p, op))
+         return false;
+      *pp = p;
+      return true;
+   }
+   if (!parse_expr(&p, &op->disp))
+      return false;
+   if (op->disp.neg != SYM_NONE || op->disp.sym == SYM_DOT)
+      return fail("unsupported expression");
+   op->kind = op->disp.sym == SYM_NONE ? OP_IMM : OP_SYM;
+   *pp = p;
+   return true;
+}
+
+// items
+
+static struct item* new_item(enum item_kind kind) {
+   const struct item it = {
+      .kind = kind,
+      .section = cur_section,
+      .line = cur_line,
+   };
+   buf_push(items, it);
+   return &buf_last(items);
+}
+
+static bool add_bytes(const uint8_t* data, size_t len, const struct fixup* fix) {
+   if (cur_section == IAS_BSS) {
+      if (fix && fix->kind != FIX_NONE)
+         return fail("relocations are not allowed in .bss");
+      for (size_t i = 0; i < len; ++i) {
+         if (data[i])
+            return fail("non-zero data in .bss");
+      }
+      new_item(ITEM_ZERO)->zero = len;
+      return true;
+   }
+   struct item* it = new_item(ITEM_BYTES);
+   it->bytes.begin = buf_len(bytes);
+   it->bytes.len = len;
+   if (fix)
+      it->bytes.fix = *fix;
+   buf__fit(bytes, buf_len(bytes) + len);
+   memcpy(bytes + buf_len(bytes), data, len);
+   buf__hdr(bytes)->len += len;
+   return true;
+}
+
+static bool define_label(struct span id) {
+   const size_t sym = get_symbol(strnint(id.begin, id.len));
+   struct ias_symbol* s = &obj.symbols[sym];
+   if (s->section >= 0)
+      return fail("symbol '%s' is already defined", s->name);
+   s->section = (int)cur_section;
+   new_item(ITEM_LABEL)->label = sym;
+   return true;
+}
+
+// instruction encoding
+
+static void put(struct insn* in, uint8_t b) {
+   in->buf[in->len++] = b;
+}
+static void put_le(struct insn* in, uint64_t v, unsigned n) {
+   for (unsigned i = 0; i < n; ++i)
+      put(in, (uint8_t)(v >> (8 * i)));
+}
+
+static bool fits8(int64_t v) {
+   return v >= -128 && v <= 127;
+}
+
+// size of the immediate of an operation of `size`
+static unsigned imm_size(unsigned size) {
+   return size == 8 ? 4 : size;
+}
+
+// checks and sign-extends an immediate for an operation of `size`
+static bool check_imm(const struct operand* op, unsigned size, int64_t* v) {
+   *v = (int64_t)op->disp.value;
+   switch (size) {
+   case 1:
+      if (*v < INT8_MIN || *v > UINT8_MAX)
+         break;
+      *v = (int8_t)*v;
+      return true;
+   case 2:
+      if (*v < INT16_MIN || *v > UINT16_MAX)
+         break;
+      *v = (int16_t)*v;
+      return true;
+   case 4:
+      if (*v < INT32_MIN || *v > UINT32_MAX)
+         break;
+      *v = (int32_t)*v;
+      return true;
+   case 8:
+      if (*v < INT32_MIN || *v > INT32_MAX)
+         break;
+      return true;
+   default:
+      return fail("invalid operand size");
+   }
+   return fail("immediate out of range");
+}
+
+// operand-size prefix and REX prefix (W = 8, R = 4, X = 2, B = 1)
+static void put_prefix(struct insn* in, unsigned size, unsigned rex, bool force_rex) {
+   if (size == 2)
+      put(in, 0x66);
+   if (size == 8)
+      rex |= 8;
+   if (rex || force_rex)
+      put(in, 0x40 | rex);
+}
+
+static void put_disp32(struct insn* in, const struct expr* disp) {
+   if (disp->sym != SYM_NONE) {
+      in->fix.kind = FIX_ABS32S;
+      in->fix.pos = in->len;
+      in->fix.expr = *disp;
+      put_le(in, 0, 4);
+   } else {
+      put_le(in, disp->value, 4);
+   }
+}
+
+static unsigned scale_bits(unsigned scale) {
+   switch (scale) {
+   case 2:  return 1;
+   case 4:  return 2;
+   case 8:  return 3;
+   default: return 0;
+   }
+}
+
+// appends the prefixes, the `opcode` and the ModRM, SIB and displacement bytes
+static bool put_modrm(struct insn* in, unsigned size, const uint8_t* opcode, size_t n, unsigned reg, bool reg_rex8, const struct operand* rm) {
+   unsigned rex = reg & 8 ? 4 : 0;
+   bool force_rex = reg_rex8;
+   if (rm->kind == OP_REG) {
+      rex |= rm->reg & 8 ? 1 : 0;
+      force_rex |= rm->rex8;
+   } else {
+      rex |= rm->base >= 0 && (rm->base & 8) ? 1 : 0;
+      rex |= rm->index >= 0 && (rm->index & 8) ? 2 : 0;
+   }
+   put_prefix(in, size, rex, force_rex);
+   for (size_t i = 0; i < n; ++i)
+      put(in, opcode[i]);
+
+   const unsigned r3 = (reg & 7) << 3;
+   if (rm->kind == OP_REG) {
+      put(in, 0xc0 | r3 | (rm->reg & 7));
+      return true;
+   }
+
+   const struct expr* disp = &rm->disp;
+   const int64_t d = (int64_t)disp->value;
+   const bool has_sym = disp->sym != SYM_NONE;
+   if (!has_sym && (d < INT32_MIN || d > INT32_MAX))
+      return fail("displacement out of range");
+   const unsigned sib_index = ((rm->index < 0 ? 4 : rm->index) & 7) << 3;
+   const unsigned ss = scale_bits(rm->scale) << 6;
+
+   if (rm->base < 0) {
+      // absolute address
+      put(in, 0x04 | r3);
+      put(in, ss | sib_index | 5);
+      put_disp32(in, disp);
+      return true;
+   }
+
+   unsigned mod;
+   if (has_sym) {
+      mod = 2;
+   } else if (d == 0 && (rm->base & 7) != 5) {
+      mod = 0;
+   } else if (fits8(d)) {
+      mod = 1;
+   } else {
+      mod = 2;
+   }
+   if (rm->index < 0 && (rm->base & 7) != 4) {
+      put(in, mod << 6 | r3 | (rm->base & 7));
+   } else {
+      put(in, mod << 6 | r3 | 4);
+      put(in, ss | sib_index | (rm->base & 7));
+   }
+   if (mod == 1) {
+      put(in, (uint8_t)d);
+   } else if (mod == 2) {
+      put_disp32(in, disp);
+   }
+   return true;
+}
+
+static bool put_modrm1(struct insn* in, unsigned size, uint8_t opcode, unsigned reg, bool reg_rex8, const struct operand* rm) {
+   return put_modrm(in, size, &opcode, 1, reg, reg_rex8, rm);
+}
+
+static bool is_rm(const struct operand* op) {
+   return op->kind == OP_REG || op->kind == OP_MEM;
+}
+
+// the size of `rm`, memory operands without a size take `size`
+static bool match_size(const struct operand* rm, unsigned size) {
+   if (rm->size && rm->size != size)
+      return fail("operand size mismatch");
+   return true;
+}
+
+static bool need_size(const struct operand* rm) {
+   return rm->size ? true : fail("missing operand size");
+}
+
+static bool bad_operands(void) {
+   return fail("invalid operands");
+}
+
+// add, or, adc, sbb, and, sub, xor, cmp
+static bool enc_alu(struct insn* in, unsigned ext, const struct operand* ops, size_t nops) {
+   if (nops != 2)
+      return bad_operands();
+   const struct operand* d = &ops[0];
+   const struct operand* s = &ops[1];
+   if (is_rm(d) && s->kind == OP_REG) {
+      if (!match_size(d, s->size))
+         return false;
+      return put_modrm1(in, s->size, ext * 8 + (s->size == 1 ? 0 : 1), s->reg, s->rex8, d);
+   } else if (d->kind == OP_REG && s->kind == OP_MEM) {
+      if (!match_size(s, d->size))
+         return false;
+      return put_modrm1(in, d->size, ext * 8 + (d->size == 1 ? 2 : 3), d->reg, d->rex8, s);
+   } else if (is_rm(d) && s->kind == OP_IMM) {
+      int64_t v;
+      if (!need_size(d) || !check_imm(s, d->size, &v))
+         return false;
+      const bool acc = d->kind == OP_REG && d->reg == 0;
+      if (d->size == 1) {
+         if (acc) {
+            put(in, ext * 8 + 4);
+         } else if (!put_modrm1(in, 1, 0x80, ext, false, d)) {
+            return false;
+         }
+         put(in, (uint8_t)v);
+      } else if (fits8(v)) {
+         if (!put_modrm1(in, d->size, 0x83, ext, false, d))
+            return false;
+         put(in, (uint8_t)v);
+      } else {
+         if (acc) {
+            put_prefix(in, d->size, 0, false);
+            put(in, ext * 8 + 5);
+         } else if (!put_modrm1(in, d->size, 0x81, ext, false, d)) {
+            return false;
+         }
+         put_le(in, v, imm_size(d->size));
+      }
+      return true;
+   }
+   return bad_operands();
+}
+
+static bool enc_test(struct insn* in, const struct operand* ops, size_t nops) {
+   if (nops != 2)
+      return bad_operands();
+   const struct operand* d = &ops[0];
+   const struct operand* s = &ops[1];
+   if (is_rm(d) && s->kind == OP_REG) {
+      if (!match_size(d, s->size))
+         return false;
+      return put_modrm1(in, s->size, s->size == 1 ? 0x84 : 0x85, s->reg, s->rex8, d);
+   } else if (d->kind == OP_REG && s->kind == OP_MEM) {
+      if (!match_size(s, d->size))
+         return false;
+      return put_modrm1(in, d->size, d->size == 1 ? 0x84 : 0x85, d->reg, d->rex8, s);
+   } else if (is_rm(d) && s->kind == OP_IMM) {
+      int64_t v;
+      if (!need_size(d) || !check_imm(s, d->size, &v))
+         return false;
+      if (d->kind == OP_REG && d->reg == 0) {
+         put_prefix(in, d->size, 0, false);
+         put(in, d->size == 1 ? 0xa8 : 0xa9);
+      } else if (!put_modrm1(in, d->size, d->size == 1 ? 0xf6 : 0xf7, 0, false, d)) {
+         return false;
+      }
+      put_le(in, v, imm_size(d->size));
+      return true;
+   }
+   return bad_operands();
+}
+
+static bool enc_mov(struct insn* in, const struct operand* ops, size_t nops) {
+   if (nops != 2)
+      return bad_operands();
+   const struct operand* d = &ops[0];
+   const struct operand* s = &ops[1];
+   if (is_rm(d) && s->kind == OP_REG) {
+      if (!match_size(d, s->size))
+         return false;
+      return put_modrm1(in, s->size, s->size == 1 ? 0x88 : 0x89, s->reg, s->rex8, d);
+   } else if (d->kind == OP_REG && s->kind == OP_MEM) {
+      if (!match_size(s, d->size))
+         return false;
+      return put_modrm1(in, d->size, d->size == 1 ? 0x8a : 0x8b, d->reg, d->rex8, s);
+   } else if (d->kind == OP_REG && s->kind == OP_IMM) {
+      int64_t v = (int64_t)s->disp.value;
+      if (d->size == 8 && (v < INT32_MIN || v > INT32_MAX)) {
+         // movabs
+         put_prefix(in, 8, d->reg & 8 ? 1 : 0, false);
+         put(in, 0xb8 + (d->reg & 7));
+         put_le(in, v, 8);
+         return true;
+      }
+      if (!check_imm(s, d->size, &v))
+         return false;
+      if (d->size == 8) {
+         if (!put_modrm1(in, 8, 0xc7, 0, false, d))
+            return false;
+         put_le(in, v, 4);
+      } else {
+         put_prefix(in, d->size, d->reg & 8 ? 1 : 0, d->rex8);
+         put(in, (d->size == 1 ? 0xb0 : 0xb8) + (d->reg & 7));
+         put_le(in, v, d->size);
+      }
+      return true;
+   } else if (d->kind == OP_MEM && s->kind == OP_IMM) {
+      int64_t v;
+      if (!need_size(d) || !check_imm(s, d->size, &v))
+         return false;
+      if (!put_modrm1(in, d->size, d->size == 1 ? 0xc6 : 0xc7, 0, false, d))
+         return false;
+      put_le(in, v, imm_size(d->size));
+      return true;
+   }
+   return bad_operands();
+}
+
+// movsx, movzx and movsxd
+static bool enc_movx(struct insn* in, bool sx, bool sxd, const struct operand* ops, size_t nops) {
+   if (nops != 2 || ops[0].kind != OP_REG || !is_rm(&ops[1]))
+      return bad_operands();
+   const struct operand* d = &ops[0];
+   const struct operand* s = &ops[1];
+   const unsigned ss = s->size ? s->size : (sxd ? 4 : 0);
+   if (!ss)
+      return fail("missing operand size");
+   if (ss == 4) {
+      if (!sx || d->size != 8)
+         return bad_operands();
+      return put_modrm1(in, 8, 0x63, d->reg, false, s);
+   }
+   if (sxd || ss >= d->size)
+      return bad_operands();
+   const uint8_t opcode[] = { 0x0f, (sx ? 0xbe : 0xb6) + (ss == 2) };
+   return put_modrm(in, d->size, opcode, 2, d->reg, false, s);
+}
+
+// not, neg, mul, imul, div, idiv, inc and dec with one operand
+static bool enc_unary(struct insn* in, uint8_t opcode, unsigned ext, const struct operand* ops, size_t nops) {
+   if (nops != 1 || !is_rm(&ops[0]))
+      return bad_operands();
+   if (!need_size(&ops[0]))
+      return false;
+   return put_modrm1(in, ops[0].size, opcode - (ops[0].size == 1), ext, false, &ops[0]);
+}
+
+static bool enc_shift(struct insn* in, unsigned ext, const struct operand* ops, size_t nops) {
+   if (nops != 2 || !is_rm(&ops[0]))
+      return bad_operands();
+   const struct operand* d = &ops[0];
+   const struct operand* s = &ops[1];
+   if (!need_size(d))
+      return false;
+   const unsigned b = d->size == 1 ? 0 : 1;
+   if (s->kind == OP_REG && s->size == 1 && s->reg == 1) {
+      return put_modrm1(in, d->size, 0xd2 + b, ext, false, d);
+   } else if (s->kind == OP_IMM) {
+      if (s->disp.value > 255)
+         return fail("shift count out of range");
+      if (s->disp.value == 1)
+         return put_modrm1(in, d->size, 0xd0 + b, ext, false, d);
+      if (!put_modrm1(in, d->size, 0xc0 + b, ext, false, d))
+         return false;
+      put(in, (uint8_t)s->disp.value);
+      return true;
+   }
+   return bad_operands();
+}
+
+static bool enc_imul(struct insn* in, const struct operand* ops, size_t nops) {
+   if (nops == 1)
+      return enc_unary(in, 0xf7, 5, ops, nops);
+   // imul reg, imm is imul reg, reg, imm
+   const struct operand* d = &ops[0];
+   const struct operand* s = &ops[1];
+   const struct operand* imm = NULL;
+   if (nops == 3) {
+      imm = &ops[2];
+   } else if (nops == 2 && s->kind == OP_IMM) {
+      imm = s;
+      s = d;
+   }
+   if (nops > 3 || d->kind != OP_REG || d->size == 1 || !is_rm(s) || (imm && imm->kind != OP_IMM))
+      return bad_operands();
+   if (!match_size(s, d->size))
+      return false;
+   if (!imm) {
+      const uint8_t opcode[] = { 0x0f, 0xaf };
+      return put_modrm(in, d->size, opcode, 2, d->reg, false, s);
+   }
+   int64_t v;
+   if (!check_imm(imm, d->size, &v))
+      return false;
+   if (fits8(v)) {
+      if (!put_modrm1(in, d->size, 0x6b, d->reg, false, s))
+         return false;
+      put(in, (uint8_t)v);
+   } else {
+      if (!put_modrm1(in, d->size, 0x69, d->reg, false, s))
+         return false;
+      put_le(in, v, imm_size(d->size));
+   }
+   return true;
+}
+
+static bool enc_push_pop(struct insn* in, bool push, const struct operand* ops, size_t nops) {
+   if (nops != 1)
+      return bad_operands();
+   const struct operand* op = &ops[0];
+   if (op->kind == OP_REG) {
+      if (op->size != 8 && op->size != 2)
+         return bad_operands();
+      put_prefix(in, op->size == 2 ? 2 : 0, op->reg & 8 ? 1 : 0, false);
+      put(in, (push ? 0x50 : 0x58) + (op->reg & 7));
+      return true;
+   } else if (op->kind == OP_MEM) {
+      if (!match_size(op, 8))
+         return false;
+      return put_modrm1(in, 0, push ? 0xff : 0x8f, push ? 6 : 0, false, op);
+   } else if (op->kind == OP_IMM && push) {
+      int64_t v;
+      if (!check_imm(op, 8, &v))
+         return false;
+      if (fits8(v)) {
+         put(in, 0x6a);
+         put(in, (uint8_t)v);
+      } else {
+         put(in, 0x68);
+         put_le(in, v, 4);
+      }
+      return true;
+   }
+   return bad_operands();
+}
+
+// indirect call or jmp
+static bool enc_indirect(struct insn* in, unsigned ext, const struct operand* ops, size_t nops) {
+   if (nops != 1 || !is_rm(&ops[0]) || !match_size(&ops[0], 8))
+      return bad_operands();
+   return put_modrm1(in, 0, 0xff, ext, false, &ops[0]);
+}
+
+enum insn_class {
+   IC_FIXED,
+   IC_ALU,
+   IC_TEST,
+   IC_MOV,
+   IC_MOVSX,
+   IC_MOVZX,
+   IC_MOVSXD,
+   IC_LEA,
+   IC_UNARY,
+   IC_INCDEC,
+   IC_SHIFT,
+   IC_IMUL,
+   IC_PUSH,
+   IC_POP,
+   IC_CALL,
+   IC_JMP,
+   IC_JCC,
+   IC_SETCC,
+   IC_CMOVCC,
+};
+
+struct mnemonic {
+   const char* name;
+   enum insn_class ic;
+   unsigned char ext;      // opcode extension in ModRM.reg
+   unsigned char len;      // IC_FIXED: length of code
+   uint8_t code[2];
+};
+
+static const struct mnemonic mnemonics[] = {
+   { "add",     IC_ALU,     0, 0, { 0 }         },
+   { "or",      IC_ALU,     1, 0, { 0 }         },
+   { "adc",     IC_ALU,     2, 0, { 0 }         },
+   { "sbb",     IC_ALU,     3, 0, { 0 }         },
+   { "and",     IC_ALU,     4, 0, { 0 }         },
+   { "sub",     IC_ALU,     5, 0, { 0 }         },
+   { "xor",     IC_ALU,     6, 0, { 0 }         },
+   { "cmp",     IC_ALU,     7, 0, { 0 }         },
+   { "test",    IC_TEST,    0, 0, { 0 }         },
+   { "mov",     IC_MOV,     0, 0, { 0 }         },
+   { "movsx",   IC_MOVSX,   0, 0, { 0 }         },
+   { "movzx",   IC_MOVZX,   0, 0, { 0 }         },
+   { "movsxd",  IC_MOVSXD,  0, 0, { 0 }         },
+   { "lea",     IC_LEA,     0, 0, { 0 }         },
+   { "not",     IC_UNARY,   2, 0, { 0 }         },
+   { "neg",     IC_UNARY,   3, 0, { 0 }         },
+   { "mul",     IC_UNARY,   4, 0, { 0 }         },
+   { "div",     IC_UNARY,   6, 0, { 0 }         },
+   { "idiv",    IC_UNARY,   7, 0, { 0 }         },
+   { "inc",     IC_INCDEC,  0, 0, { 0 }         },
+   { "dec",     IC_INCDEC,  1, 0, { 0 }         },
+   { "rol",     IC_SHIFT,   0, 0, { 0 }         },
+   { "ror",     IC_SHIFT,   1, 0, { 0 }         },
+   { "rcl",     IC_SHIFT,   2, 0, { 0 }         },
+   { "rcr",     IC_SHIFT,   3, 0, { 0 }         },
+   { "shl",     IC_SHIFT,   4, 0, { 0 }         },
+   { "sal",     IC_SHIFT,   4, 0, { 0 }         },
+   { "shr",     IC_SHIFT,   5, 0, { 0 }         },
+   { "sar",     IC_SHIFT,   7, 0, { 0 }         },
+   { "imul",    IC_IMUL,    0, 0, { 0 }         },
+   { "push",    IC_PUSH,    0, 0, { 0 }         },
+   { "pop",     IC_POP,     0, 0, { 0 }         },
+   { "call",    IC_CALL,    0, 0, { 0 }         },
+   { "jmp",     IC_JMP,     0, 0, { 0 }         },
+   { "ret",     IC_FIXED,   0, 1, { 0xc3 }      },
+   { "leave",   IC_FIXED,   0, 1, { 0xc9 }      },
+   { "nop",     IC_FIXED,   0, 1, { 0x90 }      },
+   { "hlt",     IC_FIXED,   0, 1, { 0xf4 }      },
+   { "int3",    IC_FIXED,   0, 1, { 0xcc }      },
+   { "cwde",    IC_FIXED,   0, 1, { 0x98 }      },
+   { "cdq",     IC_FIXED,   0, 1, { 0x99 }      },
+   { "cbw",     IC_FIXED,   0, 2, { 0x66, 0x98 } },
+   { "cwd",     IC_FIXED,   0, 2, { 0x66, 0x99 } },
+   { "cdqe",    IC_FIXED,   0, 2, { 0x48, 0x98 } },
+   { "cqo",     IC_FIXED,   0, 2, { 0x48, 0x99 } },
+   { "ud2",     IC_FIXED,   0, 2, { 0x0f, 0x0b } },
+   { "syscall", IC_FIXED,   0, 2, { 0x0f, 0x05 } },
+};
+
+static const struct {
+   const char* name;
+   unsigned char cc;
+} conditions[] = {
+   { "o",  0 }, { "no",  1 }, { "b",  2 }, { "c",   2 }, { "nae", 2 }, { "ae", 3 },
+   { "nb", 3 }, { "nc",  3 }, { "e",  4 }, { "z",   4 }, { "ne",  5 }, { "nz", 5 },
+   { "be", 6 }, { "na",  6 }, { "a",  7 }, { "nbe", 7 }, { "s",   8 }, { "ns", 9 },
+   { "p", 10 }, { "pe", 10 }, { "np",11 }, { "po", 11 }, { "l",  12 }, { "nge",12 },
+   { "ge",13 }, { "nl", 13 }, { "le",14 }, { "ng", 14 }, { "g",  15 }, { "nle",15 },
+};
+
+static bool lookup_cc(const char* suffix, unsigned* cc) {
+   for (size_t i = 0; i < arraylen(conditions); ++i) {
+      if (!strcmp(suffix, conditions[i].name)) {
+         *cc = conditions[i].cc;
+         return true;
+      }
+   }
+   return false;
+}
+
+// finds the mnemonic `name` (in lower-case), `cc` is set for jcc, setcc and cmovcc
+static const struct mnemonic* lookup_mnemonic(const char* name, unsigned* cc) {
+   static const struct mnemonic jcc = { "j", IC_JCC, 0, 0, { 0 } };
+   static const struct mnemonic setcc = { "set", IC_SETCC, 0, 0, { 0 } };
+   static const struct mnemonic cmovcc = { "cmov", IC_CMOVCC, 0, 0, { 0 } };
+   for (size_t i = 0; i < arraylen(mnemonics); ++i) {
+      if (!strcmp(name, mnemonics[i].name))
+         return &mnemonics[i];
+   }
+   if (name[0] == 'j' && lookup_cc(name + 1, cc))
+      return &jcc;
+   if (!strncmp(name, "set", 3) && lookup_cc(name + 3, cc))
+      return &setcc;
+   if (!strncmp(name, "cmov", 4) && lookup_cc(name + 4, cc))
+      return &cmovcc;
+   return NULL;
+}
+
+static bool parse_insn(struct span mn, const char* p) {
+   char name[16];
+   if (mn.len >= sizeof(name))
+      return fail("unknown instruction '%.*s'", (int)mn.len, mn.begin);
+   for (size_t i = 0; i < mn.len; ++i)
+      name[i] = (char)tolower((unsigned char)mn.begin[i]);
+   name[mn.len] = '\0';
+
+   unsigned cc = 0;
+   const struct mnemonic* m = lookup_mnemonic(name, &cc);
+   if (!m)
+      return fail("unknown instruction '%s'", name);
+
+   struct operand ops[3];
+   size_t nops = 0;
+   p = skip_ws(p);
+   while (*p) {
+      if (nops == arraylen(ops))
+         return fail("too many operands");
+      if (!parse_operand(&p, &ops[nops++]))
+         return false;
+      p = skip_ws(p);
+      if (*p == ',') {
+         p = skip_ws(p + 1);
+         if (!*p)
+            return fail("expected an operand");
+      } else if (*p) {
+         return fail("junk at the end of the line: '%s'", p);
+      }
+   }
+
+   if (cur_section == IAS_BSS)
+      return fail("instructions are not allowed in .bss");
+
+   if ((m->ic == IC_JMP || m->ic == IC_JCC) && nops == 1 && ops[0].kind == OP_SYM) {
+      struct item* it = new_item(ITEM_BRANCH);
+      it->branch.cc = m->ic == IC_JMP ? -1 : (int)cc;
+      it->branch.target = ops[0].disp;
+      return true;
+   }
+
+   struct insn in = { .len = 0 };
+   bool success;
+   switch (m->ic) {
+   case IC_FIXED:
+      if (nops != 0)
+         return bad_operands();
+      for (size_t i = 0; i < m->len; ++i)
+         put(&in, m->code[i]);
+      success = true;
+      break;
+   case IC_ALU:
+      success = enc_alu(&in, m->ext, ops, nops);
+      break;
+   case IC_TEST:
+      success = enc_test(&in, ops, nops);
+      break;
+   case IC_MOV:
+      success = enc_mov(&in, ops, nops);
+      break;
+   case IC_MOVSX:
+   case IC_MOVZX:
+   case IC_MOVSXD:
+      success = enc_movx(&in, m->ic != IC_MOVZX, m->ic == IC_MOVSXD, ops, nops);
+      break;
+   case IC_LEA:
+      if (nops != 2 || ops[0].kind != OP_REG || ops[0].size == 1 || ops[1].kind != OP_MEM)
+         return bad_operands();
+      success = put_modrm1(&in, ops[0].size, 0x8d, ops[0].reg, false, &ops[1]);
+      break;
+   case IC_UNARY:
+      success = enc_unary(&in, 0xf7, m->ext, ops, nops);
+      break;
+   case IC_INCDEC:
+      success = enc_unary(&in, 0xff, m->ext, ops, nops);
+      break;
+   case IC_SHIFT:
+      success = enc_shift(&in, m->ext, ops, nops);
+      break;
+   case IC_IMUL:
+      success = enc_imul(&in, ops, nops);
+      break;
+   case IC_PUSH:
+   case IC_POP:
+      success = enc_push_pop(&in, m->ic == IC_PUSH, ops, nops);
+      break;
+   case IC_CALL:
+      if (nops == 1 && ops[0].kind == OP_SYM) {
+         put(&in, 0xe8);
+         in.fix.kind = FIX_CALL;
+         in.fix.pos = in.len;
+         in.fix.expr = ops[0].disp;
+         put_le(&in, 0, 4);
+         success = true;
+      } else {
+         success = enc_indirect(&in, 2, ops, nops);
+      }
+      break;
+   case IC_JMP:
+      success = enc_indirect(&in, 4, ops, nops);
+      break;
+   case IC_JCC:
+      return bad_operands();
+   case IC_SETCC:
+   {
+      if (nops != 1 || !is_rm(&ops[0]) || !match_size(&ops[0], 1))
+         return bad_operands();
+      const uint8_t opcode[] = { 0x0f, 0x90 + cc };
+      success = put_modrm(&in, 1, opcode, 2, 0, false, &ops[0]);
+      break;
+   }
+   case IC_CMOVCC:
+   {
+      if (nops != 2 || ops[0].kind != OP_REG || ops[0].size == 1 || !is_rm(&ops[1]) || !match_size(&ops[1], ops[0].size))
+         return bad_operands();
+      const uint8_t opcode[] = { 0x0f, 0x40 + cc };
+      success = put_modrm(&in, ops[0].size, opcode, 2, ops[0].reg, false, &ops[1]);
+      break;
+   }
+   default:
+      panic("unreachable reached");
+   }
+   return success && add_bytes(in.buf, in.len, &in.fix);
+}
+
+// directives
+
+static bool parse_string(const char** pp, uint8_t** str) {
+   const char* p = skip_ws(*pp);
+   if (*p != '"')
+      return fail("expected a string");
+   for (++p; *p != '"'; ++p) {
+      if (!*p)
+         return fail("unterminated string");
+      if (*p != '\\') {
+         buf_push(*str, (uint8_t)*p);
+         continue;
+      }
+      ++p;
+      unsigned ch = 0;
+      switch (*p) {
+      case 'b':   ch = '\b'; break;
+      case 'f':   ch = '\f'; break;
+      case 'n':   ch = '\n'; break;
+      case 'r':   ch = '\r'; break;
+      case 't':   ch = '\t'; break;
+      case 'x':
+         while (isxdigit((unsigned char)p[1])) {
+            ++p;
+            ch = ch * 16 + (isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10));
+         }
+         break;
+      case '\0':
+         return fail("unterminated string");
+      default:
+         if (*p >= '0' && *p <= '7') {
+            int i = 0;
+            for (; i < 3 && p[i] >= '0' && p[i] <= '7'; ++i)
+               ch = ch * 8 + (unsigned)(p[i] - '0');
+            p += i - 1;
+         } else {
+            ch = (unsigned char)*p;
+         }
+         break;
+      }
+      buf_push(*str, (uint8_t)ch);
+   }
+   *pp = p + 1;
+   return true;
+}
+
+static bool parse_name(const char** pp, size_t* sym) {
+   struct span id;
+   const char* p = skip_ws(*pp);
+   if (!peek_ident(p, &id))
+      return fail("expected a symbol");
+   *sym = get_symbol(strnint(id.begin, id.len));
+   *pp = p + id.len;
+   return true;
+}
+
+static bool expect_comma(const char** pp) {
+   const char* p = skip_ws(*pp);
+   if (*p != ',')
+      return fail("expected ','");
+   *pp = p + 1;
+   return true;
+}
+
+// .byte, .short, .long, .quad and friends
+static bool parse_data(const char* p, unsigned size) {
+   while (1) {
+      struct expr e;
+      if (!parse_expr(&p, &e))
+         return false;
+      struct fixup fix = { .kind = FIX_NONE };
+      uint8_t data[8] = { 0 };
+      if (e.neg != SYM_NONE || e.sym == SYM_DOT) {
+         return fail("unsupported expression");
+      } else if (e.sym != SYM_NONE) {
+         if (size < 4)
+            return fail("unsupported relocation");
+         fix.kind = size == 8 ? FIX_ABS64 : FIX_ABS32;
+         fix.pos = 0;
+         fix.expr = e;
+      } else {
+         for (unsigned i = 0; i < size; ++i)
+            data[i] = (uint8_t)(e.value >> (8 * i));
+      }
+      if (!add_bytes(data, size, &fix))
+         return false;
+      p = skip_ws(p);
+      if (*p != ',')
+         break;
+      ++p;
+   }
+   return expect_end(p);
+}
+
+static bool parse_strings(const char* p, bool nul) {
+   while (1) {
+      uint8_t* str = NULL;
+      if (!parse_string(&p, &str)) {
+         buf_free(str);
+         return false;
+      }
+      if (nul)
+         buf_push(str, 0);
+      const bool success = add_bytes(str, buf_len(str), NULL);
+      buf_free(str);
+      if (!success)
+         return false;
+      p = skip_ws(p);
+      if (*p != ',')
+         break;
+      ++p;
+   }
+   return expect_end(p);
+}
+
+static bool parse_zero(const char* p) {
+   uint64_t n = 0, fill = 0;
+   if (!parse_const(&p, &n))
+      return false;
+   p = skip_ws(p);
+   if (*p == ',' && (++p, !parse_const(&p, &fill)))
+      return false;
+   if (fill) {
+      uint8_t* data = malloc(n ? n : 1);
+      if (!data)
+         panic("failed to allocate memory");
+      memset(data, (int)fill, n);
+      const bool success = add_bytes(data, n, NULL);
+      free(data);
+      if (!success)
+         return false;
+   } else {
+      new_item(ITEM_ZERO)->zero = n;
+   }
+   return expect_end(p);
+}
+
+static bool parse_align(const char* p, bool p2) {
+   uint64_t n = 0;
+   if (!parse_const(&p, &n))
+      return false;
+   if (p2) {
+      if (n >= 32)
+         return fail("alignment too large");
+      n = (uint64_t)1 << n;
+   }
+   if (!n || (n & (n - 1)))
+      return fail("alignment is not a power of 2");
+   // code is padded with nop
+   new_item(ITEM_ALIGN)->align = n;
+   struct ias_sect* sect = &obj.sections[cur_section];
+   if (n > sect->align)
+      sect->align = n;
+   return expect_end(p);
+}
+
+static bool parse_section(const char* p) {
+   static const char* const names[] = {
+      [IAS_TEXT]     = ".text",
+      [IAS_DATA]     = ".data",
+      [IAS_BSS]      = ".bss",
+      [IAS_RODATA]   = ".rodata",
+   };
+   struct span id;
+   p = skip_ws(p);
+   if (!peek_ident(p, &id))
+      return fail("expected a section name");
+   for (size_t i = 0; i < arraylen(names); ++i) {
+      if (id.len == strlen(names[i]) && !memcmp(id.begin, names[i], id.len)) {
+         cur_section = (enum ias_section)i;
+         // the flags of the known sections are implied
+         p = skip_ws(p + id.len);
+         return *p == ',' || expect_end(p);
+      }
+   }
+   return fail("unsupported section '%.*s'", (int)id.len, id.begin);
+}
+
+static bool parse_bind(const char* p, unsigned char bind) {
+   while (1) {
+      size_t sym;
+      if (!parse_name(&p, &sym))
+         return false;
+      obj.symbols[sym].bind = bind;
+      p = skip_ws(p);
+      if (*p != ',')
+         break;
+      ++p;
+   }
+   return expect_end(p);
+}
+
+static bool parse_type(const char* p) {
+   size_t sym;
+   if (!parse_name(&p, &sym) || !expect_comma(&p))
+      return false;
+   p = skip_ws(p);
+   if (*p == '@' || *p == '%')
+      ++p;
+   struct span id;
+   if (!peek_ident(p, &id))
+      return fail("expected a symbol type");
+   struct ias_symbol* s = &obj.symbols[sym];
+   if (span_is(id, "function")) {
+      s->type = STT_FUNC;
+   } else if (span_is(id, "object")) {
+      s->type = STT_OBJECT;
+   } else if (span_is(id, "notype")) {
+      s->type = STT_NOTYPE;
+   } else {
+      return fail("unsupported symbol type '%.*s'", (int)id.len, id.begin);
+   }
+   return expect_end(p + id.len);
+}
+
+static bool parse_size(const char* p) {
+   size_t sym;
+   struct expr e;
+   if (!parse_name(&p, &sym) || !expect_comma(&p) || !parse_expr(&p, &e))
+      return false;
+   struct item* it = new_item(ITEM_SIZE);
+   it->size.sym = sym;
+   it->size.expr = e;
+   return expect_end(p);
+}
+
+static bool parse_ident(const char* p) {
+   uint8_t* str = NULL;
+   if (!parse_string(&p, &str)) {
+      buf_free(str);
+      return false;
+   }
+   buf_push(str, 0);
+   const enum ias_section old = cur_section;
+   cur_section = IAS_COMMENT;
+   // .comment starts with an empty string
+   bool success = true;
+   if (!has_comment) {
+      const uint8_t nul = 0;
+      success = add_bytes(&nul, 1, NULL);
+      has_comment = true;
+   }
+   success = success && add_bytes(str, buf_len(str), NULL);
+   cur_section = old;
+   buf_free(str);
+   return success && expect_end(p);
+}
+
+static const struct {
+   const char* name;
+   unsigned size;
+} data_directives[] = {
+   { ".byte",  1 },
+   { ".short", 2 },
+   { ".value", 2 },
+   { ".word",  2 },
+   { ".2byte", 2 },
+   { ".long",  4 },
+   { ".int",   4 },
+   { ".4byte", 4 },
+   { ".quad",  8 },
+   { ".8byte", 8 },
+};
+
+static bool parse_directive(struct span name, const char* p) {
+   struct span id;
+   p = skip_ws(p);
+   for (size_t i = 0; i < arraylen(data_directives); ++i) {
+      if (span_is(name, data_directives[i].name))
+         return parse_data(p, data_directives[i].size);
+   }
+   if (span_is(name, ".intel_syntax")) {
+      if (peek_ident(p, &id) && span_is(id, "noprefix"))
+         p += id.len;
+      return expect_end(p);
+   } else if (span_is(name, ".text")) {
+      cur_section = IAS_TEXT;
+      return expect_end(p);
+   } else if (span_is(name, ".data")) {
+      cur_section = IAS_DATA;
+      return expect_end(p);
+   } else if (span_is(name, ".bss")) {
+      cur_section = IAS_BSS;
+      return expect_end(p);
+   } else if (span_is(name, ".section")) {
+      return parse_section(p);
+   } else if (span_is(name, ".global") || span_is(name, ".globl")) {
+      return parse_bind(p, STB_GLOBAL);
+   } else if (span_is(name, ".weak")) {
+      return parse_bind(p, STB_WEAK);
+   } else if (span_is(name, ".local")) {
+      return parse_bind(p, STB_LOCAL);
+   } else if (span_is(name, ".type")) {
+      return parse_type(p);
+   } else if (span_is(name, ".size")) {
+      return parse_size(p);
+   } else if (span_is(name, ".string") || span_is(name, ".asciz")) {
+      return parse_strings(p, true);
+   } else if (span_is(name, ".ascii")) {
+      return parse_strings(p, false);
+   } else if (span_is(name, ".zero") || span_is(name, ".skip") || span_is(name, ".space")) {
+      return parse_zero(p);
+   } else if (span_is(name, ".balign") || span_is(name, ".align")) {
+      return parse_align(p, false);
+   } else if (span_is(name, ".p2align")) {
+      return parse_align(p, true);
+   } else if (span_is(name, ".ident")) {
+      return parse_ident(p);
+   } else if (span_is(name, ".file")) {
+      uint8_t* str = NULL;
+      const bool success = parse_string(&p, &str);
+      buf_free(str);
+      return success && expect_end(p);
+   }
+   return fail("unsupported directive '%.*s'", (int)name.len, name.begin);
+}
+
+static bool parse_statement(const char* p) {
+   struct span id;
+   p = skip_ws(p);
+   while (peek_ident(p, &id)) {
+      const char* q = skip_ws(p + id.len);
+      if (*q != ':')
+         break;
+      if (!define_label(id))
+         return false;
+      p = skip_ws(q + 1);
+   }
+   if (!*p)
+      return true;
+   if (!peek_ident(p, &id))
+      return fail("syntax error");
+   if (*id.begin == '.')
+      return parse_directive(id, p + id.len);
+   return parse_insn(id, p + id.len);
+}
+
+// splits the input into statements and removes the comments
+static bool parse_all(const char* data, size_t len) {
+   const char* end = data + len;
+   char* stmt = NULL;
+   bool success = true;
+   cur_line = 0;
+   for (const char* p = data; success && p < end; ) {
+      const char* nl = memchr(p, '\n', (size_t)(end - p));
+      if (!nl)
+         nl = end;
+      ++cur_line;
+
+      bool in_str = false;
+      if (stmt)
+         buf__hdr(stmt)->len = 0;
+      for (const char* q = p; q < nl; ++q) {
+         const char ch = *q;
+         if (in_str) {
+            if (ch == '\\' && q + 1 < nl) {
+               buf_push(stmt, ch);
+               ++q;
+            } else if (ch == '"') {
+               in_str = false;
+            }
+         } else if (ch == '"') {
+            in_str = true;
+         } else if (ch == '#') {
+            break;
+         } else if (ch == ';') {
+            buf_push(stmt, '\0');
+            if (!(success = parse_statement(stmt)))
+               break;
+            buf__hdr(stmt)->len = 0;
+            continue;
+         }
+         buf_push(stmt, *q);
+      }
+      buf_push(stmt, '\0');
+      success = success && parse_statement(stmt);
+      p = nl + 1;
+   }
+   buf_free(stmt);
+   return success;
+}
+
+// layout
+
+// can the PC-relative reference from `it` to `e` be resolved by the assembler?
+static bool is_resolvable(const struct item* it, const struct expr* e, bool call) {
+   const struct ias_symbol* s = &obj.symbols[e->sym];
+   if (s->section != (int)it->section)
+      return false;
+   return s->bind == STB_LOCAL || (!call && s->bind == STB_GLOBAL);
+}
+
+static uint64_t branch_size(const struct item* it) {
+   if (!it->branch.is_long)
+      return 2;
+   return it->branch.cc < 0 ? 5 : 6;
+}
+
+// computes the offsets of the items, branches start short and grow until all targets are in range
+static void layout(void) {
+   bool changed;
+   do {
+      uint64_t offsets[NUM_IAS_SECTIONS] = { 0 };
+      for (size_t i = 0; i < buf_len(items); ++i) {
+         struct item* it = &items[i];
+         uint64_t* off = &offsets[it->section];
+         it->offset = *off;
+         switch (it->kind) {
+         case ITEM_BYTES:
+            *off += it->bytes.len;
+            break;
+         case ITEM_ZERO:
+            *off += it->zero;
+            break;
+         case ITEM_BRANCH:
+            *off += branch_size(it);
+            break;
+         case ITEM_LABEL:
+            obj.symbols[it->label].value = *off;
+            break;
+         case ITEM_ALIGN:
+            *off = (*off + it->align - 1) & ~(it->align - 1);
+            break;
+         case ITEM_SIZE:
+            break;
+         }
+      }
+      for (size_t i = 0; i < NUM_IAS_SECTIONS; ++i)
+         obj.sections[i].size = offsets[i];
+
+      changed = false;
+      for (size_t i = 0; i < buf_len(items); ++i) {
+         struct item* it = &items[i];
+         if (it->kind != ITEM_BRANCH || it->branch.is_long)
+            continue;
+         const struct expr* e = &it->branch.target;
+         bool is_long = !is_resolvable(it, e, false);
+         if (!is_long) {
+            const int64_t disp = (int64_t)(obj.symbols[e->sym].value + e->value - (it->offset + 2));
+            is_long = !fits8(disp);
+         }
+         if (is_long) {
+            it->branch.is_long = true;
+            changed = true;
+         }
+      }
+   } while (changed);
+}
+
+// output
+
+static void add_reloc(enum ias_section section, uint64_t offset, unsigned type, const struct expr* e, int64_t bias) {
+   const struct ias_symbol* s = &obj.symbols[e->sym];
+   struct ias_reloc r = {
+      .offset = offset,
+      .type = type,
+   };
+   if (s->section >= 0 && s->bind == STB_LOCAL) {
+      r.section = s->section;
+      r.sym = SYM_NONE;
+      r.addend = (int64_t)(s->value + e->value) + bias;
+   } else {
+      r.section = -1;
+      r.sym = e->sym;
+      r.addend = (int64_t)e->value + bias;
+   }
+   buf_push(obj.sections[section].relocs, r);
+}
+
+static void write32(uint8_t* p, uint64_t v) {
+   for (int i = 0; i < 4; ++i)
+      p[i] = (uint8_t)(v >> (8 * i));
+}
+
+// the 32-bit PC-relative field at `pos` is the last part of the instruction
+static void pc_relative(const struct item* it, uint64_t pos, const struct expr* e, bool call) {
+   const struct ias_symbol* s = &obj.symbols[e->sym];
+   struct ias_sect* sect = &obj.sections[it->section];
+   if (is_resolvable(it, e, call)) {
+      write32(sect->data + pos, s->value + e->value - (pos + 4));
+   } else if (s->section >= 0 && s->bind == STB_LOCAL) {
+      add_reloc(it->section, pos, R_X86_64_PC32, e, -4);
+   } else {
+      add_reloc(it->section, pos, R_X86_64_PLT32, e, -4);
+   }
+}
+
+static bool eval_size(const struct item* it, uint64_t* value) {
+   const struct expr* e = &it->size.expr;
+   *value = e->value;
+   if (e->sym == SYM_NONE && e->neg == SYM_NONE)
+      return true;
+   if (e->sym == SYM_NONE || e->neg == SYM_NONE)
+      return fail("the size of '%s' is not a constant", obj.symbols[it->size.sym].name);
+   uint64_t v[2];
+   int sect[2];
+   const size_t syms[2] = { e->sym, e->neg };
+   for (int i = 0; i < 2; ++i) {
+      if (syms[i] == SYM_DOT) {
+         v[i] = it->offset;
+         sect[i] = (int)it->section;
+      } else {
+         v[i] = obj.symbols[syms[i]].value;
+         sect[i] = obj.symbols[syms[i]].section;
+      }
+   }
+   if (sect[0] < 0 || sect[0] != sect[1])
+      return fail("the size of '%s' is not a constant", obj.symbols[it->size.sym].name);
+   *value += v[0] - v[1];
+   return true;
+}
+
+static bool emit_items(void) {
+   for (size_t i = 0; i < buf_len(items); ++i) {
+      const struct item* it = &items[i];
+      struct ias_sect* sect = &obj.sections[it->section];
+      const bool has_data = it->section != IAS_BSS;
+      cur_line = it->line;
+      switch (it->kind) {
+      case ITEM_BYTES:
+      {
+         buf__fit(sect->data, buf_len(sect->data) + it->bytes.len);
+         memcpy(sect->data + buf_len(sect->data), bytes + it->bytes.begin, it->bytes.len);
+         buf__hdr(sect->data)->len += it->bytes.len;
+
+         const struct fixup* fix = &it->bytes.fix;
+         const uint64_t pos = it->offset + fix->pos;
+         switch (fix->kind) {
+         case FIX_NONE:
+            break;
+         case FIX_ABS32:
+            add_reloc(it->section, pos, R_X86_64_32, &fix->expr, 0);
+            break;
+         case FIX_ABS32S:
+            add_reloc(it->section, pos, R_X86_64_32S, &fix->expr, 0);
+            break;
+         case FIX_ABS64:
+            add_reloc(it->section, pos, R_X86_64_64, &fix->expr, 0);
+            break;
+         case FIX_CALL:
+            pc_relative(it, pos, &fix->expr, true);
+            break;
+         }
+         break;
+      }
+      case ITEM_ZERO:
+         if (has_data) {
+            for (uint64_t j = 0; j < it->zero; ++j)
+               buf_push(sect->data, 0);
+         }
+         break;
+      case ITEM_BRANCH:
+      {
+         const struct expr* e = &it->branch.target;
+         const int cc = it->branch.cc;
+         if (!it->branch.is_long) {
+            const struct ias_symbol* s = &obj.symbols[e->sym];
+            buf_push(sect->data, cc < 0 ? 0xeb : 0x70 + cc);
+            buf_push(sect->data, (uint8_t)(s->value + e->value - (it->offset + 2)));
+            break;
+         }
+         if (cc < 0) {
+            buf_push(sect->data, 0xe9);
+         } else {
+            buf_push(sect->data, 0x0f);
+            buf_push(sect->data, 0x80 + cc);
+         }
+         const uint64_t pos = buf_len(sect->data);
+         for (int j = 0; j < 4; ++j)
+            buf_push(sect->data, 0);
+         pc_relative(it, pos, e, false);
+         break;
+      }
+      case ITEM_LABEL:
+         break;
+      case ITEM_ALIGN:
+         if (has_data) {
+            const uint8_t fill = it->section == IAS_TEXT ? 0x90 : 0;
+            while (buf_len(sect->data) & (it->align - 1))
+               buf_push(sect->data, fill);
+         }
+         break;
+      case ITEM_SIZE:
+      {
+         uint64_t size;
+         if (!eval_size(it, &size))
+            return false;
+         obj.symbols[it->size.sym].size = size;
+         break;
+      }
+      }
+   }
+   return true;
+}
+
+static void free_all(void) {
+   for (size_t i = 0; i < NUM_IAS_SECTIONS; ++i) {
+      buf_free(obj.sections[i].data);
+      buf_free(obj.sections[i].relocs);
+   }
+   buf_free(obj.symbols);
+   buf_free(items);
+   buf_free(bytes);
+   free(sym_table);
+   sym_table = NULL;
+   sym_table_size = 0;
+}
+
+enum ias_result ias_assemble(const char* data, size_t len, const char* name, const char* output) {
+   memset(&obj, 0, sizeof(obj));
+   for (size_t i = 0; i < NUM_IAS_SECTIONS; ++i)
+      obj.sections[i].align = 1;
+   source_name = name;
+   cur_section = IAS_TEXT;
+   has_comment = false;
+   ias_error[0] = '\0';
+
+   enum ias_result result = IAS_UNSUPPORTED;
+   if (parse_all(data, len)) {
+      layout();
+      if (emit_items())
+         result = ias_write_elf(&obj, output) ? IAS_OK : IAS_ERROR;
+   }
+   free_all();
+   return result;
+}
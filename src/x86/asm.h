@@ -0,0 +1,85 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef FILE_X86_ASM_H
+#define FILE_X86_ASM_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "strint.h"
+
+// The integrated assembler for x86_64 (see asm.c and elf.c).
+//
+// It understands the Intel syntax, that is generated by emit_ir(),
+// and writes an ELF64 relocatable object file.
+// Everything else is rejected with IAS_UNSUPPORTED,
+// the caller then falls back to the external assembler.
+
+enum ias_result {
+   IAS_OK,
+   IAS_ERROR,           // failed to write the object file
+   IAS_UNSUPPORTED,     // see ias_error
+};
+
+enum ias_section {
+   IAS_TEXT,
+   IAS_DATA,
+   IAS_BSS,
+   IAS_RODATA,
+   IAS_COMMENT,
+   NUM_IAS_SECTIONS,
+};
+
+struct ias_symbol {
+   istr_t name;
+   int section;         // -1, if undefined
+   uint64_t value;
+   uint64_t size;
+   unsigned char type;  // STT_*
+   unsigned char bind;  // STB_*
+   bool temp;           // .L symbols are not written to the symbol table
+};
+
+struct ias_reloc {
+   uint64_t offset;
+   int section;         // relocation against the section symbol, if >= 0
+   size_t sym;          // otherwise against symbols[sym]
+   unsigned type;       // R_X86_64_*
+   int64_t addend;
+};
+
+struct ias_sect {
+   uint8_t* data;       // buf, NULL for .bss
+   uint64_t size;
+   uint64_t align;
+   struct ias_reloc* relocs;
+};
+
+struct ias_object {
+   struct ias_sect sections[NUM_IAS_SECTIONS];
+   struct ias_symbol* symbols;
+};
+
+// the reason for IAS_UNSUPPORTED
+extern char ias_error[256];
+
+// assembles `len` bytes of `data` into the object file `output`
+enum ias_result ias_assemble(const char* data, size_t len, const char* source_name, const char* output);
+
+// writes `obj` as an ELF64 relocatable object file, returns false on failure
+bool ias_write_elf(const struct ias_object* obj, const char* output);
+
+#endif /* FILE_X86_ASM_H */
@@ -18,8 +18,10 @@
 
 #include <sys/wait.h>
 #include <assert.h>
+#include <signal.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <stdio.h>
 #include "binutils.h"
 #include "cmdline.h"
@@ -27,22 +29,49 @@
 #include "config.h"
 #include "error.h"
 #include "bcc.h"
+#include "asm.h"
+#include "buf.h"
 
 struct flag_option mach_opts[] = {
    BINUTILS_MACH_OPTS,
    { "stack-check", "Check the stack on every function entry", 0, .bVal = false }, // stub
+   { "libcall-muldiv", "Call libbcc for multiplication, division and modulo", 0, .bVal = false },
+   { "integrated-as", "Assemble with the integrated assembler (x86_64 only)", 0, .bVal = BITS == 64 },
 };
 const size_t num_mach_opts = arraylen(mach_opts);
 
-int assemble(const char* source, const char* output) {
+// runs the external assembler, `data` is piped into it, if it is not NULL
+static int run_as(const char* source, const char* output, const char* data, size_t len) {
+   int pipes[2];
+   if (data && pipe(pipes) != 0)
+      panic("failed to create pipes");
    const pid_t pid = fork();
    assert(pid >= 0);
    if (pid == 0) {
+      if (data) {
+         close(pipes[1]);
+         if (dup2(pipes[0], 0) < 0)
+            panic("failed to duplicate file descriptor");
+         close(pipes[0]);
+      }
       char* path_as = strdup(get_flag_opt("path-as")->sVal);
       verbose_execl(path_as, path_as, "-msyntax=intel", "-o", output, source, NULL);
       perror("bcc: failed to invoke assembler");
       _exit(1);
    } else {
+      if (data) {
+         close(pipes[0]);
+         signal(SIGPIPE, SIG_IGN);
+         for (size_t i = 0; i < len; ) {
+            const ssize_t n = write(pipes[1], data + i, len - i);
+            if (n < 0 && errno == EINTR)
+               continue;
+            if (n <= 0)
+               break;
+            i += (size_t)n;
+         }
+         close(pipes[1]);
+      }
       int wstatus;
       waitpid(pid, &wstatus, 0);
       if (WIFEXITED(wstatus))
@@ -51,6 +80,61 @@ int assemble(const char* source, const char* output) {
    }
 }
 
+#if BITS == 64
+static char* read_source(const char* source, size_t* len) {
+   FILE* file = !strcmp(source, "-") ? stdin : fopen(source, "r");
+   if (!file) {
+      fprintf(stderr, "bcc: failed to open file '%s': %s\n", source, strerror(errno));
+      return NULL;
+   }
+   char* data = NULL;
+   char chunk[4096];
+   size_t n;
+   while ((n = fread(chunk, 1, sizeof(chunk), file)) != 0) {
+      buf__fit(data, buf_len(data) + n);
+      memcpy(data + buf_len(data), chunk, n);
+      buf__hdr(data)->len += n;
+   }
+   if (file != stdin)
+      fclose(file);
+   buf__fit(data, 1);
+   *len = buf_len(data);
+   return data;
+}
+#endif
+
+int assemble(const char* source, const char* output) {
+   if (!get_mach_opt("integrated-as")->bVal)
+      return run_as(source, output, NULL, 0);
+#if BITS == 32
+   fputs("bcc: the integrated assembler only supports x86_64\n", stderr);
+   return 1;
+#else
+   size_t len;
+   char* data = read_source(source, &len);
+   if (!data)
+      return 1;
+   int ec;
+   switch (ias_assemble(data, len, source, output)) {
+   case IAS_OK:
+      ec = 0;
+      break;
+   case IAS_ERROR:
+      ec = 1;
+      break;
+   case IAS_UNSUPPORTED:
+      if (verbose)
+         fprintf(stderr, "bcc: %s, falling back to the external assembler\n", ias_error);
+      ec = run_as("-", output, data, len);
+      break;
+   default:
+      panic("unreachable reached");
+   }
+   buf_free(data);
+   return ec;
+#endif
+}
+
 bool emit_prepare(void) {
    return true;
 }
@@ -0,0 +1,299 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <elf.h>
+#include "error.h"
+#include "asm.h"
+#include "buf.h"
+
+// Writes the ELF64 relocatable object file of the integrated assembler (see asm.c).
+//
+// The fields are written byte by byte in little-endian,
+// so the object file does not depend on the host.
+//
+// Layout: ELF header, the contents of the sections, the relocations,
+//         .symtab, .strtab, .shstrtab, the section headers
+
+static const char* const section_names[NUM_IAS_SECTIONS] = {
+   [IAS_TEXT]     = ".text",
+   [IAS_DATA]     = ".data",
+   [IAS_BSS]      = ".bss",
+   [IAS_RODATA]   = ".rodata",
+   [IAS_COMMENT]  = ".comment",
+};
+
+struct shdr {
+   uint32_t name, type;
+   uint64_t flags, offset, size;
+   uint32_t link, info;
+   uint64_t align, entsize;
+};
+
+static void put_le(uint8_t** out, uint64_t v, unsigned n) {
+   for (unsigned i = 0; i < n; ++i)
+      buf_push(*out, (uint8_t)(v >> (8 * i)));
+}
+
+static void put_data(uint8_t** out, const void* data, size_t len) {
+   if (!len)
+      return;
+   buf__fit(*out, buf_len(*out) + len);
+   memcpy(*out + buf_len(*out), data, len);
+   buf__hdr(*out)->len += len;
+}
+
+static void pad(uint8_t** out, uint64_t align) {
+   while (buf_len(*out) & (align - 1))
+      buf_push(*out, 0);
+}
+
+static uint32_t add_string(char** strtab, const char* s) {
+   const uint32_t idx = (uint32_t)buf_len(*strtab);
+   buf_puts(*strtab, s);
+   buf_push(*strtab, '\0');
+   return idx;
+}
+
+static bool is_emitted(const struct ias_object* obj, enum ias_section s) {
+   return s == IAS_TEXT || s == IAS_DATA || s == IAS_BSS || obj->sections[s].size != 0;
+}
+
+bool ias_write_elf(const struct ias_object* obj, const char* output) {
+   const size_t num_syms = buf_len(obj->symbols);
+   uint8_t* out = NULL;
+   char* strtab = NULL;
+   char* shstrtab = NULL;
+   struct shdr* shdrs = NULL;
+   size_t* sym_index = calloc(num_syms + 1, sizeof(size_t));
+   if (!sym_index)
+      panic("failed to allocate memory");
+
+   buf_push(strtab, '\0');
+   buf_push(shstrtab, '\0');
+   const struct shdr null_shdr = { 0 };
+   buf_push(shdrs, null_shdr);
+
+   // section indices, every section with relocations is followed by its .rela section
+   uint32_t sect_index[NUM_IAS_SECTIONS] = { 0 };
+   uint32_t num_shdrs = 1;
+   for (size_t i = 0; i < NUM_IAS_SECTIONS; ++i) {
+      if (!is_emitted(obj, i))
+         continue;
+      sect_index[i] = num_shdrs++;
+      if (obj->sections[i].relocs)
+         ++num_shdrs;
+   }
+   const uint32_t symtab_index = num_shdrs;
+   const uint32_t strtab_index = num_shdrs + 1;
+   const uint32_t shstrtab_index = num_shdrs + 2;
+
+   // symbol table: null, section symbols, local symbols, global symbols
+   uint8_t* symtab = NULL;
+   size_t num_symtab = 0;
+   uint32_t sect_sym[NUM_IAS_SECTIONS] = { 0 };
+#define put_sym(name, info, shndx, value, size)  \
+   (put_le(&symtab, (name), 4),                   \
+    put_le(&symtab, (info), 1),                   \
+    put_le(&symtab, 0, 1),                        \
+    put_le(&symtab, (shndx), 2),                  \
+    put_le(&symtab, (value), 8),                  \
+    put_le(&symtab, (size), 8),                   \
+    num_symtab++)
+
+   // section symbols are only needed for relocations against local symbols
+   bool sect_used[NUM_IAS_SECTIONS] = { false };
+   for (size_t i = 0; i < NUM_IAS_SECTIONS; ++i) {
+      for (size_t j = 0; j < buf_len(obj->sections[i].relocs); ++j) {
+         const struct ias_reloc* r = &obj->sections[i].relocs[j];
+         if (r->section >= 0)
+            sect_used[r->section] = true;
+      }
+   }
+
+   put_sym(0, 0, SHN_UNDEF, 0, 0);
+   for (size_t i = 0; i < NUM_IAS_SECTIONS; ++i) {
+      if (!sect_used[i])
+         continue;
+      sect_sym[i] = (uint32_t)num_symtab;
+      put_sym(0, ELF64_ST_INFO(STB_LOCAL, STT_SECTION), sect_index[i], 0, 0);
+   }
+   for (size_t i = 0; i < num_syms; ++i) {
+      const struct ias_symbol* s = &obj->symbols[i];
+      if (s->temp || s->section < 0 || s->bind != STB_LOCAL)
+         continue;
+      sym_index[i] = num_symtab;
+      put_sym(add_string(&strtab, s->name), ELF64_ST_INFO(STB_LOCAL, s->type),
+              sect_index[s->section], s->value, s->size);
+   }
+   const size_t first_global = num_symtab;
+   for (size_t i = 0; i < num_syms; ++i) {
+      const struct ias_symbol* s = &obj->symbols[i];
+      if (s->section >= 0 && s->bind == STB_LOCAL)
+         continue;
+      // undefined symbols are global
+      const unsigned char bind = s->bind == STB_WEAK ? STB_WEAK : STB_GLOBAL;
+      sym_index[i] = num_symtab;
+      put_sym(add_string(&strtab, s->name), ELF64_ST_INFO(bind, s->type),
+              s->section >= 0 ? sect_index[s->section] : SHN_UNDEF, s->value, s->size);
+   }
+#undef put_sym
+
+   // ELF header, e_shoff is patched later
+   static const uint8_t ident[EI_NIDENT] = {
+      ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64, ELFDATA2LSB, EV_CURRENT, ELFOSABI_NONE,
+   };
+   put_data(&out, ident, sizeof(ident));
+   put_le(&out, ET_REL, 2);
+   put_le(&out, EM_X86_64, 2);
+   put_le(&out, EV_CURRENT, 4);
+   put_le(&out, 0, 8);              // e_entry
+   put_le(&out, 0, 8);              // e_phoff
+   const size_t shoff_pos = buf_len(out);
+   put_le(&out, 0, 8);              // e_shoff
+   put_le(&out, 0, 4);              // e_flags
+   put_le(&out, 64, 2);             // e_ehsize
+   put_le(&out, 0, 2);              // e_phentsize
+   put_le(&out, 0, 2);              // e_phnum
+   put_le(&out, 64, 2);             // e_shentsize
+   put_le(&out, shstrtab_index + 1, 2);
+   put_le(&out, shstrtab_index, 2);
+
+   for (size_t i = 0; i < NUM_IAS_SECTIONS; ++i) {
+      if (!is_emitted(obj, i))
+         continue;
+      const struct ias_sect* sect = &obj->sections[i];
+      struct shdr sh = {
+         .name = add_string(&shstrtab, section_names[i]),
+         .type = i == IAS_BSS ? SHT_NOBITS : SHT_PROGBITS,
+         .size = sect->size,
+         .align = sect->align,
+      };
+      switch (i) {
+      case IAS_TEXT:    sh.flags = SHF_ALLOC | SHF_EXECINSTR; break;
+      case IAS_DATA:
+      case IAS_BSS:     sh.flags = SHF_ALLOC | SHF_WRITE; break;
+      case IAS_RODATA:  sh.flags = SHF_ALLOC; break;
+      case IAS_COMMENT:
+         sh.flags = SHF_MERGE | SHF_STRINGS;
+         sh.entsize = 1;
+         break;
+      }
+      pad(&out, sh.align);
+      sh.offset = buf_len(out);
+      if (i != IAS_BSS)
+         put_data(&out, sect->data, buf_len(sect->data));
+      buf_push(shdrs, sh);
+
+      if (!sect->relocs)
+         continue;
+      char name[32];
+      snprintf(name, sizeof(name), ".rela%s", section_names[i]);
+      struct shdr rela = {
+         .name = add_string(&shstrtab, name),
+         .type = SHT_RELA,
+         .flags = SHF_INFO_LINK,
+         .size = buf_len(sect->relocs) * 24,
+         .link = symtab_index,
+         .info = sect_index[i],
+         .align = 8,
+         .entsize = 24,
+      };
+      pad(&out, 8);
+      rela.offset = buf_len(out);
+      for (size_t j = 0; j < buf_len(sect->relocs); ++j) {
+         const struct ias_reloc* r = &sect->relocs[j];
+         const uint64_t sym = r->section >= 0 ? sect_sym[r->section] : sym_index[r->sym];
+         put_le(&out, r->offset, 8);
+         put_le(&out, ELF64_R_INFO(sym, r->type), 8);
+         put_le(&out, (uint64_t)r->addend, 8);
+      }
+      buf_push(shdrs, rela);
+   }
+
+   pad(&out, 8);
+   const struct shdr symtab_shdr = {
+      .name = add_string(&shstrtab, ".symtab"),
+      .type = SHT_SYMTAB,
+      .offset = buf_len(out),
+      .size = buf_len(symtab),
+      .link = strtab_index,
+      .info = (uint32_t)first_global,
+      .align = 8,
+      .entsize = 24,
+   };
+   put_data(&out, symtab, buf_len(symtab));
+   buf_push(shdrs, symtab_shdr);
+
+   const struct shdr strtab_shdr = {
+      .name = add_string(&shstrtab, ".strtab"),
+      .type = SHT_STRTAB,
+      .offset = buf_len(out),
+      .size = buf_len(strtab),
+      .align = 1,
+   };
+   put_data(&out, strtab, buf_len(strtab));
+   buf_push(shdrs, strtab_shdr);
+
+   struct shdr shstrtab_shdr = {
+      .name = add_string(&shstrtab, ".shstrtab"),
+      .type = SHT_STRTAB,
+      .offset = buf_len(out),
+      .align = 1,
+   };
+   shstrtab_shdr.size = buf_len(shstrtab);
+   put_data(&out, shstrtab, buf_len(shstrtab));
+   buf_push(shdrs, shstrtab_shdr);
+
+   pad(&out, 8);
+   const uint64_t shoff = buf_len(out);
+   for (int i = 0; i < 8; ++i)
+      out[shoff_pos + i] = (uint8_t)(shoff >> (8 * i));
+   for (size_t i = 0; i < buf_len(shdrs); ++i) {
+      const struct shdr* sh = &shdrs[i];
+      put_le(&out, sh->name, 4);
+      put_le(&out, sh->type, 4);
+      put_le(&out, sh->flags, 8);
+      put_le(&out, 0, 8);           // sh_addr
+      put_le(&out, sh->offset, 8);
+      put_le(&out, sh->size, 8);
+      put_le(&out, sh->link, 4);
+      put_le(&out, sh->info, 4);
+      put_le(&out, sh->align, 8);
+      put_le(&out, sh->entsize, 8);
+   }
+
+   bool success = false;
+   FILE* file = fopen(output, "wb");
+   if (file) {
+      success = fwrite(out, 1, buf_len(out), file) == buf_len(out);
+      success = fclose(file) == 0 && success;
+      if (!success)
+         fprintf(stderr, "bcc: failed to write file '%s'\n", output);
+   } else {
+      fprintf(stderr, "bcc: failed to open file '%s': %s\n", output, strerror(errno));
+   }
+
+   buf_free(out);
+   buf_free(strtab);
+   buf_free(shstrtab);
+   buf_free(shdrs);
+   buf_free(symtab);
+   free(sym_index);
+   return success;
+}
@@ -18,14 +18,18 @@
 
 static const struct function* cur_func;
 
+// callee-saved registers used by cur_func and their stack addresses
+static unsigned saved_regs;
+static size_t saved_addrs[arraylen(regs)];
+
 #if BITS == 32
 #define only_on_x86_64() panic("this should not be reached in i386")
 #else
 #define only_on_x86_64()
 #endif
 
-#define alloc_stack(n) ((n) && optim_level >= 1 ? emit("sub %s, %zu", REG_SP, (n)) : 0)
-#define free_stack(n) ((n) && optim_level >= 1 ? emit("add %s, %zu", REG_SP, (n)) : 0)
+#define alloc_stack(n) ((n) ? emit("sub %s, %zu", REG_SP, (n)) : 0)
+#define free_stack(n) ((n) ? emit("add %s, %zu", REG_SP, (n)) : 0)
 
 void emit_init_int(enum ir_value_size irs, intmax_t val, bool is_unsigned);
 
@@ -58,6 +62,63 @@ static void emit_read(ir_reg_t d, enum ir_value_size irs, bool se, const char* a
    va_end(ap);
 }
 
+// operands smaller than int get extended for div/idiv
+static enum ir_value_size div_size(enum ir_value_size irs) {
+   return irs < IRS_INT ? IRS_INT : irs;
+}
+
+static void emit_div_operand(ir_reg_t r, const struct ir_value* v, enum ir_value_size irs, bool is_signed) {
+   const enum ir_value_size ds = div_size(irs);
+   if (v->type == IRT_UINT) {
+      emit("mov %s, %jd", reg_wsz(r, ds), v->sVal);
+   } else if (irs < IRS_INT) {
+      emit("mov%s %s, %s", is_signed ? "sx" : "zx", reg_wsz(r, ds), reg_wsz(v->reg, irs));
+   } else if (v->reg != r) {
+      emit("mov %s, %s", reg_wsz(r, ds), reg_wsz(v->reg, ds));
+   }
+}
+
+// div/idiv take the dividend in edx:eax and return the quotient in eax and the remainder in edx,
+// the register allocator keeps eax/edx free across divisions
+static void emit_divmod(const ir_node_t* n, bool is_signed, bool is_mod) {
+   const ir_reg_t dest = n->binary.dest;
+   const struct ir_value* a = &n->binary.a;
+   const struct ir_value* b = &n->binary.b;
+   const enum ir_value_size irs = n->binary.size;
+   const enum ir_value_size ds = div_size(irs);
+
+   // immediates, sub-int values and values in eax/edx are divided from the stack
+   const bool on_stack = b->type != IRT_REG || irs < IRS_INT || b->reg == 0 || b->reg == REGI_DX;
+   if (on_stack) {
+      const ir_reg_t tmp = a->type == IRT_REG && a->reg == 0 ? REGI_DX : 0;
+      emit_div_operand(tmp, b, irs, is_signed);
+      emit("push %s", reg(tmp));
+   }
+   emit_div_operand(0, a, irs, is_signed);
+
+   if (is_signed) {
+      emit(irs2sz(ds) == 8 ? "cqo" : "cdq");
+   } else {
+      emit_clear(reg_wsz(REGI_DX, IRS_INT));
+   }
+   if (on_stack) {
+      emit("%s %s PTR [%s]", is_signed ? "idiv" : "div", as_size(ds), REG_SP);
+      emit("add %s, %u", REG_SP, REGSIZE);
+   } else {
+      emit("%s %s", is_signed ? "idiv" : "div", reg_wsz(b->reg, ds));
+   }
+
+   const ir_reg_t res = is_mod ? REGI_DX : 0;
+#if BITS == 64
+   if (is_signed && irs2sz(ds) == 4) {
+      // signed ints are kept sign-extended
+      emit("movsxd %s, %s", reg(dest), regs32[res]);
+   } else
+#endif
+   if (dest != res)
+      emit("mov %s, %s", reg_wsz(dest, ds), reg_wsz(res, ds));
+}
+
 ir_node_t* emit_ir(ir_node_t* n) {
    const char* instr;
    bool flag = false, flag2 = false;
@@ -88,11 +149,55 @@ ir_node_t* emit_ir(ir_node_t* n) {
          } else {
             emit("%s %s, %s", n->type == IR_IADD ? "add" : "sub", dest, b);
          }
-      } else {
+      } else if (n->type == IR_IADD || n->binary.b.type != IRT_REG) {
          emit("lea %s, [%s %c %s]", dest, a, n->type == IR_IADD ? '+' : '-', b);
+      } else if (n->binary.dest == n->binary.b.reg) {
+         // dest = -b + a
+         emit("neg %s", dest);
+         emit("add %s, %s", dest, a);
+      } else {
+         emit("mov %s, %s", dest, a);
+         emit("sub %s, %s", dest, b);
       }
       return n->next;
    }
+   case IR_IMUL:
+   case IR_UMUL:
+   {
+      // the lower half of the product is the same for signed and unsigned
+      const struct ir_value* a = &n->binary.a;
+      const struct ir_value* b = &n->binary.b;
+      const char* dest = reg(n->binary.dest);
+
+      if (a->type == IRT_UINT) {
+         const struct ir_value* tmp = a;
+         a = b;
+         b = tmp;
+      }
+
+      if (b->type == IRT_UINT) {
+         if (a->type == IRT_REG) {
+            emit("imul %s, %s, %s", dest, reg(a->reg), irv2str(b));
+         } else {
+            emit("mov %s, %s", dest, irv2str(a));
+            emit("imul %s, %s, %s", dest, dest, irv2str(b));
+         }
+      } else if (a->reg == n->binary.dest) {
+         emit("imul %s, %s", dest, reg(b->reg));
+      } else if (b->reg == n->binary.dest) {
+         emit("imul %s, %s", dest, reg(a->reg));
+      } else {
+         emit("mov %s, %s", dest, reg(a->reg));
+         emit("imul %s, %s", dest, reg(b->reg));
+      }
+      return n->next;
+   }
+   case IR_IDIV:
+   case IR_UDIV:
+   case IR_IMOD:
+   case IR_UMOD:
+      emit_divmod(n, n->type == IR_IDIV || n->type == IR_IMOD, n->type == IR_IMOD || n->type == IR_UMOD);
+      return n->next;
    case IR_IAND:
       instr = "and";
       goto ir_bitwise;
@@ -112,14 +217,20 @@ ir_node_t* emit_ir(ir_node_t* n) {
       instr = "sar";
    {
    ir_bitwise:;
-      const char* a = irv2str(&n->binary.a);
-      const char* b = irv2str(&n->binary.b);
+      const struct ir_value* a = &n->binary.a;
+      const struct ir_value* b = &n->binary.b;
       const char* dest = reg(n->binary.dest);
-      
-      if (n->binary.a.type != IRT_REG || n->binary.dest != n->binary.a.reg) {
-         emit("mov %s, %s", dest, a);
+
+      // `mov dest, a` would overwrite b
+      if (n->type <= IR_IXOR && b->type == IRT_REG && n->binary.dest == b->reg) {
+         const struct ir_value* tmp = a;
+         a = b;
+         b = tmp;
+      }
+      if (a->type != IRT_REG || n->binary.dest != a->reg) {
+         emit("mov %s, %s", dest, irv2str(a));
       }
-      emit("%s %s, %s", instr, dest, b);
+      emit("%s %s, %s", instr, dest, irv2str(b));
       return n->next;
    }
    case IR_INOT:
@@ -130,7 +241,7 @@ ir_node_t* emit_ir(ir_node_t* n) {
    {
       const char* reg = reg_wsz(n->unary.reg, n->unary.size);
       emit("test %s, %s", reg, reg);
-      emit("sete %s", regs8[n->unary.reg]);
+      emit("sete %s", reg_wsz(n->unary.reg, IRS_BYTE));
       return n->next;
    }
 
@@ -148,37 +259,36 @@ ir_node_t* emit_ir(ir_node_t* n) {
 
    case IR_PROLOGUE:
    {
-      const ir_reg_t max_reg = n->func->max_reg;
-      //emit("# ir_max_reg(%s)=%u\n", n->func->name, (unsigned)max_reg);
       emit("push %s", REG_BP);
       emit("mov %s, %s", REG_BP, REG_SP);
       cur_func = n->func;
 
+      // the register allocator may add spill slots to the scope
+      saved_regs = linear_scan(n);
 
       // stack allocation
       size_t nrp;
 #if BITS == 32
-      if (max_reg >= 3) {
-         nrp = max_reg - 2;
-      } else {
-         nrp = 0;
-      }
+      nrp = 0;
 #else
       nrp = my_min(arraylen(param_regs), buf_len(n->func->params));
 #endif
+      size_t ncs = 0;
+      for (size_t i = 0; i < arraylen(regs); ++i) {
+         if (saved_regs & (1u << i))
+            ++ncs;
+      }
       size_t size_stack = 0;
       size_stack += nrp * REGSIZE;
       size_stack += sizeof_scope(n->func->scope);
+      size_stack = (size_stack + REGSIZE - 1) & ~(size_t)(REGSIZE - 1);
+      size_t sp_saved = size_stack;
+      size_stack += ncs * REGSIZE;
       size_stack = align_stack_size(size_stack);
       alloc_stack(size_stack);
 
       size_t sp = 0;
-#if BITS == 32
-      for (size_t i = 0; i < nrp; ++i) {
-         sp += REGSIZE;
-         emit("mov DWORD PTR [ebp - %zu], %s", sp, reg(i + 3));
-      }
-#else
+#if BITS == 64
       for (size_t i = 0; i < nrp; ++i) {
          sp += REGSIZE;
          emit("mov QWORD PTR [rbp - %zu], %s", sp, reg(param_regs[i]));
@@ -187,6 +297,15 @@ ir_node_t* emit_ir(ir_node_t* n) {
 
       assign_scope(n->func->scope, &sp);
 
+      // save the used callee-saved registers
+      for (size_t i = 0; i < arraylen(regs); ++i) {
+         if (saved_regs & (1u << i)) {
+            sp_saved += REGSIZE;
+            saved_addrs[i] = sp_saved;
+            emit("mov %s PTR [%s - %zu], %s", as_size(IRS_PTR), REG_BP, sp_saved, reg(i));
+         }
+      }
+
       return n->next;
    }
    case IR_FPARAM:
@@ -200,17 +319,10 @@ ir_node_t* emit_ir(ir_node_t* n) {
    case IR_EPILOGUE:
       emit_clear(REG_AX);
       emit("%s.ret:", n->func->name);
-#if BITS == 32
-      {
-         size_t sp = 0;
-         if (n->func->max_reg >= 3) {
-            for (size_t i = 3; i <= n->func->max_reg; ++i) {
-               sp += REGSIZE;
-               emit("mov %s, DWORD PTR [ebp - %zu]", reg(i), sp);
-            }
-         }
+      for (size_t i = 0; i < arraylen(regs); ++i) {
+         if (saved_regs & (1u << i))
+            emit("mov %s, %s PTR [%s - %zu]", reg(i), as_size(IRS_PTR), REG_BP, saved_addrs[i]);
       }
-#endif
       emit("leave");
       emit("ret");
       cur_func = NULL;
@@ -230,6 +342,9 @@ ir_node_t* emit_ir(ir_node_t* n) {
    case IR_JMP:
       emit("jmp %s", n->str);
       return n->next;
+   case IR_JMPTBL:
+      emit("jmp %s PTR [%s + %s * %u]", as_size(IRS_PTR), n->jmptbl.label, reg(n->jmptbl.reg), (unsigned)REGSIZE);
+      return n->next;
    case IR_JMPIF:
       instr = "jnz";
       goto ir_jmpifn;
@@ -281,9 +396,9 @@ ir_node_t* emit_ir(ir_node_t* n) {
          emit("%s %s", instr, n->next->str);
          return n->next->next;
       } else {
-         emit("%s %s", es[n->type].set, regs8[n->binary.dest]);
+         emit("%s %s", es[n->type].set, reg_wsz(n->binary.dest, IRS_BYTE));
          if (n->binary.size > IRS_CHAR)
-            emit("movzx %s, %s", dest, regs8[n->binary.dest]);
+            emit("movzx %s, %s", dest, reg_wsz(n->binary.dest, IRS_BYTE));
          return n->next;
       }
    }
@@ -360,47 +475,23 @@ ir_node_t* emit_ir(ir_node_t* n) {
       if (!flag && is_builtin_func(n->call.name))
          request_builtin(n->call.name);
 
-      size_t n_stack = 1;
-      n_stack += dest;
-      n_stack += np;
-      n_stack = align_stack_size(n_stack * REGSIZE);
+      const size_t n_stack = align_stack_size(np * REGSIZE);
       alloc_stack(n_stack);
 
-      uintreg_t sp = n_stack - REGSIZE;
-
-      for (size_t i = 0; i < dest; ++i) {
-         emit("mov %s PTR [%s + %ju], %s", as_size(IRS_PTR), REG_SP, (uintmax_t)sp, reg(i));
-         sp -= REGSIZE;
-      }
-
-      const size_t saved_sp = sp;
-
-      sp = REGSIZE * (np - 1);
-#if BITS == 32
-      for (size_t i = np; i != 0; --i) {
-         fcall_helper(&params[i - 1], dest, &sp);
-      }
-#else
-      for (size_t i = 0; i < my_min(np, arraylen(param_regs)); ++i) {
-         fcall_helper(&params[i], dest, &sp);
+      // the parameters are evaluated in order (see regalloc.c)
+      for (size_t i = 0; i < np; ++i) {
+         fcall_helper(params[i], param_offset(i, np));
       }
-      for (size_t i = np; i > arraylen(param_regs); --i) {
-         fcall_helper(&params[i - 1], dest, &sp);
-      }
-#endif
 
       if (flag) {
          ir_node_t* tmp = n->call.addr;
          while ((tmp = emit_ir(tmp)) != NULL);
-         emit("mov %s, %s", REG_AX, reg(n->call.dest));
+         emit("mov %s, %s", REG_AX, reg(ir_get_target(ir_end(n->call.addr))));
       }
 
 #if BITS == 64
-      sp = REGSIZE * (np - 1);
-
       for (size_t i = 0; i < my_min(np, arraylen(param_regs)); ++i) {
-         emit("mov %s, %s PTR [%s + %ju]", reg(param_regs[i]), as_size(IRS_PTR), REG_SP, (uintmax_t)sp);
-         sp -= REGSIZE;
+         emit("mov %s, %s PTR [%s + %ju]", reg(param_regs[i]), as_size(IRS_PTR), REG_SP, (uintmax_t)param_offset(i, np));
       }
 #endif
 
@@ -410,16 +501,9 @@ ir_node_t* emit_ir(ir_node_t* n) {
          emit("call %s", n->call.name);
       }
 
-      if (dest != 0)
+      if (flag2 && dest != 0)
          emit("mov %s, %s", reg(dest), reg(0));
 
-      sp = n_stack - REGSIZE;
-      for (size_t i = 0; i < dest; ++i) {
-         emit("mov %s, %s PTR [%s + %ju]", reg(i), as_size(IRS_PTR), REG_SP, (uintmax_t)sp);
-         sp -= REGSIZE;
-      }
-
-
       free_stack(n_stack);
 
       return n->next;
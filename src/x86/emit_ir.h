@@ -24,6 +24,10 @@
 
 ir_node_t* emit_ir(ir_node_t*);
 
+// allocates the registers of a function (see regalloc.c),
+// returns the mask of the used callee-saved registers
+unsigned linear_scan(ir_node_t* prologue);
+
 static void emit_clear(const char* r) {
    if (optim_level > 0) {
       emit("xor %s, %s", r, r);
@@ -55,12 +59,23 @@ static const char* irv2str(const struct ir_value* v) {
    }
 }
 
+// places a variable of `sz` bytes below `sp` and returns its address,
+// it is aligned to its size (at most REGSIZE)
+static size_t alloc_slot(size_t sp, size_t sz) {
+   size_t align = REGSIZE;
+   while (align > sz && align > 1)
+      align >>= 1;
+   sp += sz;
+   return (sp + align - 1) & ~(align - 1);
+}
+
 // TODO: merge with include/riscv/emit_ir.h
 static size_t sizeof_scope(const struct scope* scope) {
    size_t num = 0;
    for (size_t i = 0; i < buf_len(scope->vars); ++i) {
-      num += sizeof_value(scope->vars[i].type, false);
+      num = alloc_slot(num, sizeof_value(scope->vars[i].type, false));
    }
+   num = (num + REGSIZE - 1) & ~(size_t)(REGSIZE - 1);
    size_t max_child = 0;
    for (size_t i = 0; i < buf_len(scope->children); ++i) {
       const size_t sz = sizeof_scope(scope->children[i]);
@@ -75,30 +90,41 @@ static size_t align_stack_size(size_t n) {
 
 static void assign_scope(struct scope* scope, size_t* sp) {
    for (size_t i = 0; i < buf_len(scope->vars); ++i) {
-      *sp += sizeof_value(scope->vars[i].type, false);
+      *sp = alloc_slot(*sp, sizeof_value(scope->vars[i].type, false));
       scope->vars[i].addr = *sp;
    }
+   // sibling scopes share the same stack space (see sizeof_scope())
+   *sp = (*sp + REGSIZE - 1) & ~(size_t)(REGSIZE - 1);
+   const size_t base_sp = *sp;
    for (size_t i = 0; i < buf_len(scope->children); ++i) {
-      size_t tmp_sp = *sp;
+      size_t tmp_sp = base_sp;
       assign_scope(scope->children[i], &tmp_sp);
       if (tmp_sp > *sp)
          *sp = tmp_sp;
    }
 }
 
-static void fcall_helper(ir_node_t** params, const ir_reg_t dest, uintreg_t* sp) {
-   ir_reg_t target = ir_get_target(ir_end(*params));
-   if (target == IRR_NONSENSE) {
-      puts("NONSENSE"); // DEBUG
-      target = dest;
+// stack offset of the `idx`th of `np` parameters of a call
+static uintreg_t param_offset(size_t idx, size_t np) {
+#if BITS == 32
+   (void)np;
+   return REGSIZE * idx;
+#else
+   if (idx < arraylen(param_regs)) {
+      return REGSIZE * (np - 1 - idx);
+   } else {
+      return REGSIZE * (idx - arraylen(param_regs));
    }
-   *params = optim_ir_nodes(*params);
-   if (*params)
-      while ((*params = emit_ir(*params)) != NULL);
-   emit("mov %s PTR [%s + %ju], %s", as_size(IRS_PTR), REG_SP, (uintmax_t)*sp, reg(target));
-   *sp -= REGSIZE;
+#endif
 }
 
+static void fcall_helper(ir_node_t* params, uintreg_t sp) {
+   const ir_reg_t target = ir_get_target(ir_end(params));
+   if (target == IRR_NONSENSE)
+      panic("parameter without a value");
+   while ((params = emit_ir(params)) != NULL);
+   emit("mov %s PTR [%s + %ju], %s", as_size(IRS_PTR), REG_SP, (uintmax_t)sp, reg(target));
+}
 
 static int32_t calc_fp_addr(size_t idx) {
 #if BITS == 32
@@ -13,6 +13,7 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include "cmdline.h"
 #include "target.h"
 #include "optim.h"
 #include "error.h"
@@ -76,6 +77,10 @@ static bool mul_to_func(ir_node_t** n) {
       snprintf(name, sizeof(name), "__%s%ci%zu", type, sign, irs2sz(cur->binary.size) * 8);
       ir_node_t func;
       func.type = IR_IFCALL;
+      func.prev = cur->prev;
+      func.next = cur->next;
+      func.func = cur->func;
+      func.pos = cur->pos;
       func.call.name = strint(name);
       func.call.dest = dest;
       func.call.params = NULL;
@@ -83,6 +88,7 @@ static bool mul_to_func(ir_node_t** n) {
       buf_push(func.call.params, val_to_node(&cur->binary.a, dest, cur->binary.size));
       buf_push(func.call.params, val_to_node(&cur->binary.b, dest, cur->binary.size));
       *cur = func;
+      optim_note(TR_MUL_TO_FUNC, cur);
       success = true;
    }
    return success;
@@ -93,8 +99,9 @@ bool target_optim_ir(ir_node_t** n) {
    return false;
 }
 bool target_post_optim_ir(ir_node_t** n) {
+   const bool libcall_muldiv = get_mach_opt("libcall-muldiv")->bVal;
    bool success = false;
-   while (mul_to_func(n)
+   while ((libcall_muldiv && mul_to_func(n))
          || copy_to_memcpy(n))
       success = true;
    return success;
@@ -0,0 +1,225 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include "regalloc.h"
+#include "regs.h"
+#include "buf.h"
+#include "bcc.h"
+
+// Linear-scan register allocation (Poletto & Sarkar).
+//
+// Intervals that are live across a call only get callee-saved registers,
+// intervals that are live across a division never get eax/edx.
+// If no register is free, the interval with the furthest end gets spilled
+// and the whole allocation is repeated with the rewritten code.
+
+#define NUM_REGS arraylen(regs)
+#define ALL_REGS ((1u << NUM_REGS) - 1)
+#define CALLEE_SAVED_REGS (ALL_REGS & ~((1u << REGI_CALLEE_SAVED) - 1))
+
+// registers with an 8-bit variant
+static unsigned byte_regs(void) {
+   unsigned mask = 0;
+   for (size_t i = 0; i < NUM_REGS; ++i) {
+      if (regs8[i])
+         mask |= 1u << i;
+   }
+   return mask;
+}
+
+static bool is_byte(enum ir_value_size irs) {
+   return irs == IRS_BYTE || irs == IRS_CHAR;
+}
+
+// marks the registers, that are accessed as bytes
+static void find_byte_regs(const struct ra_func* ra, bool* needs_byte) {
+   for (size_t i = 0; i < buf_len(ra->insns); ++i) {
+      const struct ra_insn* insn = &ra->insns[i];
+      const ir_node_t* n = insn->node;
+      if (insn->flags & RA_ARG)
+         continue;
+      bool byte;
+      switch (n->type) {
+      case IR_ISTEQ:
+      case IR_ISTNE:
+      case IR_ISTGR:
+      case IR_ISTGE:
+      case IR_ISTLT:
+      case IR_ISTLE:
+      case IR_USTGR:
+      case IR_USTGE:
+      case IR_USTLT:
+      case IR_USTLE:
+      case IR_BNOT:
+         byte = true;
+         break;
+      case IR_IDIV:
+      case IR_UDIV:
+      case IR_IMOD:
+      case IR_UMOD:
+         byte = n->binary.size < IRS_INT;
+         break;
+      case IR_WRITE:
+         byte = is_byte(n->rw.size);
+         break;
+      case IR_IICAST:
+         byte = is_byte(n->iicast.ds) || is_byte(n->iicast.ss);
+         break;
+      case IR_FFPWR:
+         byte = is_byte(n->ffprw.size);
+         break;
+      case IR_FGLWR:
+         byte = is_byte(n->fglrw.size);
+         break;
+      case IR_FLUWR:
+         byte = is_byte(n->flurw.size);
+         break;
+      default:
+         byte = false;
+         break;
+      }
+      if (!byte)
+         continue;
+      for (size_t k = 0; k < insn->num_ops; ++k)
+         needs_byte[*insn->ops[k].reg] = true;
+   }
+}
+
+static const struct ra_interval* sort_base;
+static int cmp_begin(const void* a, const void* b) {
+   const size_t x = sort_base[*(const ir_reg_t*)a].begin;
+   const size_t y = sort_base[*(const ir_reg_t*)b].begin;
+   return (x > y) - (x < y);
+}
+
+static unsigned allowed_regs(const struct ra_interval* it, bool needs_byte) {
+   unsigned mask = ALL_REGS;
+   if (it->crosses & RA_CALL)
+      mask &= CALLEE_SAVED_REGS;
+   if (it->crosses & RA_DIV)
+      mask &= ~(1u << 0 | 1u << REGI_DX);
+   if (needs_byte)
+      mask &= byte_regs();
+   return mask;
+}
+
+// returns the registers to spill
+static ir_reg_t* scan(struct ra_func* ra, const bool* needs_byte) {
+   const size_t nv = ra->num_vregs;
+   ir_reg_t* order = NULL;
+   ir_reg_t* active = NULL;
+   ir_reg_t* spills = NULL;
+   for (size_t i = 0; i < nv; ++i) {
+      ra->intervals[i].reg = IRR_NONSENSE;
+      if (ra->intervals[i].begin != SIZE_MAX)
+         buf_push(order, i);
+   }
+   sort_base = ra->intervals;
+   if (order)
+      qsort(order, buf_len(order), sizeof(ir_reg_t), cmp_begin);
+
+   for (size_t i = 0; i < buf_len(order); ++i) {
+      const ir_reg_t v = order[i];
+      struct ra_interval* cur = &ra->intervals[v];
+      unsigned used = 0;
+
+      // expire old intervals
+      for (size_t j = 0; j < buf_len(active); ) {
+         const struct ra_interval* it = &ra->intervals[active[j]];
+         if (it->end < cur->begin) {
+            active[j] = buf_last(active);
+            buf_pop(active);
+         } else {
+            used |= 1u << it->reg;
+            ++j;
+         }
+      }
+
+      const unsigned allowed = allowed_regs(cur, needs_byte[v]);
+      const unsigned avail = allowed & ~used;
+      if (avail) {
+         // caller-saved registers come first
+         ir_reg_t r = 0;
+         while (!(avail & (1u << r)))
+            ++r;
+         cur->reg = r;
+         buf_push(active, v);
+         continue;
+      }
+
+      // spill the interval that ends last
+      size_t victim = SIZE_MAX;
+      for (size_t j = 0; j < buf_len(active); ++j) {
+         const struct ra_interval* it = &ra->intervals[active[j]];
+         if (!it->spillable || !(allowed & (1u << it->reg)))
+            continue;
+         if (victim == SIZE_MAX || it->end > ra->intervals[active[victim]].end)
+            victim = j;
+      }
+      if (victim != SIZE_MAX && (!cur->spillable || ra->intervals[active[victim]].end > cur->end)) {
+         struct ra_interval* it = &ra->intervals[active[victim]];
+         cur->reg = it->reg;
+         it->reg = IRR_NONSENSE;
+         buf_push(spills, active[victim]);
+         active[victim] = v;
+      } else if (cur->spillable) {
+         buf_push(spills, v);
+      } else {
+         panic("failed to allocate a register for R%u", (unsigned)v);
+      }
+   }
+
+   buf_free(order);
+   buf_free(active);
+   return spills;
+}
+
+unsigned linear_scan(ir_node_t* prologue) {
+   struct ra_func ra;
+   ra_init(&ra, prologue->func, prologue);
+   if (optim_level >= 1) {
+      ra_analyze(&ra, true);
+      ra_mem2reg(&ra);
+   }
+
+   bool split = true;
+   while (1) {
+      ra_analyze(&ra, split);
+      split = false;
+
+      bool* needs_byte = calloc(ra.num_vregs + 1, sizeof(bool));
+      if (!needs_byte)
+         panic("failed to allocate registers");
+      find_byte_regs(&ra, needs_byte);
+      ir_reg_t* spills = scan(&ra, needs_byte);
+      free(needs_byte);
+
+      if (!spills)
+         break;
+      for (size_t i = 0; i < buf_len(spills); ++i)
+         ra_spill(&ra, spills[i]);
+      buf_free(spills);
+   }
+
+   unsigned used = 0;
+   for (size_t i = 0; i < ra.num_vregs; ++i) {
+      if (ra.intervals[i].reg != IRR_NONSENSE)
+         used |= 1u << ra.intervals[i].reg;
+   }
+   ra_assign(&ra);
+   ra_free(&ra);
+   return used & CALLEE_SAVED_REGS;
+}
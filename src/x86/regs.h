@@ -28,8 +28,9 @@
 typedef uint32_t uintreg_t;
 static const char* regs[] = { "eax", "ecx", "edx", "esi", "edi", "ebx" };
 
-static const char* regs8[]  = { "al", "cl", "dl", "si", "di", "bx" };
-static const char* regs16[] = { "ax", "cx", "dx", "sil", "dil", "bl" };
+// esi and edi have no 8-bit registers
+static const char* regs8[]  = { "al", "cl", "dl", NULL, NULL, "bl" };
+static const char* regs16[] = { "ax", "cx", "dx", "si", "di", "bx" };
 #define regs32 regs
 static const char* gas_sizes[] = { "BYTE", "BYTE", "WORD", "DWORD", "DWORD", "DWORD" };
 
@@ -38,14 +39,32 @@ static const char* gas_sizes[] = { "BYTE", "BYTE", "WORD", "DWORD", "DWORD", "DW
 #define REG_AX "eax"
 #define REG_BX "ebx"
 
+// index of edx in regs[]
+#define REGI_DX 2
+
+// index of the first callee-saved register in regs[]
+#define REGI_CALLEE_SAVED 3
+
 #else
 
 typedef uint64_t uintreg_t;
-static const char* regs[] = { "rax", "rdi", "rsi", "rdx", "rcx",  "r8",  "r9",  "r10",  "r11" };
-
-static const char* regs8[]  = {  "al", "dil", "sil",  "dl",  "cl", "r8b", "r9b", "r10b", "r11b" };
-static const char* regs16[] = {  "ax",  "di",  "si",  "dx",  "cx", "r8w", "r9w", "r10w", "r11w" };
-static const char* regs32[] = { "eax", "edi", "esi", "edx", "ecx", "r8d", "r9d", "r10d", "r11d" };
+static const char* regs[] = {
+   "rax", "rdi", "rsi", "rdx", "rcx",  "r8",  "r9",  "r10",  "r11",
+   "rbx", "r12", "r13", "r14", "r15",
+};
+
+static const char* regs8[]  = {
+    "al", "dil", "sil",  "dl",  "cl", "r8b", "r9b", "r10b", "r11b",
+    "bl", "r12b", "r13b", "r14b", "r15b",
+};
+static const char* regs16[] = {
+    "ax",  "di",  "si",  "dx",  "cx", "r8w", "r9w", "r10w", "r11w",
+    "bx", "r12w", "r13w", "r14w", "r15w",
+};
+static const char* regs32[] = {
+   "eax", "edi", "esi", "edx", "ecx", "r8d", "r9d", "r10d", "r11d",
+   "ebx", "r12d", "r13d", "r14d", "r15d",
+};
 #define regs64 regs
 static const char* gas_sizes[] = { "BYTE", "BYTE", "WORD", "DWORD", "QWORD", "QWORD" };
 static size_t param_regs[] = { 1, 2, 3, 4, 5, 6 };
@@ -55,6 +74,12 @@ static size_t param_regs[] = { 1, 2, 3, 4, 5, 6 };
 #define REG_AX "rax"
 #define REG_BX "rbx"
 
+// index of rdx in regs[]
+#define REGI_DX 3
+
+// index of the first callee-saved register in regs[]
+#define REGI_CALLEE_SAVED 9
+
 #endif
 
 #define reg(i) (const char*)(((i) < arraylen(regs)) ? regs[(i)] : \
@@ -68,6 +93,8 @@ static const char* reg_wsz(ir_reg_t r, enum ir_value_size sz) {
    switch (sz) {
    case IRS_BYTE:
    case IRS_CHAR:
+      if (!regs8[r])
+         panic("register '%s' has no 8-bit variant", regs[r]);
       return regs8[r];
    case IRS_SHORT:
       return regs16[r];
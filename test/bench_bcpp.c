@@ -0,0 +1,83 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Benchmark of the macro table of bcpp (cpp/src/macro.c),
+// usage: bench_bcpp [num_macros]
+// A source with `num_macros` (default: 50000) definitions is generated,
+// every macro is used once by #ifdef and expanded twice.
+
+#define _XOPEN_SOURCE 700
+#include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <time.h>
+#include "bcpp.h"
+
+void panic_impl(const char* func, const char* fmt, ...) {
+   va_list ap;
+   va_start(ap, fmt);
+   fprintf(stderr, "bench_bcpp: %s(): ", func);
+   vfprintf(stderr, fmt, ap);
+   fputc('\n', stderr);
+   va_end(ap);
+   exit(1);
+}
+
+static double now(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void generate(FILE* file, size_t num) {
+   for (size_t i = 0; i < num; ++i)
+      fprintf(file, "#define MACRO_%zu %zu\n", i, i);
+   for (size_t i = 0; i < num; ++i) {
+      fprintf(file, "#ifdef MACRO_%zu\n", i);
+      fprintf(file, "int var_%zu = MACRO_%zu + MACRO_%zu;\n", i, i, num - 1 - i);
+      fputs("#endif\n", file);
+   }
+}
+
+int main(int argc, char* argv[]) {
+   const size_t num = argc > 1 ? strtoul(argv[1], NULL, 10) : 50000;
+
+   char name[] = "/tmp/bench_bcpp.XXXXXX";
+   const int fd = mkstemp(name);
+   if (fd < 0) {
+      perror("bench_bcpp: mkstemp");
+      return 1;
+   }
+   FILE* file = fdopen(fd, "w");
+   generate(file, num);
+   fclose(file);
+
+   FILE* out = fopen("/dev/null", "w");
+   bcpp_init(false);
+   const double start = now();
+   const int ec = bcpp_run(name, out, false);
+   const double time = now() - start;
+   bcpp_free();
+   fclose(out);
+   unlink(name);
+
+   if (ec != 0) {
+      fputs("bench_bcpp: failed to pre-process\n", stderr);
+      return 1;
+   }
+   printf("%zu macros: %.3f s (%.0f lines/s)\n", num, time, 4 * num / time);
+   return 0;
+}
@@ -0,0 +1,473 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// Compile-throughput benchmark of bcc,
+// usage: bench_compile [-c path_bcc] [-o results.json] [-b baseline.json]
+//                      [-s scale] [-r runs] [-X option] [workload...]
+// Every workload is a generated C source, that stresses another part of the compiler.
+// It is compiled `runs` times with -ftime-report-json, the run with the median
+// wall time is reported with its lines/s, peak RSS and the time of every phase.
+// The results are saved as JSON, and compared against an earlier result with -b.
+
+#define _XOPEN_SOURCE 700
+#include <sys/wait.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "../include/buf.h"
+
+static char* path_bcc = "../bcc";
+static char** extra_args = NULL;
+static unsigned scale = 1;
+static char dir[] = "/tmp/bench_compile.XXXXXX";
+
+
+/// workloads
+
+// one function with thousands of statements
+static void gen_huge_function(FILE* file) {
+   fputs("int huge(int x, int y) {\n", file);
+   for (unsigned i = 0; i < 1500 * scale; ++i) {
+      fprintf(file, "   x = x * %u + y;\n", i % 13 + 1);
+      fprintf(file, "   if (x > %u) y = y - x / %u; else y = y + %u;\n", i * 7, i % 5 + 1, i);
+   }
+   fputs("   return x + y;\n}\n", file);
+}
+
+// expressions nested hundreds of levels deep
+static void gen_deep_expressions(FILE* file) {
+   for (unsigned f = 0; f < 200 * scale; ++f) {
+      fprintf(file, "int deep_%u(int a, int b) {\n   return ", f);
+      for (unsigned i = 0; i < 100; ++i)
+         fputc('(', file);
+      fputs("a", file);
+      for (unsigned i = 0; i < 100; ++i) {
+         static const char* ops[] = { "+", "-", "*", "^", "|", "&" };
+         fprintf(file, " %s %s)", ops[(f + i) % 6], i % 3 ? "b" : "3");
+      }
+      fputs(";\n}\n", file);
+   }
+}
+
+// thousands of small functions
+static void gen_many_functions(FILE* file) {
+   for (unsigned i = 0; i < 4000 * scale; ++i) {
+      fprintf(file, "int small_%u(int a, int b) {\n", i);
+      fprintf(file, "   if (a > b)\n      return a * %u - b;\n", i % 17);
+      fprintf(file, "   return b + %u;\n}\n", i);
+   }
+}
+
+// a switch with thousands of cases
+static void gen_giant_switch(FILE* file) {
+   fputs("int dispatch(int op, int acc) {\n   switch (op) {\n", file);
+   for (unsigned i = 0; i < 2000 * scale; ++i)
+      fprintf(file, "   case %u:\n      acc = acc * %u + %u;\n      break;\n", i * 3, i % 7 + 2, i);
+   fputs("   default:\n      acc = -acc;\n      break;\n   }\n   return acc;\n}\n", file);
+}
+
+// global arrays and variables, that are filled from initializer lists
+static void gen_global_tables(FILE* file) {
+   for (unsigned t = 0; t < 200 * scale; ++t) {
+      fprintf(file, "int table_%u[256];\nint count_%u = %u;\n", t, t, t);
+      fprintf(file, "void init_table_%u(void) {\n   int values[32] = {", t);
+      for (unsigned i = 0; i < 32; ++i)
+         fprintf(file, "%s%u", i ? ", " : " ", (t * 31 + i * 17) % 1000);
+      fputs(" };\n", file);
+      fprintf(file, "   for (int i = 0; i < 256; ++i)\n      table_%u[i] = values[i %% 32] + count_%u;\n}\n", t, t);
+   }
+}
+
+// a header with thousands of macros, that are expanded by the source
+static void gen_macro_headers(FILE* file) {
+   char* name = NULL;
+   buf_puts(name, dir);
+   buf_puts(name, "/macros.h");
+   buf_push(name, '\0');
+   FILE* header = fopen(name, "w");
+   if (!header) {
+      perror("bench_compile: fopen");
+      exit(1);
+   }
+   buf_free(name);
+   fputs("#ifndef MACROS_H\n#define MACROS_H\n", header);
+   for (unsigned i = 0; i < 3000 * scale; ++i) {
+      fprintf(header, "#define CONST_%u %u\n", i, i);
+      fprintf(header, "#define MIX_%u(a, b) ((a) * CONST_%u + (b))\n", i, i);
+   }
+   fputs("#define TWICE(x) ((x) + (x))\n#define MIX2(a, b) MIX_1(TWICE(a), MIX_2(b, a))\n#endif\n", header);
+   fclose(header);
+
+   fputs("#include \"macros.h\"\n", file);
+   for (unsigned f = 0; f < 300 * scale; ++f) {
+      fprintf(file, "int use_%u(int a, int b) {\n", f);
+      for (unsigned i = 0; i < 10; ++i)
+         fprintf(file, "   a = MIX_%u(a, b) + MIX2(b, CONST_%u);\n", (f * 10 + i) % (3000 * scale), f);
+      fputs("   return a;\n}\n", file);
+   }
+}
+
+// string literals in tables
+static void gen_string_tables(FILE* file) {
+   for (unsigned f = 0; f < 100 * scale; ++f) {
+      fprintf(file, "int strings_%u(void) {\n   const char* strings[32] = {\n", f);
+      for (unsigned i = 0; i < 32; ++i)
+         fprintf(file, "      \"string %u of table %u, with some text\\n\"%s\n", i, f, i + 1 < 32 ? "," : "");
+      fputs("   };\n   int sum = 0;\n", file);
+      fputs("   for (int i = 0; i < 32; ++i)\n      sum = sum + strings[i][i % 8];\n   return sum;\n}\n", file);
+   }
+}
+
+static const struct workload {
+   const char* name;
+   void (*generate)(FILE*);
+} workloads[] = {
+   { "huge_function",      gen_huge_function },
+   { "deep_expressions",   gen_deep_expressions },
+   { "many_functions",     gen_many_functions },
+   { "giant_switch",       gen_giant_switch },
+   { "global_tables",      gen_global_tables },
+   { "macro_headers",      gen_macro_headers },
+   { "string_tables",      gen_string_tables },
+};
+
+
+/// measuring
+
+struct result {
+   const struct workload* workload;
+   size_t lines;
+   double wall, cpu;
+   long rss;               // KiB
+   char* phases;           // the "phases" array of the time report
+};
+
+static double now(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static char* path_in_dir(const char* name) {
+   char* path = NULL;
+   buf_puts(path, dir);
+   buf_push(path, '/');
+   buf_puts(path, name);
+   buf_push(path, '\0');
+   return path;
+}
+
+static char* read_file(const char* name) {
+   FILE* file = fopen(name, "r");
+   if (!file)
+      return NULL;
+   char* text = NULL;
+   int ch;
+   while ((ch = fgetc(file)) != EOF)
+      buf_push(text, ch);
+   buf_push(text, '\0');
+   fclose(file);
+   return text;
+}
+
+static size_t count_lines(const char* name) {
+   FILE* file = fopen(name, "r");
+   size_t lines = 0;
+   int ch;
+   while ((ch = fgetc(file)) != EOF)
+      lines += ch == '\n';
+   fclose(file);
+   return lines;
+}
+
+// compiles `source` once, returns false, if bcc failed
+static bool compile(const char* source, const char* object, const char* report, double* wall) {
+   char* arg_report = NULL;
+   buf_puts(arg_report, "-ftime-report-json=");
+   buf_puts(arg_report, report);
+   buf_push(arg_report, '\0');
+
+   char** args = NULL;
+   buf_push(args, path_bcc);
+   buf_push(args, "-c");
+   buf_push(args, "-o");
+   buf_push(args, (char*)object);
+   buf_push(args, arg_report);
+   for (size_t i = 0; i < buf_len(extra_args); ++i)
+      buf_push(args, extra_args[i]);
+   buf_push(args, (char*)source);
+   buf_push(args, NULL);
+
+   const double start = now();
+   const pid_t pid = fork();
+   if (pid < 0) {
+      perror("bench_compile: fork");
+      exit(1);
+   } else if (pid == 0) {
+      execv(path_bcc, args);
+      perror("bench_compile: execv");
+      _exit(255);
+   }
+   int wstatus;
+   waitpid(pid, &wstatus, 0);
+   *wall = now() - start;
+   buf_free(args);
+   buf_free(arg_report);
+   return WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0;
+}
+
+// extracts the totals and the phases from the time report of bcc
+static bool parse_report(const char* text, struct result* r) {
+   const char* phases = strstr(text, "\"phases\": [");
+   const char* total = strstr(text, "\"total\": {");
+   if (!phases || !total)
+      return false;
+   phases += 10;
+   const char* end = strchr(phases, ']');
+   if (!end)
+      return false;
+   r->phases = NULL;
+   for (const char* s = phases; s <= end; ++s) {
+      if (*s != '\n')
+         buf_push(r->phases, *s);
+   }
+   buf_push(r->phases, '\0');
+   double wall;
+   return sscanf(total, "\"total\": {\"wall\": %lf, \"cpu\": %lf, \"peak_rss_kib\": %ld}",
+         &wall, &r->cpu, &r->rss) == 3;
+}
+
+static int cmp_double(const void* a, const void* b) {
+   const double x = *(const double*)a, y = *(const double*)b;
+   return (x > y) - (x < y);
+}
+
+static bool run_workload(const struct workload* w, unsigned runs, struct result* r) {
+   char* source = path_in_dir("bench.c");
+   char* object = path_in_dir("bench.o");
+   FILE* file = fopen(source, "w");
+   if (!file) {
+      perror("bench_compile: fopen");
+      exit(1);
+   }
+   w->generate(file);
+   fclose(file);
+
+   memset(r, 0, sizeof(*r));
+   r->workload = w;
+   r->lines = count_lines(source);
+
+   // the report of the run with the median time is kept
+   double* walls = calloc(runs, sizeof(double));
+   char** reports = calloc(runs, sizeof(char*));
+   bool success = true;
+   for (unsigned i = 0; i < runs && success; ++i) {
+      char name[32];
+      snprintf(name, sizeof(name), "report%u.json", i);
+      char* report = path_in_dir(name);
+      success = compile(source, object, report, &walls[i]);
+      reports[i] = success ? read_file(report) : NULL;
+      remove(report);
+      buf_free(report);
+   }
+   if (success) {
+      double* sorted = calloc(runs, sizeof(double));
+      memcpy(sorted, walls, runs * sizeof(double));
+      qsort(sorted, runs, sizeof(double), cmp_double);
+      r->wall = sorted[runs / 2];
+      free(sorted);
+      for (unsigned i = 0; i < runs; ++i) {
+         if (walls[i] == r->wall) {
+            success = reports[i] && parse_report(reports[i], r);
+            break;
+         }
+      }
+      if (!success)
+         fprintf(stderr, "bench_compile: %s: invalid time report\n", w->name);
+   } else {
+      fprintf(stderr, "bench_compile: %s: failed to compile\n", w->name);
+   }
+   for (unsigned i = 0; i < runs; ++i)
+      buf_free(reports[i]);
+   free(reports);
+   free(walls);
+   remove(source);
+   remove(object);
+   buf_free(source);
+   buf_free(object);
+   return success;
+}
+
+
+/// reporting
+
+// the short hash of the checked out commit, or "unknown"
+static char* get_commit(void) {
+   static char commit[64] = "unknown";
+   FILE* git = popen("git rev-parse --short HEAD 2>/dev/null", "r");
+   if (git) {
+      if (fgets(commit, sizeof(commit), git))
+         commit[strcspn(commit, "\n")] = '\0';
+      if (pclose(git) != 0 || !*commit)
+         strcpy(commit, "unknown");
+   }
+   return commit;
+}
+
+static bool write_json(const char* name, const struct result* results, size_t num) {
+   FILE* file = fopen(name, "w");
+   if (!file) {
+      perror("bench_compile: fopen");
+      return false;
+   }
+   fprintf(file, "{\n  \"commit\": \"%s\",\n  \"scale\": %u,\n  \"workloads\": [\n", get_commit(), scale);
+   for (size_t i = 0; i < num; ++i) {
+      const struct result* r = &results[i];
+      fprintf(file, "    {\"name\": \"%s\", \"lines\": %zu, \"wall\": %.6f, \"cpu\": %.6f, "
+            "\"lines_per_sec\": %.0f, \"peak_rss_kib\": %ld,\n     \"phases\": %s}%s\n",
+            r->workload->name, r->lines, r->wall, r->cpu, r->lines / r->wall, r->rss,
+            r->phases, i + 1 < num ? "," : "");
+   }
+   fputs("  ]\n}\n", file);
+   return fclose(file) == 0;
+}
+
+// returns the wall time of `workload` in an earlier result, or a negative number
+static double baseline_wall(const char* baseline, const char* workload) {
+   char key[64];
+   snprintf(key, sizeof(key), "{\"name\": \"%s\",", workload);
+   const char* s = baseline ? strstr(baseline, key) : NULL;
+   if (!s || !(s = strstr(s, "\"wall\": ")))
+      return -1.0;
+   return strtod(s + 8, NULL);
+}
+
+static void print_results(const struct result* results, size_t num, const char* baseline) {
+   printf("%-20s%10s%12s%12s%16s%s\n", "workload", "lines", "wall (s)", "lines/s", "peak RSS (KiB)",
+         baseline ? "    change" : "");
+   for (size_t i = 0; i < num; ++i) {
+      const struct result* r = &results[i];
+      printf("%-20s%10zu%12.4f%12.0f%16ld", r->workload->name, r->lines, r->wall, r->lines / r->wall, r->rss);
+      const double base = baseline_wall(baseline, r->workload->name);
+      if (base > 0.0)
+         printf("%+9.1f%%", 100.0 * (r->wall - base) / base);
+      putchar('\n');
+   }
+}
+
+int main(int argc, char* argv[]) {
+   const char* output = "bench-compile.json";
+   const char* path_baseline = NULL;
+   unsigned runs = 3;
+   int option;
+   while ((option = getopt(argc, argv, "c:o:b:s:r:X:h")) != -1) {
+      switch (option) {
+      case 'c':
+         path_bcc = optarg;
+         break;
+      case 'o':
+         output = optarg;
+         break;
+      case 'b':
+         path_baseline = optarg;
+         break;
+      case 's':
+         scale = (unsigned)strtoul(optarg, NULL, 10);
+         break;
+      case 'r':
+         runs = (unsigned)strtoul(optarg, NULL, 10);
+         break;
+      case 'X':
+      {
+         const size_t len = strlen(optarg) + 2;
+         char* arg = malloc(len);
+         snprintf(arg, len, "-%s", optarg);
+         buf_push(extra_args, arg);
+         break;
+      }
+      default:
+         puts("Usage: bench_compile [options] [workload...]");
+         puts("Options:");
+         puts(" -c path_bcc               Path to the compiler");
+         puts(" -o results.json           Where to save the results");
+         puts(" -b baseline.json          Compare with earlier results");
+         puts(" -s scale                  Multiply the size of the workloads");
+         puts(" -r runs                   Number of compilations per workload");
+         puts(" -X option                 Pass option to bcc");
+         puts("Workloads:");
+         for (size_t i = 0; i < arraylen(workloads); ++i)
+            printf(" %s\n", workloads[i].name);
+         return option == 'h' ? 0 : 1;
+      }
+   }
+   if (!scale || !runs) {
+      fputs("bench_compile: the scale and the number of runs must be positive\n", stderr);
+      return 1;
+   }
+
+   for (int j = optind; j < argc; ++j) {
+      bool found = false;
+      for (size_t i = 0; i < arraylen(workloads); ++i)
+         found |= !strcmp(argv[j], workloads[i].name);
+      if (!found) {
+         fprintf(stderr, "bench_compile: no such workload: '%s'\n", argv[j]);
+         return 1;
+      }
+   }
+
+   char* baseline = NULL;
+   if (path_baseline && !(baseline = read_file(path_baseline))) {
+      fprintf(stderr, "bench_compile: failed to read '%s'\n", path_baseline);
+      return 1;
+   }
+   if (!mkdtemp(dir)) {
+      perror("bench_compile: mkdtemp");
+      return 1;
+   }
+
+   struct result* results = NULL;
+   int ec = 0;
+   for (size_t i = 0; i < arraylen(workloads); ++i) {
+      const struct workload* w = &workloads[i];
+      bool selected = optind == argc;
+      for (int j = optind; j < argc; ++j)
+         selected |= !strcmp(argv[j], w->name);
+      if (!selected)
+         continue;
+      struct result r;
+      if (run_workload(w, runs, &r)) {
+         buf_push(results, r);
+      } else {
+         ec = 1;
+      }
+   }
+   char* header = path_in_dir("macros.h");
+   remove(header);
+   buf_free(header);
+   rmdir(dir);
+
+   print_results(results, buf_len(results), baseline);
+   if (!write_json(output, results, buf_len(results)))
+      ec = 1;
+   for (size_t i = 0; i < buf_len(results); ++i)
+      buf_free(results[i].phases);
+   buf_free(results);
+   buf_free(baseline);
+   return ec;
+}
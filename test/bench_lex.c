@@ -0,0 +1,147 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// Throughput benchmark of the lexer (src/lex.c),
+// usage: bench_lex [file.i [MiB]]
+// Without a file, a preprocessed source of `MiB` MiB is generated.
+// The input is lexed once from a regular file and once from a pipe.
+
+#define _XOPEN_SOURCE 700
+#include <sys/wait.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "../include/error.h"
+#include "../include/lex.h"
+
+void panic_impl(const char* func, const char* fmt, ...) {
+   va_list ap;
+   va_start(ap, fmt);
+   fprintf(stderr, "bench_lex: %s(): ", func);
+   vfprintf(stderr, fmt, ap);
+   fputc('\n', stderr);
+   va_end(ap);
+   exit(1);
+}
+void parse_error(const struct source_pos* pos, const char* fmt, ...) {
+   va_list ap;
+   va_start(ap, fmt);
+   print_source_pos(stderr, pos);
+   fputs(": ", stderr);
+   vfprintf(stderr, fmt, ap);
+   fputc('\n', stderr);
+   va_end(ap);
+   exit(1);
+}
+void parse_warn(const struct source_pos* pos, const char* fmt, ...) {
+   (void)pos;
+   (void)fmt;
+}
+
+static const char* snippet =
+   "# 12 \"bench.c\"\n"
+   "static int parse_number(const char* str, unsigned long* result) {\n"
+   "   unsigned long value = 0;\n"
+   "   while (*str >= '0' && *str <= '9') {\n"
+   "      value = value * 10 + (unsigned long)(*str - '0');\n"
+   "      ++str;\n"
+   "   }\n"
+   "   if (value > 0x7fffffff) return -1;\n"
+   "   *result = value;\n"
+   "   return printf(\"%lu\\n\", value) >= 0;\n"
+   "}\n\n";
+
+static double now(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t lex_all(FILE* file) {
+   size_t num = 0;
+   lexer_init(file, "bench.i", NULL);
+   while (lexer_next().type != TK_EOF)
+      ++num;
+   lexer_free();
+   return num;
+}
+
+static void report(const char* name, size_t size, size_t num, double t) {
+   printf("%-6s %8.1f MB/s, %zu tokens in %.3fs\n", name, size / t / 1e6, num, t);
+}
+
+int main(int argc, char* argv[]) {
+   char path[] = "/tmp/bench_lex.XXXXXX";
+   const char* input = argc > 1 ? argv[1] : NULL;
+   const size_t mib = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+   if (!input) {
+      const int fd = mkstemp(path);
+      FILE* file = fd < 0 ? NULL : fdopen(fd, "w");
+      if (!file) {
+         perror("bench_lex");
+         return 1;
+      }
+      const size_t len = strlen(snippet);
+      for (size_t i = 0; i < mib * 1024 * 1024 / len; ++i)
+         fputs(snippet, file);
+      fclose(file);
+      input = path;
+   }
+
+   FILE* file = fopen(input, "r");
+   if (!file) {
+      perror(input);
+      return 1;
+   }
+   fseek(file, 0, SEEK_END);
+   const size_t size = (size_t)ftell(file);
+   rewind(file);
+
+   double begin = now();
+   size_t num = lex_all(file);
+   report("file", size, num, now() - begin);
+
+   // the same input through a pipe, like the output of bcpp
+   int pipes[2];
+   if (pipe(pipes) != 0) {
+      perror("pipe");
+      return 1;
+   }
+   const pid_t pid = fork();
+   if (pid == 0) {
+      close(pipes[0]);
+      file = fopen(input, "r");
+      char buffer[65536];
+      size_t n;
+      while (file && (n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+         if (write(pipes[1], buffer, n) != (ssize_t)n)
+            break;
+      }
+      _exit(0);
+   }
+   close(pipes[1]);
+   begin = now();
+   num = lex_all(fdopen(pipes[0], "r"));
+   report("pipe", size, num, now() - begin);
+   waitpid(pid, NULL, 0);
+
+   if (input == path)
+      remove(path);
+   return 0;
+}
@@ -0,0 +1,57 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+int printf(const char* fmt, ...);
+long clock(void);
+
+// Measures the cost of integer multiplication, division and modulo.
+// `make bench-muldiv` builds it once natively and once with -mlibcall-muldiv.
+
+#define NUM_ITER 10000000
+
+// clock() ticks are microseconds on POSIX systems
+static void report(const char* name, long begin, long end) {
+   printf("%s: %ld ps/op\n", name, (end - begin) * 1000000 / NUM_ITER);
+}
+
+int main(void) {
+   long hash = 5381;
+   long sum = 0;
+   long q = 0;
+   unsigned u = 0;
+   long begin;
+
+   begin = clock();
+   for (long i = 1; i < NUM_ITER; ++i) {
+      hash = hash * 33 + i;
+   }
+   report("mul", begin, clock());
+
+   begin = clock();
+   for (long i = 1; i < NUM_ITER; ++i) {
+      q += hash / i;
+   }
+   report("div", begin, clock());
+
+   begin = clock();
+   for (long i = 1; i < NUM_ITER; ++i) {
+      u = (unsigned)i % 1000;
+      sum += u;
+   }
+   report("mod", begin, clock());
+
+   return (int)((hash ^ q ^ sum) & 127);
+}
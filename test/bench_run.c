@@ -0,0 +1,510 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// Runtime benchmark of the code generated by bcc,
+// usage: bench_run [-c path_bcc] [-k kernel_dir] [-o results.json] [-R ref_cc]
+//                  [-r runs] [-t timeout] [-X option] [kernel...]
+// Every kernel (see kernels/) is compiled with -O0 to -O3, and run `runs` times.
+// The median wall time, the number of instructions in the assembly,
+// the size of the code and of the executable are reported for every level.
+// With -R, the kernels are also compiled with `ref_cc -O2` for comparison.
+// The output of every build must be the same, otherwise the kernel fails.
+
+#define _XOPEN_SOURCE 700
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <elf.h>
+#include "../include/buf.h"
+
+#define NUM_LEVELS 4
+
+static char* path_bcc = "../bcc";
+static char* kernel_dir = "kernels";
+static char* ref_cc = NULL;
+static char** extra_args = NULL;
+static unsigned timeout = 60;
+static char dir[] = "/tmp/bench_run.XXXXXX";
+
+static const char* kernels[] = {
+   "checksum",
+   "sort",
+   "hashtable",
+   "strscan",
+   "matrix",
+   "interp",
+   "dispatch",
+};
+
+struct measurement {
+   bool valid;
+   double time;            // median wall time (s)
+   size_t insns;           // instructions in the assembly
+   size_t text;            // size of the executable sections
+   size_t size;            // size of the executable
+};
+
+struct result {
+   const char* kernel;
+   struct measurement levels[NUM_LEVELS];
+   struct measurement ref;
+};
+
+
+/// helpers
+
+static double now(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static char* concat(const char* a, const char* b, const char* c) {
+   char* s = NULL;
+   buf_puts(s, a);
+   buf_puts(s, b);
+   buf_puts(s, c);
+   buf_push(s, '\0');
+   return s;
+}
+
+static bool file_exists(const char* name) {
+   struct stat st;
+   return stat(name, &st) == 0;
+}
+
+static int cmp_double(const void* a, const void* b) {
+   const double x = *(const double*)a, y = *(const double*)b;
+   return (x > y) - (x < y);
+}
+
+// runs `args` (a NULL-terminated buf), returns false, if it failed or timed out,
+// the standard output is saved into `output`, if it is non-NULL
+static bool run(char** args, char** output, double* wall) {
+   int fds[2];
+   if (pipe(fds) != 0) {
+      perror("bench_run: pipe");
+      exit(1);
+   }
+   const double start = now();
+   const pid_t pid = fork();
+   if (pid < 0) {
+      perror("bench_run: fork");
+      exit(1);
+   } else if (pid == 0) {
+      close(fds[0]);
+      dup2(fds[1], STDOUT_FILENO);
+      close(fds[1]);
+      alarm(timeout);
+      execvp(args[0], args);
+      perror("bench_run: execvp");
+      _exit(255);
+   }
+   close(fds[1]);
+   char buffer[256];
+   ssize_t n;
+   while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+      if (output) {
+         for (ssize_t i = 0; i < n; ++i)
+            buf_push(*output, buffer[i]);
+      }
+   }
+   close(fds[0]);
+   int wstatus;
+   waitpid(pid, &wstatus, 0);
+   if (wall)
+      *wall = now() - start;
+   if (output)
+      buf_push(*output, '\0');
+   return WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0;
+}
+
+
+/// measuring
+
+// the arguments to compile `source` with bcc, or the reference compiler, if level < 0
+static char** compile_args(const char* source, const char* output, int level, bool assembly) {
+   static char levels[NUM_LEVELS][4] = { "-O0", "-O1", "-O2", "-O3" };
+   char** args = NULL;
+   if (level < 0) {
+      buf_push(args, ref_cc);
+      buf_push(args, "-O2");
+      buf_push(args, "-w");
+   } else {
+      buf_push(args, path_bcc);
+      buf_push(args, levels[level]);
+      for (size_t i = 0; i < buf_len(extra_args); ++i)
+         buf_push(args, extra_args[i]);
+   }
+   if (assembly)
+      buf_push(args, "-S");
+   buf_push(args, "-o");
+   buf_push(args, (char*)output);
+   if (level < 0) {
+      buf_push(args, (char*)source);
+      buf_push(args, NULL);
+      return args;
+   }
+
+   // a bcc in the source tree uses the headers and libraries next to it
+   const char* slash = strrchr(path_bcc, '/');
+   char* root = NULL;
+   if (slash) {
+      for (const char* s = path_bcc; s < slash; ++s)
+         buf_push(root, *s);
+   } else {
+      buf_push(root, '.');
+   }
+   buf_push(root, '\0');
+   char* crtbegin = concat(root, "/libbcc/crtbegin.o", "");
+   if (file_exists(crtbegin)) {
+      buf_push(args, concat("-I", root, "/bcc-include"));
+      if (!assembly) {
+         buf_push(args, concat("-L", root, "/libbcc"));
+         buf_push(args, "-nobccobjs");
+         buf_push(args, crtbegin);
+         crtbegin = NULL;
+      }
+      buf_push(args, (char*)source);
+      if (!assembly)
+         buf_push(args, concat(root, "/libbcc/crtend.o", ""));
+   } else {
+      buf_push(args, (char*)source);
+   }
+   buf_free(crtbegin);
+   buf_free(root);
+   buf_push(args, NULL);
+   return args;
+}
+
+// counts the lines of the assembly, that are neither labels, directives nor comments
+static size_t count_insns(const char* name) {
+   FILE* file = fopen(name, "r");
+   if (!file)
+      return 0;
+   size_t insns = 0;
+   char line[512];
+   while (fgets(line, sizeof(line), file)) {
+      const char* s = line;
+      while (*s == ' ' || *s == '\t')
+         ++s;
+      size_t len = strcspn(s, "\n");
+      while (len && (s[len - 1] == ' ' || s[len - 1] == '\t'))
+         --len;
+      if (!len || *s == '.' || *s == '#' || *s == '/' || s[len - 1] == ':')
+         continue;
+      ++insns;
+   }
+   fclose(file);
+   return insns;
+}
+
+// the sum of the sizes of the executable sections of an ELF64 file, or 0
+static size_t text_size(const char* name) {
+   FILE* file = fopen(name, "rb");
+   if (!file)
+      return 0;
+   size_t text = 0;
+   Elf64_Ehdr ehdr;
+   if (fread(&ehdr, sizeof(ehdr), 1, file) == 1 && !memcmp(ehdr.e_ident, ELFMAG, SELFMAG)
+         && ehdr.e_ident[EI_CLASS] == ELFCLASS64 && ehdr.e_shentsize == sizeof(Elf64_Shdr)) {
+      for (unsigned i = 0; i < ehdr.e_shnum; ++i) {
+         Elf64_Shdr shdr;
+         if (fseek(file, (long)(ehdr.e_shoff + i * sizeof(shdr)), SEEK_SET) != 0
+               || fread(&shdr, sizeof(shdr), 1, file) != 1)
+            break;
+         if (shdr.sh_flags & SHF_EXECINSTR)
+            text += shdr.sh_size;
+      }
+   }
+   fclose(file);
+   return text;
+}
+
+// builds and runs `source`, the output of the first run is compared against `expected`
+static bool measure(const char* kernel, const char* source, int level, unsigned runs,
+      char** expected, struct measurement* m) {
+   char suffix[8];
+   if (level < 0) {
+      strcpy(suffix, "-ref");
+   } else {
+      snprintf(suffix, sizeof(suffix), "-O%d", level);
+   }
+   char* exe = concat(dir, "/", kernel);
+   buf_pop(exe);
+   buf_puts(exe, suffix);
+   buf_push(exe, '\0');
+   char* assembly = concat(exe, ".s", "");
+   const char* name = level < 0 ? ref_cc : "bcc";
+
+   memset(m, 0, sizeof(*m));
+   char** args = compile_args(source, exe, level, false);
+   bool success = run(args, NULL, NULL);
+   buf_free(args);
+   if (!success) {
+      fprintf(stderr, "bench_run: %s%s: failed to compile with %s\n", kernel, suffix, name);
+      goto end;
+   }
+   args = compile_args(source, assembly, level, true);
+   if (run(args, NULL, NULL))
+      m->insns = count_insns(assembly);
+   buf_free(args);
+   struct stat st;
+   if (stat(exe, &st) == 0)
+      m->size = (size_t)st.st_size;
+   m->text = text_size(exe);
+
+   double* walls = calloc(runs, sizeof(double));
+   char* exe_args[] = { exe, NULL };
+   for (unsigned i = 0; i < runs && success; ++i) {
+      char* output = NULL;
+      success = run(exe_args, &output, &walls[i]);
+      if (!success) {
+         fprintf(stderr, "bench_run: %s%s: failed to run\n", kernel, suffix);
+      } else if (!*expected) {
+         *expected = output;
+         output = NULL;
+      } else if (strcmp(*expected, output) != 0) {
+         fprintf(stderr, "bench_run: %s%s: wrong output: %s", kernel, suffix, output);
+         success = false;
+      }
+      buf_free(output);
+   }
+   if (success) {
+      qsort(walls, runs, sizeof(double), cmp_double);
+      m->time = walls[runs / 2];
+      m->valid = true;
+   }
+   free(walls);
+
+end:
+   remove(exe);
+   remove(assembly);
+   buf_free(exe);
+   buf_free(assembly);
+   return success;
+}
+
+static bool run_kernel(const char* kernel, unsigned runs, struct result* r) {
+   char* source = concat(kernel_dir, "/", kernel);
+   buf_pop(source);
+   buf_puts(source, ".c");
+   buf_push(source, '\0');
+   memset(r, 0, sizeof(*r));
+   if (!file_exists(source)) {
+      fprintf(stderr, "bench_run: failed to find '%s'\n", source);
+      buf_free(source);
+      return false;
+   }
+
+   r->kernel = kernel;
+   char* expected = NULL;
+   bool success = true;
+   if (ref_cc)
+      success &= measure(kernel, source, -1, runs, &expected, &r->ref);
+   for (int level = 0; level < NUM_LEVELS; ++level)
+      success &= measure(kernel, source, level, runs, &expected, &r->levels[level]);
+   buf_free(expected);
+   buf_free(source);
+   return success;
+}
+
+
+/// reporting
+
+// the short hash of the checked out commit, or "unknown"
+static char* get_commit(void) {
+   static char commit[64] = "unknown";
+   FILE* git = popen("git rev-parse --short HEAD 2>/dev/null", "r");
+   if (git) {
+      if (fgets(commit, sizeof(commit), git))
+         commit[strcspn(commit, "\n")] = '\0';
+      if (pclose(git) != 0 || !*commit)
+         strcpy(commit, "unknown");
+   }
+   return commit;
+}
+
+static void write_measurement(FILE* file, const char* name, const struct measurement* m) {
+   fprintf(file, "{\"name\": \"%s\", ", name);
+   if (m->valid) {
+      fprintf(file, "\"time\": %.6f, ", m->time);
+   } else {
+      fputs("\"time\": null, ", file);
+   }
+   fprintf(file, "\"insns\": %zu, \"text\": %zu, \"size\": %zu}", m->insns, m->text, m->size);
+}
+
+static bool write_json(const char* name, const struct result* results, size_t num, unsigned runs) {
+   FILE* file = fopen(name, "w");
+   if (!file) {
+      perror("bench_run: fopen");
+      return false;
+   }
+   fprintf(file, "{\n  \"commit\": \"%s\",\n  \"runs\": %u,\n", get_commit(), runs);
+   if (ref_cc)
+      fprintf(file, "  \"reference\": \"%s -O2\",\n", ref_cc);
+   fputs("  \"kernels\": [\n", file);
+   for (size_t i = 0; i < num; ++i) {
+      const struct result* r = &results[i];
+      fprintf(file, "    {\"name\": \"%s\", \"levels\": [\n", r->kernel);
+      for (int level = 0; level < NUM_LEVELS; ++level) {
+         char name[4];
+         snprintf(name, sizeof(name), "O%d", level);
+         fputs("      ", file);
+         write_measurement(file, name, &r->levels[level]);
+         fputs(level + 1 < NUM_LEVELS ? ",\n" : "\n     ]", file);
+      }
+      if (ref_cc) {
+         fputs(",\n     \"reference\": ", file);
+         write_measurement(file, "ref", &r->ref);
+      }
+      fprintf(file, "}%s\n", i + 1 < num ? "," : "");
+   }
+   fputs("  ]\n}\n", file);
+   return fclose(file) == 0;
+}
+
+static void print_measurement(const char* kernel, const char* level, const struct measurement* m,
+      const struct measurement* base, const struct measurement* ref) {
+   printf("%-12s%-6s", kernel, level);
+   if (m->valid) {
+      printf("%12.4f", m->time);
+   } else {
+      printf("%12s", "-");
+   }
+   if (m->valid && base->valid && m->time > 0.0) {
+      printf("%10.2fx", base->time / m->time);
+   } else {
+      printf("%11s", "-");
+   }
+   printf("%10zu%10zu%10zu", m->insns, m->text, m->size);
+   if (ref && m->valid && ref->valid && ref->time > 0.0)
+      printf("%10.2fx", m->time / ref->time);
+   putchar('\n');
+}
+
+// the speed-up is relative to -O0, the slow-down relative to the reference compiler
+static void print_results(const struct result* results, size_t num) {
+   printf("%-12s%-6s%12s%11s%10s%10s%10s%s\n", "kernel", "level", "median (s)", "speed-up",
+         "insns", "text", "size", ref_cc ? "  vs. ref" : "");
+   for (size_t i = 0; i < num; ++i) {
+      const struct result* r = &results[i];
+      const struct measurement* ref = ref_cc ? &r->ref : NULL;
+      for (int level = 0; level < NUM_LEVELS; ++level) {
+         char name[4];
+         snprintf(name, sizeof(name), "O%d", level);
+         print_measurement(level ? "" : r->kernel, name, &r->levels[level], &r->levels[0], ref);
+      }
+      if (ref)
+         print_measurement("", "ref", ref, &r->levels[0], NULL);
+   }
+}
+
+int main(int argc, char* argv[]) {
+   const char* output = "bench-run.json";
+   unsigned runs = 5;
+   int option;
+   while ((option = getopt(argc, argv, "c:k:o:R:r:t:X:h")) != -1) {
+      switch (option) {
+      case 'c':
+         path_bcc = optarg;
+         break;
+      case 'k':
+         kernel_dir = optarg;
+         break;
+      case 'o':
+         output = optarg;
+         break;
+      case 'R':
+         ref_cc = optarg;
+         break;
+      case 'r':
+         runs = (unsigned)strtoul(optarg, NULL, 10);
+         break;
+      case 't':
+         timeout = (unsigned)strtoul(optarg, NULL, 10);
+         break;
+      case 'X':
+      {
+         const size_t len = strlen(optarg) + 2;
+         char* arg = malloc(len);
+         snprintf(arg, len, "-%s", optarg);
+         buf_push(extra_args, arg);
+         break;
+      }
+      default:
+         puts("Usage: bench_run [options] [kernel...]");
+         puts("Options:");
+         puts(" -c path_bcc               Path to the compiler");
+         puts(" -k kernel_dir             Directory of the kernels");
+         puts(" -o results.json           Where to save the results");
+         puts(" -R ref_cc                 Compare with another compiler (with -O2)");
+         puts(" -r runs                   Number of runs per kernel and level");
+         puts(" -t timeout                Maximum time per run in seconds");
+         puts(" -X option                 Pass option to bcc");
+         puts("Kernels:");
+         for (size_t i = 0; i < arraylen(kernels); ++i)
+            printf(" %s\n", kernels[i]);
+         return option == 'h' ? 0 : 1;
+      }
+   }
+   if (!runs || !timeout) {
+      fputs("bench_run: the number of runs and the timeout must be positive\n", stderr);
+      return 1;
+   }
+
+   for (int j = optind; j < argc; ++j) {
+      bool found = false;
+      for (size_t i = 0; i < arraylen(kernels); ++i)
+         found |= !strcmp(argv[j], kernels[i]);
+      if (!found) {
+         fprintf(stderr, "bench_run: no such kernel: '%s'\n", argv[j]);
+         return 1;
+      }
+   }
+   if (!mkdtemp(dir)) {
+      perror("bench_run: mkdtemp");
+      return 1;
+   }
+
+   struct result* results = NULL;
+   int ec = 0;
+   for (size_t i = 0; i < arraylen(kernels); ++i) {
+      bool selected = optind == argc;
+      for (int j = optind; j < argc; ++j)
+         selected |= !strcmp(argv[j], kernels[i]);
+      if (!selected)
+         continue;
+      struct result r;
+      if (!run_kernel(kernels[i], runs, &r))
+         ec = 1;
+      if (r.kernel)
+         buf_push(results, r);
+   }
+   rmdir(dir);
+
+   print_results(results, buf_len(results));
+   if (!write_json(output, results, buf_len(results), runs))
+      ec = 1;
+   buf_free(results);
+   return ec;
+}
@@ -0,0 +1,88 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// Microbenchmark of the string interner (src/strint.c),
+// usage: bench_strint [num_identifiers [num_lookups]]
+
+#define _XOPEN_SOURCE 700
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "../include/strint.h"
+
+static const char* prefixes[] = {
+   "i", "len", "buf", "node", "tmp", "value", "next", "cur", "get_", "set_",
+   "parse_", "emit_", "is_", "num_", "ptr", "__builtin_", "scope", "expr",
+};
+
+static double now(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// generates identifiers, that look like the ones of real code
+static char** make_corpus(size_t num) {
+   char** corpus = malloc(num * sizeof(char*));
+   if (!corpus) {
+      perror("bench_strint");
+      exit(1);
+   }
+   for (size_t i = 0; i < num; ++i) {
+      const char* prefix = prefixes[i % (sizeof(prefixes) / sizeof(*prefixes))];
+      char buffer[64];
+      snprintf(buffer, sizeof(buffer), "%s%zx_%zu", prefix, i * 2654435761u % 0xfffff, i);
+      corpus[i] = strdup(buffer);
+   }
+   return corpus;
+}
+
+int main(int argc, char* argv[]) {
+   const size_t num = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+   const size_t num_lookups = argc > 2 ? strtoul(argv[2], NULL, 10) : 5000000;
+   if (!num) {
+      fputs("Usage: bench_strint [num_identifiers [num_lookups]]\n", stderr);
+      return 1;
+   }
+   char** corpus = make_corpus(num);
+
+   double begin = now();
+   for (size_t i = 0; i < num; ++i)
+      strint(corpus[i]);
+   const double insert_ns = (now() - begin) / num;
+
+   // pseudo-random lookups of existing identifiers
+   uint32_t seed = 42;
+   size_t check = 0;
+   begin = now();
+   for (size_t i = 0; i < num_lookups; ++i) {
+      seed = seed * 1664525 + 1013904223;
+      check += (size_t)strint(corpus[seed % num]) & 1;
+   }
+   const double lookup_ns = (now() - begin) / num_lookups;
+
+   struct strint_stats stats;
+   strint_stats(&stats);
+   printf("identifiers:   %zu\n", stats.num_strings);
+   printf("table size:    %zu\n", stats.table_size);
+   printf("insert:        %.1f ns/string\n", insert_ns);
+   printf("lookup:        %.1f ns/lookup\n", lookup_ns);
+   printf("memory:        %zu KiB (%.1f bytes/string)\n", stats.memory / 1024,
+         (double)stats.memory / stats.num_strings);
+   return check == SIZE_MAX;
+}
@@ -653,6 +653,55 @@
       "}",
    .ret_val = 98,
 },
+{
+   .name = "jump table & binary search switch",
+   .compiles = true,
+   .source =
+      "int dense(int x) {"
+      "  switch (x) {"
+      "  case 0: return 3;"
+      "  case 1: return 5;"
+      "  case 2: x = x + 4;"
+      "  case 3: return x * 2;"
+      "  case 5: return 7;"
+      "  case 6: break;"
+      "  default: return 1;"
+      "  }"
+      "  return 11;"
+      "}"
+      "int sparse(int x) {"
+      "  switch (x) {"
+      "  case -500: return 2;"
+      "  case 7: return 3;"
+      "  case 60: return 4;"
+      "  case 900: return 5;"
+      "  case 1000: return 6;"
+      "  case 1001: return 7;"
+      "  case 1002: return 8;"
+      "  case 1003: return 9;"
+      "  case 100000: return 10;"
+      "  }"
+      "  return 0;"
+      "}"
+      "int negative(int x) {"
+      "  switch (x) {"
+      "  case -5: return 2;"
+      "  case -4: return 3;"
+      "  case -2: return 4;"
+      "  case 1: return 7;"
+      "  case 3: return 8;"
+      "  default: return 1;"
+      "  }"
+      "}"
+      "int main(void) {"
+      "  int s = 0;"
+      "  for (int i = -600; i < 1100; ++i)"
+      "    s = s + dense(i) * 3 + sparse(i) + negative(i) * i;"
+      "  s = s + sparse(100000);"
+      "  return s == 429426 ? 42 : 1;"
+      "}",
+   .ret_val = 42,
+},
 {
    .name = "declaration & definition of function",
    .compiles = true,
@@ -1099,3 +1148,205 @@
       "}",
    .ret_val = 69,
 },
+{
+   .name = "multiplication, division and modulo",
+   .compiles = true,
+   .source =
+      "int sdiv(int a, int b) { return a / b; }"
+      "int smod(int a, int b) { return a % b; }"
+      "unsigned udiv(unsigned a, unsigned b) { return a / b; }"
+      "long lmul(long a, long b) { return a * b; }"
+      "int main() {"
+      "  int a = -17;"
+      "  int b = 5;"
+      "  int x = a * b + a / b + a % b + b % 3 + 100 / b;"
+      "  if (x != -68) return 1;"
+      "  if (sdiv(-7, 2) != -3) return 2;"
+      "  if (smod(-7, 2) != -1) return 2;"
+      "  if (udiv(a, 3) != 1431655759) return 3;"
+      "  if (lmul(100000, 100000) / 7 != 1428571428) return 4;"
+      "  return 42;"
+      "}",
+   .ret_val = 42,
+},
+{
+   .name = "register pressure across calls",
+   .compiles = true,
+   .source =
+      "int f(int x) { return x + 1; }"
+      "int main() {"
+      "  int a = 3;"
+      "  int b = 4;"
+      "  int x = (a + 1) * f(b) + ((a + 2) * f(b + 1) + ((a + 3) * f(b + 2) + ((a + 4) * f(b + 3) + ((a + 5) * f(b + 4) + ((a + 6) * f(b + 5) + ((a + 7) * f(b + 6) + ((a + 8) * f(b + 7) + ((a + 9) * f(b + 8) + (a + 10) * f(b + 9)))))))));"
+      "  if (x != 890) return x;"
+      "  if ((a + b) * (a - b) - ((a * b + 1) * (b - a) + (a + 5) / (b - 2) % 3) != -21) return 2;"
+      "  return 42;"
+      "}",
+   .ret_val = 42,
+},
+{
+   .name = "locals in registers",
+   .compiles = true,
+   .source =
+      "void inc(int* p) { *p = *p + 1; }"
+      "int f(char c, unsigned char uc, int n) {"
+      "  int s = 0;"
+      "  int t = 0;"
+      "  for (int i = 0; i < n; ++i) {"
+      "    c = c + 50;"
+      "    uc = uc + (unsigned char)50;"
+      "    s = s + c + uc;"
+      "    inc(&t);"
+      "  }"
+      "  return s + t;"
+      "}"
+      "int main() {"
+      "  if (f(0, 0, 10) != 1414) return 1;"
+      "  return 42;"
+      "}",
+   .ret_val = 42,
+},
+{
+   .name = "preprocessed output larger than a pipe",
+   .compiles = true,
+   .source =
+      "#define A x = x + 1;\n"
+      "#define B A A A A A A A A\n"
+      "#define C B B B B B B B B\n"
+      "#define D C C C C C C C C\n"
+      "#define E D D D D D D D D\n"
+      "int main(void) {"
+      "  int x = 0;"
+      "  E E"
+      "  if (x != 8192) return 1;"
+      "  return 42;"
+      "}",
+   .ret_val = 42,
+   .option = "-fno-integrated-cpp",
+},
+{
+   .name = "include guard and #pragma",
+   .compiles = true,
+   .source =
+      "#pragma once\n"
+      "#include <stdint.h>\n"
+      "#include <stdint.h>\n"
+      "#undef __STDINT_H__\n"
+      "#include <stdint.h>\n"
+      "#pragma unknown_pragma\n"
+      "int main(void) {"
+      "  int32_t x = 40;"
+      "  return x + 2;"
+      "}",
+   .ret_val = 42,
+},
+{
+   .name = "call at -O0",
+   .compiles = true,
+   .source =
+      "int printf(const char*, ...);"
+      "int add(int a, int b) { return a + b; }"
+      "int main(void) {"
+      "  int x = add(40, 2);"
+      "  printf(\"%d\", x);"
+      "  return add(x, 0);"
+      "}",
+   .output = "42",
+   .ret_val = 42,
+   .option = "-O0",
+},
+{
+   .name = "logical operators as values",
+   .compiles = true,
+   .source =
+      "int printf(const char*, ...);"
+      "int id(int x) { return x; }"
+      "int both(int i, int a, int b) { return i > 0 && a > b; }"
+      "int main(void) {"
+      "  int a = 5;"
+      "  int b = 3;"
+      "  printf(\"%d %d %d \", 10 + id(a > 0 && b > 4), 20 + id(a > 9 || b < 1), 30 + id(a < 9 || b > 4));"
+      "  printf(\"%d %d\", both(7, 1, 2), both(7, 2, 1));"
+      "}",
+   .output = "10 20 31 0 1",
+},
+{
+   .name = "nested conditional operator",
+   .compiles = true,
+   .source =
+      "int printf(const char*, ...);"
+      "int id(int x) { return x; }"
+      "int main(void) {"
+      "  int a = 5;"
+      "  int b = 3;"
+      "  int c = a * 10 + (b > 2 ? a : b) * 100;"
+      "  printf(\"%d %d %d\", c, 1 + id(a < b ? a : b > 1 ? 7 : 8), id(a) + (a > b ? id(b) : 0));"
+      "}",
+   .output = "550 8 8",
+},
+{
+   .name = "signed division by a power of 2",
+   .compiles = true,
+   .source =
+      "int printf(const char*, ...);"
+      "int div4(int x) { return x / 4; }"
+      "int mod4(int x) { return x % 4; }"
+      "unsigned udiv4(unsigned x) { return x / 4; }"
+      "int main(void) {"
+      "  printf(\"%d %d %d %d %u\", div4(-7), mod4(-7), div4(7), mod4(7), udiv4(4000000000));"
+      "}",
+   .output = "-1 -3 1 3 1000000000",
+},
+{
+   .name = "bitwise and with 1",
+   .compiles = true,
+   .source =
+      "int printf(const char*, ...);"
+      "int odd(int x) { return x & 1; }"
+      "int main(void) {"
+      "  printf(\"%d %d %d\", odd(6), odd(7), odd(-3));"
+      "}",
+   .output = "0 1 1",
+},
+{
+   .name = "constant divided by a variable",
+   .compiles = true,
+   .source =
+      "int printf(const char*, ...);"
+      "int f1(int x) { return 64 / x; }"
+      "int f2(int x) { return 1 / x; }"
+      "unsigned f3(unsigned x) { return 64 / x; }"
+      "int f4(int x) { return 1 * (8 / x); }"
+      "int main(void) {"
+      "  printf(\"%d %d %u %d\", f1(4), f2(4), f3(32), f4(2));"
+      "}",
+   .output = "16 0 2 4",
+},
+{
+   .name = "remark of unmuldiv",
+   .compiles = true,
+   .source =
+      "int printf(const char*, ...);"
+      "int mul8(int x) { return x * 8; }"
+      "int main(void) {"
+      "  printf(\"%d\", mul8(-5));"
+      "}",
+   .output = "-40",
+   .option = "-Rpass=unmuldiv",
+   .compiler_output = "remark: Replace multiplications by powers of 2 in 'mul8' [-Rpass=unmuldiv]\n",
+},
+{
+   .name = "optimizer statistics",
+   .compiles = true,
+   .source =
+      "int printf(const char*, ...);"
+      "int mul8(int x) { return x * 8; }"
+      "int mul16(int x) { return x * 16; }"
+      "int main(void) {"
+      "  printf(\"%d %d\", mul8(3), mul16(-3));"
+      "}",
+   .output = "24 -48",
+   .option = "-fopt-stats",
+   // one rewrite in each of mul8 and mul16, the translation unit counts both
+   .compiler_output = "\n  unmuldiv                           2\n",
+},
@@ -0,0 +1,58 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Adler-32 and FNV-1a checksums over a pseudo-random buffer.
+
+int printf(const char*, ...);
+
+#define SIZE 65536
+#define ROUNDS 200
+
+unsigned char data[SIZE];
+
+static unsigned adler32(const unsigned char* buf, unsigned len) {
+   unsigned a = 1;
+   unsigned b = 0;
+   for (unsigned i = 0; i < len; ++i) {
+      a = (a + buf[i]) % 65521;
+      b = (b + a) % 65521;
+   }
+   return b * 65536 + a;
+}
+
+static unsigned fnv1a(const unsigned char* buf, unsigned len) {
+   unsigned h = 2166136261;
+   for (unsigned i = 0; i < len; ++i) {
+      h = h ^ buf[i];
+      h = h * 16777619;
+   }
+   return h;
+}
+
+int main(void) {
+   unsigned seed = 12345;
+   for (unsigned i = 0; i < SIZE; ++i) {
+      seed = seed * 1103515245 + 12345;
+      data[i] = seed / 65536 % 256;
+   }
+   unsigned sum = 0;
+   for (unsigned r = 0; r < ROUNDS; ++r) {
+      data[r] = data[r] + 1;
+      sum = sum ^ adler32(data, SIZE);
+      sum = sum + fnv1a(data, SIZE);
+   }
+   printf("checksum: %u\n", sum);
+   return 0;
+}
@@ -0,0 +1,109 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Switch-heavy dispatch: a dense switch (jump table), a sparse switch
+// and a state machine, that are driven by pseudo-random inputs.
+
+int printf(const char*, ...);
+
+#define ROUNDS 2000000
+
+static int dense(int op, int acc) {
+   switch (op) {
+   case 0:  return acc + 1;
+   case 1:  return acc - 3;
+   case 2:  return acc * 3;
+   case 3:  return acc ^ 0x5a5a;
+   case 4:  return acc / 2;
+   case 5:  return acc + op * 7;
+   case 6:  return acc & 0xffff;
+   case 7:  return acc | 0x100;
+   case 8:  return -acc;
+   case 9:  return acc % 1000;
+   case 10: return acc + 11;
+   case 11: return acc - 13;
+   case 12: return acc * 5;
+   case 13: return acc ^ 0x1234;
+   case 14: return acc / 3;
+   case 15: return acc + 100;
+   default: return acc;
+   }
+}
+
+static int sparse(int key) {
+   switch (key) {
+   case 1:     return 3;
+   case 17:    return 5;
+   case 100:   return 7;
+   case 1000:  return 11;
+   case 4096:  return 13;
+   case 9999:  return 17;
+   case 65535: return 19;
+   default:    return 1;
+   }
+}
+
+#define S_START   0
+#define S_IDENT   1
+#define S_NUMBER  2
+#define S_SPACE   3
+#define S_OTHER   4
+
+// classifies `c` and returns the next state
+static int step(int s, int c, unsigned* count) {
+   const int alpha = (c >= 'a' && c <= 'z') || c == '_';
+   const int digit = c >= '0' && c <= '9';
+   switch (s) {
+   case S_START:
+   case S_SPACE:
+   case S_OTHER:
+      if (alpha) {
+         ++*count;
+         return S_IDENT;
+      } else if (digit) {
+         ++*count;
+         return S_NUMBER;
+      } else if (c == ' ') {
+         return S_SPACE;
+      }
+      return S_OTHER;
+   case S_IDENT:
+      if (alpha || digit)
+         return S_IDENT;
+      return c == ' ' ? S_SPACE : S_OTHER;
+   case S_NUMBER:
+      if (digit)
+         return S_NUMBER;
+      return alpha ? S_OTHER : S_START;
+   }
+   return S_START;
+}
+
+int main(void) {
+   unsigned seed = 99;
+   int acc = 1;
+   unsigned sum = 0;
+   unsigned count = 0;
+   int s = S_START;
+   for (int i = 0; i < ROUNDS; ++i) {
+      seed = seed * 1103515245 + 12345;
+      const unsigned r = seed / 65536;
+      acc = dense((int)(r % 17), acc);
+      sum = sum + (unsigned)sparse((int)(r % 5) * 17 + (r % 3 == 0 ? 1000 : 0));
+      s = step(s, (int)(r % 64) + 32, &count);
+   }
+   printf("dispatch: %d %u %u\n", acc, sum, count);
+   return 0;
+}
@@ -0,0 +1,119 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Open-addressing and chained hash tables with inserts, lookups and deletes.
+
+int printf(const char*, ...);
+
+#define CAPACITY 16384
+#define NUM_KEYS 10000
+#define ROUNDS 40
+
+// open addressing with linear probing, 0 marks an empty slot
+unsigned keys[CAPACITY];
+unsigned values[CAPACITY];
+
+struct entry {
+   unsigned key;
+   unsigned value;
+   struct entry* next;
+};
+
+#define NUM_BUCKETS 1024
+struct entry* buckets[NUM_BUCKETS];
+struct entry pool[NUM_KEYS];
+
+static unsigned hash(unsigned x) {
+   x = x * 2654435761;
+   return x ^ (x / 65536);
+}
+
+static void oa_clear(void) {
+   for (unsigned i = 0; i < CAPACITY; ++i)
+      keys[i] = 0;
+}
+
+static void oa_insert(unsigned key, unsigned value) {
+   unsigned i = hash(key) % CAPACITY;
+   while (keys[i] != 0 && keys[i] != key)
+      i = (i + 1) % CAPACITY;
+   keys[i] = key;
+   values[i] = value;
+}
+
+static unsigned oa_find(unsigned key) {
+   unsigned i = hash(key) % CAPACITY;
+   while (keys[i] != 0) {
+      if (keys[i] == key)
+         return values[i];
+      i = (i + 1) % CAPACITY;
+   }
+   return 0;
+}
+
+static void chain_clear(void) {
+   for (unsigned i = 0; i < NUM_BUCKETS; ++i)
+      buckets[i] = (struct entry*)0;
+}
+
+static void chain_insert(struct entry* e, unsigned key, unsigned value) {
+   const unsigned b = hash(key) % NUM_BUCKETS;
+   e->key = key;
+   e->value = value;
+   e->next = buckets[b];
+   buckets[b] = e;
+}
+
+static unsigned chain_find(unsigned key) {
+   for (struct entry* e = buckets[hash(key) % NUM_BUCKETS]; e; e = e->next) {
+      if (e->key == key)
+         return e->value;
+   }
+   return 0;
+}
+
+static void chain_remove(unsigned key) {
+   struct entry** link = &buckets[hash(key) % NUM_BUCKETS];
+   while (*link) {
+      if ((*link)->key == key) {
+         *link = (*link)->next;
+         return;
+      }
+      link = &(*link)->next;
+   }
+}
+
+int main(void) {
+   unsigned sum = 0;
+   for (unsigned r = 0; r < ROUNDS; ++r) {
+      oa_clear();
+      chain_clear();
+      unsigned seed = r + 1;
+      for (unsigned i = 0; i < NUM_KEYS; ++i) {
+         seed = seed * 1103515245 + 12345;
+         const unsigned key = seed % 1000000 + 1;
+         oa_insert(key, i);
+         chain_insert(&pool[i], key, i);
+      }
+      for (unsigned i = 0; i < NUM_KEYS; i += 2)
+         chain_remove(pool[i].key);
+      for (unsigned k = 1; k < 200000; k += 7) {
+         sum = sum + oa_find(k);
+         sum = sum ^ chain_find(k);
+      }
+   }
+   printf("hashtable: %u\n", sum);
+   return 0;
+}
@@ -0,0 +1,143 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// A stack-based bytecode interpreter, that runs a loop computing
+// a sum of squares and Fibonacci numbers.
+
+int printf(const char*, ...);
+
+enum opcode {
+   OP_PUSH,    // push the immediate
+   OP_LOAD,    // push a local
+   OP_STORE,   // pop into a local
+   OP_ADD,
+   OP_SUB,
+   OP_MUL,
+   OP_MOD,
+   OP_LT,
+   OP_JMP,     // jump to the immediate
+   OP_JZ,      // pop, jump if zero
+   OP_HALT,
+};
+
+#define CODE_SIZE 128
+#define STACK_SIZE 64
+#define NUM_LOCALS 8
+
+int code[CODE_SIZE];
+int ncode;
+
+static void op(int opcode) {
+   code[ncode++] = opcode;
+}
+static void op_imm(int opcode, int imm) {
+   code[ncode++] = opcode;
+   code[ncode++] = imm;
+}
+
+static int run(const int* pc_base, int arg) {
+   int stack[STACK_SIZE];
+   int locals[NUM_LOCALS];
+   int sp = 0;
+   int pc = 0;
+   for (int i = 0; i < NUM_LOCALS; ++i)
+      locals[i] = 0;
+   locals[0] = arg;
+   while (1) {
+      const int insn = pc_base[pc++];
+      if (insn == OP_PUSH) {
+         stack[sp++] = pc_base[pc++];
+      } else if (insn == OP_LOAD) {
+         stack[sp++] = locals[pc_base[pc++]];
+      } else if (insn == OP_STORE) {
+         locals[pc_base[pc++]] = stack[--sp];
+      } else if (insn == OP_ADD) {
+         --sp;
+         stack[sp - 1] = stack[sp - 1] + stack[sp];
+      } else if (insn == OP_SUB) {
+         --sp;
+         stack[sp - 1] = stack[sp - 1] - stack[sp];
+      } else if (insn == OP_MUL) {
+         --sp;
+         stack[sp - 1] = stack[sp - 1] * stack[sp];
+      } else if (insn == OP_MOD) {
+         --sp;
+         stack[sp - 1] = stack[sp - 1] % stack[sp];
+      } else if (insn == OP_LT) {
+         --sp;
+         stack[sp - 1] = stack[sp - 1] < stack[sp];
+      } else if (insn == OP_JMP) {
+         pc = pc_base[pc];
+      } else if (insn == OP_JZ) {
+         if (stack[--sp] == 0) {
+            pc = pc_base[pc];
+         } else {
+            ++pc;
+         }
+      } else {
+         return locals[1];
+      }
+   }
+}
+
+// locals: 0 = n, 1 = result, 2 = i, 3 = a, 4 = b
+static void assemble(void) {
+   ncode = 0;
+   // for (i = 0; i < n; ++i) { result = (result + i * i) % 1000003; t = a + b; a = b; b = t % 65536; }
+   op_imm(OP_PUSH, 1);
+   op_imm(OP_STORE, 4);
+   const int loop = ncode;
+   op_imm(OP_LOAD, 2);
+   op_imm(OP_LOAD, 0);
+   op(OP_LT);
+   op_imm(OP_JZ, 0);
+   const int exit_patch = ncode - 1;
+   op_imm(OP_LOAD, 1);
+   op_imm(OP_LOAD, 2);
+   op_imm(OP_LOAD, 2);
+   op(OP_MUL);
+   op(OP_ADD);
+   op_imm(OP_PUSH, 1000003);
+   op(OP_MOD);
+   op_imm(OP_STORE, 1);
+   op_imm(OP_LOAD, 3);
+   op_imm(OP_LOAD, 4);
+   op(OP_ADD);
+   op_imm(OP_LOAD, 4);
+   op_imm(OP_STORE, 3);
+   op_imm(OP_PUSH, 65536);
+   op(OP_MOD);
+   op_imm(OP_STORE, 4);
+   op_imm(OP_LOAD, 2);
+   op_imm(OP_PUSH, 1);
+   op(OP_ADD);
+   op_imm(OP_STORE, 2);
+   op_imm(OP_JMP, loop);
+   code[exit_patch] = ncode;
+   op_imm(OP_LOAD, 1);
+   op_imm(OP_LOAD, 3);
+   op(OP_ADD);
+   op_imm(OP_STORE, 1);
+   op(OP_HALT);
+}
+
+int main(void) {
+   assemble();
+   unsigned sum = 0;
+   for (int r = 0; r < 10; ++r)
+      sum = sum * 31 + (unsigned)run(code, 100000 + r);
+   printf("interp: %u\n", sum);
+   return 0;
+}
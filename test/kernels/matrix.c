@@ -0,0 +1,87 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Integer matrix multiplication, transposition and a 2D stencil.
+
+int printf(const char*, ...);
+
+#define N 128
+#define ROUNDS 16
+
+int a[N * N];
+int b[N * N];
+int c[N * N];
+
+static void init(int* m, int seed) {
+   for (int i = 0; i < N * N; ++i)
+      m[i] = (i * seed + 7) % 19 - 9;
+}
+
+static void multiply(int* dest, const int* x, const int* y) {
+   for (int i = 0; i < N; ++i) {
+      for (int j = 0; j < N; ++j) {
+         int sum = 0;
+         for (int k = 0; k < N; ++k)
+            sum += x[i * N + k] * y[k * N + j];
+         dest[i * N + j] = sum;
+      }
+   }
+}
+
+static void transpose(int* m) {
+   for (int i = 0; i < N; ++i) {
+      for (int j = i + 1; j < N; ++j) {
+         const int t = m[i * N + j];
+         m[i * N + j] = m[j * N + i];
+         m[j * N + i] = t;
+      }
+   }
+}
+
+// 5-point stencil into `dest`, the border is copied
+static void stencil(int* dest, const int* src) {
+   for (int i = 0; i < N; ++i) {
+      for (int j = 0; j < N; ++j) {
+         const int idx = i * N + j;
+         if (i == 0 || j == 0 || i == N - 1 || j == N - 1) {
+            dest[idx] = src[idx];
+         } else {
+            dest[idx] = (src[idx] * 4 + src[idx - 1] + src[idx + 1] + src[idx - N] + src[idx + N]) / 8;
+         }
+      }
+   }
+}
+
+static unsigned checksum(const int* m) {
+   unsigned h = 0;
+   for (int i = 0; i < N * N; ++i)
+      h = h * 31 + (unsigned)m[i];
+   return h;
+}
+
+int main(void) {
+   unsigned sum = 0;
+   for (int r = 0; r < ROUNDS; ++r) {
+      init(a, r + 3);
+      init(b, r + 5);
+      multiply(c, a, b);
+      sum = sum + checksum(c);
+      transpose(c);
+      stencil(a, c);
+      sum = sum ^ checksum(a);
+   }
+   printf("matrix: %u\n", sum);
+   return 0;
+}
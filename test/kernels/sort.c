@@ -0,0 +1,130 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Quicksort, insertion sort and heapsort over pseudo-random integers.
+
+int printf(const char*, ...);
+
+#define SIZE 20000
+#define ROUNDS 10
+
+int input[SIZE];
+int work[SIZE];
+
+static void fill(unsigned seed) {
+   for (int i = 0; i < SIZE; ++i) {
+      seed = seed * 1103515245 + 12345;
+      input[i] = (int)(seed / 65536 % 100000);
+   }
+}
+
+static void copy(void) {
+   for (int i = 0; i < SIZE; ++i)
+      work[i] = input[i];
+}
+
+static void swap(int* a, int* b) {
+   int t = *a;
+   *a = *b;
+   *b = t;
+}
+
+static void quicksort(int* a, int lo, int hi) {
+   while (lo < hi) {
+      const int pivot = a[lo + (hi - lo) / 2];
+      int i = lo;
+      int j = hi;
+      while (i <= j) {
+         while (a[i] < pivot)
+            ++i;
+         while (a[j] > pivot)
+            --j;
+         if (i <= j) {
+            swap(&a[i], &a[j]);
+            ++i;
+            --j;
+         }
+      }
+      // recurse into the smaller half
+      if (j - lo < hi - i) {
+         quicksort(a, lo, j);
+         lo = i;
+      } else {
+         quicksort(a, i, hi);
+         hi = j;
+      }
+   }
+}
+
+static void insertion_sort(int* a, int n) {
+   for (int i = 1; i < n; ++i) {
+      const int x = a[i];
+      int j = i - 1;
+      while (j >= 0 && a[j] > x) {
+         a[j + 1] = a[j];
+         --j;
+      }
+      a[j + 1] = x;
+   }
+}
+
+static void sift_down(int* a, int root, int n) {
+   while (root * 2 + 1 < n) {
+      int child = root * 2 + 1;
+      if (child + 1 < n && a[child] < a[child + 1])
+         ++child;
+      if (a[root] >= a[child])
+         return;
+      swap(&a[root], &a[child]);
+      root = child;
+   }
+}
+
+static void heapsort(int* a, int n) {
+   for (int i = n / 2 - 1; i >= 0; --i)
+      sift_down(a, i, n);
+   for (int i = n - 1; i > 0; --i) {
+      swap(&a[0], &a[i]);
+      sift_down(a, 0, i);
+   }
+}
+
+static unsigned verify(const int* a, int n) {
+   unsigned h = 0;
+   for (int i = 0; i < n; ++i) {
+      if (i > 0 && a[i - 1] > a[i])
+         return 0;
+      h = h * 31 + (unsigned)a[i];
+   }
+   return h;
+}
+
+int main(void) {
+   unsigned sum = 0;
+   for (unsigned r = 0; r < ROUNDS; ++r) {
+      fill(r + 1);
+      copy();
+      quicksort(work, 0, SIZE - 1);
+      sum = sum + verify(work, SIZE);
+      copy();
+      heapsort(work, SIZE);
+      sum = sum ^ verify(work, SIZE);
+      copy();
+      insertion_sort(work, SIZE / 10);
+      sum = sum + verify(work, SIZE / 10);
+   }
+   printf("sort: %u\n", sum);
+   return 0;
+}
@@ -0,0 +1,101 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Tokenizing, searching and counting in a generated text.
+
+int printf(const char*, ...);
+
+#define SIZE 200000
+#define ROUNDS 20
+
+char text[SIZE + 1];
+
+static void generate(void) {
+   const char* words[8] = { "lorem", "ipsum", "dolor", "sit", "amet", "x42", "y_1", "foo" };
+   unsigned seed = 7;
+   int pos = 0;
+   while (pos < SIZE - 16) {
+      seed = seed * 1103515245 + 12345;
+      const char* w = words[seed / 65536 % 8];
+      while (*w)
+         text[pos++] = *w++;
+      text[pos++] = seed % 5 == 0 ? '\n' : ' ';
+   }
+   text[pos] = '\0';
+}
+
+static int is_alpha(char c) {
+   return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static int is_digit(char c) {
+   return c >= '0' && c <= '9';
+}
+
+static unsigned str_len(const char* s) {
+   const char* p = s;
+   while (*p)
+      ++p;
+   return (unsigned)(p - s);
+}
+
+// counts the identifiers, numbers and lines
+static unsigned tokenize(const char* s) {
+   unsigned idents = 0;
+   unsigned numbers = 0;
+   unsigned lines = 0;
+   while (*s) {
+      if (is_alpha(*s)) {
+         while (is_alpha(*s) || is_digit(*s))
+            ++s;
+         ++idents;
+      } else if (is_digit(*s)) {
+         while (is_digit(*s))
+            ++s;
+         ++numbers;
+      } else {
+         if (*s == '\n')
+            ++lines;
+         ++s;
+      }
+   }
+   return idents * 10000 + numbers * 100 + lines;
+}
+
+// the number of occurrences of `pattern`
+static unsigned find_all(const char* s, const char* pattern) {
+   unsigned n = 0;
+   for (; *s; ++s) {
+      int i = 0;
+      while (pattern[i] && s[i] == pattern[i])
+         ++i;
+      if (!pattern[i])
+         ++n;
+   }
+   return n;
+}
+
+int main(void) {
+   generate();
+   unsigned sum = 0;
+   for (unsigned r = 0; r < ROUNDS; ++r) {
+      sum = sum + str_len(text + r);
+      sum = sum ^ tokenize(text + r);
+      sum = sum + find_all(text, "sit amet");
+      sum = sum + find_all(text + r, "y_1\n");
+   }
+   printf("strscan: %u\n", sum);
+   return 0;
+}
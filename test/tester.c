@@ -32,6 +32,7 @@ static char* path_bcpp = "../cpp/bcpp";
 static char* path_test = "./test";
 static char* path_startfiles = "../libbcc";
 static bool no_colors = false;
+static bool compare_as = false;
 static char** extra_args = NULL;
 
 struct test_case {
@@ -40,6 +41,8 @@ struct test_case {
    const char* source;
    const char* output;
    int ret_val;
+   const char* option;     // passed to bcc after the default options
+   const char* compiler_output;  // must be part of what bcc prints
 };
 
 static struct test_case cases[] = {
@@ -104,7 +107,7 @@ static int do_wait(const pid_t pid, char** text, const char* what) {
    return 254;
 }
 
-static int run_compiler(const char* source, char** output) {
+static int run_compiler(const char* source, const char* option, char** output) {
    int pipes_t2c[2];
    int pipes_c2t[2];
    int tmp;
@@ -167,6 +170,8 @@ static int run_compiler(const char* source, char** output) {
 
       buf_push(args, b);
 
+      if (option)
+         buf_push(args, (char*)option);
       for (size_t i = 0; i < buf_len(extra_args); ++i)
          buf_push(args, extra_args[i]);
 
@@ -240,9 +245,69 @@ static int run_program(char** output) {
    }
 }
 
+// assembles `source` into path_obj and returns the disassembly of it
+static char* assemble_dump(const char* source, const char* option, const char* path_obj, bool integrated) {
+   char* cmd = NULL;
+   buf_puts(cmd, path_bcc);
+   buf_puts(cmd, " -c -o");
+   buf_puts(cmd, path_obj);
+   buf_puts(cmd, " -fpath-cpp=");
+   buf_puts(cmd, path_bcpp);
+   buf_puts(cmd, " -I../bcc-include -O2");
+   if (option) {
+      buf_push(cmd, ' ');
+      buf_puts(cmd, option);
+   }
+   for (size_t i = 0; i < buf_len(extra_args); ++i) {
+      buf_push(cmd, ' ');
+      buf_puts(cmd, extra_args[i]);
+   }
+   if (!integrated)
+      buf_puts(cmd, " -mno-integrated-as");
+   buf_puts(cmd, " - 2>/dev/null");
+   buf_push(cmd, '\0');
+
+   FILE* file = popen(cmd, "w");
+   assert(file != NULL);
+   fputs(source, file);
+   const int status = pclose(file);
+   buf_free(cmd);
+   if (status != 0)
+      return NULL;
+
+   buf_puts(cmd, "objdump -drs ");
+   buf_puts(cmd, path_obj);
+   buf_push(cmd, '\0');
+   file = popen(cmd, "r");
+   assert(file != NULL);
+   buf_free(cmd);
+   char* text = NULL;
+   int ch;
+   while ((ch = fgetc(file)) != EOF)
+      buf_push(text, ch);
+   buf_push(text, '\0');
+   pclose(file);
+   return text;
+}
+
+// compares the objects of the integrated and the external assembler
+static bool compare_assemblers(const struct test_case* c) {
+   char path_obj[32];
+   snprintf(path_obj, sizeof(path_obj), "%s.o", path_test);
+   char* ias = assemble_dump(c->source, c->option, path_obj, true);
+   char* gas = assemble_dump(c->source, c->option, path_obj, false);
+   remove(path_obj);
+   const bool same = ias && gas && !strcmp(ias, gas);
+   buf_free(ias);
+   buf_free(gas);
+   if (!same)
+      print(1, 4, "TEST '%s': the integrated assembler differs from as\n", c->name);
+   return same;
+}
+
 static bool run_test(const struct test_case* c) {
    char* output;
-   int ec = run_compiler(c->source, &output);
+   int ec = run_compiler(c->source, c->option, &output);
    print(2, 5, "Running test '%s'\n", c->name);
    if (output && ec < 255) {
       print(2, 5, "Compiler Output:\n%s", output);
@@ -253,6 +318,10 @@ static bool run_test(const struct test_case* c) {
          print(1, 4, "TEST '%s': unexpected compilation success\n", c->name);
          return false;
       }
+      if (c->compiler_output && (!output || !strstr(output, c->compiler_output))) {
+         print(1, 4, "TEST '%s': invalid compiler output\n", c->name);
+         return false;
+      }
       break;
    case 1:
       if (c->compiles) {
@@ -276,6 +345,9 @@ static bool run_test(const struct test_case* c) {
    }
    buf_free(output);
 
+   if (compare_as && !compare_assemblers(c))
+      return false;
+
    print(2, 5, "Running executable\n");
 
    ec = run_program(&output);
@@ -315,7 +387,7 @@ int main(int argc, char* argv[]) {
    bool always0 = false;
    int option;
 
-   while ((option = getopt(argc, argv, ":vshc:e:t:f:k0CX:")) != -1) {
+   while ((option = getopt(argc, argv, ":vshc:e:t:f:k0CaX:")) != -1) {
       switch (option) {
       case 'v':
          verbosity = 2;
@@ -344,6 +416,9 @@ int main(int argc, char* argv[]) {
       case 'C':
          no_colors = true;
          break;
+      case 'a':
+         compare_as = true;
+         break;
       case 'X':
       {
          const size_t len = strlen(optarg) + 2;
@@ -362,6 +437,7 @@ int main(int argc, char* argv[]) {
          puts(" -k                        Keep the test executable");
          puts(" -0                        Return always with exit code 0");
          puts(" -C                        Disable color output");
+         puts(" -a                        Compare the integrated assembler with as");
          puts(" -c path_bcc               Path to the compiler");
          puts(" -e path_bcpp              Path to the pre-processor");
          puts(" -t path_test              Path to the test executable");
@@ -0,0 +1,27 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// takes longer to compile than jobs_fast.c and has a warning (see Makefile)
+
+#define A x = x * 3 + 1;
+#define B A A A A A A A A
+#define C B B B B B B B B
+#define D C C C C C C C C
+
+extern int jobs_slow(int x) {
+   D D D D D D D D
+   return x;
+}
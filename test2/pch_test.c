@@ -0,0 +1,50 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "pch_test.h"
+
+int pch_counter;
+
+int pch_sum(struct pch_node* n) {
+   int s = 0;
+   while (n) {
+      s = s + PCH_MUL(n->a, PCH_SCALE) + n->b;
+      n = n->next;
+   }
+   return s;
+}
+
+int main(void) {
+   struct pch_node n1;
+   struct pch_node n2;
+   struct pch_even e;
+   struct pch_odd o;
+   union pch_word w;
+   n1.a = 1;
+   n1.b = 2;
+   n1.next = &n2;
+   n2.a = 3;
+   n2.b = 4;
+   n2.next = (struct pch_node*)0;
+   e.odd = &o;
+   e.value = PCH_GREEN;
+   o.even = &e;
+   o.value = PCH_BLUE;
+   w.l = 0;
+   w.c = 1;
+   pch_counter = pch_sum(&n1) + o.even->odd->value + (int)w.l;
+   return pch_counter == 18 + 6 + 1 ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+//  Copyright (C) 2021 Benjamin Stürz
+//  
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef FILE_PCH_TEST_H
+#define FILE_PCH_TEST_H
+
+// the header of the precompiled header test (see Makefile)
+
+#define PCH_SCALE 3
+#define PCH_MUL(a, b) ((a) * (b))
+
+typedef long pch_int;
+
+enum pch_color {
+   PCH_RED,
+   PCH_GREEN,
+   PCH_BLUE = 6
+};
+
+struct pch_node {
+   int a;
+   int b;
+   struct pch_node* next;
+};
+
+struct pch_odd;
+struct pch_even {
+   struct pch_odd* odd;
+   int value;
+};
+struct pch_odd {
+   struct pch_even* even;
+   int value;
+};
+
+union pch_word {
+   pch_int l;
+   char c;
+};
+
+int pch_sum(struct pch_node* n);
+extern int pch_counter;
+
+#endif /* FILE_PCH_TEST_H */